@@ -0,0 +1,160 @@
+#include "auto_calibration.hpp"
+
+#include <vector>
+#include <cstdlib>
+
+#include "discharger_define.hpp"
+#include "voltage_mapping.hpp"
+#include "src/display/adafruit_gfx_utility.hpp"
+
+void AutoCalibration::start()
+{
+    for (uint8_t channel{0}; channel < CHANNEL_SIZE; ++channel)
+    {
+        _fits[channel].reset();
+        _measuredVs[channel] = 0.f;
+        _sampleSums[channel] = 0;
+        _sampleCounts[channel] = 0;
+    }
+    _samplingFlag = false;
+    _serialLength = 0;
+}
+
+void AutoCalibration::requestCapture()
+{
+    for (uint8_t channel{0}; channel < CHANNEL_SIZE; ++channel)
+    {
+        _sampleSums[channel] = 0;
+        _sampleCounts[channel] = 0;
+    }
+    _samplingFlag = true;
+}
+
+void AutoCalibration::update(const VoltageMapping &voltageMapping)
+{
+    if (!_samplingFlag)
+    {
+        return;
+    }
+
+    for (uint8_t channel{0}; channel < CHANNEL_SIZE; ++channel)
+    {
+        if (_enabledFlags[channel] && _sampleCounts[channel] < SAMPLE_COUNT)
+        {
+            return;
+        }
+    }
+
+    for (uint8_t channel{0}; channel < CHANNEL_SIZE; ++channel)
+    {
+        if (!_enabledFlags[channel])
+        {
+            _measuredVs[channel] = 0.f;
+            continue;
+        }
+        // 電源電圧の補正は合計に掛ける（平均の小数部を残すため）
+        const float average{static_cast<float>(SupplyReference::compensate(_sampleSums[channel])) / static_cast<float>(_sampleCounts[channel])};
+        _measuredVs[channel] = voltageMapping.getVoltage(average);
+        if (average >= MIN_READ_VALUE || _referenceV < 0.01f)
+        {
+            _fits[channel].addPoint(_measuredVs[channel], _referenceV);
+        }
+    }
+    _samplingFlag = false;
+
+    Serial.print("CAL");
+    for (uint8_t channel{0}; channel < CHANNEL_SIZE; ++channel)
+    {
+        Serial.print(" ");
+        Serial.print(_measuredVs[channel], 4);
+    }
+    Serial.println();
+}
+
+void AutoCalibration::readSerial(Stream &stream)
+{
+    while (stream.available() > 0)
+    {
+        const char c{static_cast<char>(stream.read())};
+        if (c == '\r' || c == '\n')
+        {
+            if (_serialLength > 0 && !_samplingFlag)
+            {
+                _serialLine[_serialLength] = '\0';
+                char *endPtr{nullptr};
+                const float volt{strtof(_serialLine, &endPtr)};
+                if (endPtr != _serialLine)
+                {
+                    _referenceV = std::clamp(volt, REFERENCE_V_MIN, REFERENCE_V_MAX);
+                    requestCapture();
+                }
+            }
+            _serialLength = 0;
+        }
+        else if (_serialLength < (sizeof(_serialLine) - 1))
+        {
+            _serialLine[_serialLength++] = c;
+        }
+    }
+}
+
+bool AutoCalibration::fit(VoltCorrection (&corrections)[CHANNEL_SIZE]) const
+{
+    bool resultFlag{false};
+    for (uint8_t channel{0}; channel < CHANNEL_SIZE; ++channel)
+    {
+        if (_enabledFlags[channel] && _fits[channel].fit(corrections[channel]))
+        {
+            resultFlag = true;
+        }
+    }
+    return resultFlag;
+}
+
+void AutoCalibration::setDisplay(Adafruit_SSD1306 &display) const
+{
+    int line{0};
+    AdafruitGfxUtility::drawFillLine(display, line);
+    AdafruitGfxUtility::drawStringC(display, "Auto Calib", line);
+
+    ++line;
+    AdafruitGfxUtility::drawFillLine(display, line);
+    AdafruitGfxUtility::drawString(display, "Ref", 1, line);
+    AdafruitGfxUtility::drawFloatR(display, _referenceV, 12, line, 6, 3);
+    AdafruitGfxUtility::drawString(display, "V", 12, line);
+
+    for (uint8_t channel{0}; channel < CHANNEL_SIZE; ++channel)
+    {
+        const int channelLine{line + 1 + (channel / 2)};
+        const int offsetX{1 + (channel % 2) * 10};
+        if ((channel % 2) == 0)
+        {
+            AdafruitGfxUtility::drawFillLine(display, channelLine);
+        }
+        AdafruitGfxUtility::drawInt(display, channel + 1, offsetX, channelLine);
+        if (_enabledFlags[channel])
+        {
+            AdafruitGfxUtility::drawFloatR(display, _measuredVs[channel], offsetX + 8, channelLine, 6, 4);
+        }
+        else
+        {
+            AdafruitGfxUtility::drawStringR(display, "Link", offsetX + 8, channelLine);
+        }
+    }
+
+    line += 3;
+    AdafruitGfxUtility::drawFillLine(display, line);
+    if (_samplingFlag)
+    {
+        const unsigned long percent{(_sampleCounts[0] * 100UL) / SAMPLE_COUNT};
+        AdafruitGfxUtility::drawStringC(display, String("Sampling ") + String(percent) + String("%"), line);
+    }
+    else
+    {
+        AdafruitGfxUtility::drawStringC(display, String("Points ") + String(_fits[0].pointCount()), line);
+    }
+
+    ++line;
+    AdafruitGfxUtility::drawFillLine(display, line);
+    AdafruitGfxUtility::drawStringC(display, "A:Get B:Save ON:Exit", line);
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "voltage_calibration.hpp"
+
+class Adafruit_SSD1306;
+struct VoltageMapping;
+
+// 基準電圧を全スロットに印加し、チャンネル毎に平均値を取って補正式を求める自動キャリブレーション
+class AutoCalibration
+{
+public:
+  static constexpr uint8_t CHANNEL_SIZE{4};
+  static constexpr unsigned long SAMPLE_COUNT{4096}; // 1点あたり、1チャンネルあたりのサンプル数
+  static constexpr float REFERENCE_V_MIN{0.f};
+  static constexpr float REFERENCE_V_MAX{2.5f};
+  static constexpr int MIN_READ_VALUE{10}; // これ未満のチャンネルは電圧が印加されていないとみなす
+
+  void start();
+
+  void shiftReference(float shift)
+  {
+    _referenceV = std::clamp(_referenceV + shift, REFERENCE_V_MIN, REFERENCE_V_MAX);
+  }
+
+  void requestCapture();
+
+  bool isSampling() const
+  {
+    return _samplingFlag;
+  }
+
+  // 無効なチャンネル（リンク中のスロット3,4）はサンプルを待たず、補正点も補正式も作らない
+  void setEnabled(uint8_t channel, bool enabledFlag)
+  {
+    if (channel < CHANNEL_SIZE)
+    {
+      _enabledFlags[channel] = enabledFlag;
+    }
+  }
+
+  bool isEnabled(uint8_t channel) const
+  {
+    return channel < CHANNEL_SIZE && _enabledFlags[channel];
+  }
+
+  void addSample(uint8_t channel, int value)
+  {
+    if (!_samplingFlag || channel >= CHANNEL_SIZE || _sampleCounts[channel] >= SAMPLE_COUNT)
+    {
+      return;
+    }
+    _sampleSums[channel] += static_cast<unsigned long>(value);
+    ++_sampleCounts[channel];
+  }
+
+  // フレーム毎に呼ぶ。全チャンネルのサンプルが揃ったら補正点として登録する
+  void update(const VoltageMapping &voltageMapping);
+
+  // Serial から "1.2345" のような行を受け取ると、基準電圧を設定して取り込みを開始する
+  void readSerial(Stream &stream);
+
+  bool fit(VoltCorrection (&corrections)[CHANNEL_SIZE]) const;
+
+  void setDisplay(Adafruit_SSD1306 &display) const;
+
+private:
+  float _referenceV{1.f};
+  float _measuredVs[CHANNEL_SIZE]{};
+  unsigned long _sampleSums[CHANNEL_SIZE]{};
+  unsigned long _sampleCounts[CHANNEL_SIZE]{};
+  CalibrationFit _fits[CHANNEL_SIZE]{};
+  bool _samplingFlag{false};
+  bool _enabledFlags[CHANNEL_SIZE]{true, true, true, true};
+
+  char _serialLine[16]{};
+  uint8_t _serialLength{0};
+};
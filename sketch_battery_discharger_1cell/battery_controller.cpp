@@ -3,6 +3,7 @@
 // #define DEEP_SLEEP_ESCAPE_PIN   D14
 #include <EEPROM.h>
 #include "src/display/adafruit_gfx_utility.hpp"
+#include "src/input/button_input.hpp"
 
 extern Adafruit_SSD1306 oledDisplay;
 
@@ -69,6 +70,25 @@ void BatteryController::loadMain()
     _saveBatteryConfigData = tempData;
 };
 
+void BatteryController::reportRunRecordShort()
+{
+    // 記録は入る件数だけで続ける
+    Serial.print("ERR RECORD AREA ");
+    Serial.print(_runRecordStore.capacity());
+    Serial.print("/");
+    Serial.print(RUN_RECORD_CAPACITY);
+    Serial.print(" EEPROM ");
+    Serial.println(EEPROM.length());
+
+    oledDisplay.clearDisplay();
+    AdafruitGfxUtility::drawStringC(oledDisplay, "Record area short", 1);
+    AdafruitGfxUtility::drawStringC(oledDisplay, String(_runRecordStore.capacity()) + String("/") + String(RUN_RECORD_CAPACITY) + String(" records"), 3);
+    AdafruitGfxUtility::drawStringC(oledDisplay, String("EEPROM ") + String(EEPROM.length()) + String("byte"), 4);
+    oledDisplay.display();
+    delay(2000);
+    clearDisplay();
+}
+
 void BatteryController::clearEEPROM()
 {
     const uint8_t clearSize{256};
@@ -99,6 +119,12 @@ void BatteryController::setup()
         saveConfig();
     }
 
+    _runRecordStore.load(EEPROM.length() - RUN_RECORD_ADDRESS);
+    if (isRunRecordShort())
+    {
+        reportRunRecordShort();
+    }
+
     // Button
     pinMode(PUSH_BUTTON_L, INPUT_PULLUP);
     pinMode(PUSH_BUTTON_D, INPUT_PULLUP);
@@ -116,6 +142,14 @@ void BatteryController::setup()
     _buttonBStatus.init(PUSH_BUTTON_B);
     _buttonOnStatus.init(PUSH_BUTTON_ON);
 
+    // 割り込みでエッジを拾い、updateButtonStatus() でまとめて処理する
+    for (uint8_t index{0}; index < _buttonStatuses.size(); ++index)
+    {
+        ButtonStatus *buttonStatus{_buttonStatuses[index]};
+        buttonStatus->addEdge(digitalRead(buttonStatus->_pinId) == LOW, millis());
+        ButtonInput::attach(index, buttonStatus->_pinId);
+    }
+
     // PushDischargeのボタン割り当て初期化
     static const std::vector<int> dischargeButtonIndices{PUSH_DISCHARGE_NO1, PUSH_DISCHARGE_NO2, PUSH_DISCHARGE_NO3, PUSH_DISCHARGE_NO4};
 
@@ -151,8 +185,18 @@ void BatteryController::updateConfigSaveData()
         customMappingData.push_back(_saveConfigData._voltDatas[i]);
     }
     _voltageMapping.initMapping(customMappingData);
+    _voltageMapping.initCorrections(_saveConfigData._voltCorrections);
+    for (uint8_t channel{0}; channel < SaveConfigData::CHANNEL_SIZE; ++channel)
+    {
+        _currentTables[channel] = _saveConfigData._currentTables[channel];
+    }
 
     _ledOnFlag = _saveConfigData._ledOnFlag;
+    _syncSampleFlag = (_saveConfigData._syncSampleFlag != 0);
+    _syncSampler.restart(micros());
+    _thermalLimitFlag = (_saveConfigData._thermalLimitFlag != 0);
+    _finishTogetherFlag = (_saveConfigData._finishTogetherFlag != 0);
+    beginLink(static_cast<LinkRole>(_saveConfigData._linkRole % static_cast<uint8_t>(LinkRole::Max)), _saveConfigData._linkPinFlag != 0);
     _calibI = _saveConfigData._calibI;
     _decimal = _saveConfigData._decimal;
     _dischargeI = _saveConfigData._dischargeI;
@@ -171,16 +215,22 @@ void BatteryController::updateBatterySaveData()
             *saveBattery = defaultSaveBattery;
         }
 
-        batteryStatus._targetI = saveBattery->_targetI;
-        batteryStatus._targetV = saveBattery->_targetV;
-        batteryStatus._disChargeMode = saveBattery->_disChargeMode;
-        batteryStatus._reduceMode = saveBattery->_reduceMode;
-        batteryStatus._holdMin = saveBattery->_holdMin;
-
+        batteryStatus.loadSetting();
         batteryStatus.setup();
     }
 }
 
+void BatteryController::applyBatterySetting(const SaveBattery *saveBattery)
+{
+    for (auto &batteryStatus : _batteryStatuses)
+    {
+        if (batteryStatus._saveBattery == saveBattery)
+        {
+            batteryStatus.loadSetting();
+        }
+    }
+}
+
 void BatteryController::drawXiaoBattery(float xiaoVolt) const
 {
     uint8_t index{0};
@@ -256,6 +306,16 @@ void BatteryController::setDisplayPushDischarge() const
     }
 }
 
+void BatteryController::setDisplayAutoCalib() const
+{
+    _autoCalibration.setDisplay(oledDisplay);
+}
+
+void BatteryController::setDisplayCurrentCalib() const
+{
+    _currentCalibration.setDisplay(oledDisplay);
+}
+
 void BatteryController::setDisplayNone() const
 {
     oledDisplay.clearDisplay();
@@ -263,6 +323,18 @@ void BatteryController::setDisplayNone() const
 
 void BatteryController::setDisplayData() const
 {
+    if (_plotViewFlag)
+    {
+        setDisplayPlot();
+        return;
+    }
+
+    if (_linkViewIndex > 0)
+    {
+        setDisplayLinkNode();
+        return;
+    }
+
     AdafruitGfxUtility::drawFillLine(oledDisplay, 0);
     for (auto &batteryStatus : _batteryStatuses)
     {
@@ -270,6 +342,159 @@ void BatteryController::setDisplayData() const
     }
 };
 
+void BatteryController::setDisplayPlot() const
+{
+    oledDisplay.clearDisplay();
+    _batteryStatuses[_currentBatteryIndex].setDisplayPlot(oledDisplay, _plotSpanIndex);
+}
+
+void BatteryController::setDisplayHistory() const
+{
+    oledDisplay.clearDisplay();
+
+    const uint16_t count{historyCount()};
+    const String slotString{(_historySlot == 0) ? String("All") : (String("Slot") + String(_historySlot))};
+    const String indexString{(count == 0) ? String("0/0") : (String(_historyIndex + 1) + String("/") + String(count))};
+    AdafruitGfxUtility::drawStringC(oledDisplay, String("History ") + slotString + String(" ") + indexString, 0);
+
+    RunRecord record{};
+    if (!findHistory(_historyIndex, record))
+    {
+        AdafruitGfxUtility::drawStringC(oledDisplay, "No record", 3);
+    }
+    else
+    {
+        // プログラムを使った場合は DiscMode / ReduceI の代わりにプログラム名
+        const String modeString{(record._programType != 0) ? PROGRAM_NAMES[record._programType % PROGRAM_NAMES.size()] : (DISC_MODE_NAMES[record._disChargeMode % DISC_MODE_NAMES.size()] + String(" ") + REDUCE_MODE_NAMES[record._reduceMode % REDUCE_MODE_NAMES.size()])};
+        AdafruitGfxUtility::drawString(oledDisplay, String("#") + String(record._runId) + String(" S") + String(record._slot + 1) + String(" ") + modeString, 0, 1);
+        AdafruitGfxUtility::drawString(oledDisplay, String(record._startMilliVolt / 1000.f, 3) + String("V -> ") + String(record._endMilliVolt / 1000.f, 3) + String("V"), 0, 2);
+        AdafruitGfxUtility::drawString(oledDisplay, String(record._milliAmpereHour) + String("mAh ") + String(record._milliWattHour) + String("mWh"), 0, 3);
+
+        const unsigned long minutes{record._durationSeconds / 60};
+        static constexpr char CHAR_DATA_OHM[] = {0x6D, 0xe9, 0x00};
+        AdafruitGfxUtility::drawString(oledDisplay, String(minutes / 60) + String("h") + String(minutes % 60) + String("m ") + String(record._deciMilliOhm / 10.f, 1) + String(CHAR_DATA_OHM), 0, 4);
+    }
+
+    if (isRunRecordShort())
+    {
+        AdafruitGfxUtility::drawStringC(oledDisplay, String("Area ") + String(_runRecordStore.capacity()) + String("/") + String(RUN_RECORD_CAPACITY), 5);
+    }
+
+    AdafruitGfxUtility::drawStringC(oledDisplay, "L/R:Run U/D:Slot", 6);
+}
+
+// ADC の値のばらつきを mV で表示する（放電は止めた状態で測る）
+void BatteryController::setDisplayAdcStat() const
+{
+    static constexpr int SLOPE_COUNTS{100};
+    oledDisplay.clearDisplay();
+
+    const AdcStatistics &firstStatistics{_batteryStatuses[0]._adcStatistics};
+    AdafruitGfxUtility::drawString(oledDisplay, String("ADC n=") + String(firstStatistics.count()), 0, 0);
+    // ADC の基準（電源電圧）の実測値。測れていない場合は公称値に * を付ける
+    AdafruitGfxUtility::drawString(oledDisplay, String(SupplyReference::isValid() ? "" : "*") + String(SupplyReference::volt(), 3) + String("V"), 14, 0);
+
+    if (_adcStatPage == 0)
+    {
+        AdafruitGfxUtility::drawString(oledDisplay, "  Mean     SD  P-P", 0, 1);
+    }
+    else
+    {
+        // 窓の点数毎の Allan 偏差(mV)
+        AdafruitGfxUtility::drawString(oledDisplay, "AD", 0, 1);
+        for (uint8_t index{0}; index < AdcStatistics::WINDOW_COUNT; ++index)
+        {
+            AdafruitGfxUtility::drawIntR(oledDisplay, AdcStatistics::WINDOW_SAMPLES[index], 8 + index * 5, 1);
+        }
+    }
+
+    for (const BatteryInfo &batteryStatus : _batteryStatuses)
+    {
+        const AdcStatistics &statistics{batteryStatus._adcStatistics};
+        const int line{batteryStatus._batteryIndex + 2};
+        AdafruitGfxUtility::drawString(oledDisplay, String(batteryStatus._batteryIndex + 1), 0, line);
+        if (statistics.count() == 0)
+        {
+            continue;
+        }
+
+        // 平均付近の傾きで ADC の値を mV に換算する
+        const unsigned long meanValue{static_cast<unsigned long>(std::max(0.f, statistics.mean()) + 0.5f)};
+        const float milliVoltPerCount{
+            (_voltageMapping.getCompensatedVoltage(meanValue + SLOPE_COUNTS, batteryStatus._batteryIndex) - _voltageMapping.getCompensatedVoltage(meanValue, batteryStatus._batteryIndex)) * (1000.f / SLOPE_COUNTS)};
+
+        if (_adcStatPage == 0)
+        {
+            AdafruitGfxUtility::drawFloatR(oledDisplay, _voltageMapping.getCompensatedVoltage(meanValue, batteryStatus._batteryIndex), 8, line, 6, 4);
+            AdafruitGfxUtility::drawFloatR(oledDisplay, statistics.deviation() * milliVoltPerCount, 14, line, 5, 2);
+            AdafruitGfxUtility::drawFloatR(oledDisplay, (statistics.maxValue() - statistics.minValue()) * milliVoltPerCount, 19, line, 4, 1);
+        }
+        else
+        {
+            for (uint8_t index{0}; index < AdcStatistics::WINDOW_COUNT; ++index)
+            {
+                const float allanDeviation{statistics.allanDeviation(index)};
+                const int offsetX{8 + index * 5};
+                if (allanDeviation < 0.f)
+                {
+                    AdafruitGfxUtility::drawString(oledDisplay, "  -", offsetX - 3, line);
+                }
+                else
+                {
+                    AdafruitGfxUtility::drawFloatR(oledDisplay, allanDeviation * milliVoltPerCount, offsetX, line, 5, 3);
+                }
+            }
+        }
+    }
+
+    AdafruitGfxUtility::drawStringC(oledDisplay, "A:Reset U/D:Page", 6);
+}
+
+void BatteryController::resetAdcStatistics()
+{
+    for (auto &batteryStatus : _batteryStatuses)
+    {
+        batteryStatus._adcStatistics.reset();
+    }
+}
+
+void BatteryController::setDisplayLinkNode() const
+{
+    const uint8_t nodeIndex{static_cast<uint8_t>(_linkViewIndex - 1)};
+    const LinkNodeState &nodeState{_linkMaster.nodeState(nodeIndex)};
+
+    int line{0};
+    AdafruitGfxUtility::drawFillLine(oledDisplay, line);
+    const String nodeString{String("Node ") + String(nodeIndex + 1)};
+    AdafruitGfxUtility::drawStringC(oledDisplay, _linkMaster.isOnline(nodeIndex) ? nodeString : (nodeString + String(" --")), line);
+
+    for (uint8_t slot{0}; slot < LinkConst::SLOT_MAX; ++slot)
+    {
+        ++line;
+        AdafruitGfxUtility::drawFillLine(oledDisplay, line);
+        if (slot >= nodeState._slotCount)
+        {
+            continue;
+        }
+
+        const LinkSlotState &slotState{nodeState._slots[slot]};
+        if (slot == _linkSlotIndex)
+        {
+            AdafruitGfxUtility::drawString(oledDisplay, ">", 0, line);
+        }
+        AdafruitGfxUtility::drawString(oledDisplay, String(slot + 1) + (slotState._activeFlag ? String("*") : String(" ")), 1, line);
+        AdafruitGfxUtility::drawFloatR(oledDisplay, slotState._sleepMilliVolt / 1000.f, 9, line, 5, 3);
+        AdafruitGfxUtility::drawString(oledDisplay, "V", 9, line);
+        AdafruitGfxUtility::drawFloatR(oledDisplay, slotState._milliAmpere / 1000.f, 15, line, 4, 2);
+        AdafruitGfxUtility::drawString(oledDisplay, "A", 15, line);
+        AdafruitGfxUtility::drawIntR(oledDisplay, slotState._milliAmpereHour, 20, line);
+    }
+
+    ++line;
+    AdafruitGfxUtility::drawFillLine(oledDisplay, line);
+    AdafruitGfxUtility::drawStringC(oledDisplay, "A:On/Off U/D:Node", line);
+}
+
 void BatteryController::writePinReset()
 {
     analogWrite(WRITE1_PIN, 0);
@@ -287,9 +512,18 @@ void BatteryController::displaySleep()
 
 void BatteryController::shiftTargetBattery(int shift)
 {
+    // 無効なスロット（リンク中のスロット3,4）は飛ばす
     const int count{static_cast<int>(_batteryStatuses.size())};
-    const int currentIndex{static_cast<int>(_currentBatteryIndex)};
-    _currentBatteryIndex = static_cast<size_t>((count + currentIndex + shift) % count);
+    int currentIndex{static_cast<int>(_currentBatteryIndex)};
+    for (int index{0}; index < count; ++index)
+    {
+        currentIndex = (count + currentIndex + shift) % count;
+        if (_batteryStatuses[currentIndex].isEnabled())
+        {
+            break;
+        }
+    }
+    _currentBatteryIndex = static_cast<size_t>(currentIndex);
 
     for (size_t index{0}; index < _batteryStatuses.size(); ++index)
     {
@@ -347,15 +581,78 @@ void BatteryController::changeSettingMode(int shift)
     }
 };
 
+void BatteryController::changeMainMode(MainMode nextMode)
+{
+    if (_mainMode == nextMode)
+    {
+        return;
+    }
+
+    writePinReset();
+    for (auto &batteryStatus : _batteryStatuses)
+    {
+        batteryStatus._nextBatteryStatus = BatteryStatus::None;
+        batteryStatus._activeFlag = false;
+        batteryStatus.reset();
+    }
+    oledDisplay.clearDisplay();
+    _mainMode = nextMode;
+}
+
 void BatteryController::updateButtonStatus()
 {
+    ButtonEdge edge{};
+    while (ButtonInput::pop(edge))
+    {
+        if (edge._buttonIndex < _buttonStatuses.size())
+        {
+            _buttonStatuses[edge._buttonIndex]->addEdge(edge._pushFlag, edge._millis);
+        }
+    }
+
+    // キューから取り出した後に時刻を取る（割り込み側の時刻が現在時刻を追い越さないように）
+    const unsigned long currentMillis{millis()};
+    const bool overflowFlag{ButtonInput::checkOverflow()};
     for (ButtonStatus* buttonStatus :_buttonStatuses)
     {
-        buttonStatus->update();
+        if (overflowFlag)
+        {
+            buttonStatus->addEdge(digitalRead(buttonStatus->_pinId) == LOW, currentMillis);
+        }
+        buttonStatus->updateType(currentMillis);
     }
 
     MainMode nextMode{_mainMode};
-    if (_mainMode == MainMode::DischargerMode)
+
+    // マスターの場合、U/D でノードの電池の表示に切り替える
+    if (_linkViewIndex > _linkMaster.nodeCount())
+    {
+        shiftLinkView(-_linkViewIndex);
+    }
+    if (_mainMode == MainMode::DischargerMode && !_plotViewFlag && _linkRole == LinkRole::Master && _linkMaster.nodeCount() > 0)
+    {
+        PushType pushType{0};
+        pushType = _buttonUStatus.getVal();
+        if (pushType == PushType::ReleaseShort)
+        {
+            shiftLinkView(-1);
+        }
+        pushType = _buttonDStatus.getVal();
+        if (pushType == PushType::ReleaseShort)
+        {
+            shiftLinkView(1);
+        }
+    }
+
+    if (_mainMode == MainMode::DischargerMode && _plotViewFlag)
+    {
+        updatePlotViewButtons();
+    }
+    else if (_mainMode == MainMode::DischargerMode && _linkViewIndex > 0)
+    {
+        updateLinkViewButtons();
+    }
+    else if (_mainMode == MainMode::DischargerMode)
     {
         PushType pushType{0};
         pushType = _buttonLStatus.getVal();
@@ -390,6 +687,10 @@ void BatteryController::updateButtonStatus()
             writePinReset();
             nextMode = MainMode::BatteryConfigMode;
         }
+        else if (pushType == PushType::ReleaseLong)
+        {
+            changePlotView(true);
+        }
 
         pushType = _buttonOnStatus.getVal();
         if (pushType == PushType::ReleaseShort)
@@ -470,6 +771,29 @@ void BatteryController::updateButtonStatus()
         {
             changeSettingMode(1);
         }
+        pushType = _buttonAStatus.getVal();
+        if (pushType == PushType::ReleaseShort && _configSettingMode == ConfigSettingMode::autoCalibSetting)
+        {
+            _autoCalibration.start();
+            nextMode = MainMode::AutoCalibMode;
+        }
+        if (pushType == PushType::ReleaseShort && _configSettingMode == ConfigSettingMode::currentCalibSetting)
+        {
+            _currentCalibration.start();
+            nextMode = MainMode::CurrentCalibMode;
+        }
+        if (pushType == PushType::ReleaseShort && _configSettingMode == ConfigSettingMode::adcStatSetting)
+        {
+            _adcStatPage = 0;
+            resetAdcStatistics();
+            nextMode = MainMode::AdcStatMode;
+        }
+        if (pushType == PushType::ReleaseShort && _configSettingMode == ConfigSettingMode::historySetting)
+        {
+            _historySlot = 0;
+            _historyIndex = 0;
+            nextMode = MainMode::HistoryMode;
+        }
         pushType = _buttonBStatus.getVal();
         if (pushType == PushType::ReleaseShort)
         {
@@ -484,6 +808,152 @@ void BatteryController::updateButtonStatus()
             nextMode = _cachedMainMode;
         }
     }
+    else if (_mainMode == MainMode::AutoCalibMode)
+    {
+        PushType pushType{0};
+        pushType = _buttonLStatus.getVal();
+        if (pushType == PushType::ReleaseShort || pushType == PushType::PushLong)
+        {
+            _autoCalibration.shiftReference(-0.001f);
+        }
+        pushType = _buttonRStatus.getVal();
+        if (pushType == PushType::ReleaseShort || pushType == PushType::PushLong)
+        {
+            _autoCalibration.shiftReference(0.001f);
+        }
+        pushType = _buttonUStatus.getVal();
+        if (pushType == PushType::ReleaseShort)
+        {
+            _autoCalibration.shiftReference(0.1f);
+        }
+        pushType = _buttonDStatus.getVal();
+        if (pushType == PushType::ReleaseShort)
+        {
+            _autoCalibration.shiftReference(-0.1f);
+        }
+        pushType = _buttonAStatus.getVal();
+        if (pushType == PushType::ReleaseShort && !_autoCalibration.isSampling())
+        {
+            _autoCalibration.requestCapture();
+        }
+        pushType = _buttonBStatus.getVal();
+        if (pushType == PushType::ReleaseShort && !_autoCalibration.isSampling())
+        {
+            if (_autoCalibration.fit(_saveConfigData._voltCorrections))
+            {
+                updateConfigSaveData();
+                saveConfig();
+            }
+            nextMode = MainMode::ConfigMode;
+        }
+        pushType = _buttonOnStatus.getVal();
+        if (pushType == PushType::ReleaseShort)
+        {
+            nextMode = MainMode::ConfigMode;
+        }
+    }
+    else if (_mainMode == MainMode::HistoryMode)
+    {
+        // L: 古い記録へ、R: 新しい記録へ、U/D: スロットの絞り込み
+        static constexpr uint8_t SLOT_FILTER_COUNT{SaveConfigData::CHANNEL_SIZE + 1};
+        const uint16_t count{historyCount()};
+        PushType pushType{0};
+        pushType = _buttonLStatus.getVal();
+        if ((pushType == PushType::ReleaseShort || pushType == PushType::PushLong) && (_historyIndex + 1) < count)
+        {
+            ++_historyIndex;
+        }
+        pushType = _buttonRStatus.getVal();
+        if ((pushType == PushType::ReleaseShort || pushType == PushType::PushLong) && _historyIndex > 0)
+        {
+            --_historyIndex;
+        }
+        pushType = _buttonUStatus.getVal();
+        if (pushType == PushType::ReleaseShort)
+        {
+            _historySlot = static_cast<uint8_t>((_historySlot + SLOT_FILTER_COUNT - 1) % SLOT_FILTER_COUNT);
+            _historyIndex = 0;
+        }
+        pushType = _buttonDStatus.getVal();
+        if (pushType == PushType::ReleaseShort)
+        {
+            _historySlot = static_cast<uint8_t>((_historySlot + 1) % SLOT_FILTER_COUNT);
+            _historyIndex = 0;
+        }
+        const PushType pushTypeB{_buttonBStatus.getVal()};
+        pushType = _buttonOnStatus.getVal();
+        if (pushTypeB == PushType::ReleaseShort || pushType == PushType::ReleaseShort)
+        {
+            nextMode = MainMode::ConfigMode;
+        }
+    }
+    else if (_mainMode == MainMode::AdcStatMode)
+    {
+        PushType pushType{0};
+        pushType = _buttonUStatus.getVal();
+        const PushType pushTypeD{_buttonDStatus.getVal()};
+        if (pushType == PushType::ReleaseShort || pushTypeD == PushType::ReleaseShort)
+        {
+            _adcStatPage = static_cast<uint8_t>((_adcStatPage + 1) % 2);
+        }
+        pushType = _buttonAStatus.getVal();
+        if (pushType == PushType::ReleaseShort)
+        {
+            resetAdcStatistics();
+        }
+        const PushType pushTypeB{_buttonBStatus.getVal()};
+        pushType = _buttonOnStatus.getVal();
+        if (pushTypeB == PushType::ReleaseShort || pushType == PushType::ReleaseShort)
+        {
+            nextMode = MainMode::ConfigMode;
+        }
+    }
+    else if (_mainMode == MainMode::CurrentCalibMode)
+    {
+        PushType pushType{0};
+        pushType = _buttonLStatus.getVal();
+        if (pushType == PushType::ReleaseShort || pushType == PushType::PushLong)
+        {
+            _currentCalibration.shiftMeasured(-0.001f);
+        }
+        pushType = _buttonRStatus.getVal();
+        if (pushType == PushType::ReleaseShort || pushType == PushType::PushLong)
+        {
+            _currentCalibration.shiftMeasured(0.001f);
+        }
+        pushType = _buttonUStatus.getVal();
+        if (pushType == PushType::ReleaseShort)
+        {
+            _currentCalibration.shiftChannel(-1);
+        }
+        pushType = _buttonDStatus.getVal();
+        if (pushType == PushType::ReleaseShort)
+        {
+            _currentCalibration.shiftChannel(1);
+        }
+        pushType = _buttonAStatus.getVal();
+        if (pushType == PushType::ReleaseShort)
+        {
+            _currentCalibration.confirm();
+        }
+        pushType = _buttonBStatus.getVal();
+        if (pushType == PushType::ReleaseShort)
+        {
+            if (_currentCalibration.apply(_saveConfigData._currentTables))
+            {
+                updateConfigSaveData();
+                saveConfig();
+            }
+            writePinReset();
+            nextMode = MainMode::ConfigMode;
+        }
+        pushType = _buttonOnStatus.getVal();
+        if (pushType == PushType::ReleaseShort)
+        {
+            writePinReset();
+            nextMode = MainMode::ConfigMode;
+        }
+    }
     else if (_mainMode == MainMode::PushDischargerMode)
     {
 
@@ -513,8 +983,7 @@ void BatteryController::updateButtonStatus()
         }
     }
 
-    if ((_buttonUStatus.getVal() == PushType::Pushed || _buttonUStatus.getVal() == PushType::PushShort || _buttonUStatus.getVal() == PushType::PushLong)
-        && (_buttonDStatus.getVal() == PushType::Pushed || _buttonDStatus.getVal() == PushType::PushShort || _buttonDStatus.getVal() == PushType::PushLong))
+    if (ButtonStatus::isChordPushing(_buttonUStatus, _buttonDStatus))
     {
         if (_mainMode == MainMode::DischargerMode || _mainMode == MainMode::PushDischargerMode)
         {
@@ -537,6 +1006,322 @@ void BatteryController::setDisplayBatteryConfig(Adafruit_SSD1306& display) const
     _saveBatteryConfigData._battery[_currentBatterySettingIndex].setDisplayBatteryConfig(display, _currentBatterySettingIndex, _batteryConfigSettingMode);
 }
 
+void BatteryController::beginLink(LinkRole linkRole, bool pinFlag)
+{
+    if (linkRole == _linkRole && pinFlag == _linkPinFlag)
+    {
+        return;
+    }
+
+    // Serial1 はスロット3,4の読み取りピンと同じなので、スロットを止めてからリンクを始め、リンクを止めてからスロットを戻す
+    const bool activeFlag{isLinkActive()};
+    _linkRole = linkRole;
+    _linkPinFlag = pinFlag;
+    if (!activeFlag && isLinkActive())
+    {
+        setLinkSlotsEnabled(false);
+        Serial1.begin(LINK_BAUD);
+    }
+    else if (activeFlag && !isLinkActive())
+    {
+        Serial1.end();
+        setLinkSlotsEnabled(true);
+    }
+
+    _linkMaster.start(millis());
+    _linkNode.reset();
+    _linkViewIndex = 0;
+}
+
+void BatteryController::setLinkSlotsEnabled(bool enabledFlag)
+{
+    for (auto &batteryStatus : _batteryStatuses)
+    {
+        if (batteryStatus._readPin == LINK_TX_PIN || batteryStatus._readPin == LINK_RX_PIN)
+        {
+            batteryStatus.setEnabled(enabledFlag);
+            _autoCalibration.setEnabled(batteryStatus._batteryIndex, enabledFlag);
+        }
+    }
+
+    if (!_batteryStatuses[_currentBatteryIndex].isEnabled())
+    {
+        changeTargetBattery(0);
+    }
+}
+
+void BatteryController::updateLink()
+{
+    if (!isLinkActive())
+    {
+        return;
+    }
+
+    if (_linkRole == LinkRole::Master)
+    {
+        _linkMaster.update(millis());
+    }
+    else if (_linkRole == LinkRole::Node)
+    {
+        _linkNode.update([this](LinkNodeState &state) { fillLinkState(state); },
+                         [this](const LinkCommand &command) { applyLinkCommand(command); });
+    }
+}
+
+void BatteryController::fillLinkState(LinkNodeState &state) const
+{
+    // 有効なスロットは先頭から並ぶ（リンク中は 1, 2 だけ）
+    uint8_t slotCount{0};
+    while (slotCount < std::min(_batteryStatuses.size(), static_cast<size_t>(LinkConst::SLOT_MAX)) && _batteryStatuses[slotCount].isEnabled())
+    {
+        ++slotCount;
+    }
+    state._slotCount = slotCount;
+    for (uint8_t slot{0}; slot < state._slotCount; ++slot)
+    {
+        const BatteryInfo &batteryStatus{_batteryStatuses[slot]};
+        LinkSlotState &slotState{state._slots[slot]};
+        slotState._status = static_cast<uint8_t>(batteryStatus._currentBatteryStatus);
+        slotState._activeFlag = batteryStatus._activeFlag;
+        slotState._doneFlag = batteryStatus._dischargedCount > 0;
+        slotState._sleepMilliVolt = static_cast<uint16_t>(std::max(0.f, batteryStatus._sleepV) * 1000.f + 0.5f);
+        slotState._milliAmpere = static_cast<uint16_t>(std::max(0.f, batteryStatus._i) * 1000.f + 0.5f);
+        slotState._milliAmpereHour = static_cast<uint16_t>(std::clamp(batteryStatus._milliAmpereHour, 0.f, 65535.f));
+        slotState._targetMilliVolt = static_cast<uint16_t>(batteryStatus._targetV * 1000.f + 0.5f);
+    }
+}
+
+// マスターからの操作。Serial コマンドと同じく、設定は電池設定（ペアで共有）に反映するが保存はしない
+void BatteryController::applyLinkCommand(const LinkCommand &command)
+{
+    if (command._slot >= _batteryStatuses.size() || !_batteryStatuses[command._slot].isEnabled())
+    {
+        return;
+    }
+
+    BatteryInfo &batteryStatus{_batteryStatuses[command._slot]};
+    if (command._op == LinkCommandOp::Start || command._op == LinkCommandOp::Stop)
+    {
+        const bool startFlag{command._op == LinkCommandOp::Start};
+        if (_mainMode == MainMode::DischargerMode && batteryStatus._activeFlag != startFlag)
+        {
+            batteryStatus.changeActive(1);
+        }
+    }
+    else if (command._op == LinkCommandOp::SetTargetV)
+    {
+        batteryStatus._saveBattery->_targetV = std::clamp(command._value / 1000.f, SaveBattery::TARGET_V_MIN, SaveBattery::TARGET_V_MAX);
+        applyBatterySetting(batteryStatus._saveBattery);
+    }
+    else if (command._op == LinkCommandOp::SetTargetI)
+    {
+        batteryStatus._saveBattery->_targetI = std::clamp(command._value / 1000.f, SaveBattery::TARGET_I_MIN, SaveBattery::TARGET_I_MAX);
+        applyBatterySetting(batteryStatus._saveBattery);
+    }
+}
+
+void BatteryController::shiftLinkView(int shift)
+{
+    const int count{_linkMaster.nodeCount() + 1};
+    _linkViewIndex = static_cast<uint8_t>((count + _linkViewIndex + shift) % count);
+    _linkSlotIndex = 0;
+    oledDisplay.clearDisplay();
+}
+
+void BatteryController::updateLinkViewButtons()
+{
+    const uint8_t nodeIndex{static_cast<uint8_t>(_linkViewIndex - 1)};
+    const uint8_t slotCount{std::max<uint8_t>(1, _linkMaster.nodeState(nodeIndex)._slotCount)};
+    if (_linkSlotIndex >= slotCount)
+    {
+        _linkSlotIndex = 0;
+    }
+    PushType pushType{0};
+    pushType = _buttonLStatus.getVal();
+    if (pushType == PushType::ReleaseShort)
+    {
+        _linkSlotIndex = static_cast<uint8_t>((slotCount + _linkSlotIndex - 1) % slotCount);
+    }
+    pushType = _buttonRStatus.getVal();
+    if (pushType == PushType::ReleaseShort)
+    {
+        _linkSlotIndex = static_cast<uint8_t>((_linkSlotIndex + 1) % slotCount);
+    }
+    pushType = _buttonAStatus.getVal();
+    if (pushType == PushType::ReleaseShort && _linkMaster.isOnline(nodeIndex) && _linkSlotIndex < _linkMaster.nodeState(nodeIndex)._slotCount)
+    {
+        const bool activeFlag{_linkMaster.nodeState(nodeIndex)._slots[_linkSlotIndex]._activeFlag};
+        _linkMaster.sendCommand(nodeIndex, LinkCommand{_linkSlotIndex, activeFlag ? LinkCommandOp::Stop : LinkCommandOp::Start, 0});
+    }
+    pushType = _buttonOnStatus.getVal();
+    if (pushType == PushType::ReleaseShort)
+    {
+        shiftLinkView(-_linkViewIndex);
+    }
+}
+
+// 放電が終わったスロットの結果を記録する
+void BatteryController::storeRunRecords()
+{
+    for (auto &batteryStatus : _batteryStatuses)
+    {
+        RunRecord record{};
+        if (batteryStatus.takeRunRecord(record))
+        {
+            _runRecordStore.append(record);
+        }
+    }
+}
+
+uint16_t BatteryController::historyCount() const
+{
+    return (_historySlot == 0) ? _runRecordStore.count() : _runRecordStore.countBySlot(_historySlot - 1);
+}
+
+bool BatteryController::findHistory(uint16_t index, RunRecord &record) const
+{
+    return (_historySlot == 0) ? _runRecordStore.findByAge(index, record) : _runRecordStore.findBySlot(_historySlot - 1, index, record);
+}
+
+void BatteryController::changePlotView(bool plotViewFlag)
+{
+    _plotViewFlag = plotViewFlag;
+    oledDisplay.clearDisplay();
+}
+
+// L/R: 電池の切り替え、U/D: 表示期間の切り替え、A: 放電 ON/OFF、B/ON: 元の画面へ戻る
+void BatteryController::updatePlotViewButtons()
+{
+    static constexpr uint8_t SPAN_COUNT{BatteryInfo::HISTORY_LEVEL_COUNT + 1};
+    PushType pushType{0};
+    pushType = _buttonLStatus.getVal();
+    if (pushType == PushType::ReleaseShort)
+    {
+        shiftTargetBattery(-1);
+    }
+    pushType = _buttonRStatus.getVal();
+    if (pushType == PushType::ReleaseShort)
+    {
+        shiftTargetBattery(1);
+    }
+    pushType = _buttonUStatus.getVal();
+    if (pushType == PushType::ReleaseShort)
+    {
+        _plotSpanIndex = static_cast<uint8_t>((_plotSpanIndex + 1) % SPAN_COUNT);
+    }
+    pushType = _buttonDStatus.getVal();
+    if (pushType == PushType::ReleaseShort)
+    {
+        _plotSpanIndex = static_cast<uint8_t>((_plotSpanIndex + SPAN_COUNT - 1) % SPAN_COUNT);
+    }
+    pushType = _buttonAStatus.getVal();
+    if (pushType == PushType::ReleaseShort)
+    {
+        changeActive(1);
+    }
+    const PushType pushTypeB{_buttonBStatus.getVal()};
+    pushType = _buttonOnStatus.getVal();
+    if (pushTypeB == PushType::ReleaseShort || pushTypeB == PushType::ReleaseLong || pushType == PushType::ReleaseShort)
+    {
+        changePlotView(false);
+    }
+}
+
+// 前のフレームの電流で熱モデルを進め、次のフレームの電流上限を決める
+void BatteryController::updateThermalBudget()
+{
+    static constexpr uint8_t CHANNEL_SIZE{SaveConfigData::CHANNEL_SIZE};
+    static constexpr float MAX_DT_SECONDS{0.5f}; // 起動直後などで間隔が空いても、積分が発散しないようにする
+
+    const unsigned long tempMillis{millis()};
+    const float dtSeconds{std::min(static_cast<float>(tempMillis - _thermalMillis) / SEC, MAX_DT_SECONDS)};
+    _thermalMillis = tempMillis;
+
+    const bool outputFlag{_mainMode == MainMode::DischargerMode || _mainMode == MainMode::PushDischargerMode};
+    float powers[CHANNEL_SIZE]{};
+    float requestIs[CHANNEL_SIZE]{};
+    float volts[CHANNEL_SIZE]{};
+    for (uint8_t channel{0}; channel < CHANNEL_SIZE; ++channel)
+    {
+        const BatteryInfo &batteryStatus{_batteryStatuses[channel]};
+        powers[channel] = outputFlag ? (batteryStatus._v * batteryStatus._i) : 0.f;
+        requestIs[channel] = batteryStatus._requestI;
+        volts[channel] = batteryStatus._v;
+    }
+    _thermalBudget.update(powers, dtSeconds);
+
+    float limitIs[CHANNEL_SIZE]{};
+    _thermalBudget.allocate(requestIs, volts, limitIs);
+    for (uint8_t channel{0}; channel < CHANNEL_SIZE; ++channel)
+    {
+        _batteryStatuses[channel]._limitI = _thermalLimitFlag ? limitIs[channel] : std::numeric_limits<float>::infinity();
+    }
+}
+
+// 同時終了モード。放電中のスロットの残り放電量から、次の測定周期の電流を決める
+void BatteryController::updateFinishTogether()
+{
+    static constexpr uint8_t CHANNEL_SIZE{SaveConfigData::CHANNEL_SIZE};
+    static constexpr float TAPER_MARGIN_V{0.02f}; // 目標電圧付近は calcI の絞りに任せる
+
+    float remains[CHANNEL_SIZE]{};
+    float maxIs[CHANNEL_SIZE]{};
+    float volts[CHANNEL_SIZE]{};
+    float resultIs[CHANNEL_SIZE]{};
+    float powerBudget{_thermalLimitFlag ? _thermalBudget.allowedBoardPower() : 0.f};
+    uint8_t slowestChannel{CHANNEL_SIZE};
+    float slowestHours{0.f};
+    for (uint8_t channel{0}; channel < CHANNEL_SIZE; ++channel)
+    {
+        const BatteryInfo &batteryStatus{_batteryStatuses[channel]};
+        volts[channel] = batteryStatus._sleepV;
+        if (_finishTogetherFlag && batteryStatus._activeFlag && batteryStatus._programType == ProgramType::None
+            && batteryStatus._currentBatteryStatus == BatteryStatus::Active && (batteryStatus._sleepV - batteryStatus._targetV) >= TAPER_MARGIN_V)
+        {
+            remains[channel] = batteryStatus._dischargeSlope.remainMilliAmpereHour(batteryStatus._sleepV, batteryStatus._targetV);
+        }
+
+        if (remains[channel] <= 0.f)
+        {
+            // 対象外のスロットが使う分は、電力枠から除く
+            powerBudget -= batteryStatus._v * batteryStatus._i;
+        }
+        else
+        {
+            // 最大電流は TargetI。一番遅れているスロットだけは、全体を短くするため TARGET_I_MAX まで上げる
+            maxIs[channel] = batteryStatus._targetI;
+            const float hours{remains[channel] / std::max(batteryStatus._targetI, SaveBattery::TARGET_I_MIN)};
+            if (hours > slowestHours)
+            {
+                slowestHours = hours;
+                slowestChannel = channel;
+            }
+        }
+    }
+    if (slowestChannel < CHANNEL_SIZE)
+    {
+        maxIs[slowestChannel] = SaveBattery::TARGET_I_MAX;
+    }
+    for (uint8_t channel{0}; channel < CHANNEL_SIZE; ++channel)
+    {
+        // 熱制限が有効な場合は、さらに熱制限の範囲内
+        if (_thermalLimitFlag && remains[channel] > 0.f)
+        {
+            maxIs[channel] = std::min(maxIs[channel], _thermalBudget.allowedChannelPower(channel) / std::max(volts[channel], 0.1f));
+        }
+    }
+    if (_thermalLimitFlag && powerBudget <= 0.f)
+    {
+        powerBudget = 0.001f;
+    }
+
+    FinishTogether<CHANNEL_SIZE>::allocate(remains, maxIs, volts, powerBudget, SaveBattery::TARGET_I_MIN, resultIs);
+    for (uint8_t channel{0}; channel < CHANNEL_SIZE; ++channel)
+    {
+        _batteryStatuses[channel]._coordinatedI = (remains[channel] > 0.f) ? resultIs[channel] : -1.f;
+    }
+}
+
 void BatteryController::loopSub()
 {
     ++_loopSubCount;
@@ -558,6 +1343,14 @@ void BatteryController::loopSub()
     }
     */
 #endif
+    // 校正モードでは Serial を基準値の入力に使う
+    if (_mainMode != MainMode::AutoCalibMode && _mainMode != MainMode::CurrentCalibMode)
+    {
+        _serialCommand.poll(Serial, *this);
+    }
+
+    updateThermalBudget();
+
     updateButtonStatus();
 
     if (_clearDisplayFlag)
@@ -573,6 +1366,8 @@ void BatteryController::loopSub()
             {
                 batteryStatus.loopSubNormalDischarge();
             }
+            updateFinishTogether();
+            storeRunRecords();
 
             if ((_loopSubCount % 3) == 0)
             {
@@ -596,6 +1391,50 @@ void BatteryController::loopSub()
                 oledDisplay.display();
             }
         }
+        else if (_mainMode == MainMode::AutoCalibMode)
+        {
+            _autoCalibration.update(_voltageMapping);
+            _autoCalibration.readSerial(Serial);
+
+            if ((_loopSubCount % 3) == 0)
+            {
+                setDisplayAutoCalib();
+                oledDisplay.display();
+            }
+        }
+        else if (_mainMode == MainMode::AdcStatMode)
+        {
+            if ((_loopSubCount % 3) == 0)
+            {
+                setDisplayAdcStat();
+                oledDisplay.display();
+            }
+        }
+        else if (_mainMode == MainMode::HistoryMode)
+        {
+            if ((_loopSubCount % 3) == 0)
+            {
+                setDisplayHistory();
+                oledDisplay.display();
+            }
+        }
+        else if (_mainMode == MainMode::CurrentCalibMode)
+        {
+            _currentCalibration.readSerial(Serial);
+
+            // 校正中のチャンネルのみ出力する
+            for (auto &batteryStatus : _batteryStatuses)
+            {
+                const bool targetFlag{batteryStatus._batteryIndex == _currentCalibration.channel()};
+                analogWrite(batteryStatus._writePin, targetFlag ? _currentCalibration.currentPWMValue() : 0);
+            }
+
+            if ((_loopSubCount % 3) == 0)
+            {
+                setDisplayCurrentCalib();
+                oledDisplay.display();
+            }
+        }
         else if (_mainMode == MainMode::PushDischargerMode)
         {
             for (auto &batteryStatus : _batteryStatuses)
@@ -1,11 +1,27 @@
 #pragma once
 
+#include <EEPROM.h>
+
 #include "discharger_define.hpp"
 #include "battery_info.hpp"
 #include "save_config_data.hpp"
 #include "voltage_mapping.hpp"
 #include "button_status.hpp"
+#include "auto_calibration.hpp"
+#include "current_calibration.hpp"
+#include "serial_command.hpp"
 #include "src/display/adafruit_gfx_utility.hpp"
+#include "src/adc/pwm_sync_sampler.hpp"
+#include "src/control/thermal_budget.hpp"
+#include "src/control/finish_together.hpp"
+#include "src/link/link_master.hpp"
+#include "src/link/link_node.hpp"
+#include "src/link/stream_link_port.hpp"
+
+namespace benchmark
+{
+    class Benchmark;
+}
 
 static constexpr float FPS{30.f};
 static constexpr float SEC{1000.f};
@@ -17,11 +33,18 @@ enum class MainMode : uint8_t
     PushDischargerMode, // ボタン押す放電モード
     ConfigMode, // 設定モード（電圧値のキャリブレーション等）
     BatteryConfigMode, // ーマル放電モード時の設定モード
+    AutoCalibMode, // 基準電圧を使った自動キャリブレーション
+    CurrentCalibMode, // 電流計を使った PWM -> 電流 テーブルの校正
+    HistoryMode, // 放電記録の閲覧
+    AdcStatMode, // ADC のノイズの診断
     Max,
 };
 
 class BatteryController
 {
+    friend class SerialCommand;
+    friend class benchmark::Benchmark;
+
 private:
     ButtonStatus _buttonLStatus{};
     ButtonStatus _buttonRStatus{};
@@ -64,6 +87,59 @@ private:
 
     uint8_t _ledOnFlag{0};
 
+    bool _syncSampleFlag{false};
+
+    PwmSyncSampler _syncSampler{PWM_PERIOD_MICROS, SYNC_SAMPLE_PERIODS, SYNC_SAMPLE_COUNT};
+
+    bool _thermalLimitFlag{false};
+
+    ThermalBudget<SaveConfigData::CHANNEL_SIZE> _thermalBudget{};
+
+    unsigned long _thermalMillis{0};
+
+    bool _finishTogetherFlag{false};
+
+    LinkRole _linkRole{LinkRole::Off};
+
+    bool _linkPinFlag{false}; // D6/D7 をリンクに使う（スロット3,4を止める）。ユニット毎に明示して有効にする
+
+    StreamLinkPort _linkPort{Serial1};
+
+    LinkMaster _linkMaster{_linkPort};
+
+    LinkNode _linkNode{_linkPort};
+
+    uint8_t _linkViewIndex{0}; // 0 は自分の電池、1 以降はノードの電池を表示する
+
+    uint8_t _linkSlotIndex{0};
+
+    bool _plotViewFlag{false}; // 選択中の電池の電圧グラフを表示する
+
+    uint8_t _plotSpanIndex{BatteryInfo::HISTORY_LEVEL_COUNT}; // グラフの表示期間（初期値は全体）
+
+    static constexpr int RUN_RECORD_ADDRESS{0x800};
+    static constexpr uint16_t RUN_RECORD_CAPACITY{80}; // 24byte x 80 = 1920byte（EEPROM は 0x800 + 1920 = 3968byte 必要）
+
+    static_assert(SaveConfigData::SAVEDATA_ADDRESS + sizeof(SaveConfigData) <= RUN_RECORD_ADDRESS, "run records overlap SaveConfigData");
+    static_assert(SaveBatteryConfigData::SAVEDATA_ADDRESS + sizeof(SaveBatteryConfigData) <= RUN_RECORD_ADDRESS, "run records overlap SaveBatteryConfigData");
+
+    RunRecordStore<EEPROMClass, RUN_RECORD_CAPACITY> _runRecordStore{EEPROM, RUN_RECORD_ADDRESS};
+
+    // EEPROM が小さく、記録が RUN_RECORD_CAPACITY 件入らない
+    bool isRunRecordShort() const
+    {
+        return _runRecordStore.capacity() < RUN_RECORD_CAPACITY;
+    }
+
+    // 記録領域が足りないことを Serial と画面に出す（起動時）
+    void reportRunRecordShort();
+
+    uint8_t _historySlot{0}; // 閲覧する記録のスロット。0 は全て、1 - 4 はそのスロットのみ
+
+    uint16_t _historyIndex{0}; // 新しい順に何番目の記録を表示するか
+
+    uint8_t _adcStatPage{0}; // 0: 平均と標準偏差、1: Allan 偏差
+
     float _dischargeI{2.f};
 
 
@@ -75,6 +151,12 @@ private:
 
     SaveConfigData _saveConfigData{};
 
+    AutoCalibration _autoCalibration{};
+
+    CurrentCalibration _currentCalibration{};
+
+    SerialCommand _serialCommand{};
+
     MainMode _mainMode{MainMode::DischargerMode};
 
     MainMode _cachedMainMode{MainMode::DischargerMode};
@@ -101,6 +183,8 @@ public:
 
     VoltageMapping _voltageMapping;
 
+    CurrentTable _currentTables[SaveConfigData::CHANNEL_SIZE]{};
+
 private:
     void saveConfig();
 
@@ -116,6 +200,9 @@ private:
 
     void updateConfigSaveData();
 
+    // 電池設定を変更した後に、その設定を共有する電池へ反映する（放電中の状態はそのまま）
+    void applyBatterySetting(const SaveBattery *saveBattery);
+
     void setDisplayConfig() const;
 
     void setDisplayBatteryConfig(Adafruit_SSD1306& display) const;
@@ -126,6 +213,20 @@ private:
 
     void setDisplayNone() const;
 
+    void setDisplayAutoCalib() const;
+
+    void setDisplayCurrentCalib() const;
+
+    void setDisplayLinkNode() const;
+
+    void setDisplayPlot() const;
+
+    void setDisplayHistory() const;
+
+    void setDisplayAdcStat() const;
+
+    void resetAdcStatistics();
+
     // void goDeepSleep();
 
     void updateButtonStatus();
@@ -143,6 +244,8 @@ private:
 
     void changeSettingMode(int shift);
 
+    void changeMainMode(MainMode nextMode);
+
     void changeActive(int shift)
     {
         _batteryStatuses[_currentBatteryIndex].changeActive(shift);
@@ -152,14 +255,102 @@ private:
 
     void loopSub();
 
+    void updateThermalBudget();
+
+    void updateFinishTogether();
+
+    void beginLink(LinkRole linkRole, bool pinFlag);
+
+    // 役割が Off 以外で、D6/D7 をリンクに使う設定の場合だけリンクを動かす
+    bool isLinkActive() const
+    {
+        return _linkRole != LinkRole::Off && _linkPinFlag;
+    }
+
+    // 読み取りピンが Serial1 と重なるスロットの有効 / 無効を切り替える
+    void setLinkSlotsEnabled(bool enabledFlag);
+
+    void updateLink();
+
+    void shiftLinkView(int shift);
+
+    void updateLinkViewButtons();
+
+    void changePlotView(bool plotViewFlag);
+
+    void updatePlotViewButtons();
+
+    void storeRunRecords();
+
+    uint16_t historyCount() const;
+
+    bool findHistory(uint16_t index, RunRecord &record) const;
+
+    void fillLinkState(LinkNodeState &state) const;
+
+    void applyLinkCommand(const LinkCommand &command);
+
     void loopMain()
     {
-        for (auto &batteryStatus : _batteryStatuses)
+        updateLink();
+
+        if (_mainMode == MainMode::AutoCalibMode)
+        {
+            if (_autoCalibration.isSampling())
+            {
+                for (auto &batteryStatus : _batteryStatuses)
+                {
+                    if (batteryStatus.isEnabled())
+                    {
+                        _autoCalibration.addSample(batteryStatus._batteryIndex, analogRead(batteryStatus._readPin));
+                    }
+                }
+            }
+            return;
+        }
+
+        if (_syncSampleFlag)
+        {
+            readSync();
+        }
+        else
+        {
+            for (auto &batteryStatus : _batteryStatuses)
+            {
+                batteryStatus.read();
+            }
+        }
+
+        if (_mainMode == MainMode::DischargerMode || _mainMode == MainMode::PushDischargerMode)
         {
-            batteryStatus.read();
+            for (auto &batteryStatus : _batteryStatuses)
+            {
+                batteryStatus.updateOutput();
+            }
         }
     };
 
+    void readSync()
+    {
+        const SyncSampleEvent syncSampleEvent{_syncSampler.poll(micros())};
+        if (syncSampleEvent == SyncSampleEvent::None)
+        {
+            return;
+        }
+
+        for (auto &batteryStatus : _batteryStatuses)
+        {
+            if (syncSampleEvent == SyncSampleEvent::Slipped)
+            {
+                batteryStatus.discardSyncWindow();
+            }
+            else
+            {
+                batteryStatus.readSyncSample(syncSampleEvent == SyncSampleEvent::WindowEnd);
+            }
+        }
+    }
+
     void clearDisplay()
     {
         _clearDisplayFlag = true;
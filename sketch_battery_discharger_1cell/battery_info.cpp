@@ -12,6 +12,8 @@ const std::vector<String> DISC_MODE_NAMES{String("Keep"), String("KeepMin"), Str
 
 const std::vector<String> REDUCE_MODE_NAMES{String("Mild"), String("Normal"), String("Hard"), String("None")};
 
+const std::vector<String> PROGRAM_NAMES{String("None"), String("Cond"), String("Capa"), String("PulseIR"), String("Custom")};
+
 void printMinuteSecond(int sec, char *str)
 {
     int min{sec / 60.f};
@@ -84,27 +86,59 @@ float BatteryInfo::calcI(const float targetI, const float v, const float targetV
     return resultI;
 };
 
-int BatteryInfo::calcPWMValue(float ampere, float activeRate, float calibI)
+int32_t BatteryInfo::calcDuty(float ampere, float activeRate) const
+{
+    return calcDuty(ampere, activeRate, _batteryController->_calibI, _batteryController->_currentTables[_batteryIndex]);
+}
+
+int BatteryInfo::calcPWMValue(float ampere, float activeRate) const
+{
+    return calcPWMValue(ampere, activeRate, _batteryController->_calibI, _batteryController->_currentTables[_batteryIndex]);
+}
+
+int BatteryInfo::calcPWMValue(float ampere, float activeRate, float calibI, const CurrentTable &currentTable)
+{
+    const int32_t duty{calcDuty(ampere, activeRate, calibI, currentTable)};
+    return static_cast<int>((duty + (1 << (DitheredPwm::FRACTION_BITS - 1))) >> DitheredPwm::FRACTION_BITS);
+}
+
+int32_t BatteryInfo::calcDuty(float ampere, float activeRate, float calibI, const CurrentTable &currentTable)
 {
-    static const int MAX_PWM{0xFF};
-    static const float MAX_PWM_F{static_cast<float>(MAX_PWM)};
+    static const float MAX_PWM_F{static_cast<float>(DitheredPwm::MAX_VALUE)};
+    static const float DUTY_SCALE{static_cast<float>(1 << DitheredPwm::FRACTION_BITS)};
     static const float REG{0.1f};
     static const float REG_RATE{(RES_A + RES_B + RES_C) / RES_C};
     static const float I_TO_V{REG * REG_RATE};
     static const float TO_V_RATE{I_TO_V / VOLT3_3};
     static const float AMP_TUNE{1.04f};
 
-    const float voltRate{ampere * TO_V_RATE};
+    // PWM の平均電圧は電源電圧に比例するので、電源電圧が下がった分 duty を上げる（テーブルも 3.3V で測った前提）
+    int32_t duty{0};
+    if (currentTable.isValid())
+    {
+        const float milliAmpere{ampere * 1000.f * (calibI / activeRate)};
+        duty = currentTable.lookupDuty(static_cast<int32_t>(milliAmpere + 0.5f));
+    }
+    else
+    {
+        const float voltRate{ampere * TO_V_RATE};
+        duty = static_cast<int32_t>(voltRate * MAX_PWM_F * DUTY_SCALE * ((AMP_TUNE * calibI) / activeRate));
+    }
 
-    return std::clamp(static_cast<int>(voltRate * MAX_PWM_F * ((AMP_TUNE * calibI) / activeRate)), 0, MAX_PWM);
+    return std::clamp(SupplyReference::compensateDuty(duty), static_cast<int32_t>(0), DitheredPwm::MAX_DUTY);
 };
 
 void BatteryInfo::loopSubPushDischarge()
 {
+    if (!_enabledFlag)
+    {
+        return;
+    }
+    _pulseCounter.reset();
     unsigned long temp{_valueCounter.calcValue()};
     if (_tunedI > 0.01f)
     {
-        _v = _batteryController->_voltageMapping.getVoltage(temp);
+        _v = _batteryController->_voltageMapping.getCompensatedVoltage(temp, _batteryIndex);
 
         if ((_tunedI > 0.f) && (_sleepV - _v) && ((millis() - _startMillis) < 1000))
         {
@@ -113,29 +147,75 @@ void BatteryInfo::loopSubPushDischarge()
     }
     else
     {
-        _sleepV = _batteryController->_voltageMapping.getVoltage(temp);
+        _sleepV = _batteryController->_voltageMapping.getCompensatedVoltage(temp, _batteryIndex);
         _v = _sleepV;
     }
 
-    _i = std::max(0.f, _tunedI);
-    int intValue = calcPWMValue(_i, 1.f, _batteryController->_calibI);
-    analogWrite(_writePin, intValue);
+    _requestI = std::max(0.f, _tunedI);
+    _i = std::min(_requestI, _limitI);
+    _pwmOutput.setDuty(calcDuty(_i, 1.f));
+
+    updateHistory();
 }
 
-void BatteryInfo::writePinReset() const
+void BatteryInfo::startProgram()
 {
+    _programReachedFlag = false;
+    _pulseResistance.reset();
+
+    const DischargeProgram *program{nullptr};
+    if (_programType == ProgramType::Conditioning)
+    {
+        program = &DischargePrograms::CONDITIONING;
+    }
+    else if (_programType == ProgramType::Capacity)
+    {
+        program = &DischargePrograms::CAPACITY;
+    }
+    else if (_programType == ProgramType::PulseIR)
+    {
+        program = &DischargePrograms::PULSE_IR;
+    }
+    else if (_programType == ProgramType::Custom && _saveBattery)
+    {
+        program = &(_saveBattery->_customProgram);
+    }
+
+    if (program)
+    {
+        _programRunner.start(program, millis());
+    }
+    else
+    {
+        _programRunner.stop();
+    }
+}
+
+void BatteryInfo::writePinReset()
+{
+    _pwmOutput.reset();
     analogWrite(_writePin, 0);
 }
 
 void BatteryInfo::loopSubNormalDischarge()
 {
+    if (!_enabledFlag)
+    {
+        return;
+    }
     _currentBatteryStatus = _nextBatteryStatus;
 
+    // 直前のフレームの平均電圧（パルスの内部抵抗用）
+    const unsigned long pulseValue{_pulseCounter.calcValue()};
+    const float pulseVolt{pulseValue > 0 ? _batteryController->_voltageMapping.getCompensatedVoltage(pulseValue, _batteryIndex) : 0.f};
+    bool programPulseFlag{false};
+
+    float activeRate{ACTIVE_RATE};
     if (!_activeFlag)
     {
         _currentTimeStatus = static_cast<TimeStatus>(NONE_MODE_LOOPS[(++_loopCount) % sizeof(NONE_MODE_LOOPS)]);
         unsigned long temp{_valueCounter.calcValue()};
-        _sleepV = _batteryController->_voltageMapping.getVoltage(temp);
+        _sleepV = _batteryController->_voltageMapping.getCompensatedVoltage(temp, _batteryIndex);
         _v = _sleepV;
         _tunedI = 0;
         _i = 0;
@@ -144,20 +224,52 @@ void BatteryInfo::loopSubNormalDischarge()
     {
         _currentTimeStatus = static_cast<TimeStatus>(DISCHARGE_MODE_LOOPS[(++_loopCount) % sizeof(DISCHARGE_MODE_LOOPS)]);
 
+        bool programConstantFlag{false};
+        bool programStopFlag{false};
+        // プログラムのステップの目標値。設定（_targetV / _targetI）は書き換えない
+        float programV{_targetV};
+        float programI{_targetI};
+
         unsigned long tempMillis{millis()};
         static const float RATE{1.f / (60.f * 60.f)};
         _milliAmpereHour += _i * (tempMillis - _ampereHourTime) * RATE;
+        _milliWattHour += _i * _v * (tempMillis - _ampereHourTime) * RATE;
         _ampereHourTime = tempMillis;
 
+        // 熱制限をかける前の電流から続ける（制限後の電流を引き継ぐと、要求電流が 0 になり上限も 0 のまま戻らない）
+        _i = _requestI;
+
+        // 放電プログラム実行中は、ステップに応じて目標値を上書きする
+        if (_programType != ProgramType::None)
+        {
+            const ProgramSetpoint setpoint{_programRunner.update(tempMillis, _programReachedFlag)};
+            _programReachedFlag = false;
+            if (setpoint._action == ProgramAction::Taper)
+            {
+                programV = setpoint._targetV;
+                programI = setpoint._targetI;
+            }
+            else if (setpoint._action == ProgramAction::Constant)
+            {
+                programConstantFlag = true;
+                programI = setpoint._targetI;
+            }
+            else
+            {
+                programStopFlag = true;
+            }
+            programPulseFlag = programConstantFlag || programStopFlag;
+        }
+
         if (_currentTimeStatus == TimeStatus::None)
         {
         }
         else if (_currentTimeStatus == TimeStatus::Active)
         {
             unsigned long temp{_valueCounter.calcValue()};
-            _v = _batteryController->_voltageMapping.getVoltage(temp);
+            _v = _batteryController->_voltageMapping.getCompensatedVoltage(temp, _batteryIndex);
             _i = std::max(0.f, _tunedI);
-            if ((_tunedI > 0.f) && (_sleepV - _v))
+            if ((_tunedI > 0.f) && (_sleepV - _v) && !_pulseResistance.isMeasuring() && (_pulseResistance.count() == 0))
             {
                 _ohm = ((_sleepV - _v) * 1000.f) * (ACTIVE_RATE / _tunedI);
             }
@@ -165,7 +277,7 @@ void BatteryInfo::loopSubNormalDischarge()
         else if (_currentTimeStatus == TimeStatus::SleepStart)
         {
             unsigned long temp{_valueCounter.calcValue()};
-            _v = _batteryController->_voltageMapping.getVoltage(temp);
+            _v = _batteryController->_voltageMapping.getCompensatedVoltage(temp, _batteryIndex);
             _i = 0;
         }
         else if (_currentTimeStatus == TimeStatus::SleepStartRead)
@@ -176,7 +288,7 @@ void BatteryInfo::loopSubNormalDischarge()
         else if (_currentTimeStatus == TimeStatus::SleepEnd)
         {
             bool stopContinueFlag{false};
-            if (_currentBatteryStatus == BatteryStatus::Stop)
+            if (_currentBatteryStatus == BatteryStatus::Stop && _programType == ProgramType::None)
             {
                 if (_disChargeMode == DisChargeMode::DischargeStop)
                 {
@@ -192,18 +304,38 @@ void BatteryInfo::loopSubNormalDischarge()
             }
 
             unsigned long temp{_valueCounter.calcValue()};
-            _sleepV = _batteryController->_voltageMapping.getVoltage(temp);
+            _sleepV = _batteryController->_voltageMapping.getCompensatedVoltage(temp, _batteryIndex);
+            if (_currentBatteryStatus == BatteryStatus::Active)
+            {
+                _dischargeSlope.add(_milliAmpereHour, _sleepV);
+            }
+
             if (stopContinueFlag)
             {
                 _tunedI = 0;
             }
             else
             {
-                _tunedI = calcI(_targetI, _sleepV, _targetV, _reduceMode);
+                const float targetI{(_coordinatedI > 0.f && _programType == ProgramType::None) ? _coordinatedI : programI};
+                _tunedI = calcI(targetI, _sleepV, programV, _reduceMode);
+                _programReachedFlag = (_tunedI == 0);
             }
 
             _i = std::max(0.f, _tunedI);
         }
+
+        // パルスや休止は測定周期に関係なく、すぐに反映する
+        if (programConstantFlag)
+        {
+            _tunedI = programI;
+            _i = programI;
+        }
+        else if (programStopFlag)
+        {
+            _tunedI = 0;
+            _i = 0;
+        }
+        activeRate = programConstantFlag ? 1.f : ACTIVE_RATE;
     }
 
     if (_currentBatteryStatus == BatteryStatus::Active || _currentBatteryStatus == BatteryStatus::Stop)
@@ -250,13 +382,91 @@ void BatteryInfo::loopSubNormalDischarge()
         {
             _nextBatteryStatus = BatteryStatus::Active;
             reset();
+            _startV = _v;
+        }
+    }
+
+    _requestI = _i;
+    _i = std::min(_i, _limitI);
+    _pwmOutput.setDuty(calcDuty(_i, activeRate));
+
+    // パルスと休止のフレームだけ内部抵抗を測る（熱制限後の電流で割る）
+    if (_activeFlag && _programType != ProgramType::None)
+    {
+        _pulseResistance.add(pulseVolt, programPulseFlag ? _i : -1.f);
+        if (_pulseResistance.count() > 0)
+        {
+            _ohm = _pulseResistance.milliOhm();
         }
     }
 
-    int intValue = calcPWMValue(_i, ACTIVE_RATE, _batteryController->_calibI);
-    analogWrite(_writePin, intValue);
+    if (_activeFlag && !_runRecordedFlag && isRunFinished())
+    {
+        _runRecordedFlag = true;
+        _runPendingFlag = true;
+    }
+
+    updateHistory();
 };
 
+bool BatteryInfo::isRunFinished() const
+{
+    if (_programType == ProgramType::None)
+    {
+        return _dischargedCount > 0;
+    }
+    return !_programRunner.isRunning() || _programRunner.stepIndex() >= DischargeProgram::STEP_MAX;
+}
+
+bool BatteryInfo::takeRunRecord(RunRecord &record)
+{
+    if (!_runPendingFlag)
+    {
+        return false;
+    }
+    _runPendingFlag = false;
+
+    const auto toUint16{[](float value) {
+        return static_cast<uint16_t>(std::clamp(value + 0.5f, 0.f, 65535.f));
+    }};
+    record._durationSeconds = (millis() - _startMillis) / 1000;
+    record._startMilliVolt = toUint16(_startV * 1000.f);
+    record._endMilliVolt = toUint16(_sleepV * 1000.f);
+    record._milliAmpereHour = toUint16(_milliAmpereHour);
+    record._milliWattHour = toUint16(_milliWattHour);
+    record._deciMilliOhm = toUint16(_ohm * 10.f);
+    record._slot = _batteryIndex;
+    record._disChargeMode = static_cast<uint8_t>(_disChargeMode);
+    record._reduceMode = static_cast<uint8_t>(_reduceMode);
+    record._programType = static_cast<uint8_t>(_programType);
+    return true;
+}
+
+void BatteryInfo::updateHistory()
+{
+    const unsigned long currentMillis{millis()};
+    if (_currentBatteryStatus == BatteryStatus::NoBat || _v <= 0.1f)
+    {
+        _historyMillis = currentMillis;
+        return;
+    }
+    if (currentMillis - _historyMillis < HISTORY_PERIOD_MILLIS)
+    {
+        return;
+    }
+    _historyMillis += HISTORY_PERIOD_MILLIS;
+    if (currentMillis - _historyMillis >= HISTORY_PERIOD_MILLIS)
+    {
+        // 保存などで大きく遅れた場合は追いかけない
+        _historyMillis = currentMillis;
+    }
+
+    // 放電中は 放電中の電圧 - 休止中電圧 の範囲になる（幅が内部抵抗による電圧降下）
+    const uint16_t milliVolt{static_cast<uint16_t>(_v * 1000.f + 0.5f)};
+    const uint16_t sleepMilliVolt{(_sleepV > 0.1f) ? static_cast<uint16_t>(_sleepV * 1000.f + 0.5f) : milliVolt};
+    _history.add(milliVolt, sleepMilliVolt);
+}
+
 void BatteryInfo::setDisplayVoltOnly(Adafruit_SSD1306 &display) const
 {
     static constexpr int DISPLAY_MENU_START_COL{3};
@@ -288,7 +498,15 @@ void BatteryInfo::setDisplayDetailOld(Adafruit_SSD1306 &display) const
     AdafruitGfxUtility::drawFillLine(display, line);
 
     virOffset = DISPLAY_MENU_START_COL;
-    AdafruitGfxUtility::drawStringC(display, DISC_MODE_NAMES[static_cast<uint8_t>(_disChargeMode)], line);
+    if (_programType != ProgramType::None)
+    {
+        const String stepString{_programRunner.isRunning() ? String(_programRunner.stepIndex() + 1) : String("End")};
+        AdafruitGfxUtility::drawStringC(display, PROGRAM_NAMES[static_cast<uint8_t>(_programType)] + String(" ") + stepString, line);
+    }
+    else
+    {
+        AdafruitGfxUtility::drawStringC(display, DISC_MODE_NAMES[static_cast<uint8_t>(_disChargeMode)], line);
+    }
 
     ++line;
     AdafruitGfxUtility::drawFillLine(display, line);
@@ -355,7 +573,7 @@ void BatteryInfo::setDisplayDetailOld(Adafruit_SSD1306 &display) const
     {
         ++line;
         AdafruitGfxUtility::drawFillLine(display, line);
-        AdafruitGfxUtility::drawInt(display, calcPWMValue(_targetI, ACTIVE_RATE, _batteryController->_calibI), SETTING_MENU_START_COL, line);
+        AdafruitGfxUtility::drawInt(display, calcPWMValue(_targetI, ACTIVE_RATE), SETTING_MENU_START_COL, line);
         AdafruitGfxUtility::drawString(display, "PWM", SETTING_MENU_START_COL + SETTING_MENU_OFFSET_COL, line);
     }
 
@@ -460,6 +678,67 @@ void BatteryInfo::setDisplayDetail(Adafruit_SSD1306 &display) const
     AdafruitGfxUtility::drawStringC(display, milliAmpereHourText, START_LINE + 4);
 }
 
+void BatteryInfo::setDisplayPlot(Adafruit_SSD1306 &display, uint8_t spanIndex) const
+{
+    static constexpr int PLOT_TOP{10};
+    static constexpr int PLOT_BOTTOM{AdafruitGfxUtility::SCREEN_HEIGHT - 1};
+    static constexpr int PLOT_WIDTH{AdafruitGfxUtility::SCREEN_WIDTH};
+    static constexpr uint16_t MIN_RANGE_MILLI_VOLT{50};
+
+    const bool allFlag{spanIndex >= HISTORY_LEVEL_COUNT};
+    const uint8_t level{allFlag ? _history.fitLevel() : spanIndex};
+    const uint16_t columnCount{_history.columnCount(level)};
+
+    const unsigned long spanSeconds{allFlag ? _history.sampleCount() : _history.bucketSamples(level) * HISTORY_SIZE};
+    const unsigned long spanMinutes{(spanSeconds * (HISTORY_PERIOD_MILLIS / 1000) + 59) / 60};
+    const String spanString{(spanMinutes < 60) ? (String(spanMinutes) + String("m")) : (String(spanMinutes / 60) + String("h"))};
+
+    MinMaxSample range{};
+    for (uint16_t index{0}; index < columnCount; ++index)
+    {
+        range.merge(_history.column(level, index));
+    }
+
+    String headerString{String(_batteryIndex + 1) + (allFlag ? String(" All ") : String(" ")) + spanString};
+    if (!range.isValid())
+    {
+        AdafruitGfxUtility::drawString(display, headerString, 0, 0);
+        AdafruitGfxUtility::drawStringC(display, "No data", 3);
+        return;
+    }
+
+    // 変化が小さい場合も、ノイズが目立ちすぎないように最低 50mV の幅で表示する
+    int lower{range._min};
+    int upper{range._max};
+    if (upper - lower < MIN_RANGE_MILLI_VOLT)
+    {
+        const int center{(upper + lower) / 2};
+        lower = center - MIN_RANGE_MILLI_VOLT / 2;
+        upper = lower + MIN_RANGE_MILLI_VOLT;
+    }
+    headerString += String(" ") + String(range._min / 1000.f, 2) + String("-") + String(range._max / 1000.f, 2) + String("V");
+    AdafruitGfxUtility::drawString(display, headerString, 0, 0);
+
+    const auto toY{[lower, upper](int milliVolt) {
+        return PLOT_BOTTOM - ((milliVolt - lower) * (PLOT_BOTTOM - PLOT_TOP)) / (upper - lower);
+    }};
+
+    // 直近表示は1区間 = 1ドットで右詰め、全体表示は区間数に合わせて横に引き伸ばす
+    const int startX{allFlag ? 0 : PLOT_WIDTH - columnCount};
+    for (int x{startX}; x < PLOT_WIDTH; ++x)
+    {
+        const uint16_t index{static_cast<uint16_t>(allFlag ? (x * columnCount) / PLOT_WIDTH : x - startX)};
+        const MinMaxSample sample{_history.column(level, index)};
+        if (!sample.isValid())
+        {
+            continue;
+        }
+        const int topY{toY(sample._max)};
+        const int bottomY{toY(sample._min)};
+        display.drawFastVLine(x, topY, bottomY - topY + 1, SSD1306_WHITE);
+    }
+}
+
 void BatteryInfo::setDisplayPushData(Adafruit_SSD1306 &display) const
 {
     ++_displayCount;
@@ -478,7 +757,7 @@ void BatteryInfo::setDisplayPushData(Adafruit_SSD1306 &display) const
             {
                 const std::pair<int, int> &position{positionArray[_batteryIndex]};
                 display.setCursor(position.first, position.second);
-                display.print(String(_v, _batteryController->_decimal) + String("V"));
+                display.print(_enabledFlag ? (String(_v, _batteryController->_decimal) + String("V")) : String("Link"));
             }
             display.setFont(nullptr);
         }
@@ -506,6 +785,12 @@ void BatteryInfo::setDisplayData(Adafruit_SSD1306 &display) const
         AdafruitGfxUtility::drawString(display, ">", 5 * _batteryIndex, 0);
     }
 
+    if (!_enabledFlag)
+    {
+        AdafruitGfxUtility::drawString(display, "Link", 5 * _batteryIndex + 1, 0);
+        return;
+    }
+
     if (_tunedI > 0 && (_displayCount % 2))
     {
     }
@@ -529,9 +814,39 @@ void BatteryInfo::setDisplayData(Adafruit_SSD1306 &display) const
 
 void BatteryInfo::read()
 {
-    constexpr int MIN_VOLT{10};
+    if (!_enabledFlag)
+    {
+        return;
+    }
     const int volt{analogRead(_readPin)};
     _valueCounter.readVolt(volt);
+    _pulseCounter.readVolt(volt);
+    _adcStatistics.add(volt);
+    checkNoBat(volt);
+};
+
+void BatteryInfo::readSyncSample(bool windowEndFlag)
+{
+    if (!_enabledFlag)
+    {
+        return;
+    }
+    const int volt{analogRead(_readPin)};
+    _syncWindowTotal += volt;
+    _adcStatistics.add(volt);
+    ++_syncWindowCount;
+    if (windowEndFlag)
+    {
+        _valueCounter.addTotal(_syncWindowTotal, _syncWindowCount);
+        _pulseCounter.addTotal(_syncWindowTotal, _syncWindowCount);
+        discardSyncWindow();
+    }
+    checkNoBat(volt);
+};
+
+void BatteryInfo::checkNoBat(int volt)
+{
+    constexpr int MIN_VOLT{10};
     if (volt < MIN_VOLT)
     {
         _nextBatteryStatus = BatteryStatus::NoBat;
@@ -543,9 +858,49 @@ void BatteryInfo::read()
     }
 };
 
+void BatteryInfo::loadSetting()
+{
+    _targetI = _saveBattery->_targetI;
+    _targetV = _saveBattery->_targetV;
+    _disChargeMode = _saveBattery->_disChargeMode;
+    _reduceMode = _saveBattery->_reduceMode;
+    _holdMin = _saveBattery->_holdMin;
+    _programType = _saveBattery->_programType;
+};
+
 void BatteryInfo::setup()
 {
-    pinMode(_readPin, INPUT);
+    if (_enabledFlag)
+    {
+        pinMode(_readPin, INPUT);
+    }
     pinMode(_writePin, OUTPUT);
     reset();
 };
+
+void BatteryInfo::setEnabled(bool enabledFlag)
+{
+    if (_enabledFlag == enabledFlag)
+    {
+        return;
+    }
+
+    _enabledFlag = enabledFlag;
+    _activeFlag = false;
+    _currentBatteryStatus = BatteryStatus::None;
+    _nextBatteryStatus = BatteryStatus::None;
+    reset();
+    _runPendingFlag = false;
+    _valueCounter.reset();
+    _pulseCounter.reset();
+    discardSyncWindow();
+    _v = 0.f;
+    _sleepV = 0.f;
+    _tunedI = 0.f;
+    _requestI = 0.f;
+    writePinReset();
+    if (_enabledFlag)
+    {
+        pinMode(_readPin, INPUT);
+    }
+};
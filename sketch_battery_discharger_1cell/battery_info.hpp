@@ -2,9 +2,16 @@
 
 #include <Arduino.h>
 #include <vector>
+#include <limits>
 
 #include "discharger_define.hpp"
 #include "save_battery_config_data.hpp"
+#include "current_table.hpp"
+#include "src/output/dithered_pwm.hpp"
+#include "src/adc/adc_statistics.hpp"
+#include "src/control/discharge_slope.hpp"
+#include "src/history/min_max_history.hpp"
+#include "src/history/run_record_store.hpp"
 
 class Adafruit_SSD1306;
 class SaveConfigData;
@@ -12,6 +19,7 @@ class BatteryController;
 
 extern const std::vector<String> DISC_MODE_NAMES;
 extern const std::vector<String> REDUCE_MODE_NAMES;
+extern const std::vector<String> PROGRAM_NAMES;
 
 enum class TimeStatus : uint8_t
 {
@@ -36,6 +44,12 @@ public:
     _count += 1;
   }
 
+  void addTotal(unsigned long inTotalValue, int inCount)
+  {
+    _totalValue += inTotalValue;
+    _count += inCount;
+  }
+
   void reset()
   {
     _totalValue = 0;
@@ -111,6 +125,12 @@ class BatteryInfo
 
   unsigned long _loopCount{0};
 
+  unsigned long _syncWindowTotal{0};
+
+  int _syncWindowCount{0};
+
+  void checkNoBat(int volt);
+
   // 点滅表示用
   mutable unsigned long _displayCount{0};
 
@@ -118,21 +138,91 @@ class BatteryInfo
 
   static float calcI(const float targetI, const float v, const float targetV, const ReduceMode reduceMode);
 
-  static int calcPWMValue(float ampere, float activeRate, float calibI);
+  int32_t calcDuty(float ampere, float activeRate) const;
+
+  int calcPWMValue(float ampere, float activeRate) const;
+
+  DitheredPwm _pwmOutput{PWM_PERIOD_MICROS};
+
+  ProgramRunner _programRunner{};
+
+  bool _programReachedFlag{false}; // 絞り放電が目標電圧に達した（プログラムの次のステップへ）
+
+  ValueCounter _pulseCounter{}; // フレーム毎の電圧（パルスの内部抵抗用。_valueCounter とは別に数える）
+
+  PulseResistance _pulseResistance{};
+
+  void startProgram();
+
+  // 1秒毎に電圧を履歴に追加する
+  void updateHistory();
+
+  // 放電が終わった（目標電圧に達した、またはプログラムが終わった）かどうか
+  bool isRunFinished() const;
+
+  bool _runRecordedFlag{false}; // 今回の放電の結果を記録に渡したかどうか
+  bool _runPendingFlag{false};  // 記録に渡す結果がある
+
+  bool _enabledFlag{true};
 
 public:
+  // 履歴の段: 1秒、10秒、1分、10分。各128区間（= 画面幅）で、約2分、21分、2時間、21時間分
+  static constexpr uint8_t HISTORY_LEVEL_COUNT{4};
+  static constexpr uint16_t HISTORY_SIZE{128};
+  static constexpr uint16_t HISTORY_RATIOS[HISTORY_LEVEL_COUNT]{1, 10, 6, 10};
+  static constexpr unsigned long HISTORY_PERIOD_MILLIS{1000};
+
+  using VoltHistory = MinMaxHistory<HISTORY_LEVEL_COUNT, HISTORY_SIZE>;
+
+
+  // currentTable が有効な場合は実測テーブル、無効な場合は回路定数から duty を求める（8.8 固定小数点）
+  static int32_t calcDuty(float ampere, float activeRate, float calibI, const CurrentTable &currentTable);
+
+  static int calcPWMValue(float ampere, float activeRate, float calibI, const CurrentTable &currentTable);
+
   BatteryInfo(uint8_t inReadPin, uint8_t inWritePin, uint8_t inBatteryIndex)
       : _batteryIndex{inBatteryIndex}, _readPin{inReadPin}, _writePin{inWritePin} {};
 
   void read();
 
+  // PWM 周期の整数倍の窓での等間隔サンプリング（SyncADC）。窓が完結したときだけ ValueCounter に加える
+  void readSyncSample(bool windowEndFlag);
+
+  void discardSyncWindow()
+  {
+    _syncWindowTotal = 0;
+    _syncWindowCount = 0;
+  }
+
   void setup();
 
+  // 無効にすると、読み取りピンを読まず、出力も表示もしない（リンクが Serial1 で同じピンを使う間）
+  // 切り替えると放電を止めて状態を初期化する。有効に戻すときに読み取りピンを入力に設定し直す
+  void setEnabled(bool enabledFlag);
+
+  bool isEnabled() const
+  {
+    return _enabledFlag;
+  }
+
+  // 設定（_saveBattery、ペアで共有）を反映する。放電中の状態はそのまま
+  void loadSetting();
+
   void loopSubPushDischarge();
 
   void loopSubNormalDischarge();
 
-  void writePinReset() const;
+  void writePinReset();
+
+  // loopMain から毎回呼ぶ。ΔΣ変調した PWM 値を PWM 周期毎に出力する
+  void updateOutput()
+  {
+    if (!_enabledFlag)
+    {
+      return;
+    }
+    _pwmOutput.update(micros(), [this](uint8_t value) { analogWrite(_writePin, value); });
+  }
 
   void miniReset()
   {
@@ -144,6 +234,7 @@ public:
   void reset()
   {
     miniReset();
+    _pwmOutput.reset();
     _milliAmpereHour = 0.f;
     _startMillis = millis();
     _endMillis = millis();
@@ -152,10 +243,22 @@ public:
     _dischargedCount = 0;
     _milliAmpereHour = 0;
     _ohm = 0;
+    _dischargeSlope.reset();
+    _coordinatedI = -1.f;
+    _history.reset();
+    _historyMillis = millis();
+    _milliWattHour = 0.f;
+    _runRecordedFlag = false;
+    _runPendingFlag = false;
+    startProgram();
   }
 
   void pushOn(float inI)
   {
+    if (!_enabledFlag)
+    {
+      return;
+    }
     if (_tunedI == 0.f)
     {
       _startMillis = millis();
@@ -170,6 +273,10 @@ public:
 
   void changeActive(int shift)
   {
+    if (!_enabledFlag)
+    {
+      return;
+    }
     if (_activeFlag)
     {
       _activeFlag = false;
@@ -178,6 +285,7 @@ public:
     {
       _nextBatteryStatus = BatteryStatus::None;
       reset();
+      _startV = _sleepV;
       _activeFlag = true;
     }
   }
@@ -192,6 +300,18 @@ public:
 
   void setDisplayDetailOld(Adafruit_SSD1306 &display) const; 
 
+  // spanIndex: 0 - HISTORY_LEVEL_COUNT-1 は各段の全区間（直近）、HISTORY_LEVEL_COUNT は放電開始からの全体
+  void setDisplayPlot(Adafruit_SSD1306 &display, uint8_t spanIndex) const;
+
+  // 放電が終わっていれば、その結果を record に入れて true を返す（1回の放電につき1度だけ）
+  bool takeRunRecord(RunRecord &record);
+
+  // 実行中のプログラムのステップ（0 始まり）。プログラムを使っていないか、終わっていれば DischargeProgram::STEP_MAX
+  uint8_t programStepIndex() const
+  {
+    return _programRunner.isRunning() ? _programRunner.stepIndex() : DischargeProgram::STEP_MAX;
+  }
+
   ValueCounter _valueCounter{};
 
   BatteryStatus _currentBatteryStatus{BatteryStatus::None};
@@ -216,11 +336,24 @@ public:
   float _tunedI{1.f};
   float _ohm{0.f};
   float _targetI{0.2f};
+  float _requestI{0.f}; // 熱制限をかける前の電流
+  float _limitI{std::numeric_limits<float>::infinity()}; // 熱制限による電流の上限
+  float _coordinatedI{-1.f}; // 同時終了モードで割り当てられた電流。負の場合は _targetI を使う
   float _milliAmpereHour{0.0f};
+  float _milliWattHour{0.0f};
+  float _startV{0.f}; // 放電開始前の休止中電圧
   unsigned long _ampereHourTime{0};
   DisChargeMode _disChargeMode{DisChargeMode::DischargeHold};
   ReduceMode _reduceMode{ReduceMode::Normal};
   int _holdMin{30};
+  ProgramType _programType{ProgramType::None};
+
+  DischargeSlope _dischargeSlope{}; // 休止中電圧の傾き（同時終了モードで残り放電量の見積もりに使う）
+
+  AdcStatistics _adcStatistics{}; // ADC の生の値のノイズ（診断画面用）
+
+  VoltHistory _history{HISTORY_RATIOS}; // 放電中の電圧(mV) と休止中電圧の範囲
+  unsigned long _historyMillis{0};
 
   SaveBattery* _saveBattery{nullptr};
 
@@ -1,6 +1,7 @@
 #include "battery_monitor.hpp"
 
 #include "discharger_define.hpp"
+#include "src/adc/supply_reference.hpp"
 
 void BatteryMonitor::setup()
 {
@@ -17,6 +18,9 @@ bool BatteryMonitor::update()
         return false;
     }
 
+    // ADC の基準の電源電圧を測り直す（IADC の設定は測定後に元に戻る）
+    SupplyReference::update();
+
     _xiaoVolt = readXiaoBatteryVolt();
     if (_xiaoVoltValidFlag)
     {
@@ -53,5 +57,5 @@ bool BatteryMonitor::shouldGoDeepSleep() const
 float BatteryMonitor::readXiaoBatteryVolt() const
 {
     const int readValue{analogRead(XIAO_READ_BAT)};
-    return (static_cast<float>(readValue) / 4096.f) * XIAO_BATTERY_DIVIDER_RATE * VOLT3_3;
+    return (static_cast<float>(readValue) / 4096.f) * XIAO_BATTERY_DIVIDER_RATE * SupplyReference::volt();
 }
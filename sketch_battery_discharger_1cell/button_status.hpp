@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+
 enum class PushType : uint8_t
 {
     None,
@@ -14,10 +16,25 @@ enum class PushType : uint8_t
 struct ButtonStatus
 {
     static constexpr int LONG_PUSH_MILLIS{1000};
+    static constexpr unsigned long DEBOUNCE_MILLIS{20}; // エッジ確定後、この時間は反対側のエッジを無視する
+    static constexpr uint8_t PENDING_TYPE_MAX{4};
+
+    static bool isPushing(PushType pushType)
+    {
+        return pushType == PushType::Pushed || pushType == PushType::PushShort || pushType == PushType::PushLong;
+    }
+
+    // 2つのボタンの同時押し（U+D、L+R 等）
+    static bool isChordPushing(const ButtonStatus &lhs, const ButtonStatus &rhs)
+    {
+        return isPushing(lhs.getVal()) && isPushing(rhs.getVal());
+    }
 
+    // 起動直後の最初の押下がチャタリング除去で捨てられないように、除去期間は済んだことにする
     void init(const int inPinID)
     {
         _pinId = inPinID;
+        _stableMillis = millis() - DEBOUNCE_MILLIS;
     }
 
     PushType getVal() const
@@ -25,60 +42,64 @@ struct ButtonStatus
         return _cachedType;
     }
 
+    // ポーリング版（割り込みを使わない場合）
     void update()
     {
-        int val = digitalRead(_pinId);
-        if (val == LOW)
-        {
-            _buttonFlag = true;
-        }
-        else
+        const unsigned long currentMillis{millis()};
+        addEdge(digitalRead(_pinId) == LOW, currentMillis);
+        updateType(currentMillis);
+    }
+
+    // 生のエッジ（押した/離した、発生時刻）を入力する。割り込みのイベントキューから呼ばれる
+    void addEdge(bool pushFlag, unsigned long edgeMillis)
+    {
+        if (pushFlag != _rawFlag)
         {
-            _buttonFlag = false;
+            _rawFlag = pushFlag;
+            _rawMillis = edgeMillis;
         }
 
-        bool releaseFlag{false};
-
-        if (_buttonFlag && (_buttonOldFlag != _buttonFlag))
+        if (pushFlag == _buttonFlag)
         {
-            _pushedMillis = millis();
+            return;
         }
-        else if (!_buttonFlag && (_buttonOldFlag != _buttonFlag))
+
+        if (elapsedMillis(_stableMillis, edgeMillis) < static_cast<long>(DEBOUNCE_MILLIS))
         {
-            releaseFlag = true;
+            // チャタリング中、最終的な状態は settle() で確定する
+            return;
         }
-        _buttonOldFlag = _buttonFlag;
 
-        if (releaseFlag)
+        acceptEdge(pushFlag, edgeMillis);
+    }
+
+    // フレーム毎に1回呼ぶ。確定したエッジを1つずつ PushType に変換する
+    void updateType(unsigned long currentMillis)
+    {
+        settle(currentMillis);
+
+        if (_pendingTypeCount > 0)
         {
-            if ((millis() - _pushedMillis) > LONG_PUSH_MILLIS)
+            _cachedType = _pendingTypes[0];
+            for (uint8_t i{1}; i < _pendingTypeCount; ++i)
             {
-                _cachedType = PushType::ReleaseLong;
-                return;
-            }
-            else
-            {
-                _cachedType = PushType::ReleaseShort;
-                return;
+                _pendingTypes[i - 1] = _pendingTypes[i];
             }
+            --_pendingTypeCount;
+            return;
         }
-        else if (_buttonFlag)
+
+        if (_buttonFlag)
         {
-            if (millis() - _pushedMillis == 0)
-            {
-                _cachedType = PushType::Pushed;
-                return;
-            }
-            else if ((millis() - _pushedMillis) < LONG_PUSH_MILLIS)
+            if (elapsedMillis(_pushedMillis, currentMillis) < LONG_PUSH_MILLIS)
             {
                 _cachedType = PushType::PushShort;
-                return;
             }
             else
             {
                 _cachedType = PushType::PushLong;
-                return;
             }
+            return;
         }
 
         _cachedType = PushType::None;
@@ -86,7 +107,64 @@ struct ButtonStatus
 
     PushType _cachedType{0};
     int _pinId{0};
-    bool _buttonFlag{false};
-    bool _buttonOldFlag{false};
+    bool _buttonFlag{false}; // チャタリング除去後の状態
+    bool _rawFlag{false};
     unsigned long _pushedMillis{0};
+    unsigned long _stableMillis{0};
+    unsigned long _rawMillis{0};
+
+private:
+    void settle(unsigned long currentMillis)
+    {
+        if (_rawFlag == _buttonFlag)
+        {
+            return;
+        }
+
+        const unsigned long lockoutEndMillis{_stableMillis + DEBOUNCE_MILLIS};
+        if (elapsedMillis(lockoutEndMillis, currentMillis) < 0)
+        {
+            return;
+        }
+
+        acceptEdge(_rawFlag, (elapsedMillis(lockoutEndMillis, _rawMillis) > 0) ? _rawMillis : lockoutEndMillis);
+    }
+
+    // millis() の桁あふれと、割り込み側の時刻が前後する場合を考慮した差分
+    static long elapsedMillis(unsigned long fromMillis, unsigned long toMillis)
+    {
+        return static_cast<long>(toMillis - fromMillis);
+    }
+
+    void acceptEdge(bool pushFlag, unsigned long edgeMillis)
+    {
+        _buttonFlag = pushFlag;
+        _stableMillis = edgeMillis;
+
+        if (pushFlag)
+        {
+            _pushedMillis = edgeMillis;
+            pushPendingType(PushType::Pushed);
+        }
+        else if (elapsedMillis(_pushedMillis, edgeMillis) > LONG_PUSH_MILLIS)
+        {
+            pushPendingType(PushType::ReleaseLong);
+        }
+        else
+        {
+            pushPendingType(PushType::ReleaseShort);
+        }
+    }
+
+    void pushPendingType(PushType pushType)
+    {
+        if (_pendingTypeCount >= PENDING_TYPE_MAX)
+        {
+            return;
+        }
+        _pendingTypes[_pendingTypeCount++] = pushType;
+    }
+
+    PushType _pendingTypes[PENDING_TYPE_MAX]{};
+    uint8_t _pendingTypeCount{0};
 };
@@ -0,0 +1,169 @@
+#include "current_calibration.hpp"
+
+#include <cstdlib>
+
+#include "battery_info.hpp"
+#include "src/display/adafruit_gfx_utility.hpp"
+
+void CurrentCalibration::start()
+{
+    for (uint8_t channel{0}; channel < CHANNEL_SIZE; ++channel)
+    {
+        _tables[channel] = CurrentTable{};
+        _completeFlags[channel] = false;
+        _failedPoints[channel] = -1;
+    }
+    _channel = 0;
+    _serialLength = 0;
+    resetStep();
+}
+
+void CurrentCalibration::resetStep()
+{
+    _step = 0;
+    _measuredI = nominalI();
+}
+
+void CurrentCalibration::confirm()
+{
+    if (_step >= CurrentTable::POINT_SIZE)
+    {
+        if (_failedPoints[_channel] >= 0)
+        {
+            _failedPoints[_channel] = -1;
+            resetStep();
+        }
+        return;
+    }
+
+    const uint16_t milliAmpere{static_cast<uint16_t>(_measuredI * 1000.f + 0.5f)};
+    _tables[_channel].setPoint(_step, static_cast<uint8_t>(currentPWMValue()), milliAmpere);
+
+    ++_step;
+    if (_step < CurrentTable::POINT_SIZE)
+    {
+        _measuredI = nominalI();
+        return;
+    }
+
+    _completeFlags[_channel] = _tables[_channel].validate();
+    _failedPoints[_channel] = _tables[_channel].findInvalidPoint();
+    if (!_completeFlags[_channel])
+    {
+        return;
+    }
+
+    if (_channel + 1 < CHANNEL_SIZE)
+    {
+        ++_channel;
+        resetStep();
+    }
+}
+
+void CurrentCalibration::shiftChannel(int shift)
+{
+    _channel = static_cast<uint8_t>((CHANNEL_SIZE + _channel + shift) % CHANNEL_SIZE);
+    resetStep();
+}
+
+int CurrentCalibration::currentPWMValue() const
+{
+    if (_step >= CurrentTable::POINT_SIZE)
+    {
+        return 0;
+    }
+    return BatteryInfo::calcPWMValue(nominalI(), 1.f, 1.f, CurrentTable{});
+}
+
+void CurrentCalibration::readSerial(Stream &stream)
+{
+    while (stream.available() > 0)
+    {
+        const char c{static_cast<char>(stream.read())};
+        if (c == '\r' || c == '\n')
+        {
+            if (_serialLength > 0)
+            {
+                _serialLine[_serialLength] = '\0';
+                char *endPtr{nullptr};
+                const float ampere{strtof(_serialLine, &endPtr)};
+                if (endPtr != _serialLine)
+                {
+                    _measuredI = std::clamp(ampere, 0.f, MEASURED_I_MAX);
+                    confirm();
+                }
+            }
+            _serialLength = 0;
+        }
+        else if (_serialLength < (sizeof(_serialLine) - 1))
+        {
+            _serialLine[_serialLength++] = c;
+        }
+    }
+}
+
+bool CurrentCalibration::apply(CurrentTable (&tables)[CHANNEL_SIZE]) const
+{
+    bool resultFlag{false};
+    for (uint8_t channel{0}; channel < CHANNEL_SIZE; ++channel)
+    {
+        if (_completeFlags[channel])
+        {
+            tables[channel] = _tables[channel];
+            resultFlag = true;
+        }
+    }
+    return resultFlag;
+}
+
+void CurrentCalibration::setDisplay(Adafruit_SSD1306 &display) const
+{
+    int line{0};
+    AdafruitGfxUtility::drawFillLine(display, line);
+    AdafruitGfxUtility::drawStringC(display, "Current Calib", line);
+
+    ++line;
+    AdafruitGfxUtility::drawFillLine(display, line);
+    String slotText{String("Slot ") + String(_channel + 1)};
+    for (uint8_t channel{0}; channel < CHANNEL_SIZE; ++channel)
+    {
+        slotText += _completeFlags[channel] ? String(" o") : ((_failedPoints[channel] >= 0) ? String(" x") : String(" -"));
+    }
+    AdafruitGfxUtility::drawString(display, slotText, 1, line);
+
+    ++line;
+    AdafruitGfxUtility::drawFillLine(display, line);
+    const int8_t failedPoint{_failedPoints[_channel]};
+    const bool failedFlag{_step >= CurrentTable::POINT_SIZE && failedPoint >= 0};
+    if (failedFlag)
+    {
+        // 使えなかった点と、その点で入力した電流値
+        const CurrentTable &table{_tables[_channel]};
+        AdafruitGfxUtility::drawString(display, String("Error P") + String(failedPoint + 1) + String(" ") + String(table._milliAmperes[failedPoint]) + String("mA"), 1, line);
+    }
+    else if (_step >= CurrentTable::POINT_SIZE)
+    {
+        AdafruitGfxUtility::drawStringC(display, _completeFlags[_channel] ? "Done" : "Error", line);
+    }
+    else
+    {
+        AdafruitGfxUtility::drawString(display, String("Step ") + String(_step + 1) + String("/") + String(CurrentTable::POINT_SIZE), 1, line);
+        AdafruitGfxUtility::drawString(display, String("PWM ") + String(currentPWMValue()), 12, line);
+    }
+
+    ++line;
+    AdafruitGfxUtility::drawFillLine(display, line);
+    AdafruitGfxUtility::drawString(display, "Set", 1, line);
+    AdafruitGfxUtility::drawFloatR(display, (_step < CurrentTable::POINT_SIZE) ? nominalI() : 0.f, 12, line, 5, 3);
+    AdafruitGfxUtility::drawString(display, "A", 12, line);
+
+    ++line;
+    AdafruitGfxUtility::drawFillLine(display, line);
+    AdafruitGfxUtility::drawString(display, "Meas", 1, line);
+    AdafruitGfxUtility::drawFloatR(display, _measuredI, 12, line, 5, 3);
+    AdafruitGfxUtility::drawString(display, "A", 12, line);
+
+    ++line;
+    AdafruitGfxUtility::drawFillLine(display, line);
+    AdafruitGfxUtility::drawStringC(display, failedFlag ? "A:Retry B:Save ON:Exit" : "A:Next B:Save ON:Exit", line);
+}
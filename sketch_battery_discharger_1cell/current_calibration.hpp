@@ -0,0 +1,64 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "current_table.hpp"
+
+class Adafruit_SSD1306;
+
+// 電流計を直列につないだ状態で、チャンネル毎に PWM -> 電流 のテーブルを作る手順
+// 各ステップで計算上の電流に相当する PWM を出力し、電流計の値を入力して次へ進む
+class CurrentCalibration
+{
+public:
+  static constexpr uint8_t CHANNEL_SIZE{4};
+  static constexpr float MEASURED_I_MAX{3.f};
+
+  void start();
+
+  void shiftMeasured(float shift)
+  {
+    _measuredI = std::clamp(_measuredI + shift, 0.f, MEASURED_I_MAX);
+  }
+
+  // 現在のステップの実測値を確定して次のステップへ進む
+  // テーブルが使えない場合はそのチャンネルに留まり、もう一度呼ぶと最初のステップからやり直す
+  void confirm();
+
+  // 対象チャンネルを変更する（そのチャンネルは最初のステップからやり直し）
+  void shiftChannel(int shift);
+
+  uint8_t channel() const
+  {
+    return _channel;
+  }
+
+  // 現在のステップで出力する PWM 値
+  int currentPWMValue() const;
+
+  // Serial から "0.412" のような行を受け取ると、その値で現在のステップを確定する
+  void readSerial(Stream &stream);
+
+  // 全ステップを完了したチャンネルのテーブルを書き出す
+  bool apply(CurrentTable (&tables)[CHANNEL_SIZE]) const;
+
+  void setDisplay(Adafruit_SSD1306 &display) const;
+
+private:
+  void resetStep();
+
+  float nominalI() const
+  {
+    return static_cast<float>(CurrentTable::NOMINAL_MILLI_AMPERES[_step]) / 1000.f;
+  }
+
+  CurrentTable _tables[CHANNEL_SIZE]{};
+  bool _completeFlags[CHANNEL_SIZE]{};
+  int8_t _failedPoints[CHANNEL_SIZE]{-1, -1, -1, -1}; // テーブルの検証で使えなかった点（-1 はなし）
+  uint8_t _channel{0};
+  uint8_t _step{0};
+  float _measuredI{0.f};
+
+  char _serialLine[16]{};
+  uint8_t _serialLength{0};
+};
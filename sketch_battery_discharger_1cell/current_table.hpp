@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+
+// チャンネル毎の PWM -> 電流 の実測テーブル
+// 2SK4017 のゲートしきい値付近は非線形なので、実測点の間を線形補間して PWM 値を求める
+struct CurrentTable
+{
+  static constexpr uint8_t POINT_SIZE{8};
+  static constexpr uint16_t NOMINAL_MILLI_AMPERES[POINT_SIZE]{100, 200, 300, 400, 600, 800, 1200, 2000}; // 校正時に流す電流（計算値）
+  static constexpr uint8_t DUTY_FRACTION_BITS{8};
+  static constexpr int32_t MAX_DUTY{0xFF << DUTY_FRACTION_BITS};
+
+  uint8_t _pwmValues[POINT_SIZE]{};
+  uint16_t _milliAmperes[POINT_SIZE]{};
+  uint8_t _validFlag{0};
+
+  bool isValid() const
+  {
+    return _validFlag != 0;
+  }
+
+  void setPoint(uint8_t index, uint8_t pwmValue, uint16_t milliAmpere)
+  {
+    if (index >= POINT_SIZE)
+    {
+      return;
+    }
+    _pwmValues[index] = pwmValue;
+    _milliAmperes[index] = milliAmpere;
+  }
+
+  // 使えない点の番号を返す。問題がなければ -1
+  // PWM 値は単調増加、電流値は減らないこと（ゲートしきい値以下で 0mA が続くのはよい）。最後の点は 0mA より大きいこと
+  int8_t findInvalidPoint() const
+  {
+    for (uint8_t i{1}; i < POINT_SIZE; ++i)
+    {
+      if (_pwmValues[i] <= _pwmValues[i - 1] || _milliAmperes[i] < _milliAmperes[i - 1])
+      {
+        return static_cast<int8_t>(i);
+      }
+    }
+    if (_milliAmperes[POINT_SIZE - 1] == 0)
+    {
+      return static_cast<int8_t>(POINT_SIZE - 1);
+    }
+    return -1;
+  }
+
+  bool validate()
+  {
+    _validFlag = (findInvalidPoint() < 0) ? 1 : 0;
+    return isValid();
+  }
+
+  // 電流値(mA) から PWM 値を求める。戻り値は下位 DUTY_FRACTION_BITS ビットが小数部の固定小数点
+  int32_t lookupDuty(int32_t milliAmpere) const
+  {
+    if (milliAmpere <= 0)
+    {
+      return 0;
+    }
+
+    uint8_t upper{1};
+    while (upper < (POINT_SIZE - 1) && milliAmpere > _milliAmperes[upper])
+    {
+      ++upper;
+    }
+
+    // 範囲外は両端の区間を延長する
+    uint8_t lower{static_cast<uint8_t>(upper - 1)};
+
+    // 電流が変わらない区間（しきい値以下の 0mA 等）では補間できないので、その先の区間を使う
+    // 最後の区間が平らな場合は、手前の電流が変わる区間を延長する
+    while (_milliAmperes[upper] == _milliAmperes[lower] && upper < (POINT_SIZE - 1))
+    {
+      lower = upper;
+      ++upper;
+    }
+    while (_milliAmperes[upper] == _milliAmperes[lower] && lower > 0)
+    {
+      upper = lower;
+      --lower;
+    }
+
+    const int32_t lowerDuty{static_cast<int32_t>(_pwmValues[lower]) << DUTY_FRACTION_BITS};
+    const int32_t dutyRange{static_cast<int32_t>(_pwmValues[upper] - _pwmValues[lower]) << DUTY_FRACTION_BITS};
+    const int32_t currentRange{static_cast<int32_t>(_milliAmperes[upper]) - static_cast<int32_t>(_milliAmperes[lower])};
+    if (currentRange <= 0)
+    {
+      return std::clamp(lowerDuty, static_cast<int32_t>(0), MAX_DUTY);
+    }
+    const int32_t duty{lowerDuty + ((milliAmpere - static_cast<int32_t>(_milliAmperes[lower])) * dutyRange) / currentRange};
+
+    return std::clamp(duty, static_cast<int32_t>(0), MAX_DUTY);
+  }
+};
@@ -0,0 +1,278 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+// 放電プログラムの命令
+enum class ProgramOp : uint8_t
+{
+  End,         // 終了
+  DischargeTo, // _current(10mA単位) で _value(mV) まで絞り放電
+  Rest,        // _value 分休止
+  Pulse,       // _current(10mA単位) を _value(ms) 流し、_time(ms) 休む
+  HoldAt,      // _value(mV) を _time 分保持（最大 _current）
+  Loop,        // _current 番目のステップへ戻る。合計 _value 回繰り返す
+  Max,
+};
+
+// 1ステップ 6byte。EEPROM にそのまま保存する
+struct ProgramStep
+{
+  ProgramOp _op{ProgramOp::End};
+  uint8_t _current{0};
+  uint16_t _value{0};
+  uint16_t _time{0};
+};
+
+struct DischargeProgram
+{
+  static constexpr uint8_t STEP_MAX{8};
+  static constexpr uint8_t BYTE_SIZE{STEP_MAX * sizeof(ProgramStep)};
+
+  ProgramStep _steps[STEP_MAX]{};
+};
+
+// 組み込みのプログラム
+enum class ProgramType : uint8_t
+{
+  None,         // プログラムを使わない（通常の放電）
+  Conditioning, // 1A で 1.0V まで -> 10分休止 -> 0.4A で 1.0V まで
+  Capacity,     // 0.5A で 1.0V まで -> 5分休止
+  PulseIR,      // 1A 100ms / 休止 900ms を10回 -> 1分休止。パルス前後の電圧差から内部抵抗を求める
+  Custom,       // Serial から書き込んだプログラム
+  Max,
+};
+
+namespace DischargePrograms
+{
+  static constexpr DischargeProgram CONDITIONING{{
+      {ProgramOp::DischargeTo, 100, 1000, 0},
+      {ProgramOp::Rest, 0, 10, 0},
+      {ProgramOp::DischargeTo, 40, 1000, 0},
+      {ProgramOp::End, 0, 0, 0},
+  }};
+
+  static constexpr DischargeProgram CAPACITY{{
+      {ProgramOp::DischargeTo, 50, 1000, 0},
+      {ProgramOp::Rest, 0, 5, 0},
+      {ProgramOp::End, 0, 0, 0},
+  }};
+
+  static constexpr DischargeProgram PULSE_IR{{
+      {ProgramOp::Pulse, 100, 100, 900},
+      {ProgramOp::Loop, 0, 10, 0},
+      {ProgramOp::Rest, 0, 1, 0},
+      {ProgramOp::End, 0, 0, 0},
+  }};
+}
+
+enum class ProgramAction : uint8_t
+{
+  Off,      // 電流を流さない
+  Taper,    // _targetV まで _targetI で絞り放電（既存の calcI を使う）
+  Constant, // _targetI を流し続ける
+  Finished, // プログラム終了
+};
+
+struct ProgramSetpoint
+{
+  ProgramAction _action{ProgramAction::Finished};
+  float _targetV{0.f};
+  float _targetI{0.f};
+};
+
+// プログラムを実行する。動的確保はしない
+class ProgramRunner
+{
+public:
+  void start(const DischargeProgram *program, unsigned long nowMillis)
+  {
+    _program = program;
+    _stepIndex = 0;
+    _stepStartMillis = nowMillis;
+    for (uint16_t &loopCount : _loopCounts)
+    {
+      loopCount = 0;
+    }
+  }
+
+  void stop()
+  {
+    _program = nullptr;
+  }
+
+  bool isRunning() const
+  {
+    return _program != nullptr;
+  }
+
+  uint8_t stepIndex() const
+  {
+    return _stepIndex;
+  }
+
+  // 制御周期毎に呼ぶ。reachedFlag は絞り放電が目標電圧に達したかどうか
+  ProgramSetpoint update(unsigned long nowMillis, bool reachedFlag)
+  {
+    // Loop は時間を使わないので、同じ周期内で続けて処理する（無限ループ防止に上限あり）
+    for (uint8_t count{0}; count <= DischargeProgram::STEP_MAX; ++count)
+    {
+      if (!isRunning() || _stepIndex >= DischargeProgram::STEP_MAX)
+      {
+        return ProgramSetpoint{};
+      }
+
+      const ProgramStep &step{_program->_steps[_stepIndex]};
+      const unsigned long elapsedMillis{nowMillis - _stepStartMillis};
+      ProgramSetpoint setpoint{};
+      bool nextFlag{false};
+
+      switch (step._op)
+      {
+      case ProgramOp::DischargeTo:
+        setpoint = {ProgramAction::Taper, toVolt(step._value), toAmpere(step._current)};
+        nextFlag = reachedFlag;
+        break;
+      case ProgramOp::Rest:
+        setpoint = {ProgramAction::Off, 0.f, 0.f};
+        nextFlag = elapsedMillis >= minutesToMillis(step._value);
+        break;
+      case ProgramOp::Pulse:
+        if (elapsedMillis < step._value)
+        {
+          setpoint = {ProgramAction::Constant, 0.f, toAmpere(step._current)};
+        }
+        else
+        {
+          setpoint = {ProgramAction::Off, 0.f, 0.f};
+        }
+        nextFlag = elapsedMillis >= (static_cast<unsigned long>(step._value) + step._time);
+        break;
+      case ProgramOp::HoldAt:
+        setpoint = {ProgramAction::Taper, toVolt(step._value), toAmpere(step._current)};
+        nextFlag = elapsedMillis >= minutesToMillis(step._time);
+        break;
+      case ProgramOp::Loop:
+        if (++_loopCounts[_stepIndex] < step._value && step._current < _stepIndex)
+        {
+          jump(step._current, nowMillis);
+        }
+        else
+        {
+          _loopCounts[_stepIndex] = 0;
+          jump(_stepIndex + 1, nowMillis);
+        }
+        reachedFlag = false;
+        continue;
+      default:
+        stop();
+        return ProgramSetpoint{};
+      }
+
+      if (!nextFlag)
+      {
+        return setpoint;
+      }
+
+      jump(_stepIndex + 1, nowMillis);
+      reachedFlag = false;
+    }
+
+    return ProgramSetpoint{ProgramAction::Off, 0.f, 0.f};
+  }
+
+private:
+  static float toVolt(uint16_t milliVolt)
+  {
+    return static_cast<float>(milliVolt) / 1000.f;
+  }
+
+  static float toAmpere(uint8_t current)
+  {
+    return static_cast<float>(current) / 100.f;
+  }
+
+  static unsigned long minutesToMillis(uint16_t minutes)
+  {
+    return static_cast<unsigned long>(minutes) * 60UL * 1000UL;
+  }
+
+  void jump(uint8_t stepIndex, unsigned long nowMillis)
+  {
+    _stepIndex = stepIndex;
+    _stepStartMillis = nowMillis;
+  }
+
+  const DischargeProgram *_program{nullptr};
+  uint8_t _stepIndex{0};
+  unsigned long _stepStartMillis{0};
+  uint16_t _loopCounts[DischargeProgram::STEP_MAX]{};
+};
+
+// パルス放電の電圧差から内部抵抗を求める
+// フレーム毎に、直前のフレームの平均電圧と、次のフレームに流す電流を渡す
+// パルス直前の休止中電圧と、パルス最後のフレームの電圧の差を、パルス電流で割る。パルス毎の値を平均する
+class PulseResistance
+{
+public:
+  void reset()
+  {
+    _prevI = -1.f;
+    _restV = 0.f;
+    _restFlag = false;
+    _totalMilliOhm = 0.f;
+    _count = 0;
+  }
+
+  // nextI: 次のフレームに流す電流。プログラムの絞り放電など、パルスでも休止でもない場合は負の値
+  void add(float volt, float nextI)
+  {
+    const float prevI{_prevI};
+    _prevI = nextI;
+    if (prevI < 0.f || volt <= 0.f)
+    {
+      _restFlag = false;
+      return;
+    }
+    if (prevI == 0.f)
+    {
+      _restV = volt;
+      _restFlag = true;
+      return;
+    }
+    if (nextI > 0.f)
+    {
+      // パルスの途中。最後のフレームの電圧を使う
+      return;
+    }
+    if (_restFlag)
+    {
+      _totalMilliOhm += std::max(0.f, _restV - volt) * 1000.f / prevI;
+      ++_count;
+    }
+    _restFlag = false;
+  }
+
+  // 直前のフレームがパルスか休止だった
+  bool isMeasuring() const
+  {
+    return _prevI >= 0.f;
+  }
+
+  uint8_t count() const
+  {
+    return _count;
+  }
+
+  float milliOhm() const
+  {
+    return _count > 0 ? _totalMilliOhm / _count : 0.f;
+  }
+
+private:
+  float _prevI{-1.f};
+  float _restV{0.f};
+  bool _restFlag{false};
+  float _totalMilliOhm{0.f};
+  uint8_t _count{0};
+};
@@ -22,6 +22,21 @@ namespace DisplayConst
 
 static constexpr float VOLT3_3{3.3f};
 
+// analogWrite の PWM 周期の想定値。ΔΣ の値を進める周期と、SyncADC の窓の長さに使う
+// コアの PWM 周期はここから設定も取得もしないので、コアを変えた場合は実測して合わせること
+// ずれてもタイマーに位相を合わせていないので壊れはしない（SyncADC のリップル除去が弱まるだけ）
+static constexpr unsigned long PWM_PERIOD_MICROS{1000};
+// SyncADC の窓（3周期に8サンプル、等間隔）
+static constexpr uint8_t SYNC_SAMPLE_PERIODS{3};
+static constexpr uint8_t SYNC_SAMPLE_COUNT{8};
+
+// ユニット間リンク（Serial1 = D6/D7）。現行の基板では READ3_PIN / READ4_PIN と重なり、空いているピンもないので、
+// 設定の LinkPin を Link にしたユニットだけ、リンク中はこのピンを読むスロット（3, 4）を使わない
+// （I2C は OLED が全ユニットで 0x3C 固定のため、ユニット間では共有できない）
+static constexpr unsigned long LINK_BAUD{115200};
+static constexpr uint8_t LINK_TX_PIN{6};
+static constexpr uint8_t LINK_RX_PIN{7};
+
 static constexpr float XIAO_FULL_VOLT{4.f};
 static constexpr float XIAO_LEVEL2_VOLT{3.9f};
 static constexpr float XIAO_MIN_VOLT{3.7f};
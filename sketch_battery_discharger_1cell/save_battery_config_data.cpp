@@ -4,12 +4,13 @@
 
 void SaveBattery::setDisplayBatteryConfig(Adafruit_SSD1306 &display, int index, BatteryConfigSettingMode settingMode) const
 {
-    std::vector<String> menuList{"TargetV", "TargetI", "DiscMode", "ReduceI", "KeepMin"};
+    std::vector<String> menuList{"TargetV", "TargetI", "DiscMode", "ReduceI", "KeepMin", "Program"};
 
     const String &disChargeModeString{DISC_MODE_NAMES[static_cast<uint8_t>(_disChargeMode)]};
     const String &reduceModeString{REDUCE_MODE_NAMES[static_cast<uint8_t>(_reduceMode)]};
+    const String &programString{PROGRAM_NAMES[static_cast<uint8_t>(_programType)]};
 
-    std::vector<String> valueList{String(_targetV, 3), String(_targetI), disChargeModeString, reduceModeString, String(_holdMin)};
+    std::vector<String> valueList{String(_targetV, 3), String(_targetI), disChargeModeString, reduceModeString, String(_holdMin), programString};
 
     String title{"Battery Pair."};
     title += String(index + 1);
@@ -40,4 +41,9 @@ void SaveBattery::shiftParam(BatteryConfigSettingMode settingMode, int shift)
         const int nextModeIndex{(static_cast<int>(ReduceMode::Max) + static_cast<int>(_reduceMode) + shift) % static_cast<int>(ReduceMode::Max)};
         _reduceMode = static_cast<ReduceMode>(nextModeIndex);
     }
+    else if (settingMode == BatteryConfigSettingMode::ProgramSetting)
+    {
+        const int nextProgramIndex{(static_cast<int>(ProgramType::Max) + static_cast<int>(_programType) + shift) % static_cast<int>(ProgramType::Max)};
+        _programType = static_cast<ProgramType>(nextProgramIndex);
+    }
 };
@@ -2,6 +2,8 @@
 
 #include <cstdint>
 
+#include "discharge_program.hpp"
+
 class Adafruit_SSD1306;
 
 enum class BatteryConfigSettingMode : uint8_t
@@ -11,6 +13,7 @@ enum class BatteryConfigSettingMode : uint8_t
   ModeChangeSetting, // 放電モード
   ReduceModeChangeSetting, // 絞り放電の絞り強さ
   HoldMinSetting, // 放電後の、電圧保持する時間（分）
+  ProgramSetting, // 放電プログラム
   Max,
 };
 
@@ -50,6 +53,9 @@ struct SaveBattery
 
     bool _padding{true};
 
+    ProgramType _programType{ProgramType::None};
+    DischargeProgram _customProgram{}; // Serial の PROG コマンドで書き込む
+
     void shiftParam(BatteryConfigSettingMode settingMode, int shift);
 
     void setDisplayBatteryConfig(Adafruit_SSD1306 &display, int index, BatteryConfigSettingMode settingMode) const;
@@ -61,6 +67,6 @@ struct SaveBatteryConfigData
     static constexpr int SAVEDATA_ID{0xABCE};
     static constexpr int SAVEDATA_ADDRESS{0X400};
     int _id{SAVEDATA_ID};
-    int _ver{2};
+    int _ver{3};
     SaveBattery _battery[4];
 };
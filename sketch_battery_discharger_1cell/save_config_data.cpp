@@ -3,38 +3,109 @@
 #include <algorithm>
 #include "src/display/adafruit_gfx_utility.hpp"
 
+namespace
+{
+    const char *const LINK_ROLE_NAMES[]{"Off", "Master", "Node"};
+}
+
 
 int SaveConfigData::voltClamp(int value)
 {
 return std::clamp(value, -1 * VOLT_RANGE, VOLT_RANGE);
 };
 
+bool SaveConfigData::hasVoltCorrection() const
+{
+    for (const VoltCorrection &voltCorrection : _voltCorrections)
+    {
+        if (!voltCorrection.isIdentity())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SaveConfigData::hasCurrentTable() const
+{
+    for (const CurrentTable &currentTable : _currentTables)
+    {
+        if (currentTable.isValid())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void SaveConfigData::clearVoltCorrections()
+{
+    for (VoltCorrection &voltCorrection : _voltCorrections)
+    {
+        voltCorrection = VoltCorrection{};
+    }
+}
+
+void SaveConfigData::shiftVoltData(uint8_t index, int shift)
+{
+    const int voltData{SaveConfigData::voltClamp(_voltDatas[index] + shift)};
+    if (voltData == _voltDatas[index])
+    {
+        return;
+    }
+    _voltDatas[index] = voltData;
+
+    // 補正式は変更前の対応表で換算した電圧に対して求めたものなので、対応表を変えたら使えない
+    clearVoltCorrections();
+}
+
 void SaveConfigData::shiftParam(const ConfigSettingMode &configMode, int shift)
 {
     if (configMode == ConfigSettingMode::tuneVolt00Setting)
     {
-        _voltDatas[0] = SaveConfigData::voltClamp(_voltDatas[0] + shift);
+        shiftVoltData(0, shift);
     }
     else if (configMode == ConfigSettingMode::tuneVolt05Setting)
     {
-        _voltDatas[1] = SaveConfigData::voltClamp(_voltDatas[1] + shift);
+        shiftVoltData(1, shift);
     }
     else if (configMode == ConfigSettingMode::tuneVolt10Setting)
     {
-        _voltDatas[2] = SaveConfigData::voltClamp(_voltDatas[2] + shift);
+        shiftVoltData(2, shift);
     }
     else if (configMode == ConfigSettingMode::tuneVolt15Setting)
     {
-        _voltDatas[3] = SaveConfigData::voltClamp(_voltDatas[3] + shift);
+        shiftVoltData(3, shift);
     }
     else if (configMode == ConfigSettingMode::tuneVolt20Setting)
     {
-        _voltDatas[4] = SaveConfigData::voltClamp(_voltDatas[4] + shift);
+        shiftVoltData(4, shift);
     }
     else if (configMode == ConfigSettingMode::LedOnSetting)
     {
         _ledOnFlag = ((_ledOnFlag == 0) ? 1 : 0);
     }
+    else if (configMode == ConfigSettingMode::syncSampleSetting)
+    {
+        _syncSampleFlag = ((_syncSampleFlag == 0) ? 1 : 0);
+    }
+    else if (configMode == ConfigSettingMode::thermalSetting)
+    {
+        _thermalLimitFlag = ((_thermalLimitFlag == 0) ? 1 : 0);
+    }
+    else if (configMode == ConfigSettingMode::finishTogetherSetting)
+    {
+        _finishTogetherFlag = ((_finishTogetherFlag == 0) ? 1 : 0);
+    }
+    else if (configMode == ConfigSettingMode::linkSetting)
+    {
+        const int roleSize{static_cast<int>(LinkRole::Max)};
+        _linkRole = static_cast<uint8_t>((roleSize + _linkRole + shift) % roleSize);
+    }
+    else if (configMode == ConfigSettingMode::linkPinSetting)
+    {
+        _linkPinFlag = ((_linkPinFlag == 0) ? 1 : 0);
+    }
     else if (configMode == ConfigSettingMode::discISetting)
     {
         _dischargeI = std::clamp(_dischargeI + (shift * 0.1f), 0.4f, 3.f);
@@ -47,11 +118,22 @@ void SaveConfigData::shiftParam(const ConfigSettingMode &configMode, int shift)
     {
         _decimal = std::clamp(_decimal + shift, 2, 3);
     }
+    else if (configMode == ConfigSettingMode::autoCalibSetting)
+    {
+        clearVoltCorrections();
+    }
+    else if (configMode == ConfigSettingMode::currentCalibSetting)
+    {
+        for (CurrentTable &currentTable : _currentTables)
+        {
+            currentTable = CurrentTable{};
+        }
+    }
 };
 
 void SaveConfigData::setDisplayConfig(Adafruit_SSD1306 &display, ConfigSettingMode settingMode) const
 {
-    std::vector<String> menuList{"0.0V", "0.5V", "1.0V", "1.5V", "2.0V", "LedOn", "DiscI", "AmpTune", "Decimal"};
+    std::vector<String> menuList{"0.0V", "0.5V", "1.0V", "1.5V", "2.0V", "LedOn", "DiscI", "AmpTune", "Decimal", "AutoCal", "ICal", "SyncADC", "Thermal", "Together", "Link", "LinkPin", "History", "AdcStat"};
 
     std::vector<String> valueList{
         String(_voltDatas[0]),
@@ -63,6 +145,15 @@ void SaveConfigData::setDisplayConfig(Adafruit_SSD1306 &display, ConfigSettingMo
         String(_dischargeI),
         String(_calibI),
         String(_decimal),
+        String(hasVoltCorrection() ? "Set" : "None"),
+        String(hasCurrentTable() ? "Set" : "None"),
+        String(_syncSampleFlag == 0 ? false : true),
+        String(_thermalLimitFlag == 0 ? false : true),
+        String(_finishTogetherFlag == 0 ? false : true),
+        String(LINK_ROLE_NAMES[_linkRole % static_cast<uint8_t>(LinkRole::Max)]),
+        String(_linkPinFlag == 0 ? "Slot" : "Link"),
+        String("A"),
+        String("A"),
     };
 
     AdafruitGfxUtility::setDisplayTuneMenu(display, "Config", menuList, valueList, static_cast<int>(settingMode));
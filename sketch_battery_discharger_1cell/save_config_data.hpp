@@ -2,6 +2,9 @@
 
 #include <cstdint>
 
+#include "voltage_calibration.hpp"
+#include "current_table.hpp"
+
 class Adafruit_SSD1306;
 
 enum class ConfigSettingMode : uint8_t
@@ -15,6 +18,23 @@ enum class ConfigSettingMode : uint8_t
   discISetting,      // 放電用電流
   tuneISetting,      // 電流値のキャリブレーション
   decimalSetting,    // 小数点何桁まで表示するか
+  autoCalibSetting,  // 自動キャリブレーション（A で開始、L/R で補正をクリア）
+  currentCalibSetting, // 電流テーブルの校正（A で開始、L/R でテーブルをクリア）
+  syncSampleSetting, // PWM 周期の整数倍の窓で、等間隔に電圧を読む
+  thermalSetting,    // 熱モデルで電流を制限する
+  finishTogetherSetting, // 全スロットが同時に目標電圧に達するように電流を配分する
+  linkSetting,       // ユニット間リンクの役割
+  linkPinSetting,    // D6/D7 をリンクに使う（スロット3,4の読み取りを止める）
+  historySetting,    // 放電記録の閲覧（A で開始）
+  adcStatSetting,    // ADC のノイズの診断（A で開始）
+  Max,
+};
+
+enum class LinkRole : uint8_t
+{
+  Off,
+  Master, // ほかのユニットの電池を表示・操作する
+  Node,   // マスターから操作される
   Max,
 };
 
@@ -24,15 +44,32 @@ struct SaveConfigData
   static constexpr int8_t VOLT_DATA_SIZE{5};
   static constexpr int SAVEDATA_ADDRESS{0X100};
   static constexpr int VOLT_RANGE{100};
+  static constexpr uint8_t CHANNEL_SIZE{4};
   static int voltClamp(int value);
 
   int _id{SAVEDATA_ID};
-  int _ver{5};
+  int _ver{12};
   int _voltDatas[VOLT_DATA_SIZE] = {-10, 0, 0, 0, 0}; // 電圧キャリブレーション
   uint8_t _ledOnFlag{0};
   float _dischargeI{2.f};
   float _calibI{1.f};
   int _decimal{3};
+  VoltCorrection _voltCorrections[CHANNEL_SIZE]{}; // チャンネル毎の電圧補正（自動キャリブレーション）
+  CurrentTable _currentTables[CHANNEL_SIZE]{}; // チャンネル毎の PWM -> 電流 テーブル
+  uint8_t _syncSampleFlag{0};
+  uint8_t _thermalLimitFlag{0};
+  uint8_t _finishTogetherFlag{0};
+  uint8_t _linkRole{0}; // LinkRole
+  uint8_t _linkPinFlag{0}; // 1 で D6/D7 をリンクに使う。0 の間は役割を選んでもリンクは動かず、スロット3,4はそのまま
+
+  bool hasVoltCorrection() const;
+
+  bool hasCurrentTable() const;
+
+  void clearVoltCorrections();
+
+  // 電圧の対応表を変えると、自動キャリブレーションの補正もクリアする
+  void shiftVoltData(uint8_t index, int shift);
 
   void shiftParam(const ConfigSettingMode &configMode, int shift);
 
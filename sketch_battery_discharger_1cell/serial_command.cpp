@@ -0,0 +1,645 @@
+#include "serial_command.hpp"
+
+#include <cstdlib>
+#include <cctype>
+#include <cstring>
+
+#include "battery_controller.hpp"
+
+namespace
+{
+    const char *const BATTERY_STATUS_NAMES[]{"None", "Active", "Sleep", "Stop", "NoBat"};
+
+    void printSlotHeader(Print &out, const char *name, const BatteryInfo &batteryInfo)
+    {
+        out.print(name);
+        out.print(" ");
+        out.print(batteryInfo._batteryIndex + 1);
+    }
+
+    void printStatus(Print &out, const BatteryInfo &batteryInfo)
+    {
+        printSlotHeader(out, "STATUS", batteryInfo);
+        out.print(" ");
+        out.print(BATTERY_STATUS_NAMES[static_cast<uint8_t>(batteryInfo._currentBatteryStatus) % static_cast<uint8_t>(BatteryStatus::Max)]);
+        out.print(batteryInfo._activeFlag ? " ON " : " OFF ");
+        out.print(batteryInfo._v, 4);
+        out.print(" ");
+        out.print(batteryInfo._sleepV, 4);
+        out.print(" ");
+        out.print(batteryInfo._i, 3);
+        out.print(" ");
+        out.print(batteryInfo._milliAmpereHour, 2);
+        out.println();
+    }
+
+    void printSetting(Print &out, const BatteryInfo &batteryInfo)
+    {
+        printSlotHeader(out, "GET", batteryInfo);
+        out.print(" V ");
+        out.print(batteryInfo._targetV, 3);
+        out.print(" I ");
+        out.print(batteryInfo._targetI, 3);
+        out.print(" DMODE ");
+        out.print(static_cast<int>(batteryInfo._disChargeMode));
+        out.print(" RMODE ");
+        out.print(static_cast<int>(batteryInfo._reduceMode));
+        out.print(" HOLD ");
+        out.print(batteryInfo._holdMin);
+        out.print(" PROG ");
+        out.print(static_cast<int>(batteryInfo._programType));
+        out.println();
+    }
+
+    void printResult(Print &out, const BatteryInfo &batteryInfo)
+    {
+        printSlotHeader(out, "RESULT", batteryInfo);
+        out.print(batteryInfo._dischargedCount > 0 ? " DONE " : " RUN ");
+        out.print(batteryInfo._startSeconds);
+        out.print(" ");
+        out.print(batteryInfo._endSeconds);
+        out.print(" ");
+        out.print(batteryInfo._sleepV, 4);
+        out.print(" ");
+        out.print(batteryInfo._milliAmpereHour, 2);
+        out.print(" ");
+        out.print(batteryInfo._ohm, 1);
+        out.println();
+    }
+
+    // REC <id> <slot> <開始V> <終了V> <mAh> <mWh> <秒> <mΩ> <DMODE> <RMODE> <PROG>
+    void printRecord(Print &out, const RunRecord &record)
+    {
+        out.print("REC ");
+        out.print(record._runId);
+        out.print(" ");
+        out.print(record._slot + 1);
+        out.print(" ");
+        out.print(record._startMilliVolt / 1000.f, 3);
+        out.print(" ");
+        out.print(record._endMilliVolt / 1000.f, 3);
+        out.print(" ");
+        out.print(record._milliAmpereHour);
+        out.print(" ");
+        out.print(record._milliWattHour);
+        out.print(" ");
+        out.print(record._durationSeconds);
+        out.print(" ");
+        out.print(record._deciMilliOhm / 10.f, 1);
+        out.print(" ");
+        out.print(record._disChargeMode);
+        out.print(" ");
+        out.print(record._reduceMode);
+        out.print(" ");
+        out.print(record._programType);
+        out.println();
+    }
+
+    // リンクでつながったノードの電池。slotNumber は 1 始まりの通し番号
+    void printRemoteStatus(Print &out, const char *name, int slotNumber, const LinkSlotState &slotState, bool onlineFlag)
+    {
+        out.print(name);
+        out.print(" ");
+        out.print(slotNumber);
+        if (!onlineFlag)
+        {
+            out.println(" OFFLINE");
+            return;
+        }
+
+        const float sleepV{slotState._sleepMilliVolt / 1000.f};
+        if (SerialCommand::equals(name, "STATUS"))
+        {
+            out.print(" ");
+            out.print(BATTERY_STATUS_NAMES[slotState._status % static_cast<uint8_t>(BatteryStatus::Max)]);
+            out.print(slotState._activeFlag ? " ON " : " OFF ");
+            out.print(sleepV, 4);
+            out.print(" ");
+            out.print(sleepV, 4);
+            out.print(" ");
+            out.print(slotState._milliAmpere / 1000.f, 3);
+            out.print(" ");
+            out.print(static_cast<int>(slotState._milliAmpereHour));
+        }
+        else if (SerialCommand::equals(name, "GET"))
+        {
+            out.print(" V ");
+            out.print(slotState._targetMilliVolt / 1000.f, 3);
+        }
+        else
+        {
+            out.print(slotState._doneFlag ? " DONE - - " : " RUN - - ");
+            out.print(sleepV, 4);
+            out.print(" ");
+            out.print(static_cast<int>(slotState._milliAmpereHour));
+            out.print(" -");
+        }
+        out.println();
+    }
+
+    int hexValue(char c)
+    {
+        if (c >= '0' && c <= '9')
+        {
+            return c - '0';
+        }
+        c = static_cast<char>(toupper(static_cast<unsigned char>(c)));
+        if (c >= 'A' && c <= 'F')
+        {
+            return c - 'A' + 10;
+        }
+        return -1;
+    }
+
+    // 16進文字列をプログラムに変換する。足りないステップは End で埋める
+    bool parseProgram(const char *hex, DischargeProgram &program)
+    {
+        uint8_t bytes[DischargeProgram::BYTE_SIZE]{};
+        const size_t length{strlen(hex)};
+        if ((length % 2) != 0 || length > (DischargeProgram::BYTE_SIZE * 2))
+        {
+            return false;
+        }
+        for (size_t i{0}; i < length; i += 2)
+        {
+            const int upper{hexValue(hex[i])};
+            const int lower{hexValue(hex[i + 1])};
+            if (upper < 0 || lower < 0)
+            {
+                return false;
+            }
+            bytes[i / 2] = static_cast<uint8_t>((upper << 4) | lower);
+        }
+        memcpy(&program, bytes, sizeof(bytes));
+        for (const ProgramStep &step : program._steps)
+        {
+            if (static_cast<uint8_t>(step._op) >= static_cast<uint8_t>(ProgramOp::Max))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void printProgram(Print &out, const BatteryInfo &batteryInfo)
+    {
+        static constexpr char HEX_CHARS[]{"0123456789ABCDEF"};
+        printSlotHeader(out, "PROG", batteryInfo);
+        out.print(" ");
+        const uint8_t *bytes{reinterpret_cast<const uint8_t *>(&batteryInfo._saveBattery->_customProgram)};
+        for (uint8_t i{0}; i < DischargeProgram::BYTE_SIZE; ++i)
+        {
+            out.print(HEX_CHARS[bytes[i] >> 4]);
+            out.print(HEX_CHARS[bytes[i] & 0x0F]);
+        }
+        out.println();
+    }
+
+    // ノードの電池に送れる設定
+    bool isRemoteKey(const char *key)
+    {
+        return SerialCommand::equals(key, "V") || SerialCommand::equals(key, "I");
+    }
+
+    bool isSettingKey(const char *key)
+    {
+        static const char *const KEYS[]{"V", "I", "DMODE", "RMODE", "HOLD", "PROG"};
+        for (const char *settingKey : KEYS)
+        {
+            if (SerialCommand::equals(key, settingKey))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 電池設定（ボタンの電池設定画面と同じ、ペアで共有）を変更する。key は isSettingKey() で確かめておく
+    void setParam(SaveBattery &saveBattery, const char *key, float value)
+    {
+        if (SerialCommand::equals(key, "V"))
+        {
+            saveBattery._targetV = std::clamp(value, SaveBattery::TARGET_V_MIN, SaveBattery::TARGET_V_MAX);
+        }
+        else if (SerialCommand::equals(key, "I"))
+        {
+            saveBattery._targetI = std::clamp(value, SaveBattery::TARGET_I_MIN, SaveBattery::TARGET_I_MAX);
+        }
+        else if (SerialCommand::equals(key, "DMODE"))
+        {
+            saveBattery._disChargeMode = static_cast<DisChargeMode>(std::clamp(static_cast<int>(value), 0, static_cast<int>(DisChargeMode::Max) - 1));
+        }
+        else if (SerialCommand::equals(key, "RMODE"))
+        {
+            saveBattery._reduceMode = static_cast<ReduceMode>(std::clamp(static_cast<int>(value), 0, static_cast<int>(ReduceMode::Max) - 1));
+        }
+        else if (SerialCommand::equals(key, "HOLD"))
+        {
+            saveBattery._holdMin = std::clamp(static_cast<int>(value), SaveBattery::HOLDMIN_MIN, SaveBattery::HOLDMIN_MAX);
+        }
+        else if (SerialCommand::equals(key, "PROG"))
+        {
+            saveBattery._programType = static_cast<ProgramType>(std::clamp(static_cast<int>(value), 0, static_cast<int>(ProgramType::Max) - 1));
+        }
+    }
+}
+
+bool SerialCommand::equals(const char *lhs, const char *rhs)
+{
+    while (*lhs != '\0' && *rhs != '\0')
+    {
+        if (toupper(static_cast<unsigned char>(*lhs)) != toupper(static_cast<unsigned char>(*rhs)))
+        {
+            return false;
+        }
+        ++lhs;
+        ++rhs;
+    }
+    return *lhs == *rhs;
+}
+
+uint8_t SerialCommand::tokenize(char *line, char *(&tokens)[TOKEN_MAX])
+{
+    uint8_t count{0};
+    char *p{line};
+    while (*p != '\0' && count < TOKEN_MAX)
+    {
+        while (*p == ' ' || *p == '\t')
+        {
+            *p = '\0';
+            ++p;
+        }
+        if (*p == '\0')
+        {
+            break;
+        }
+        tokens[count++] = p;
+        while (*p != '\0' && *p != ' ' && *p != '\t')
+        {
+            ++p;
+        }
+    }
+    return count;
+}
+
+int8_t SerialCommand::parseSlot(const char *token, uint8_t slotCount)
+{
+    if (equals(token, "ALL"))
+    {
+        return ALL_SLOTS;
+    }
+    char *endPtr{nullptr};
+    const long slot{strtol(token, &endPtr, 10)};
+    if (endPtr == token || *endPtr != '\0' || slot < 1 || slot > slotCount)
+    {
+        return INVALID_SLOT;
+    }
+    return static_cast<int8_t>(slot - 1);
+}
+
+void SerialCommand::poll(Stream &stream, BatteryController &controller)
+{
+    // RECORDS の出力中は、応答の順番が入れ替わらないように次の行を読まない
+    if (_recordExportFlag)
+    {
+        continueRecords(stream, controller);
+        return;
+    }
+
+    for (uint8_t readCount{0}; readCount < READ_BYTES_PER_FRAME && stream.available() > 0 && !_recordExportFlag; ++readCount)
+    {
+        const char c{static_cast<char>(stream.read())};
+        if (c == '\r' || c == '\n')
+        {
+            if (_overflowFlag)
+            {
+                stream.println("ERR LINE");
+            }
+            else if (_lineLength > 0)
+            {
+                _line[_lineLength] = '\0';
+                execute(_line, stream, controller);
+            }
+            _lineLength = 0;
+            _overflowFlag = false;
+        }
+        else if (_lineLength < (LINE_MAX - 1))
+        {
+            _line[_lineLength++] = c;
+        }
+        else
+        {
+            _overflowFlag = true;
+        }
+    }
+}
+
+void SerialCommand::execute(char *line, Print &out, BatteryController &controller)
+{
+    char *tokens[TOKEN_MAX]{};
+    const uint8_t tokenCount{tokenize(line, tokens)};
+    if (tokenCount == 0)
+    {
+        return;
+    }
+
+    std::vector<BatteryInfo> &batteryStatuses{controller._batteryStatuses};
+    const uint8_t localSlotCount{static_cast<uint8_t>(batteryStatuses.size())};
+    // マスターの場合、ノードの電池を 5 番以降のスロットとして扱う
+    LinkMaster &linkMaster{controller._linkMaster};
+    const uint8_t remoteSlotCount{static_cast<uint8_t>((controller._linkRole == LinkRole::Master) ? linkMaster.nodeCount() * LinkConst::SLOT_MAX : 0)};
+    const uint8_t slotCount{static_cast<uint8_t>(localSlotCount + remoteSlotCount)};
+    const char *command{tokens[0]};
+
+    if (equals(command, "HELP"))
+    {
+        out.println("OK START STOP SET GET STATUS RESULT MODE PROG THERMAL TOGETHER RECORDS RECORD");
+        return;
+    }
+
+    if (equals(command, "MODE"))
+    {
+        if (tokenCount < 2)
+        {
+            out.println(controller._mainMode == MainMode::PushDischargerMode ? "OK MODE PUSH" : "OK MODE DISCHARGE");
+        }
+        else if (equals(tokens[1], "DISCHARGE"))
+        {
+            controller.changeMainMode(MainMode::DischargerMode);
+            out.println("OK MODE DISCHARGE");
+        }
+        else if (equals(tokens[1], "PUSH"))
+        {
+            controller.changeMainMode(MainMode::PushDischargerMode);
+            out.println("OK MODE PUSH");
+        }
+        else
+        {
+            out.println("ERR MODE");
+        }
+        return;
+    }
+
+    if (equals(command, "TOGETHER"))
+    {
+        if (tokenCount >= 2)
+        {
+            if (equals(tokens[1], "ON") || equals(tokens[1], "OFF"))
+            {
+                controller._finishTogetherFlag = equals(tokens[1], "ON");
+            }
+            else
+            {
+                out.println("ERR VALUE");
+                return;
+            }
+        }
+        out.println(controller._finishTogetherFlag ? "OK TOGETHER ON" : "OK TOGETHER OFF");
+        return;
+    }
+
+    if (equals(command, "THERMAL"))
+    {
+        out.print("THERMAL ");
+        out.print(controller._thermalBudget.boardTemp(), 1);
+        for (const BatteryInfo &batteryInfo : batteryStatuses)
+        {
+            out.print(" ");
+            out.print(controller._thermalBudget.channelTemp(batteryInfo._batteryIndex), 1);
+            out.print("/");
+            out.print(std::min(batteryInfo._limitI, SaveBattery::TARGET_I_MAX), 2);
+        }
+        out.println();
+        out.println("OK");
+        return;
+    }
+
+    if (equals(command, "RECORD"))
+    {
+        if (tokenCount < 2)
+        {
+            out.println("ERR ARG");
+            return;
+        }
+        if (equals(tokens[1], "CLEAR"))
+        {
+            controller._runRecordStore.clear();
+            out.println("OK");
+            return;
+        }
+        char *endPtr{nullptr};
+        const unsigned long runId{strtoul(tokens[1], &endPtr, 10)};
+        RunRecord record{};
+        if (endPtr == tokens[1] || *endPtr != '\0' || !controller._runRecordStore.findByRunId(runId, record))
+        {
+            out.println("ERR ID");
+            return;
+        }
+        printRecord(out, record);
+        out.println("OK");
+        return;
+    }
+
+    // 古い順に出力する。記録が多い場合は、フレーム毎に RECORDS_PER_POLL 件ずつ
+    if (equals(command, "RECORDS"))
+    {
+        const int8_t recordSlot{(tokenCount < 2) ? ALL_SLOTS : parseSlot(tokens[1], localSlotCount)};
+        if (recordSlot == INVALID_SLOT)
+        {
+            out.println("ERR SLOT");
+            return;
+        }
+        const auto &store{controller._runRecordStore};
+        _recordExportFlag = true;
+        _recordSlot = recordSlot;
+        _recordLastRunId = store.newestRunId();
+        _recordRunId = (_recordLastRunId > store.capacity()) ? (_recordLastRunId - store.capacity() + 1) : 1;
+        _recordPrintCount = 0;
+        continueRecords(out, controller);
+        return;
+    }
+
+    const int8_t slot{(tokenCount < 2) ? ALL_SLOTS : parseSlot(tokens[1], slotCount)};
+    if (slot == INVALID_SLOT || (slot != ALL_SLOTS && !isSlotEnabled(controller, slot)))
+    {
+        out.println("ERR SLOT");
+        return;
+    }
+    const uint8_t beginIndex{static_cast<uint8_t>((slot == ALL_SLOTS) ? 0 : slot)};
+    const uint8_t endIndex{static_cast<uint8_t>((slot == ALL_SLOTS) ? slotCount : slot + 1)};
+
+    if (equals(command, "STATUS") || equals(command, "GET") || equals(command, "RESULT"))
+    {
+        for (uint8_t index{beginIndex}; index < endIndex; ++index)
+        {
+            if (!isSlotEnabled(controller, index))
+            {
+                continue;
+            }
+            if (index >= localSlotCount)
+            {
+                const uint8_t nodeIndex{static_cast<uint8_t>((index - localSlotCount) / LinkConst::SLOT_MAX)};
+                const uint8_t nodeSlot{static_cast<uint8_t>((index - localSlotCount) % LinkConst::SLOT_MAX)};
+                printRemoteStatus(out, command, index + 1, linkMaster.nodeState(nodeIndex)._slots[nodeSlot], linkMaster.isOnline(nodeIndex));
+            }
+            else if (equals(command, "STATUS"))
+            {
+                printStatus(out, batteryStatuses[index]);
+            }
+            else if (equals(command, "GET"))
+            {
+                printSetting(out, batteryStatuses[index]);
+            }
+            else
+            {
+                printResult(out, batteryStatuses[index]);
+            }
+        }
+        out.println("OK");
+        return;
+    }
+
+    if (tokenCount < 2)
+    {
+        out.println("ERR ARG");
+        return;
+    }
+
+    if (equals(command, "START") || equals(command, "STOP"))
+    {
+        if (controller._mainMode != MainMode::DischargerMode)
+        {
+            out.println("ERR MODE");
+            return;
+        }
+        const bool startFlag{equals(command, "START")};
+        for (uint8_t index{beginIndex}; index < endIndex; ++index)
+        {
+            if (!isSlotEnabled(controller, index))
+            {
+                continue;
+            }
+            if (index >= localSlotCount)
+            {
+                const uint8_t nodeIndex{static_cast<uint8_t>((index - localSlotCount) / LinkConst::SLOT_MAX)};
+                const uint8_t nodeSlot{static_cast<uint8_t>((index - localSlotCount) % LinkConst::SLOT_MAX)};
+                linkMaster.sendCommand(nodeIndex, LinkCommand{nodeSlot, startFlag ? LinkCommandOp::Start : LinkCommandOp::Stop, 0});
+                continue;
+            }
+            BatteryInfo &batteryInfo{batteryStatuses[index]};
+            if (batteryInfo._activeFlag != startFlag)
+            {
+                batteryInfo.changeActive(1);
+            }
+        }
+        out.println("OK");
+        return;
+    }
+
+    if (equals(command, "PROG"))
+    {
+        if (slot == ALL_SLOTS || slot >= localSlotCount)
+        {
+            out.println("ERR SLOT");
+            return;
+        }
+        BatteryInfo &batteryInfo{batteryStatuses[slot]};
+        if (tokenCount >= 3)
+        {
+            DischargeProgram program{};
+            if (!parseProgram(tokens[2], program))
+            {
+                out.println("ERR VALUE");
+                return;
+            }
+            batteryInfo._saveBattery->_customProgram = program;
+            controller.saveMain();
+        }
+        printProgram(out, batteryInfo);
+        out.println("OK");
+        return;
+    }
+
+    if (equals(command, "SET"))
+    {
+        if (tokenCount < 4)
+        {
+            out.println("ERR ARG");
+            return;
+        }
+        char *endPtr{nullptr};
+        const float value{strtof(tokens[3], &endPtr)};
+        if (endPtr == tokens[3])
+        {
+            out.println("ERR VALUE");
+            return;
+        }
+        // 一部の電池だけ変更して失敗しないように、全ての対象で key を確かめてから変更する（ノードの電池は V / I のみ）
+        const char *key{tokens[2]};
+        const bool localFlag{beginIndex < localSlotCount};
+        const bool remoteFlag{endIndex > localSlotCount};
+        if ((localFlag && !isSettingKey(key)) || (remoteFlag && !isRemoteKey(key)))
+        {
+            out.println("ERR KEY");
+            return;
+        }
+        for (uint8_t index{beginIndex}; index < endIndex; ++index)
+        {
+            if (!isSlotEnabled(controller, index))
+            {
+                continue;
+            }
+            if (index >= localSlotCount)
+            {
+                const uint8_t nodeIndex{static_cast<uint8_t>((index - localSlotCount) / LinkConst::SLOT_MAX)};
+                const uint8_t nodeSlot{static_cast<uint8_t>((index - localSlotCount) % LinkConst::SLOT_MAX)};
+                const uint16_t milliValue{static_cast<uint16_t>(std::clamp(value, 0.f, 60.f) * 1000.f + 0.5f)};
+                linkMaster.sendCommand(nodeIndex, LinkCommand{nodeSlot, equals(key, "V") ? LinkCommandOp::SetTargetV : LinkCommandOp::SetTargetI, milliValue});
+                continue;
+            }
+            SaveBattery *saveBattery{batteryStatuses[index]._saveBattery};
+            setParam(*saveBattery, key, value);
+            controller.applyBatterySetting(saveBattery);
+        }
+        out.println("OK");
+        return;
+    }
+
+    out.println("ERR COMMAND");
+}
+
+bool SerialCommand::isSlotEnabled(const BatteryController &controller, uint8_t index)
+{
+    const uint8_t localSlotCount{static_cast<uint8_t>(controller._batteryStatuses.size())};
+    if (index < localSlotCount)
+    {
+        return controller._batteryStatuses[index].isEnabled();
+    }
+    const uint8_t nodeIndex{static_cast<uint8_t>((index - localSlotCount) / LinkConst::SLOT_MAX)};
+    const uint8_t nodeSlot{static_cast<uint8_t>((index - localSlotCount) % LinkConst::SLOT_MAX)};
+    return nodeSlot < controller._linkMaster.nodeState(nodeIndex)._slotCount;
+}
+
+void SerialCommand::continueRecords(Print &out, BatteryController &controller)
+{
+    const auto &store{controller._runRecordStore};
+    uint8_t printCount{0};
+    for (uint8_t scanCount{0}; scanCount < RECORD_SCAN_PER_POLL && printCount < RECORDS_PER_POLL && _recordRunId <= _recordLastRunId; ++scanCount)
+    {
+        // 出力中に上書きされた記録は飛ばす
+        RunRecord record{};
+        if (store.findByRunId(_recordRunId++, record) && (_recordSlot == ALL_SLOTS || record._slot == _recordSlot))
+        {
+            printRecord(out, record);
+            ++printCount;
+            ++_recordPrintCount;
+        }
+    }
+
+    if (_recordRunId > _recordLastRunId)
+    {
+        _recordExportFlag = false;
+        out.print("OK RECORDS ");
+        out.println(_recordPrintCount);
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <Arduino.h>
+
+class BatteryController;
+
+// Serial から1行ずつコマンドを受け取り、BatteryController を操作する
+// ボタン操作なしで、ホスト側のスクリプトからまとめて電池を処理するために使う
+//
+//   START <slot|ALL>             放電開始
+//   STOP <slot|ALL>              放電停止
+//   SET <slot|ALL> <key> <value> key: V(目標電圧) I(目標電流) DMODE(0-2) RMODE(0-3) HOLD(分) PROG(0-4)
+//                                電池設定画面と同じく、ペア（1-2、3-4）で共有する設定を変更する。保存はしない
+//   GET <slot|ALL>               設定値
+//   PROG <slot> [hex]            カスタム放電プログラム（ペア単位）の書き込み / 読み出し。1ステップ6byte
+//   STATUS [slot|ALL]            現在の状態
+//   RESULT <slot|ALL>            放電結果
+//   MODE <DISCHARGE|PUSH>        MainMode の切り替え
+//   THERMAL                      熱モデルの推定温度と電流上限
+//   TOGETHER [ON|OFF]            同時終了モードの切り替え（保存はしない）
+//   RECORDS [slot|ALL]           放電記録を古い順に出力（フレーム毎に数件ずつ。出力中は次の行を読まない）
+//   RECORD <id|CLEAR>            runId の放電記録 / 全記録の消去
+//   HELP
+//
+// slot は 1 - 4。リンクのマスターの場合、ノードの電池が 5 番以降に続く（ノード1 が 5 - 8 ...）
+// ノードの電池は START / STOP / SET(V, I) / STATUS / GET / RESULT のみ
+// リンク中はスロット 3, 4 を使えない（ERR SLOT。ALL の場合は飛ばす）
+// 応答は "OK ..." / "ERR ..." で始まる
+class SerialCommand
+{
+public:
+  static constexpr uint8_t LINE_MAX{112};
+  static constexpr uint8_t TOKEN_MAX{5};
+  static constexpr uint8_t READ_BYTES_PER_FRAME{64}; // 1フレームで読む最大バイト数（フレーム時間を超えないように）
+  static constexpr uint8_t RECORDS_PER_POLL{4};       // RECORDS で1フレームに出力する最大件数
+  static constexpr uint8_t RECORD_SCAN_PER_POLL{16};  // RECORDS で1フレームに調べる最大件数（スロット指定で飛ばす分を含む）
+  static constexpr int8_t ALL_SLOTS{-1};
+  static constexpr int8_t INVALID_SLOT{-2};
+
+  void poll(Stream &stream, BatteryController &controller);
+
+  // 行をトークンに分割する（区切りは空白）。line は書き換えられる
+  static uint8_t tokenize(char *line, char *(&tokens)[TOKEN_MAX]);
+
+  // "1" - "4" を 0 - 3 に、"ALL" を ALL_SLOTS に変換する
+  static int8_t parseSlot(const char *token, uint8_t slotCount);
+
+  static bool equals(const char *lhs, const char *rhs);
+
+private:
+  void execute(char *line, Print &out, BatteryController &controller);
+
+  // RECORDS の続きを出力する。最後まで出したら "OK RECORDS <件数>"
+  void continueRecords(Print &out, BatteryController &controller);
+
+  // リンク中のスロット3,4、ノードが報告していないスロットは使えない
+  static bool isSlotEnabled(const BatteryController &controller, uint8_t index);
+
+  char _line[LINE_MAX]{};
+  uint8_t _lineLength{0};
+  bool _overflowFlag{false};
+
+  bool _recordExportFlag{false}; // RECORDS の出力中
+  int8_t _recordSlot{ALL_SLOTS};
+  uint32_t _recordRunId{0};      // 次に出力する runId
+  uint32_t _recordLastRunId{0};  // 出力を始めたときの最新の runId
+  uint16_t _recordPrintCount{0};
+};
@@ -8,9 +8,11 @@
 #include "battery_monitor.hpp"
 #include "battery_controller.hpp"
 #include "src/display/adafruit_gfx_utility.hpp"
+#include "src/input/button_input.hpp"
 
 #include "src/app/flappy.hpp"
 #include "src/app/stopwatch.hpp"
+#include "src/app/benchmark.hpp"
 
 Adafruit_SSD1306 oledDisplay{AdafruitGfxUtility::SCREEN_WIDTH, AdafruitGfxUtility::SCREEN_HEIGHT, &Wire, AdafruitGfxUtility::OLED_RESET};
 
@@ -22,6 +24,7 @@ ButtonStatus buttonRStatus{};
 
 flappy::Game flappyGame;
 stopwatch::Stopwatch stopWatch;
+benchmark::Benchmark benchmarkApp;
 BatteryMonitor batteryMonitor;
 
 unsigned long loopSubMillis{0};;
@@ -33,6 +36,7 @@ enum class StartupMode : uint8_t
   BatteryController,
   FlappyGame,
   Stopwatch,
+  Benchmark,
 };
 
 StartupMode startupMode{StartupMode::BatteryController};
@@ -57,6 +61,10 @@ void displayCurrentModeSleep()
   {
     flappyGame.displaySleep();
   }
+  else if (startupMode == StartupMode::Benchmark)
+  {
+    benchmarkApp.displaySleep();
+  }
   else
   {
     controller.displaySleep();
@@ -68,8 +76,9 @@ void setup()
 {
   pinMode(LED_BUILTIN, OUTPUT);
 
+  Serial.begin(115200); // 自動キャリブレーションの基準電圧入力にも使う
+
 #ifdef SERIAL_DEBUG_ON
-  Serial.begin(115200);
   while (!Serial);
   Serial.print("Start!");
 #endif
@@ -85,9 +94,11 @@ void setup()
   batteryMonitor.setup();
   pinMode(PUSH_BUTTON_D, INPUT_PULLUP);
   pinMode(PUSH_BUTTON_U, INPUT_PULLUP);
+  pinMode(PUSH_BUTTON_B, INPUT_PULLUP);
 
   const bool flappyRequested{!digitalRead(PUSH_BUTTON_D)};
   const bool stopwatchRequested{!digitalRead(PUSH_BUTTON_U)};
+  const bool benchmarkRequested{!digitalRead(PUSH_BUTTON_B)};
 
   // 開始時にどのボタンを押しているかで、ゲームモード、ストップウォッチモードを起動するか決定する
   if (stopwatchRequested)
@@ -98,6 +109,10 @@ void setup()
   {
     startupMode = StartupMode::FlappyGame;
   }
+  else if (benchmarkRequested)
+  {
+    startupMode = StartupMode::Benchmark;
+  }
   else
   {
     startupMode = StartupMode::BatteryController;
@@ -111,6 +126,10 @@ void setup()
   {
     flappyGame.setup();
   }
+  else if (startupMode == StartupMode::Benchmark)
+  {
+    benchmarkApp.setup(controller);
+  }
   else
   {
     controller.setup();
@@ -128,14 +147,10 @@ void callback()
 
 bool updateDisplayDumpRequest()
 {
-  const auto isActivePush = [](PushType pushType) {
-    return pushType == PushType::Pushed || pushType == PushType::PushShort || pushType == PushType::PushLong;
-  };
-
   buttonLStatus.update();
   buttonRStatus.update();
 
-  const bool dumpDisplayRequested{isActivePush(buttonLStatus.getVal()) && isActivePush(buttonRStatus.getVal())};
+  const bool dumpDisplayRequested{ButtonStatus::isChordPushing(buttonLStatus, buttonRStatus)};
   if (dumpDisplayRequested)
   {
     if (!dumpDisplayButtonLock)
@@ -152,6 +167,7 @@ bool updateDisplayDumpRequest()
 
 void goDeepSleep()
 {
+    ButtonInput::detachAll();
     LowPower.attachInterruptWakeup(WAKE_UP_PIN, callback, RISING);
 
     BatteryController::writePinReset();
@@ -245,6 +261,10 @@ void loop()
     {
       flappyGame.loop();
     }
+    else if (startupMode == StartupMode::Benchmark)
+    {
+      benchmarkApp.loop();
+    }
     else
     {
       controller.loopWhile();
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+// ADC の生の値の統計。1点毎に O(1) で更新し、サンプルを保存しない
+// - Welford 法による平均と分散、最小値と最大値
+// - 隣り合う WINDOW_SAMPLES 点の平均の差から求める Allan 偏差（窓毎）
+//   平均をとる点数を増やしても下がらなくなるところが、ドリフトや低周波ノイズの大きさ
+class AdcStatistics
+{
+public:
+  static constexpr uint8_t WINDOW_COUNT{3};
+  static constexpr uint16_t WINDOW_SAMPLES[WINDOW_COUNT]{16, 256, 4096};
+
+  void reset()
+  {
+    *this = AdcStatistics{};
+  }
+
+  void add(int value)
+  {
+    // 最初の値を原点にする（float で平均付近の桁落ちを避ける）
+    if (_count == 0)
+    {
+      _origin = value;
+      _min = value;
+      _max = value;
+    }
+    ++_count;
+    _min = std::min(_min, value);
+    _max = std::max(_max, value);
+
+    const float x{static_cast<float>(value - _origin)};
+    const float delta{x - _mean};
+    _mean += delta / static_cast<float>(_count);
+    _m2 += delta * (x - _mean);
+
+    for (uint8_t index{0}; index < WINDOW_COUNT; ++index)
+    {
+      Window &window{_windows[index]};
+      window._sum += value - _origin;
+      if (++window._sampleCount < WINDOW_SAMPLES[index])
+      {
+        continue;
+      }
+
+      const float windowMean{static_cast<float>(window._sum) / WINDOW_SAMPLES[index]};
+      if (window._blockCount > 0)
+      {
+        const float diff{windowMean - window._previousMean};
+        window._sumSquare += diff * diff;
+      }
+      ++window._blockCount;
+      window._previousMean = windowMean;
+      window._sum = 0;
+      window._sampleCount = 0;
+    }
+  }
+
+  uint32_t count() const
+  {
+    return _count;
+  }
+
+  float mean() const
+  {
+    return _origin + _mean;
+  }
+
+  // 不偏分散の平方根
+  float deviation() const
+  {
+    return (_count > 1) ? std::sqrt(_m2 / static_cast<float>(_count - 1)) : 0.f;
+  }
+
+  int minValue() const
+  {
+    return _min;
+  }
+
+  int maxValue() const
+  {
+    return _max;
+  }
+
+  // 差が1つもない（2窓分たまっていない）場合は負
+  float allanDeviation(uint8_t index) const
+  {
+    const Window &window{_windows[index]};
+    if (window._blockCount < 2)
+    {
+      return -1.f;
+    }
+    return std::sqrt(window._sumSquare / (2.f * static_cast<float>(window._blockCount - 1)));
+  }
+
+private:
+  struct Window
+  {
+    int32_t _sum{0};           // 途中の窓の合計（原点からの差）
+    uint16_t _sampleCount{0};  // 途中の窓の点数
+    uint32_t _blockCount{0};   // 完結した窓の数
+    float _previousMean{0.f};
+    float _sumSquare{0.f};     // 隣り合う窓の平均の差の2乗和
+  };
+
+  uint32_t _count{0};
+  int _origin{0};
+  int _min{0};
+  int _max{0};
+  float _mean{0.f}; // 原点からの平均
+  float _m2{0.f};
+  Window _windows[WINDOW_COUNT]{};
+};
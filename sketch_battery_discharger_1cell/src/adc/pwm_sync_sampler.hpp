@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+
+enum class SyncSampleEvent : uint8_t
+{
+    None,      // まだサンプル時刻ではない
+    Sample,    // サンプルを取る
+    WindowEnd, // サンプルを取り、窓が完結した
+    Slipped,   // サンプル時刻に間に合わなかった。途中の窓は捨てる
+};
+
+// PWM 周期の整数倍の窓の中で、等間隔にサンプル時刻を決める（等間隔のオーバーサンプリング）
+// PWM のタイマーとは位相を合わせない。読み始めの位相はランダムでよい
+// - 窓の長さが PWM 周期の整数倍なら、窓内のサンプルは位相を均等に覆うので、リップルは読み始めの位相によらず窓平均で打ち消される
+// - periodsPerWindow と samplesPerWindow が互いに素なら、位相は samplesPerWindow 通りに分散する
+//   samplesPerWindow の倍数次の高調波だけは打ち消せない（フィルタ後は小さい）
+// - periodMicros が実際の PWM 周期とずれると窓毎にリップルが残るが、位相が回るので多数の窓の平均では小さくなる
+// 各値は test/test_pwm_sync_sampler.cpp のシミュレーションで確かめている
+class PwmSyncSampler
+{
+public:
+    PwmSyncSampler(unsigned long periodMicros, uint8_t periodsPerWindow, uint8_t samplesPerWindow)
+        : _intervalMicros{(periodMicros * periodsPerWindow) / samplesPerWindow}, _samplesPerWindow{samplesPerWindow} {};
+
+    unsigned long intervalMicros() const
+    {
+        return _intervalMicros;
+    }
+
+    void restart(unsigned long nowMicros)
+    {
+        _nextMicros = nowMicros;
+        _sampleIndex = 0;
+    }
+
+    SyncSampleEvent poll(unsigned long nowMicros)
+    {
+        const long lateMicros{static_cast<long>(nowMicros - _nextMicros)};
+        if (lateMicros < 0)
+        {
+            return SyncSampleEvent::None;
+        }
+
+        // 遅れが大きいと位相がずれるので、窓を最初からやり直す
+        if (lateMicros > static_cast<long>(_intervalMicros / 2))
+        {
+            const bool partialFlag{_sampleIndex > 0};
+            restart(nowMicros + _intervalMicros);
+            return partialFlag ? SyncSampleEvent::Slipped : SyncSampleEvent::None;
+        }
+
+        _nextMicros += _intervalMicros;
+        ++_sampleIndex;
+        if (_sampleIndex >= _samplesPerWindow)
+        {
+            _sampleIndex = 0;
+            return SyncSampleEvent::WindowEnd;
+        }
+        return SyncSampleEvent::Sample;
+    }
+
+private:
+    unsigned long _intervalMicros{0};
+    unsigned long _nextMicros{0};
+    uint8_t _samplesPerWindow{1};
+    uint8_t _sampleIndex{0};
+};
@@ -0,0 +1,189 @@
+#include "supply_reference.hpp"
+
+#if defined(ARDUINO_ARCH_SILABS)
+#include <Arduino.h>
+#include <em_cmu.h>
+#include <em_iadc.h>
+#endif
+
+uint32_t SupplyReference::_filtered{0};
+
+bool SupplyReference::_validFlag{false};
+
+uint32_t SupplyReference::_rejectCount{0};
+
+uint32_t SupplyReference::_scale{1UL << SupplyReference::SCALE_BITS};
+
+uint32_t SupplyReference::_inverseScale{1UL << SupplyReference::SCALE_BITS};
+
+void SupplyReference::update()
+{
+    add(measureMilliVolt());
+}
+
+#if defined(ARDUINO_ARCH_SILABS)
+namespace
+{
+    constexpr uint8_t CONFIG_COUNT{2}; // IADC0->CFG[0..1]
+
+    // analogRead（Arduino コア）が使っている IADC0 の設定。測定の前に読み、後で書き戻す
+    struct IadcRegisters
+    {
+        uint32_t _en;
+        uint32_t _ctrl;
+        uint32_t _timer;
+        uint32_t _trigger;
+        uint32_t _cmpthr;
+        uint32_t _cfg[CONFIG_COUNT];
+        uint32_t _scale[CONFIG_COUNT];
+        uint32_t _sched[CONFIG_COUNT];
+        uint32_t _singleFifoCfg;
+        uint32_t _scanFifoCfg;
+        uint32_t _single;
+        uint32_t _ien;
+    };
+
+    constexpr unsigned long WAIT_TIMEOUT_MICROS{1000}; // 1回の変換は 10MHz で数十us
+
+    // 条件が満たされるまで待つ。時間内に満たされなければ false
+    template <typename Predicate>
+    bool waitUntil(Predicate &&predicate)
+    {
+        const unsigned long startMicros{micros()};
+        while (!predicate())
+        {
+            if (micros() - startMicros >= WAIT_TIMEOUT_MICROS)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool isIdle()
+    {
+        return (IADC0->STATUS & (_IADC_STATUS_CONVERTING_MASK | _IADC_STATUS_SINGLEQUEUEPENDING_MASK | _IADC_STATUS_SCANQUEUEPENDING_MASK)) == 0;
+    }
+
+    // 設定のレジスタは無効にしてからでないと書けない
+    bool disableIadc()
+    {
+        IADC0->EN = 0;
+#if defined(_IADC_EN_DISABLING_MASK)
+        return waitUntil([] { return (IADC0->EN & _IADC_EN_DISABLING_MASK) == 0; });
+#else
+        return true;
+#endif
+    }
+
+    void saveRegisters(IadcRegisters &registers)
+    {
+        registers._en = IADC0->EN & _IADC_EN_EN_MASK;
+        registers._ctrl = IADC0->CTRL;
+        registers._timer = IADC0->TIMER;
+        registers._trigger = IADC0->TRIGGER;
+        registers._cmpthr = IADC0->CMPTHR;
+        for (uint8_t config{0}; config < CONFIG_COUNT; ++config)
+        {
+            registers._cfg[config] = IADC0->CFG[config].CFG;
+            registers._scale[config] = IADC0->CFG[config].SCALE;
+            registers._sched[config] = IADC0->CFG[config].SCHED;
+        }
+        registers._singleFifoCfg = IADC0->SINGLEFIFOCFG;
+        registers._scanFifoCfg = IADC0->SCANFIFOCFG;
+        registers._single = IADC0->SINGLE;
+        registers._ien = IADC0->IEN;
+    }
+
+    void restoreRegisters(const IadcRegisters &registers)
+    {
+        disableIadc();
+        IADC0->CTRL = registers._ctrl;
+        IADC0->TIMER = registers._timer;
+        IADC0->TRIGGER = registers._trigger;
+        IADC0->CMPTHR = registers._cmpthr;
+        for (uint8_t config{0}; config < CONFIG_COUNT; ++config)
+        {
+            IADC0->CFG[config].CFG = registers._cfg[config];
+            IADC0->CFG[config].SCALE = registers._scale[config];
+            IADC0->CFG[config].SCHED = registers._sched[config];
+        }
+        IADC0->SINGLEFIFOCFG = registers._singleFifoCfg;
+        IADC0->SCANFIFOCFG = registers._scanFifoCfg;
+        IADC0->EN = registers._en;
+        // SINGLE は有効な状態で書く。測定で立った割り込みフラグは消してから割り込みを戻す
+        IADC0->SINGLE = registers._single;
+        IADC0->IF_CLR = _IADC_IF_MASK;
+        IADC0->IEN = registers._ien;
+    }
+}
+#endif
+
+uint16_t SupplyReference::measureMilliVolt()
+{
+#if defined(ARDUINO_ARCH_SILABS)
+    static constexpr uint32_t INTERNAL_REF_MILLI_VOLT{1210};
+    static constexpr uint32_t AVDD_DIVIDER{4}; // IADC の AVDD 入力は 1/4 に分圧されている
+    static constexpr uint32_t FULL_SCALE{4095};
+    static constexpr uint32_t CLOCK_HZ{10000000};
+
+    // analogRead と同じ IADC0 を一時的に設定し直し、測り終えたら元の設定に戻す（IADC_reset は使わない）
+    CMU_ClockEnable(cmuClock_IADC0, true);
+
+    IadcRegisters registers{};
+    saveRegisters(registers);
+    IADC0->IEN = 0;
+
+    // analogRead の変換中（割り込みから呼ばれた場合など）は測らない
+    if (!waitUntil(isIdle))
+    {
+        IADC0->IEN = registers._ien;
+        return 0;
+    }
+
+    IADC_Init_t init = IADC_INIT_DEFAULT;
+    IADC_AllConfigs_t allConfigs = IADC_ALLCONFIGS_DEFAULT;
+    IADC_InitSingle_t initSingle = IADC_INITSINGLE_DEFAULT;
+    IADC_SingleInput_t input = IADC_SINGLEINPUT_DEFAULT;
+
+    init.srcClkPrescale = IADC_calcSrcClkPrescale(IADC0, CLOCK_HZ, 0);
+    allConfigs.configs[0].reference = iadcCfgReferenceInt1V2;
+    allConfigs.configs[0].vRef = INTERNAL_REF_MILLI_VOLT;
+    allConfigs.configs[0].adcClkPrescale = IADC_calcAdcClkPrescale(IADC0, CLOCK_HZ, 0, iadcCfgModeNormal, init.srcClkPrescale);
+    input.posInput = iadcPosInputAvdd;
+    input.negInput = iadcNegInputGnd;
+
+    uint32_t data{0};
+    bool okFlag{disableIadc()};
+    if (okFlag)
+    {
+        // 前の analogRead の結果が残っていれば捨てる
+        while (IADC0->SINGLEFIFOSTAT & _IADC_SINGLEFIFOSTAT_FIFOREADCNT_MASK)
+        {
+            (void)IADC0->SINGLEFIFODATA;
+        }
+        IADC_init(IADC0, &init, &allConfigs);
+        IADC_initSingle(IADC0, &initSingle, &input);
+
+        IADC_command(IADC0, iadcCmdStartSingle);
+        okFlag = waitUntil([] { return (IADC0->STATUS & (_IADC_STATUS_CONVERTING_MASK | _IADC_STATUS_SINGLEFIFODV_MASK)) == IADC_STATUS_SINGLEFIFODV; });
+        if (okFlag)
+        {
+            data = IADC_pullSingleFifoResult(IADC0).data;
+        }
+        else
+        {
+            IADC_command(IADC0, iadcCmdStopSingle);
+        }
+    }
+    restoreRegisters(registers);
+
+    if (!okFlag)
+    {
+        return 0;
+    }
+    return static_cast<uint16_t>((data * INTERNAL_REF_MILLI_VOLT * AVDD_DIVIDER + FULL_SCALE / 2) / FULL_SCALE);
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+
+// ADC の基準（AVDD = 3.3V 電源）の実測値
+// analogRead は AVDD 基準なので、電源電圧が下がると同じ電池電圧でも読み値が上がる
+// 内部の 1.21V 基準で AVDD/4 を測り、生の値を 3.3V 基準の値に固定小数点で換算する
+// 測れない環境（MG24 以外）や範囲外の値の場合は公称値のまま（補正なし）
+class SupplyReference
+{
+public:
+  static constexpr uint16_t NOMINAL_MILLI_VOLT{3300};
+  static constexpr uint16_t MIN_MILLI_VOLT{2700}; // これより外れた測定値は捨てる
+  static constexpr uint16_t MAX_MILLI_VOLT{3700};
+  static constexpr uint8_t FILTER_SHIFT{2};       // 1/4 ずつ新しい値に寄せる
+  static constexpr uint8_t SCALE_BITS{16};
+
+  // AVDD を1回測って反映する（数秒毎に呼ぶ）
+  static void update();
+
+  // 測定値(mV)を反映する。0（測れない）と範囲外は捨てる
+  static void add(uint16_t milliVolt)
+  {
+    if (milliVolt == 0)
+    {
+      return;
+    }
+    if (milliVolt < MIN_MILLI_VOLT || MAX_MILLI_VOLT < milliVolt)
+    {
+      ++_rejectCount;
+      return;
+    }
+
+    const uint32_t sample{static_cast<uint32_t>(milliVolt) << FILTER_SHIFT};
+    if (!_validFlag)
+    {
+      _filtered = sample;
+      _validFlag = true;
+    }
+    else
+    {
+      _filtered = _filtered + ((static_cast<int32_t>(sample) - static_cast<int32_t>(_filtered)) >> FILTER_SHIFT);
+    }
+
+    const uint32_t supply{filteredMilliVolt()};
+    _scale = ((supply << SCALE_BITS) + NOMINAL_MILLI_VOLT / 2) / NOMINAL_MILLI_VOLT;
+    _inverseScale = ((static_cast<uint32_t>(NOMINAL_MILLI_VOLT) << SCALE_BITS) + supply / 2) / supply;
+  }
+
+  static void reset()
+  {
+    _filtered = 0;
+    _validFlag = false;
+    _rejectCount = 0;
+    _scale = 1UL << SCALE_BITS;
+    _inverseScale = 1UL << SCALE_BITS;
+  }
+
+  static bool isValid()
+  {
+    return _validFlag;
+  }
+
+  static uint16_t milliVolt()
+  {
+    return static_cast<uint16_t>(filteredMilliVolt());
+  }
+
+  static float volt()
+  {
+    return milliVolt() / 1000.f;
+  }
+
+  static uint32_t rejectCount()
+  {
+    return _rejectCount;
+  }
+
+  // AVDD 基準の ADC の値（合計でも可）を、3.3V 基準の値にする
+  static uint32_t compensate(uint32_t count)
+  {
+    return static_cast<uint32_t>((static_cast<uint64_t>(count) * _scale + (1UL << (SCALE_BITS - 1))) >> SCALE_BITS);
+  }
+
+  // 3.3V 基準で求めた PWM の duty を、AVDD 基準の duty にする（PWM の平均電圧も AVDD に比例する）
+  static int32_t compensateDuty(int32_t duty)
+  {
+    return static_cast<int32_t>((static_cast<int64_t>(duty) * _inverseScale + (1L << (SCALE_BITS - 1))) >> SCALE_BITS);
+  }
+
+private:
+  // AVDD/4 を内部基準で測る。IADC0 の設定は測定後に元に戻す
+  // analogRead の変換が終わらない、変換が時間内に終わらない、または測れない環境では 0
+  static uint16_t measureMilliVolt();
+
+  static uint32_t filteredMilliVolt()
+  {
+    return _validFlag ? ((_filtered + (1UL << (FILTER_SHIFT - 1))) >> FILTER_SHIFT) : NOMINAL_MILLI_VOLT;
+  }
+
+  static uint32_t _filtered;     // mV << FILTER_SHIFT
+  static bool _validFlag;
+  static uint32_t _rejectCount;
+  static uint32_t _scale;        // AVDD / 3.3V（SCALE_BITS の固定小数点）
+  static uint32_t _inverseScale; // 3.3V / AVDD
+};
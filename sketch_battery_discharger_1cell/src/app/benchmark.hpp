@@ -0,0 +1,278 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Adafruit_SSD1306.h>
+
+#include "../../button_status.hpp"
+#include "../../discharger_define.hpp"
+#include "../../battery_controller.hpp"
+#include "../display/adafruit_gfx_utility.hpp"
+#include "../adc/supply_reference.hpp"
+
+extern Adafruit_SSD1306 oledDisplay;
+
+// 基板、ファームウェア、I2C クロックの違いを比べるための速度測定
+// 起動時に B を押していると起動する。A で測り直す
+// 結果は画面と、Serial に1行（BENCH key=value ...）で出力する
+namespace benchmark
+{
+  constexpr uint16_t ADC_READ_COUNT{2000};
+  constexpr uint8_t DISPLAY_COUNT{20};
+  constexpr uint8_t RENDER_COUNT{10};
+  constexpr unsigned long LOOP_MILLIS{1000};
+
+  // 描画時間を測る MainMode と、画面と Serial に出す名前
+  constexpr MainMode RENDER_MODES[]{
+      MainMode::DischargerMode,
+      MainMode::PushDischargerMode,
+      MainMode::ConfigMode,
+      MainMode::BatteryConfigMode,
+      MainMode::AutoCalibMode,
+      MainMode::CurrentCalibMode,
+      MainMode::HistoryMode,
+      MainMode::AdcStatMode,
+  };
+  constexpr uint8_t RENDER_MODE_COUNT{sizeof(RENDER_MODES) / sizeof(RENDER_MODES[0])};
+  constexpr char RENDER_MODE_CHARS[RENDER_MODE_COUNT + 1]{"DPCBAIHS"};
+
+  struct Result
+  {
+    float _adcPerSecond[SaveConfigData::CHANNEL_SIZE]{}; // analogRead の回数/秒
+    unsigned long _displayMicros{0};                    // oledDisplay.display() 1回
+    unsigned long _renderMicros[RENDER_MODE_COUNT]{};   // 画面クリア + 1画面分の描画
+    unsigned long _saveConfigMicros{0};
+    unsigned long _saveMainMicros{0};
+    unsigned long _loopPerSecond{0};                    // BatteryController::loopMain() の回数/秒
+  };
+
+  class Benchmark
+  {
+    ButtonStatus _buttonAStatus{};
+
+    BatteryController *_controller{nullptr};
+
+    Result _result{};
+
+    void measureAdc()
+    {
+      // リンク中のスロット3,4（Serial1 と同じピン）は読まない。結果は 0 のまま
+      for (BatteryInfo &batteryStatus : _controller->_batteryStatuses)
+      {
+        if (!batteryStatus.isEnabled())
+        {
+          _result._adcPerSecond[batteryStatus._batteryIndex] = 0.f;
+          continue;
+        }
+        const unsigned long startMicros{micros()};
+        for (uint16_t count{0}; count < ADC_READ_COUNT; ++count)
+        {
+          analogRead(batteryStatus._readPin);
+        }
+        const unsigned long elapsedMicros{micros() - startMicros};
+        _result._adcPerSecond[batteryStatus._batteryIndex] = (elapsedMicros > 0) ? (ADC_READ_COUNT * 1000000.f) / elapsedMicros : 0.f;
+      }
+    }
+
+    void measureDisplay()
+    {
+      const unsigned long startMicros{micros()};
+      for (uint8_t count{0}; count < DISPLAY_COUNT; ++count)
+      {
+        oledDisplay.display();
+      }
+      _result._displayMicros = (micros() - startMicros) / DISPLAY_COUNT;
+    }
+
+    void render(MainMode mainMode) const
+    {
+      const BatteryController &controller{*_controller};
+      switch (mainMode)
+      {
+      case MainMode::DischargerMode:
+        controller.setDisplayData();
+        break;
+      case MainMode::PushDischargerMode:
+        controller.setDisplayPushDischarge();
+        break;
+      case MainMode::ConfigMode:
+        controller.setDisplayConfig();
+        break;
+      case MainMode::BatteryConfigMode:
+        controller.setDisplayBatteryConfig(oledDisplay);
+        break;
+      case MainMode::AutoCalibMode:
+        controller.setDisplayAutoCalib();
+        break;
+      case MainMode::CurrentCalibMode:
+        controller.setDisplayCurrentCalib();
+        break;
+      case MainMode::HistoryMode:
+        controller.setDisplayHistory();
+        break;
+      case MainMode::AdcStatMode:
+        controller.setDisplayAdcStat();
+        break;
+      default:
+        break;
+      }
+    }
+
+    void measureRender()
+    {
+      for (uint8_t index{0}; index < RENDER_MODE_COUNT; ++index)
+      {
+        const unsigned long startMicros{micros()};
+        for (uint8_t count{0}; count < RENDER_COUNT; ++count)
+        {
+          oledDisplay.clearDisplay();
+          render(RENDER_MODES[index]);
+        }
+        _result._renderMicros[index] = (micros() - startMicros) / RENDER_COUNT;
+      }
+    }
+
+    // 保存と同じ大きさ、同じ 1byte ずつの書き込みで、EEPROM の内容を RAM に写してそのまま書き戻す
+    // saveConfig() / saveMain() は呼ばない（読み込めなかった場合の初期値を保存してしまうため）
+    template <typename T>
+    static unsigned long measureRewrite()
+    {
+      uint8_t bytes[sizeof(T)];
+      for (size_t i{0}; i < sizeof(T); ++i)
+      {
+        bytes[i] = EEPROM.read(T::SAVEDATA_ADDRESS + i);
+      }
+
+      const unsigned long startMicros{micros()};
+      for (size_t i{0}; i < sizeof(T); ++i)
+      {
+        EEPROM.write(T::SAVEDATA_ADDRESS + i, bytes[i]);
+      }
+      return micros() - startMicros;
+    }
+
+    void measureSave()
+    {
+      _result._saveConfigMicros = measureRewrite<SaveConfigData>();
+      _result._saveMainMicros = measureRewrite<SaveBatteryConfigData>();
+    }
+
+    // 放電していない状態の loopMain()（ADC の読み取りと PWM の出力）
+    void measureLoop()
+    {
+      unsigned long loopCount{0};
+      const unsigned long startMillis{millis()};
+      while (millis() - startMillis < LOOP_MILLIS)
+      {
+        _controller->loopMain();
+        ++loopCount;
+      }
+      _result._loopPerSecond = (loopCount * 1000UL) / LOOP_MILLIS;
+    }
+
+    void run()
+    {
+      oledDisplay.clearDisplay();
+      AdafruitGfxUtility::drawStringC(oledDisplay, "Benchmark...", 3);
+      oledDisplay.display();
+
+      // 結果に出す電源電圧を測っておく
+      SupplyReference::update();
+      measureAdc();
+      measureDisplay();
+      measureRender();
+      measureSave();
+      measureLoop();
+
+      print(Serial);
+      draw();
+    }
+
+    void print(Print &out) const
+    {
+      out.print("BENCH adc=");
+      for (uint8_t channel{0}; channel < SaveConfigData::CHANNEL_SIZE; ++channel)
+      {
+        out.print(channel == 0 ? "" : ",");
+        out.print(static_cast<unsigned long>(_result._adcPerSecond[channel] + 0.5f));
+      }
+      out.print(" display_us=");
+      out.print(_result._displayMicros);
+      for (uint8_t index{0}; index < RENDER_MODE_COUNT; ++index)
+      {
+        out.print(" render_");
+        out.print(RENDER_MODE_CHARS[index]);
+        out.print("_us=");
+        out.print(_result._renderMicros[index]);
+      }
+      out.print(" save_config_us=");
+      out.print(_result._saveConfigMicros);
+      out.print(" save_main_us=");
+      out.print(_result._saveMainMicros);
+      out.print(" loop_hz=");
+      out.print(_result._loopPerSecond);
+      out.print(" vdd_mv=");
+      out.print(SupplyReference::milliVolt());
+      out.println();
+    }
+
+    void draw()
+    {
+      oledDisplay.clearDisplay();
+      AdafruitGfxUtility::drawStringC(oledDisplay, "Benchmark  A:Retry", 0);
+
+      String adcString{"ADCk/s"};
+      for (const float adcPerSecond : _result._adcPerSecond)
+      {
+        adcString += String(" ") + String(static_cast<unsigned long>(adcPerSecond / 1000.f + 0.5f));
+      }
+      AdafruitGfxUtility::drawString(oledDisplay, adcString, 0, 1);
+      AdafruitGfxUtility::drawString(oledDisplay, String("Disp ") + String(_result._displayMicros / 1000.f, 2) + String("ms"), 0, 2);
+
+      // 描画時間(ms) を4画面ずつ2行で
+      for (uint8_t row{0}; row < 2; ++row)
+      {
+        String renderString{};
+        for (uint8_t index{static_cast<uint8_t>(row * 4)}; index < std::min<uint8_t>(RENDER_MODE_COUNT, (row + 1) * 4); ++index)
+        {
+          renderString += String(RENDER_MODE_CHARS[index]) + String(_result._renderMicros[index] / 1000.f, 1) + String(" ");
+        }
+        AdafruitGfxUtility::drawString(oledDisplay, renderString, 0, 3 + row);
+      }
+
+      AdafruitGfxUtility::drawString(oledDisplay, String("Save C") + String(_result._saveConfigMicros / 1000.f, 1) + String(" M") + String(_result._saveMainMicros / 1000.f, 1) + String("ms"), 0, 5);
+      AdafruitGfxUtility::drawString(oledDisplay, String("Loop ") + String(_result._loopPerSecond) + String("/s"), 0, 6);
+      AdafruitGfxUtility::drawString(oledDisplay, String("Vdd ") + String(SupplyReference::volt(), 3) + String("V"), 0, 7);
+      oledDisplay.display();
+    }
+
+  public:
+    void displaySleep()
+    {
+      oledDisplay.clearDisplay();
+      oledDisplay.display();
+      oledDisplay.ssd1306_command(SSD1306_DISPLAYOFF);
+    }
+
+    void setup(BatteryController &controller)
+    {
+      _controller = &controller;
+
+      pinMode(PUSH_BUTTON_A, INPUT_PULLUP);
+      _buttonAStatus.init(PUSH_BUTTON_A);
+
+      // 通常の起動と同じ設定（電圧の補正、SyncADC、リンク）で測る。起動時に A も押していると設定を初期化する点も同じ
+      _controller->setup();
+
+      run();
+    }
+
+    void loop()
+    {
+      _buttonAStatus.update();
+      if (_buttonAStatus.getVal() == PushType::ReleaseShort)
+      {
+        run();
+      }
+    }
+  };
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+
+// 放電量(mAh) に対する休止中電圧(V) の傾きを、古い点ほど軽くした最小二乗法で求める
+// 傾きから目標電圧までの残り放電量を見積もる
+class DischargeSlope
+{
+public:
+  static constexpr float FORGET_RATE{0.95f};      // 1点毎に古い点の重みを掛ける
+  static constexpr uint8_t MIN_POINT_COUNT{8};    // 傾きを使うのに必要な点数
+  static constexpr float MIN_SPAN_MAH{150.f};     // 傾きを使うのに必要な放電量の幅（満充電直後の急な電圧降下を避ける）
+  static constexpr float MIN_SLOPE{-0.00001f};    // これより緩い（平坦な）傾きは使わない(V/mAh)
+
+  void reset()
+  {
+    _weight = 0.f;
+    _sumQ = 0.f;
+    _sumV = 0.f;
+    _sumQQ = 0.f;
+    _sumQV = 0.f;
+    _pointCount = 0;
+    _minQ = 0.f;
+    _maxQ = 0.f;
+  }
+
+  // 数値誤差を抑えるため、最初の点を原点にして積算する
+  void add(float milliAmpereHour, float volt)
+  {
+    if (_pointCount == 0)
+    {
+      _originQ = milliAmpereHour;
+      _originV = volt;
+      _minQ = milliAmpereHour;
+    }
+    const float q{milliAmpereHour - _originQ};
+    const float v{volt - _originV};
+    _weight = _weight * FORGET_RATE + 1.f;
+    _sumQ = _sumQ * FORGET_RATE + q;
+    _sumV = _sumV * FORGET_RATE + v;
+    _sumQQ = _sumQQ * FORGET_RATE + q * q;
+    _sumQV = _sumQV * FORGET_RATE + q * v;
+    _maxQ = milliAmpereHour;
+    if (_pointCount < 0xFF)
+    {
+      ++_pointCount;
+    }
+  }
+
+  bool isValid() const
+  {
+    return _pointCount >= MIN_POINT_COUNT && (_maxQ - _minQ) >= MIN_SPAN_MAH && slope() < MIN_SLOPE;
+  }
+
+  // V/mAh（放電中は負）
+  float slope() const
+  {
+    const float denominator{_weight * _sumQQ - _sumQ * _sumQ};
+    if (denominator <= 0.f)
+    {
+      return 0.f;
+    }
+    return (_weight * _sumQV - _sumQ * _sumV) / denominator;
+  }
+
+  // volt から targetV まで下がるのに必要な放電量(mAh)
+  float remainMilliAmpereHour(float volt, float targetV) const
+  {
+    if (!isValid() || volt <= targetV)
+    {
+      return 0.f;
+    }
+    return (volt - targetV) / -slope();
+  }
+
+private:
+  float _weight{0.f};
+  float _sumQ{0.f};
+  float _sumV{0.f};
+  float _sumQQ{0.f};
+  float _sumQV{0.f};
+  float _originQ{0.f};
+  float _originV{0.f};
+  float _minQ{0.f};
+  float _maxQ{0.f};
+  uint8_t _pointCount{0};
+};
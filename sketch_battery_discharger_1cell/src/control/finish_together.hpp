@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+
+// 目標電圧までの残り放電量から、全チャンネルが同時に終わるように電流を割り当てる
+// 終わる時刻は、各チャンネルの最大電流と、全体の電力枠（熱制限）の両方を満たす最短の時刻に揃える
+// 早く終わるチャンネルの電流を下げた分の電力枠を、遅いチャンネルに回せる
+template <uint8_t CHANNEL_SIZE>
+class FinishTogether
+{
+public:
+  // remains: 残り放電量(mAh)。0 以下のチャンネルは対象外（resultIs は変更しない）
+  // maxIs: チャンネル毎に流せる最大電流(A)
+  // volts: 電池電圧(V)。powerBudget: 対象チャンネルで使える電力の合計(W)。0 以下なら制限なし
+  // 戻り値は揃えた終了までの見込み時間(h)。対象がない場合は 0
+  static float allocate(const float (&remains)[CHANNEL_SIZE], const float (&maxIs)[CHANNEL_SIZE], const float (&volts)[CHANNEL_SIZE],
+                        float powerBudget, float minI, float (&resultIs)[CHANNEL_SIZE])
+  {
+    float finishHours{0.f};
+    float energy{0.f}; // mWh
+    for (uint8_t channel{0}; channel < CHANNEL_SIZE; ++channel)
+    {
+      if (remains[channel] > 0.f && maxIs[channel] > 0.f)
+      {
+        finishHours = std::max(finishHours, remains[channel] / (maxIs[channel] * 1000.f));
+        energy += remains[channel] * volts[channel];
+      }
+    }
+    if (finishHours <= 0.f)
+    {
+      return 0.f;
+    }
+    if (powerBudget > 0.f)
+    {
+      finishHours = std::max(finishHours, energy / (powerBudget * 1000.f));
+    }
+
+    for (uint8_t channel{0}; channel < CHANNEL_SIZE; ++channel)
+    {
+      if (remains[channel] > 0.f)
+      {
+        const float i{remains[channel] / (finishHours * 1000.f)};
+        resultIs[channel] = std::clamp(i, minI, std::max(minI, maxIs[channel]));
+      }
+    }
+    return finishHours;
+  }
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+
+// 放熱のモデル定数（基板と放熱の状態で変わるので、実測で合わせること）
+// 1A 程度を2分以上続けると MOSFET が限界に近づく想定
+struct ThermalParameter
+{
+  float _ambientTemp{25.f};     // 周囲温度(℃)
+  float _channelCapacity{2.f};  // MOSFET 周りの熱容量(J/K)
+  float _channelResist{30.f};   // MOSFET -> 基板 の熱抵抗(K/W)
+  float _boardCapacity{40.f};   // 基板全体の熱容量(J/K)
+  float _boardResist{12.f};     // 基板 -> 周囲 の熱抵抗(K/W)
+  float _channelLimitTemp{100.f};
+  float _boardLimitTemp{70.f};
+  float _horizonSeconds{10.f};  // この秒数で上限に達する分までは、定常値を超えて流してよい
+};
+
+// MOSFET 毎の RC と、共通の基板の RC からなる熱回路で温度を推定し、
+// 上限温度を超えないように各チャンネルの電流を割り当てる
+template <uint8_t CHANNEL_SIZE>
+class ThermalBudget
+{
+public:
+  explicit ThermalBudget(const ThermalParameter &parameter = ThermalParameter{})
+      : _parameter{parameter}
+  {
+    reset();
+  }
+
+  void reset()
+  {
+    for (float &temp : _channelTemps)
+    {
+      temp = _parameter._ambientTemp;
+    }
+    _boardTemp = _parameter._ambientTemp;
+  }
+
+  // powers は各チャンネルの消費電力(W)。電池の電力はほぼ全て MOSFET とシャント抵抗で熱になる
+  void update(const float (&powers)[CHANNEL_SIZE], float dtSeconds)
+  {
+    float boardInflow{0.f};
+    for (uint8_t channel{0}; channel < CHANNEL_SIZE; ++channel)
+    {
+      const float outflow{(_channelTemps[channel] - _boardTemp) / _parameter._channelResist};
+      _channelTemps[channel] += ((powers[channel] - outflow) * dtSeconds) / _parameter._channelCapacity;
+      boardInflow += outflow;
+    }
+    const float boardOutflow{(_boardTemp - _parameter._ambientTemp) / _parameter._boardResist};
+    _boardTemp += ((boardInflow - boardOutflow) * dtSeconds) / _parameter._boardCapacity;
+  }
+
+  // 要求電流 requestIs(A) と電池電圧 volts(V) から、各チャンネルの電流上限 limitIs(A) を求める
+  // 基板の電力枠は 1mA あたりの発熱が少ない（電圧が低い）チャンネルから順に割り当てる
+  // 放電量の合計（mA）を最大にする割り当て
+  void allocate(const float (&requestIs)[CHANNEL_SIZE], const float (&volts)[CHANNEL_SIZE], float (&limitIs)[CHANNEL_SIZE]) const
+  {
+    uint8_t order[CHANNEL_SIZE]{};
+    for (uint8_t channel{0}; channel < CHANNEL_SIZE; ++channel)
+    {
+      order[channel] = channel;
+      limitIs[channel] = 0.f;
+    }
+    std::sort(order, order + CHANNEL_SIZE, [&volts](uint8_t lhs, uint8_t rhs) { return volts[lhs] < volts[rhs]; });
+
+    float boardPower{allowedBoardPower()};
+    for (const uint8_t channel : order)
+    {
+      const float volt{std::max(volts[channel], MIN_VOLT)};
+      const float power{std::min({requestIs[channel] * volt, allowedChannelPower(channel), boardPower})};
+      if (power <= 0.f)
+      {
+        continue;
+      }
+      limitIs[channel] = power / volt;
+      boardPower -= power;
+    }
+  }
+
+  float channelTemp(uint8_t channel) const
+  {
+    return _channelTemps[channel];
+  }
+
+  float boardTemp() const
+  {
+    return _boardTemp;
+  }
+
+  // 上限温度で釣り合う電力に、上限までの余裕を _horizonSeconds で使い切る分を足す
+  // 温度が上限に近づくと定常値に収束する
+  float allowedChannelPower(uint8_t channel) const
+  {
+    const float steadyPower{(_parameter._channelLimitTemp - _boardTemp) / _parameter._channelResist};
+    const float headroomPower{(_parameter._channelCapacity * (_parameter._channelLimitTemp - _channelTemps[channel])) / _parameter._horizonSeconds};
+    return std::max(0.f, steadyPower + headroomPower);
+  }
+
+  float allowedBoardPower() const
+  {
+    const float steadyPower{(_parameter._boardLimitTemp - _parameter._ambientTemp) / _parameter._boardResist};
+    const float headroomPower{(_parameter._boardCapacity * (_parameter._boardLimitTemp - _boardTemp)) / _parameter._horizonSeconds};
+    return std::max(0.f, steadyPower + headroomPower);
+  }
+
+private:
+  static constexpr float MIN_VOLT{0.1f};
+
+  ThermalParameter _parameter{};
+  float _channelTemps[CHANNEL_SIZE]{};
+  float _boardTemp{0.f};
+};
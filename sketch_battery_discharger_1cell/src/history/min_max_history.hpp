@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+
+// 1区間の最小値と最大値
+struct MinMaxSample
+{
+  uint16_t _min{UINT16_MAX};
+  uint16_t _max{0};
+
+  bool isValid() const
+  {
+    return _min <= _max;
+  }
+
+  void merge(const MinMaxSample &sample)
+  {
+    _min = std::min(_min, sample._min);
+    _max = std::max(_max, sample._max);
+  }
+};
+
+// 段毎に区間の長さが違う（1秒、10秒、1分 ...）最小値/最大値の履歴
+// 各段は LEVEL_SIZE 区間のリングバッファで、古い区間から上書きされる（RAM は固定）
+// 1つ下の段の区間が ratio 個たまると、まとめて1区間にして上の段へ送る
+// 1点の追加は段数分の処理だけで済む（全段の区間を作り直さない）
+template <uint8_t LEVEL_COUNT, uint16_t LEVEL_SIZE>
+class MinMaxHistory
+{
+public:
+  // ratios[0] は段0 の1区間の点数、ratios[n] は段n の1区間に入る 段n-1 の区間数
+  explicit MinMaxHistory(const uint16_t (&ratios)[LEVEL_COUNT])
+  {
+    uint32_t sampleCount{1};
+    for (uint8_t level{0}; level < LEVEL_COUNT; ++level)
+    {
+      _ratios[level] = std::max<uint16_t>(ratios[level], 1);
+      sampleCount *= _ratios[level];
+      _bucketSamples[level] = sampleCount;
+    }
+  }
+
+  void reset()
+  {
+    for (Level &level : _levels)
+    {
+      level = Level{};
+    }
+    _sampleCount = 0;
+  }
+
+  void add(uint16_t minValue, uint16_t maxValue)
+  {
+    MinMaxSample sample{std::min(minValue, maxValue), std::max(minValue, maxValue)};
+    ++_sampleCount;
+    for (uint8_t level{0}; level < LEVEL_COUNT; ++level)
+    {
+      Level &current{_levels[level]};
+      current._pending.merge(sample);
+      if (++current._pendingCount < _ratios[level])
+      {
+        return;
+      }
+
+      sample = current._pending;
+      current._buckets[current._head] = sample;
+      current._head = (current._head + 1) % LEVEL_SIZE;
+      current._bucketCount = std::min<uint16_t>(current._bucketCount + 1, LEVEL_SIZE);
+      current._pending = MinMaxSample{};
+      current._pendingCount = 0;
+    }
+  }
+
+  uint32_t sampleCount() const
+  {
+    return _sampleCount;
+  }
+
+  // 段level の1区間の点数
+  uint32_t bucketSamples(uint8_t level) const
+  {
+    return _bucketSamples[level];
+  }
+
+  // 全ての点が段level の LEVEL_SIZE 区間に収まる、一番細かい段
+  uint8_t fitLevel() const
+  {
+    for (uint8_t level{0}; level < LEVEL_COUNT; ++level)
+    {
+      if ((_sampleCount + _bucketSamples[level] - 1) / _bucketSamples[level] <= LEVEL_SIZE)
+      {
+        return level;
+      }
+    }
+    return LEVEL_COUNT - 1;
+  }
+
+  // 段level で表示に使える区間数（まとめ途中の最新区間を含む。最大 LEVEL_SIZE）
+  uint16_t columnCount(uint8_t level) const
+  {
+    const uint16_t count{static_cast<uint16_t>(_levels[level]._bucketCount + (pendingColumn(level).isValid() ? 1 : 0))};
+    return std::min(count, LEVEL_SIZE);
+  }
+
+  // index は古い順（0 が一番古い、columnCount - 1 が最新）
+  MinMaxSample column(uint8_t level, uint16_t index) const
+  {
+    const uint16_t count{columnCount(level)};
+    const MinMaxSample pending{pendingColumn(level)};
+    if (pending.isValid())
+    {
+      if (index + 1 == count)
+      {
+        return pending;
+      }
+    }
+    const uint16_t age{static_cast<uint16_t>(count - 1 - index - (pending.isValid() ? 1 : 0))};
+    const Level &current{_levels[level]};
+    return current._buckets[(current._head + LEVEL_SIZE - 1 - age) % LEVEL_SIZE];
+  }
+
+private:
+  struct Level
+  {
+    MinMaxSample _buckets[LEVEL_SIZE]{};
+    MinMaxSample _pending{}; // まとめ途中の区間
+    uint16_t _pendingCount{0};
+    uint16_t _head{0}; // 次に書き込む位置
+    uint16_t _bucketCount{0};
+  };
+
+  // 段level のまとめ途中の区間に、下の段のまとめ途中の区間も合わせる（最新の点まで表示するため）
+  MinMaxSample pendingColumn(uint8_t level) const
+  {
+    MinMaxSample sample{};
+    for (uint8_t lower{0}; lower <= level; ++lower)
+    {
+      sample.merge(_levels[lower]._pending);
+    }
+    return sample;
+  }
+
+  Level _levels[LEVEL_COUNT]{};
+  uint16_t _ratios[LEVEL_COUNT]{};
+  uint32_t _bucketSamples[LEVEL_COUNT]{};
+  uint32_t _sampleCount{0};
+};
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+
+// 放電1回分の結果（24byte 固定長）
+struct RunRecord
+{
+  static constexpr uint32_t EMPTY_RUN_ID{0xFFFFFFFF}; // 消去済みの領域
+
+  uint32_t _runId{EMPTY_RUN_ID};
+  uint32_t _durationSeconds{0};
+  uint16_t _startMilliVolt{0}; // 開始前の休止中電圧
+  uint16_t _endMilliVolt{0};   // 終了時の休止中電圧
+  uint16_t _milliAmpereHour{0};
+  uint16_t _milliWattHour{0};
+  uint16_t _deciMilliOhm{0};   // 内部抵抗(0.1mΩ)
+  uint8_t _slot{0};            // 0 始まり
+  uint8_t _disChargeMode{0};   // DisChargeMode
+  uint8_t _reduceMode{0};      // ReduceMode
+  uint8_t _programType{0};     // ProgramType
+  uint16_t _checksum{0};       // 書き込み途中の電源断を見分ける
+
+  uint16_t calcChecksum() const
+  {
+    // Fletcher-16
+    const uint8_t *bytes{reinterpret_cast<const uint8_t *>(this)};
+    uint16_t sum1{0};
+    uint16_t sum2{0};
+    for (size_t i{0}; i < offsetof(RunRecord, _checksum); ++i)
+    {
+      sum1 = (sum1 + bytes[i]) % 255;
+      sum2 = (sum2 + sum1) % 255;
+    }
+    return static_cast<uint16_t>((sum2 << 8) | sum1);
+  }
+
+  bool isValid() const
+  {
+    return _runId != EMPTY_RUN_ID && _checksum == calcChecksum();
+  }
+};
+static_assert(sizeof(RunRecord) == 24, "RunRecord size");
+
+// 放電結果を追記していく記録領域
+// EEPROM（フラッシュのエミュレーション）上のリングバッファで、いっぱいになると古い記録から上書きする
+// 記録は連番の runId 順に並ぶので、runId から位置を直接計算できる
+// スロット毎の検索用に、位置 -> スロット の索引（1記録 1byte）を RAM に持つ
+// Storage は uint8_t read(int) / void write(int, uint8_t) を持つ型（EEPROMClass 等）
+template <typename Storage, uint16_t CAPACITY>
+class RunRecordStore
+{
+public:
+  static constexpr uint16_t RECORD_SIZE{sizeof(RunRecord)};
+
+  RunRecordStore(Storage &storage, int baseAddress)
+      : _storage{storage}, _baseAddress{baseAddress}
+  {
+  }
+
+  // 起動時に1回呼ぶ。byteSize は使える領域の大きさ（足りない場合は記録数を減らす）
+  void load(int byteSize)
+  {
+    _capacity = static_cast<uint16_t>(std::clamp(byteSize / static_cast<int>(RECORD_SIZE), 0, static_cast<int>(CAPACITY)));
+    _count = 0;
+    _newestRunId = 0;
+    _newestPosition = (_capacity > 0) ? (_capacity - 1) : 0;
+
+    for (uint16_t position{0}; position < _capacity; ++position)
+    {
+      RunRecord record{};
+      readRecord(position, record);
+      if (!record.isValid())
+      {
+        _slots[position] = EMPTY_SLOT;
+        continue;
+      }
+      _slots[position] = record._slot;
+      ++_count;
+      if (_count == 1 || record._runId > _newestRunId)
+      {
+        _newestRunId = record._runId;
+        _newestPosition = position;
+      }
+    }
+  }
+
+  // 全て消去する（runId は 1 からやり直し）
+  void clear()
+  {
+    for (int i{0}; i < _capacity * RECORD_SIZE; ++i)
+    {
+      _storage.write(_baseAddress + i, 0xFF);
+    }
+    load(_capacity * RECORD_SIZE);
+  }
+
+  // runId を振って追記し、振った runId を返す。領域がない場合は EMPTY_RUN_ID
+  uint32_t append(RunRecord record)
+  {
+    if (_capacity == 0)
+    {
+      return RunRecord::EMPTY_RUN_ID;
+    }
+
+    const uint16_t position{static_cast<uint16_t>((_newestPosition + 1) % _capacity)};
+    _newestRunId = (_count == 0) ? 1 : (_newestRunId + 1);
+    if (_slots[position] == EMPTY_SLOT)
+    {
+      ++_count;
+    }
+
+    _newestPosition = position;
+    record._runId = _newestRunId;
+    record._checksum = record.calcChecksum();
+    _slots[position] = record._slot;
+
+    const uint8_t *bytes{reinterpret_cast<const uint8_t *>(&record)};
+    for (uint16_t i{0}; i < RECORD_SIZE; ++i)
+    {
+      _storage.write(address(position) + i, bytes[i]);
+    }
+    return _newestRunId;
+  }
+
+  uint16_t capacity() const
+  {
+    return _capacity;
+  }
+
+  uint16_t count() const
+  {
+    return _count;
+  }
+
+  uint32_t newestRunId() const
+  {
+    return (_count > 0) ? _newestRunId : RunRecord::EMPTY_RUN_ID;
+  }
+
+  bool findByRunId(uint32_t runId, RunRecord &record) const
+  {
+    if (_count == 0 || runId > _newestRunId || (_newestRunId - runId) >= _capacity)
+    {
+      return false;
+    }
+    const uint16_t age{static_cast<uint16_t>(_newestRunId - runId)};
+    readRecord(positionByAge(age), record);
+    return record.isValid() && record._runId == runId;
+  }
+
+  // 新しい順に nth 番目（0 が最新）
+  bool findByAge(uint16_t nth, RunRecord &record) const
+  {
+    uint16_t found{0};
+    for (uint16_t age{0}; age < _capacity; ++age)
+    {
+      const uint16_t position{positionByAge(age)};
+      if (_slots[position] != EMPTY_SLOT && found++ == nth)
+      {
+        readRecord(position, record);
+        return record.isValid();
+      }
+    }
+    return false;
+  }
+
+  uint16_t countBySlot(uint8_t slot) const
+  {
+    return static_cast<uint16_t>(std::count(_slots, _slots + _capacity, slot));
+  }
+
+  // スロット slot の記録の中で、新しい順に nth 番目（0 が最新）。索引で位置を探すので、読み出しは1記録分だけ
+  bool findBySlot(uint8_t slot, uint16_t nth, RunRecord &record) const
+  {
+    uint16_t found{0};
+    for (uint16_t age{0}; age < _capacity; ++age)
+    {
+      const uint16_t position{positionByAge(age)};
+      if (_slots[position] == slot && found++ == nth)
+      {
+        readRecord(position, record);
+        return record.isValid();
+      }
+    }
+    return false;
+  }
+
+private:
+  static constexpr uint8_t EMPTY_SLOT{0xFF};
+
+  int address(uint16_t position) const
+  {
+    return _baseAddress + position * RECORD_SIZE;
+  }
+
+  uint16_t positionByAge(uint16_t age) const
+  {
+    return static_cast<uint16_t>((_newestPosition + _capacity - (age % _capacity)) % _capacity);
+  }
+
+  void readRecord(uint16_t position, RunRecord &record) const
+  {
+    uint8_t *bytes{reinterpret_cast<uint8_t *>(&record)};
+    for (uint16_t i{0}; i < RECORD_SIZE; ++i)
+    {
+      bytes[i] = _storage.read(address(position) + i);
+    }
+  }
+
+  Storage &_storage;
+  int _baseAddress{0};
+  uint16_t _capacity{0};
+  uint16_t _count{0};
+  uint16_t _newestPosition{0};
+  uint32_t _newestRunId{0};
+  uint8_t _slots[CAPACITY]{}; // 位置毎のスロット番号（EMPTY_SLOT は空き）
+};
@@ -0,0 +1,52 @@
+#include "button_input.hpp"
+
+SpscQueue<ButtonEdge, ButtonInput::QUEUE_SIZE> ButtonInput::_queue{};
+
+int ButtonInput::_pinIds[ButtonInput::BUTTON_MAX]{};
+
+bool ButtonInput::_attachedFlags[ButtonInput::BUTTON_MAX]{};
+
+void (*const ButtonInput::ISR_TABLE[ButtonInput::BUTTON_MAX])() = {
+    &ButtonInput::onChange<0>,
+    &ButtonInput::onChange<1>,
+    &ButtonInput::onChange<2>,
+    &ButtonInput::onChange<3>,
+    &ButtonInput::onChange<4>,
+    &ButtonInput::onChange<5>,
+    &ButtonInput::onChange<6>,
+    &ButtonInput::onChange<7>,
+};
+
+bool ButtonInput::attach(uint8_t buttonIndex, int pinId)
+{
+    if (buttonIndex >= BUTTON_MAX)
+    {
+        return false;
+    }
+
+    _pinIds[buttonIndex] = pinId;
+    _attachedFlags[buttonIndex] = true;
+    attachInterrupt(digitalPinToInterrupt(pinId), ISR_TABLE[buttonIndex], CHANGE);
+    return true;
+}
+
+void ButtonInput::detachAll()
+{
+    for (uint8_t i{0}; i < BUTTON_MAX; ++i)
+    {
+        if (_attachedFlags[i])
+        {
+            detachInterrupt(digitalPinToInterrupt(_pinIds[i]));
+            _attachedFlags[i] = false;
+        }
+    }
+}
+
+void ButtonInput::pushEdge(uint8_t buttonIndex)
+{
+    ButtonEdge edge{};
+    edge._millis = millis();
+    edge._buttonIndex = buttonIndex;
+    edge._pushFlag = (digitalRead(_pinIds[buttonIndex]) == LOW);
+    _queue.push(edge);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "spsc_queue.hpp"
+
+// ボタンの生エッジ（割り込み発生時の状態と時刻）
+struct ButtonEdge
+{
+    unsigned long _millis{0};
+    uint8_t _buttonIndex{0};
+    bool _pushFlag{false};
+};
+
+// GPIO 割り込みでボタンのエッジをキューに積む。チャタリング除去と押下種別の判定は ButtonStatus 側で行う
+class ButtonInput
+{
+public:
+    static constexpr uint8_t BUTTON_MAX{8};
+    static constexpr uint8_t QUEUE_SIZE{32};
+
+    static bool attach(uint8_t buttonIndex, int pinId);
+
+    static void detachAll();
+
+    static bool pop(ButtonEdge &edge)
+    {
+        return _queue.pop(edge);
+    }
+
+    // キューが溢れた場合、呼び出し側は digitalRead で状態を取り直す
+    static bool checkOverflow()
+    {
+        return _queue.checkOverflow();
+    }
+
+private:
+    template <uint8_t INDEX>
+    static void onChange()
+    {
+        pushEdge(INDEX);
+    }
+
+    static void pushEdge(uint8_t buttonIndex);
+
+    static void (*const ISR_TABLE[BUTTON_MAX])();
+
+    static SpscQueue<ButtonEdge, QUEUE_SIZE> _queue;
+
+    static int _pinIds[BUTTON_MAX];
+
+    static bool _attachedFlags[BUTTON_MAX];
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// 割り込み（書き込み側1つ）とメインループ（読み出し側1つ）の間で使うロックフリーのリングバッファ
+// SIZE は 2 の累乗であること
+template <typename T, uint8_t SIZE>
+class SpscQueue
+{
+    static_assert((SIZE & (SIZE - 1)) == 0, "SIZE must be a power of two.");
+    static constexpr uint8_t INDEX_MASK{SIZE - 1};
+
+    T _buffer[SIZE]{};
+    std::atomic<uint8_t> _head{0}; // 読み出し側のみが更新
+    std::atomic<uint8_t> _tail{0}; // 書き込み側のみが更新
+    std::atomic<bool> _overflowFlag{false};
+
+public:
+    // 書き込み側（割り込み）から呼ぶ。満杯の場合は捨ててオーバーフローを記録する
+    bool push(const T &value)
+    {
+        const uint8_t tail{_tail.load(std::memory_order_relaxed)};
+        const uint8_t head{_head.load(std::memory_order_acquire)};
+        if (static_cast<uint8_t>(tail - head) >= SIZE)
+        {
+            _overflowFlag.store(true, std::memory_order_relaxed);
+            return false;
+        }
+
+        _buffer[tail & INDEX_MASK] = value;
+        _tail.store(static_cast<uint8_t>(tail + 1), std::memory_order_release);
+        return true;
+    }
+
+    // 読み出し側（メインループ）から呼ぶ
+    bool pop(T &value)
+    {
+        const uint8_t head{_head.load(std::memory_order_relaxed)};
+        const uint8_t tail{_tail.load(std::memory_order_acquire)};
+        if (head == tail)
+        {
+            return false;
+        }
+
+        value = _buffer[head & INDEX_MASK];
+        _head.store(static_cast<uint8_t>(head + 1), std::memory_order_release);
+        return true;
+    }
+
+    // オーバーフローがあったかどうか（読み出すとクリアされる）
+    bool checkOverflow()
+    {
+        return _overflowFlag.exchange(false, std::memory_order_relaxed);
+    }
+};
@@ -0,0 +1,179 @@
+#include "link_frame.hpp"
+
+namespace
+{
+    static constexpr uint8_t STATUS_MASK{0x0F};
+    static constexpr uint8_t ACTIVE_BIT{0x80};
+    static constexpr uint8_t DONE_BIT{0x40};
+    static constexpr uint8_t COMMAND_SIZE{4};
+
+    void writeU16(uint8_t *out, uint16_t value)
+    {
+        out[0] = static_cast<uint8_t>(value & 0xFF);
+        out[1] = static_cast<uint8_t>(value >> 8);
+    }
+
+    uint16_t readU16(const uint8_t *in)
+    {
+        return static_cast<uint16_t>(in[0] | (in[1] << 8));
+    }
+}
+
+uint16_t LinkCodec::crc16(const uint8_t *data, size_t length)
+{
+    uint16_t crc{0xFFFF};
+    for (size_t i{0}; i < length; ++i)
+    {
+        crc ^= static_cast<uint16_t>(data[i]) << 8;
+        for (uint8_t bit{0}; bit < 8; ++bit)
+        {
+            crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+        }
+    }
+    return crc;
+}
+
+size_t LinkCodec::encode(const LinkFrame &frame, uint8_t (&out)[LinkConst::FRAME_MAX])
+{
+    const uint8_t length{(frame._length < LinkConst::PAYLOAD_MAX) ? frame._length : LinkConst::PAYLOAD_MAX};
+    out[0] = LinkConst::SYNC0;
+    out[1] = LinkConst::SYNC1;
+    out[2] = frame._dst;
+    out[3] = frame._src;
+    out[4] = static_cast<uint8_t>(frame._type);
+    out[5] = frame._seq;
+    out[6] = length;
+    for (uint8_t i{0}; i < length; ++i)
+    {
+        out[LinkConst::HEADER_SIZE + i] = frame._payload[i];
+    }
+    const size_t crcIndex{static_cast<size_t>(LinkConst::HEADER_SIZE + length)};
+    writeU16(&out[crcIndex], crc16(&out[2], crcIndex - 2));
+    return crcIndex + LinkConst::CRC_SIZE;
+}
+
+void LinkCodec::packState(const LinkNodeState &state, LinkFrame &frame)
+{
+    const uint8_t slotCount{(state._slotCount < LinkConst::SLOT_MAX) ? state._slotCount : LinkConst::SLOT_MAX};
+    frame._type = LinkType::State;
+    frame._payload[0] = slotCount;
+    uint8_t *out{&frame._payload[1]};
+    for (uint8_t slot{0}; slot < slotCount; ++slot)
+    {
+        const LinkSlotState &slotState{state._slots[slot]};
+        out[0] = static_cast<uint8_t>((slotState._status & STATUS_MASK) | (slotState._activeFlag ? ACTIVE_BIT : 0) | (slotState._doneFlag ? DONE_BIT : 0));
+        writeU16(&out[1], slotState._sleepMilliVolt);
+        writeU16(&out[3], slotState._milliAmpere);
+        writeU16(&out[5], slotState._milliAmpereHour);
+        writeU16(&out[7], slotState._targetMilliVolt);
+        out += LinkConst::SLOT_STATE_SIZE;
+    }
+    frame._length = static_cast<uint8_t>(1 + slotCount * LinkConst::SLOT_STATE_SIZE);
+}
+
+bool LinkCodec::unpackState(const LinkFrame &frame, LinkNodeState &state)
+{
+    if (frame._type != LinkType::State || frame._length < 1)
+    {
+        return false;
+    }
+    const uint8_t slotCount{frame._payload[0]};
+    if (slotCount > LinkConst::SLOT_MAX || frame._length != (1 + slotCount * LinkConst::SLOT_STATE_SIZE))
+    {
+        return false;
+    }
+
+    state._slotCount = slotCount;
+    const uint8_t *in{&frame._payload[1]};
+    for (uint8_t slot{0}; slot < slotCount; ++slot)
+    {
+        LinkSlotState &slotState{state._slots[slot]};
+        slotState._status = in[0] & STATUS_MASK;
+        slotState._activeFlag = (in[0] & ACTIVE_BIT) != 0;
+        slotState._doneFlag = (in[0] & DONE_BIT) != 0;
+        slotState._sleepMilliVolt = readU16(&in[1]);
+        slotState._milliAmpere = readU16(&in[3]);
+        slotState._milliAmpereHour = readU16(&in[5]);
+        slotState._targetMilliVolt = readU16(&in[7]);
+        in += LinkConst::SLOT_STATE_SIZE;
+    }
+    return true;
+}
+
+void LinkCodec::packCommand(const LinkCommand &command, LinkFrame &frame)
+{
+    frame._type = LinkType::Command;
+    frame._payload[0] = command._slot;
+    frame._payload[1] = static_cast<uint8_t>(command._op);
+    writeU16(&frame._payload[2], command._value);
+    frame._length = COMMAND_SIZE;
+}
+
+bool LinkCodec::unpackCommand(const LinkFrame &frame, LinkCommand &command)
+{
+    if (frame._type != LinkType::Command || frame._length != COMMAND_SIZE || frame._payload[1] >= static_cast<uint8_t>(LinkCommandOp::Max))
+    {
+        return false;
+    }
+    command._slot = frame._payload[0];
+    command._op = static_cast<LinkCommandOp>(frame._payload[1]);
+    command._value = readU16(&frame._payload[2]);
+    return true;
+}
+
+bool LinkParser::feed(uint8_t value, LinkFrame &frame)
+{
+    // 同期パターンを探す
+    if (_length == 0)
+    {
+        if (value == LinkConst::SYNC0)
+        {
+            _buffer[_length++] = value;
+        }
+        return false;
+    }
+    if (_length == 1)
+    {
+        if (value == LinkConst::SYNC1)
+        {
+            _buffer[_length++] = value;
+        }
+        else
+        {
+            _length = (value == LinkConst::SYNC0) ? 1 : 0;
+        }
+        return false;
+    }
+
+    _buffer[_length++] = value;
+    if (_length == LinkConst::HEADER_SIZE && _buffer[6] > LinkConst::PAYLOAD_MAX)
+    {
+        ++_errorCount;
+        _length = 0;
+        return false;
+    }
+    if (_length < LinkConst::HEADER_SIZE || _length < (LinkConst::HEADER_SIZE + _buffer[6] + LinkConst::CRC_SIZE))
+    {
+        return false;
+    }
+
+    const uint8_t payloadLength{_buffer[6]};
+    const size_t crcIndex{static_cast<size_t>(LinkConst::HEADER_SIZE + payloadLength)};
+    _length = 0;
+    if (LinkCodec::crc16(&_buffer[2], crcIndex - 2) != readU16(&_buffer[crcIndex]) || _buffer[4] >= static_cast<uint8_t>(LinkType::Max))
+    {
+        ++_errorCount;
+        return false;
+    }
+
+    frame._dst = _buffer[2];
+    frame._src = _buffer[3];
+    frame._type = static_cast<LinkType>(_buffer[4]);
+    frame._seq = _buffer[5];
+    frame._length = payloadLength;
+    for (uint8_t i{0}; i < payloadLength; ++i)
+    {
+        frame._payload[i] = _buffer[LinkConst::HEADER_SIZE + i];
+    }
+    return true;
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// 放電器ユニット同士をつなぐリンクのフレーム
+//   SYNC0 SYNC1 dst src type seq len payload[len] crc16(LE)
+// リング接続（マスター TX -> ノード1 RX -> ノード1 TX -> ノード2 RX ... -> 最後のノード TX -> マスター RX）で使う
+// ノードは自分宛て以外のフレームを次へそのまま送り、マスターは1度に1つの要求だけを出す
+namespace LinkConst
+{
+  static constexpr uint8_t SYNC0{0xA5};
+  static constexpr uint8_t SYNC1{0x5A};
+  static constexpr uint8_t MASTER_ADDRESS{0};
+  static constexpr uint8_t BROADCAST_ADDRESS{0xFF};
+  static constexpr uint8_t NODE_MAX{8};
+  static constexpr uint8_t SLOT_MAX{4};
+  static constexpr uint8_t SLOT_STATE_SIZE{9};
+  static constexpr uint8_t PAYLOAD_MAX{1 + SLOT_MAX * SLOT_STATE_SIZE};
+  static constexpr uint8_t HEADER_SIZE{7};
+  static constexpr uint8_t CRC_SIZE{2};
+  static constexpr uint8_t FRAME_MAX{HEADER_SIZE + PAYLOAD_MAX + CRC_SIZE};
+}
+
+enum class LinkType : uint8_t
+{
+  Enumerate, // アドレス割り当て。payload[0] が次のノードのアドレス。各ノードが +1 して次へ送る
+  Poll,      // 状態の要求
+  State,     // 状態の応答（ノード -> マスター）
+  Command,   // 操作（応答は State）
+  Max,
+};
+
+enum class LinkCommandOp : uint8_t
+{
+  Start,
+  Stop,
+  SetTargetV, // _value は mV
+  SetTargetI, // _value は mA
+  Max,
+};
+
+struct LinkFrame
+{
+  uint8_t _dst{0};
+  uint8_t _src{0};
+  LinkType _type{LinkType::Max};
+  uint8_t _seq{0};
+  uint8_t _length{0};
+  uint8_t _payload[LinkConst::PAYLOAD_MAX]{};
+};
+
+// 1スロット分の状態。フレーム上は LinkConst::SLOT_STATE_SIZE byte
+struct LinkSlotState
+{
+  uint8_t _status{0};    // BatteryStatus
+  bool _activeFlag{false};
+  bool _doneFlag{false}; // 目標電圧に達したことがある
+  uint16_t _sleepMilliVolt{0};
+  uint16_t _milliAmpere{0};
+  uint16_t _milliAmpereHour{0};
+  uint16_t _targetMilliVolt{0};
+};
+
+struct LinkNodeState
+{
+  uint8_t _slotCount{0};
+  LinkSlotState _slots[LinkConst::SLOT_MAX]{};
+};
+
+struct LinkCommand
+{
+  uint8_t _slot{0};
+  LinkCommandOp _op{LinkCommandOp::Max};
+  uint16_t _value{0};
+};
+
+namespace LinkCodec
+{
+  // CRC-16/CCITT-FALSE
+  uint16_t crc16(const uint8_t *data, size_t length);
+
+  // 戻り値は書き込んだバイト数
+  size_t encode(const LinkFrame &frame, uint8_t (&out)[LinkConst::FRAME_MAX]);
+
+  void packState(const LinkNodeState &state, LinkFrame &frame);
+
+  bool unpackState(const LinkFrame &frame, LinkNodeState &state);
+
+  void packCommand(const LinkCommand &command, LinkFrame &frame);
+
+  bool unpackCommand(const LinkFrame &frame, LinkCommand &command);
+}
+
+// 1byte ずつ受け取ってフレームを組み立てる。CRC が合わないものは捨てる
+class LinkParser
+{
+public:
+  // フレームが完成したら frame に入れて true を返す
+  bool feed(uint8_t value, LinkFrame &frame);
+
+  void reset()
+  {
+    _length = 0;
+  }
+
+  uint16_t errorCount() const
+  {
+    return _errorCount;
+  }
+
+private:
+  uint8_t _buffer[LinkConst::FRAME_MAX]{};
+  uint8_t _length{0};
+  uint16_t _errorCount{0};
+};
+
+// リンクの送受信先。Arduino では Stream、ホストではメモリ上のループバックにつなぐ
+class LinkPort
+{
+public:
+  virtual ~LinkPort() = default;
+
+  // 受信データがない場合は -1
+  virtual int read() = 0;
+
+  virtual void write(const uint8_t *data, size_t length) = 0;
+
+  void writeFrame(const LinkFrame &frame)
+  {
+    uint8_t buffer[LinkConst::FRAME_MAX]{};
+    write(buffer, LinkCodec::encode(frame, buffer));
+  }
+};
@@ -0,0 +1,161 @@
+#include "link_master.hpp"
+
+#include <algorithm>
+
+void LinkMaster::start(unsigned long nowMillis)
+{
+    _nodeCount = 0;
+    _waitingFlag = false;
+    _enumerateFlag = true;
+    _enumerateMillis = nowMillis;
+    _parser.reset();
+}
+
+bool LinkMaster::sendCommand(uint8_t nodeIndex, const LinkCommand &command)
+{
+    if (nodeIndex >= _nodeCount)
+    {
+        return false;
+    }
+    return _commandQueue.push(PendingCommand{nodeIndex, command});
+}
+
+void LinkMaster::update(unsigned long nowMillis)
+{
+    receive(nowMillis);
+
+    if (_waitingFlag && (nowMillis - _sendMillis) >= replyTimeoutMillis())
+    {
+        timeout();
+    }
+
+    if (!_waitingFlag)
+    {
+        sendNext(nowMillis);
+    }
+}
+
+void LinkMaster::receive(unsigned long nowMillis)
+{
+    LinkFrame frame{};
+    for (int value{_port.read()}; value >= 0; value = _port.read())
+    {
+        if (!_parser.feed(static_cast<uint8_t>(value), frame))
+        {
+            continue;
+        }
+        if (!_waitingFlag || frame._seq != _waitingSeq)
+        {
+            continue;
+        }
+
+        if (_waitingType == LinkType::Enumerate && frame._type == LinkType::Enumerate)
+        {
+            // 一周して戻ってきた。payload[0] - 1 がノード数
+            const uint8_t nextAddress{(frame._length > 0) ? frame._payload[0] : static_cast<uint8_t>(1)};
+            _nodeCount = std::min<uint8_t>(static_cast<uint8_t>(nextAddress - 1), LinkConst::NODE_MAX);
+            for (uint8_t nodeIndex{0}; nodeIndex < LinkConst::NODE_MAX; ++nodeIndex)
+            {
+                _missCounts[nodeIndex] = 0;
+                _validFlags[nodeIndex] = false;
+            }
+            _pollIndex = _nodeCount;
+            _waitingFlag = false;
+        }
+        else if (frame._type == LinkType::State && frame._dst == LinkConst::MASTER_ADDRESS && frame._src == _waitingAddress)
+        {
+            const uint8_t nodeIndex{static_cast<uint8_t>(frame._src - 1)};
+            if (nodeIndex < _nodeCount && LinkCodec::unpackState(frame, _nodeStates[nodeIndex]))
+            {
+                _updateMillis[nodeIndex] = nowMillis;
+                _missCounts[nodeIndex] = 0;
+                _validFlags[nodeIndex] = true;
+            }
+            _waitingFlag = false;
+        }
+    }
+}
+
+void LinkMaster::timeout()
+{
+    _waitingFlag = false;
+    ++_timeoutCount;
+    _parser.reset();
+
+    if (_waitingType == LinkType::Enumerate)
+    {
+        // リングがつながっていない
+        _nodeCount = 0;
+        return;
+    }
+
+    const uint8_t nodeIndex{static_cast<uint8_t>(_waitingAddress - 1)};
+    if (nodeIndex < _nodeCount && ++_missCounts[nodeIndex] >= MISS_MAX)
+    {
+        _enumerateFlag = true;
+    }
+}
+
+void LinkMaster::sendNext(unsigned long nowMillis)
+{
+    LinkFrame frame{};
+
+    if (_enumerateFlag || (_nodeCount == 0 && (nowMillis - _enumerateMillis) >= ENUMERATE_INTERVAL_MILLIS))
+    {
+        _enumerateFlag = false;
+        _enumerateMillis = nowMillis;
+        frame._dst = LinkConst::BROADCAST_ADDRESS;
+        frame._type = LinkType::Enumerate;
+        frame._payload[0] = 1;
+        frame._length = 1;
+        send(frame, nowMillis);
+        return;
+    }
+
+    if (_nodeCount == 0)
+    {
+        return;
+    }
+
+    // 操作はポーリングより先に送る
+    PendingCommand pendingCommand{};
+    if (_commandQueue.pop(pendingCommand))
+    {
+        if (pendingCommand._nodeIndex < _nodeCount)
+        {
+            frame._dst = static_cast<uint8_t>(pendingCommand._nodeIndex + 1);
+            LinkCodec::packCommand(pendingCommand._command, frame);
+            send(frame, nowMillis);
+        }
+        return;
+    }
+
+    if (_pollIndex >= _nodeCount)
+    {
+        if ((nowMillis - _cycleMillis) < CYCLE_MILLIS)
+        {
+            return;
+        }
+        _cycleMillis = nowMillis;
+        _pollIndex = 0;
+    }
+
+    frame._dst = static_cast<uint8_t>(_pollIndex + 1);
+    frame._type = LinkType::Poll;
+    frame._length = 0;
+    ++_pollIndex;
+    send(frame, nowMillis);
+}
+
+void LinkMaster::send(LinkFrame &frame, unsigned long nowMillis)
+{
+    frame._src = LinkConst::MASTER_ADDRESS;
+    frame._seq = ++_seq;
+    _port.writeFrame(frame);
+
+    _waitingFlag = true;
+    _waitingType = frame._type;
+    _waitingAddress = frame._dst;
+    _waitingSeq = frame._seq;
+    _sendMillis = nowMillis;
+}
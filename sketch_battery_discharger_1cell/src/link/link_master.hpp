@@ -0,0 +1,98 @@
+#pragma once
+
+#include "link_frame.hpp"
+#include "../input/spsc_queue.hpp"
+
+// リンクのマスター側。ノードの列挙、状態の定期ポーリング、操作の送信を行う
+// 要求は1度に1つだけ出し、応答かタイムアウトで次へ進む（ブロックしない。loopMain から毎回 update を呼ぶ）
+// 状態の遅れは、応答が返る限り CYCLE_MILLIS + ノード数 x replyTimeoutMillis() 以内
+class LinkMaster
+{
+public:
+  static constexpr unsigned long CYCLE_MILLIS{100};             // ポーリング周期
+  static constexpr unsigned long BASE_TIMEOUT_MILLIS{10};       // 応答待ちの基本時間
+  static constexpr unsigned long HOP_TIMEOUT_MILLIS{6};         // ノード1台あたりの中継時間（115200bps で最大フレーム約4ms）
+  static constexpr unsigned long ENUMERATE_INTERVAL_MILLIS{3000}; // ノードが見つからない間の列挙間隔
+  static constexpr uint8_t MISS_MAX{3};                         // 連続してタイムアウトしたら再列挙する
+  static constexpr uint8_t COMMAND_QUEUE_SIZE{8};
+
+  explicit LinkMaster(LinkPort &port)
+      : _port{port} {}
+
+  // 列挙からやり直す
+  void start(unsigned long nowMillis);
+
+  void update(unsigned long nowMillis);
+
+  // nodeIndex は 0 始まり（アドレスは nodeIndex + 1）
+  bool sendCommand(uint8_t nodeIndex, const LinkCommand &command);
+
+  uint8_t nodeCount() const
+  {
+    return _nodeCount;
+  }
+
+  // 最後の応答から MISS_MAX 回続けてタイムアウトしていない
+  bool isOnline(uint8_t nodeIndex) const
+  {
+    return nodeIndex < _nodeCount && _validFlags[nodeIndex] && _missCounts[nodeIndex] < MISS_MAX;
+  }
+
+  const LinkNodeState &nodeState(uint8_t nodeIndex) const
+  {
+    return _nodeStates[nodeIndex];
+  }
+
+  unsigned long stateAgeMillis(uint8_t nodeIndex, unsigned long nowMillis) const
+  {
+    return nowMillis - _updateMillis[nodeIndex];
+  }
+
+  unsigned long replyTimeoutMillis() const
+  {
+    return BASE_TIMEOUT_MILLIS + HOP_TIMEOUT_MILLIS * (_nodeCount + 1);
+  }
+
+  uint16_t timeoutCount() const
+  {
+    return _timeoutCount;
+  }
+
+private:
+  struct PendingCommand
+  {
+    uint8_t _nodeIndex{0};
+    LinkCommand _command{};
+  };
+
+  void receive(unsigned long nowMillis);
+
+  void sendNext(unsigned long nowMillis);
+
+  void send(LinkFrame &frame, unsigned long nowMillis);
+
+  void timeout();
+
+  LinkPort &_port;
+  LinkParser _parser{};
+  SpscQueue<PendingCommand, COMMAND_QUEUE_SIZE> _commandQueue{};
+
+  uint8_t _nodeCount{0};
+  LinkNodeState _nodeStates[LinkConst::NODE_MAX]{};
+  unsigned long _updateMillis[LinkConst::NODE_MAX]{};
+  uint8_t _missCounts[LinkConst::NODE_MAX]{};
+  bool _validFlags[LinkConst::NODE_MAX]{};
+
+  bool _waitingFlag{false};
+  LinkType _waitingType{LinkType::Max};
+  uint8_t _waitingAddress{0};
+  uint8_t _waitingSeq{0};
+  unsigned long _sendMillis{0};
+
+  uint8_t _seq{0};
+  uint8_t _pollIndex{0};
+  unsigned long _cycleMillis{0};
+  bool _enumerateFlag{true};
+  unsigned long _enumerateMillis{0};
+  uint16_t _timeoutCount{0};
+};
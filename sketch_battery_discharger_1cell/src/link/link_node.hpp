@@ -0,0 +1,77 @@
+#pragma once
+
+#include "link_frame.hpp"
+
+// リンクのノード側。列挙でアドレスをもらい、自分宛ての要求に応答し、それ以外は次へ送る
+class LinkNode
+{
+public:
+  static constexpr uint8_t READ_BYTES_PER_UPDATE{64}; // 1回の update で読む最大バイト数
+
+  explicit LinkNode(LinkPort &port)
+      : _port{port} {}
+
+  void reset()
+  {
+    _address = 0;
+    _parser.reset();
+  }
+
+  // 0 はまだ列挙されていない
+  uint8_t address() const
+  {
+    return _address;
+  }
+
+  // fillState(LinkNodeState&) で自分の状態を詰め、applyCommand(const LinkCommand&) で操作を反映する
+  template <typename StateFunc, typename CommandFunc>
+  void update(StateFunc &&fillState, CommandFunc &&applyCommand)
+  {
+    LinkFrame frame{};
+    for (uint8_t readCount{0}; readCount < READ_BYTES_PER_UPDATE; ++readCount)
+    {
+      const int value{_port.read()};
+      if (value < 0)
+      {
+        break;
+      }
+      if (!_parser.feed(static_cast<uint8_t>(value), frame))
+      {
+        continue;
+      }
+
+      if (frame._type == LinkType::Enumerate && frame._dst == LinkConst::BROADCAST_ADDRESS && frame._length > 0)
+      {
+        _address = frame._payload[0];
+        frame._payload[0] = static_cast<uint8_t>(_address + 1);
+        _port.writeFrame(frame);
+      }
+      else if (_address != 0 && frame._dst == _address && (frame._type == LinkType::Poll || frame._type == LinkType::Command))
+      {
+        LinkCommand command{};
+        if (LinkCodec::unpackCommand(frame, command))
+        {
+          applyCommand(command);
+        }
+
+        LinkNodeState state{};
+        fillState(state);
+        LinkFrame reply{};
+        reply._dst = LinkConst::MASTER_ADDRESS;
+        reply._src = _address;
+        reply._seq = frame._seq;
+        LinkCodec::packState(state, reply);
+        _port.writeFrame(reply);
+      }
+      else
+      {
+        _port.writeFrame(frame);
+      }
+    }
+  }
+
+private:
+  LinkPort &_port;
+  LinkParser _parser{};
+  uint8_t _address{0};
+};
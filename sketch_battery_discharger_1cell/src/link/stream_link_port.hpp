@@ -0,0 +1,26 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "link_frame.hpp"
+
+// Arduino の Stream（Serial1 など）をリンクの送受信先にする
+class StreamLinkPort : public LinkPort
+{
+public:
+  explicit StreamLinkPort(Stream &stream)
+      : _stream{stream} {}
+
+  int read() override
+  {
+    return _stream.read();
+  }
+
+  void write(const uint8_t *data, size_t length) override
+  {
+    _stream.write(data, length);
+  }
+
+private:
+  Stream &_stream;
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+
+// 8bit の analogWrite を1次ΔΣ変調で切り替えて、平均で 1/256 LSB 単位の duty を出す
+// duty は下位 FRACTION_BITS ビットが小数部の固定小数点
+// 値は PWM の1周期に1回だけ進める。loop が遅れて何周期も同じ値を出した場合は、その周期数分の誤差を積算する
+class DitheredPwm
+{
+public:
+  static constexpr uint8_t FRACTION_BITS{8};
+  static constexpr int32_t FRACTION_MASK{(1 << FRACTION_BITS) - 1};
+  static constexpr int32_t MAX_VALUE{0xFF};
+  static constexpr int32_t MAX_DUTY{MAX_VALUE << FRACTION_BITS};
+  // 積算する誤差の上限（64 LSB x 周期）。長く止まった後に古い誤差を引きずらないようにする
+  static constexpr int32_t MAX_ERROR{64 << FRACTION_BITS};
+
+  explicit DitheredPwm(unsigned long periodMicros)
+      : _periodMicros{std::max(periodMicros, 1UL)} {}
+
+  void setDuty(int32_t duty)
+  {
+    _duty = std::clamp(duty, static_cast<int32_t>(0), MAX_DUTY);
+  }
+
+  int32_t duty() const
+  {
+    return _duty;
+  }
+
+  // 経過した PWM 周期の数だけ、出していた値と duty の差を積算する
+  // 戻り値は新しい周期が始まったかどうか
+  bool advance(unsigned long nowMicros)
+  {
+    const unsigned long periods{(nowMicros - _periodStartMicros) / _periodMicros};
+    if (periods == 0)
+    {
+      return false;
+    }
+    _periodStartMicros += periods * _periodMicros;
+
+    const int64_t error{static_cast<int64_t>(periods) * (_duty - (static_cast<int32_t>(_lastValue) << FRACTION_BITS))};
+    _error = static_cast<int32_t>(std::clamp<int64_t>(_error + error, -MAX_ERROR, MAX_ERROR));
+    return true;
+  }
+
+  // 次の周期に出力する 8bit 値。積算した誤差と小数部の和が 1 を超えたら1段上を出す
+  uint8_t nextValue() const
+  {
+    const int32_t integerValue{_duty >> FRACTION_BITS};
+    if (_error + (_duty & FRACTION_MASK) > FRACTION_MASK)
+    {
+      return static_cast<uint8_t>(std::min(integerValue + 1, MAX_VALUE));
+    }
+    return static_cast<uint8_t>(integerValue);
+  }
+
+  // loopMain から毎回呼ぶ。新しい周期に入った場合のみ値を進め、前回と値が変わった場合のみ書き込む
+  template <typename WriteFunc>
+  void update(unsigned long nowMicros, WriteFunc &&writeFunc)
+  {
+    if (_lastValue < 0)
+    {
+      // reset() 後の最初の書き込みで周期の起点を決める
+      _periodStartMicros = nowMicros;
+    }
+    else if (!advance(nowMicros))
+    {
+      return;
+    }
+
+    const uint8_t value{nextValue()};
+    if (value != _lastValue)
+    {
+      writeFunc(value);
+      _lastValue = value;
+    }
+  }
+
+  // ピンを直接書き換えた後は、次の update() で必ず書き込むようにする
+  void reset()
+  {
+    _duty = 0;
+    _error = 0;
+    _lastValue = -1;
+  }
+
+private:
+  unsigned long _periodMicros;
+  unsigned long _periodStartMicros{0};
+  int32_t _duty{0};
+  int32_t _error{0}; // duty と出力した値の差の積算（1/256 LSB x 周期）
+  int16_t _lastValue{-1};
+};
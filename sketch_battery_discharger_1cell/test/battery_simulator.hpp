@@ -0,0 +1,118 @@
+#pragma once
+
+// スロット毎の電池の簡単なモデル。PWM の出力値から電流を求め、端子電圧を ADC の値にして読ませる
+// 開放電圧は残量に比例（emptyV - fullV）、端子電圧は 開放電圧 - 電流 x 内部抵抗
+
+#include "controller_harness.hpp"
+
+class BatterySimulator
+{
+public:
+  static constexpr uint8_t SLOT_COUNT{SaveConfigData::CHANNEL_SIZE};
+  static constexpr unsigned long STEP_MICROS{500};
+
+  struct Cell
+  {
+    bool presentFlag{false};
+    float fullV{1.40f};
+    float emptyV{1.05f};
+    float ohm{0.08f};
+    float capacityMilliAmpereHour{2000.f};
+    float usedMilliAmpereHour{0.f};
+    float i{0.f};
+  };
+
+  explicit BatterySimulator(BatteryController &controller)
+      : _controller{controller}
+  {
+  }
+
+  Cell &cell(uint8_t slot)
+  {
+    return _cells[slot];
+  }
+
+  // PWM の出力値 1 あたりの電流（電流テーブルが無い場合の calcDuty は電流に比例する）
+  float ampereFromValue(int value, uint8_t slot) const
+  {
+    const BatteryInfo &batteryStatus{_controller._batteryStatuses[slot]};
+    const float dutyPerAmpere{static_cast<float>(BatteryInfo::calcDuty(1.f, 1.f, _controller._calibI, _controller._currentTables[batteryStatus._batteryIndex]))};
+    return static_cast<float>(value << DitheredPwm::FRACTION_BITS) / dutyPerAmpere;
+  }
+
+  float terminalVolt(uint8_t slot) const
+  {
+    const Cell &target{_cells[slot]};
+    if (!target.presentFlag)
+    {
+      return 0.f;
+    }
+    const float remainRate{std::max(0.f, 1.f - target.usedMilliAmpereHour / target.capacityMilliAmpereHour)};
+    const float openV{target.emptyV + (target.fullV - target.emptyV) * remainRate - (remainRate > 0.f ? 0.f : 0.2f)};
+    return std::max(0.f, openV - target.i * target.ohm);
+  }
+
+  // loopWhile を1回呼び、STEP_MICROS 進める
+  void step()
+  {
+    for (uint8_t slot{0}; slot < SLOT_COUNT; ++slot)
+    {
+      Cell &target{_cells[slot]};
+      const BatteryInfo &batteryStatus{_controller._batteryStatuses[slot]};
+      target.i = target.presentFlag ? ampereFromValue(stub_pin::writtenValues()[batteryStatus._writePin & 31], slot) : 0.f;
+      target.usedMilliAmpereHour += target.i * (STEP_MICROS / 3600000.f);
+      stub_pin::analogValues()[batteryStatus._readPin & 31] = countFromVolt(terminalVolt(slot), batteryStatus._batteryIndex);
+    }
+    _controller.loopWhile();
+    stub_time::advanceMicros(STEP_MICROS);
+  }
+
+  void run(unsigned long millisValue)
+  {
+    const unsigned long stepCount{millisValue * 1000UL / STEP_MICROS};
+    for (unsigned long count{0}; count < stepCount; ++count)
+    {
+      step();
+    }
+  }
+
+  // 条件を満たすか、最大 millisValue まで進める
+  template <typename Predicate>
+  bool runUntil(unsigned long millisValue, Predicate predicate)
+  {
+    const unsigned long stepCount{millisValue * 1000UL / STEP_MICROS};
+    for (unsigned long count{0}; count < stepCount; ++count)
+    {
+      if (predicate())
+      {
+        return true;
+      }
+      step();
+    }
+    return predicate();
+  }
+
+private:
+  // 電圧変換（VoltageMapping）の逆。volt 以上になる最小の ADC の値
+  int countFromVolt(float volt, uint8_t channel) const
+  {
+    int low{0};
+    int high{4095};
+    while (low < high)
+    {
+      const int middle{(low + high) / 2};
+      if (_controller._voltageMapping.getCompensatedVoltage(middle, channel) < volt)
+      {
+        low = middle + 1;
+      }
+      else
+      {
+        high = middle;
+      }
+    }
+    return low;
+  }
+
+  BatteryController &_controller;
+  Cell _cells[SLOT_COUNT]{};
+};
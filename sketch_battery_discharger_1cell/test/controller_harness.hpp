@@ -0,0 +1,62 @@
+#pragma once
+
+// BatteryController 全体をホストで動かすテスト用の仕組み
+// 内部状態を確かめるため、private を public にして読み込む（標準ヘッダーは先に読み込んでおく）
+
+#include <Arduino.h>
+#include <Adafruit_SSD1306.h>
+#include <EEPROM.h>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <string>
+#include <vector>
+
+#define private public
+#include "battery_controller.hpp"
+#undef private
+
+namespace controller_harness
+{
+  constexpr unsigned long FRAME_MILLIS{34};
+
+  // loopSub が1回ずつ回るように時刻を進めながら loopWhile を呼ぶ
+  inline void runFrames(BatteryController &controller, uint16_t frameCount)
+  {
+    for (uint16_t frame{0}; frame < frameCount; ++frame)
+    {
+      stub_time::advance(FRAME_MILLIS);
+      controller.loopWhile();
+    }
+  }
+
+  // Serial にコマンドを流し込み、frameCount フレーム分の応答を返す
+  inline std::string runScript(BatteryController &controller, const std::string &script, uint16_t frameCount)
+  {
+    Serial._output.clear();
+    Serial.feed(script);
+    runFrames(controller, frameCount);
+    return Serial._output;
+  }
+
+  inline size_t countLines(const std::string &text, const std::string &prefix)
+  {
+    size_t count{0};
+    size_t position{0};
+    while (position < text.size())
+    {
+      const size_t end{std::min(text.find('\n', position), text.size())};
+      if (text.compare(position, prefix.size(), prefix) == 0)
+      {
+        ++count;
+      }
+      position = end + 1;
+    }
+    return count;
+  }
+
+  inline bool contains(const std::string &text, const std::string &part)
+  {
+    return text.find(part) != std::string::npos;
+  }
+}
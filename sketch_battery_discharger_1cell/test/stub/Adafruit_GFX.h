@@ -0,0 +1,67 @@
+#pragma once
+
+#include <Arduino.h>
+
+struct GFXfont
+{
+  int _unused{0};
+};
+
+// 描画の代わりに、表示した文字列を _text に記録する（テストで内容を確かめる）
+class Adafruit_GFX : public Print
+{
+public:
+  std::string _text{};
+
+  Adafruit_GFX(int16_t width, int16_t height) : _width{width}, _height{height} {}
+
+  size_t write(uint8_t value) override
+  {
+    _text += static_cast<char>(value);
+    return 1;
+  }
+  using Print::write;
+
+  void setCursor(int16_t x, int16_t y)
+  {
+    _cursorX = x;
+    _cursorY = y;
+    _text += '\n';
+  }
+
+  int16_t getCursorX() const { return _cursorX; }
+  int16_t getCursorY() const { return _cursorY; }
+  int16_t width() const { return _width; }
+  int16_t height() const { return _height; }
+
+  void setTextSize(uint8_t) {}
+  void setTextColor(uint16_t) {}
+  void setTextColor(uint16_t, uint16_t) {}
+  void setTextWrap(bool) {}
+  void setFont(const GFXfont * = nullptr) {}
+  void getTextBounds(const char *text, int16_t x, int16_t y, int16_t *x1, int16_t *y1, uint16_t *w, uint16_t *h)
+  {
+    *x1 = x;
+    *y1 = y;
+    *w = static_cast<uint16_t>(std::strlen(text) * 6);
+    *h = 8;
+  }
+  void getTextBounds(const String &text, int16_t x, int16_t y, int16_t *x1, int16_t *y1, uint16_t *w, uint16_t *h)
+  {
+    getTextBounds(text.c_str(), x, y, x1, y1, w, h);
+  }
+
+  void drawPixel(int16_t, int16_t, uint16_t) {}
+  void drawFastHLine(int16_t, int16_t, int16_t, uint16_t) {}
+  void drawFastVLine(int16_t, int16_t, int16_t, uint16_t) {}
+  void drawLine(int16_t, int16_t, int16_t, int16_t, uint16_t) {}
+  void drawRect(int16_t, int16_t, int16_t, int16_t, uint16_t) {}
+  void fillRect(int16_t, int16_t, int16_t, int16_t, uint16_t) {}
+  void drawBitmap(int16_t, int16_t, const uint8_t *, int16_t, int16_t, uint16_t) {}
+
+private:
+  int16_t _width;
+  int16_t _height;
+  int16_t _cursorX{0};
+  int16_t _cursorY{0};
+};
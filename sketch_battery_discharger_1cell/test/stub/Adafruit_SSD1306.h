@@ -0,0 +1,28 @@
+#pragma once
+
+#include <Wire.h>
+#include <Adafruit_GFX.h>
+
+#define BLACK 0
+#define WHITE 1
+#define INVERSE 2
+#define SSD1306_BLACK 0
+#define SSD1306_WHITE 1
+#define SSD1306_INVERSE 2
+#define SSD1306_SWITCHCAPVCC 0x02
+#define SSD1306_DISPLAYOFF 0xAE
+#define SSD1306_DISPLAYON 0xAF
+
+class Adafruit_SSD1306 : public Adafruit_GFX
+{
+  uint8_t _buffer[128 * 64 / 8]{};
+
+public:
+  Adafruit_SSD1306(uint8_t width, uint8_t height, TwoWire *, int8_t) : Adafruit_GFX{width, height} {}
+
+  bool begin(uint8_t = SSD1306_SWITCHCAPVCC, uint8_t = 0, bool = true, bool = true) { return true; }
+  void clearDisplay() { _text.clear(); }
+  void display() {}
+  void ssd1306_command(uint8_t) {}
+  uint8_t *getBuffer() { return _buffer; }
+};
@@ -0,0 +1,315 @@
+#pragma once
+
+// ホストでテストするための Arduino API の最小限の代用
+// 時刻はテストから進める（stub_time::set / advance）
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <algorithm>
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define CHANGE 3
+#define FALLING 4
+#define RISING 5
+#define F(text) (text)
+#define PROGMEM
+#define DEC 10
+#define HEX 16
+
+// XIAO MG24 のピン番号
+#define PA6 27
+#define PD3 28
+#define PD4 29
+#define D6 6
+#define D7 7
+#define D9 9
+#define D14 14
+#define LED_BUILTIN 30
+
+namespace stub_time
+{
+  inline unsigned long &microsRef()
+  {
+    static unsigned long value{0};
+    return value;
+  }
+
+  inline void set(unsigned long millisValue)
+  {
+    microsRef() = millisValue * 1000UL;
+  }
+
+  inline void setMicros(unsigned long microsValue)
+  {
+    microsRef() = microsValue;
+  }
+
+  inline void advance(unsigned long millisValue)
+  {
+    microsRef() += millisValue * 1000UL;
+  }
+
+  inline void advanceMicros(unsigned long microsValue)
+  {
+    microsRef() += microsValue;
+  }
+}
+
+namespace stub_pin
+{
+  inline int *levels()
+  {
+    static int values[32]{};
+    return values;
+  }
+
+  inline int *analogValues()
+  {
+    static int values[32]{};
+    return values;
+  }
+
+  inline int *writtenValues()
+  {
+    static int values[32]{};
+    return values;
+  }
+
+  // analogRead の回数（ピンを使っていないことを確かめる）
+  inline unsigned long *readCounts()
+  {
+    static unsigned long values[32]{};
+    return values;
+  }
+}
+
+inline unsigned long millis()
+{
+  return stub_time::microsRef() / 1000UL;
+}
+
+inline unsigned long micros()
+{
+  return stub_time::microsRef();
+}
+
+inline void delay(unsigned long ms)
+{
+  stub_time::advance(ms);
+}
+
+inline void delayMicroseconds(unsigned int us)
+{
+  stub_time::advanceMicros(us);
+}
+
+// プルアップした入力は、押していない状態（HIGH）から始める
+inline void pinMode(int pin, int mode)
+{
+  if (mode == INPUT_PULLUP)
+  {
+    stub_pin::levels()[pin & 31] = 1;
+  }
+}
+
+inline int digitalRead(int pin)
+{
+  return stub_pin::levels()[pin & 31];
+}
+
+inline void digitalWrite(int pin, int value)
+{
+  stub_pin::levels()[pin & 31] = value;
+}
+
+inline int analogRead(int pin)
+{
+  ++stub_pin::readCounts()[pin & 31];
+  return stub_pin::analogValues()[pin & 31];
+}
+
+inline void analogWrite(int pin, int value)
+{
+  stub_pin::writtenValues()[pin & 31] = value;
+}
+
+inline void analogReadResolution(int) {}
+inline void attachInterrupt(int, void (*)(), int) {}
+inline void detachInterrupt(int) {}
+inline int digitalPinToInterrupt(int pin) { return pin; }
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+typedef uint8_t byte;
+
+using std::max;
+using std::min;
+
+template <typename T>
+inline T constrain(T value, T low, T high)
+{
+  return value < low ? low : (high < value ? high : value);
+}
+
+inline long map(long x, long inMin, long inMax, long outMin, long outMax)
+{
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+class String
+{
+  std::string _value{};
+
+public:
+  String() = default;
+  String(const char *value) : _value{value ? value : ""} {}
+  String(const std::string &value) : _value{value} {}
+  String(char value) : _value(1, value) {}
+  String(int value, int base = DEC) : _value{fromLong(value, base)} {}
+  String(unsigned int value, int base = DEC) : _value{fromUnsigned(value, base)} {}
+  String(long value, int base = DEC) : _value{fromLong(value, base)} {}
+  String(unsigned long value, int base = DEC) : _value{fromUnsigned(value, base)} {}
+  String(float value, int decimals = 2) : _value{fromDouble(value, decimals)} {}
+  String(double value, int decimals = 2) : _value{fromDouble(value, decimals)} {}
+
+  void reserve(unsigned int size) { _value.reserve(size); }
+  bool startsWith(const String &prefix) const { return _value.compare(0, prefix._value.size(), prefix._value) == 0; }
+  const char *c_str() const { return _value.c_str(); }
+  unsigned int length() const { return static_cast<unsigned int>(_value.size()); }
+  char operator[](unsigned int index) const { return index < _value.size() ? _value[index] : '\0'; }
+  char charAt(unsigned int index) const { return (*this)[index]; }
+  String &operator+=(const String &rhs) { _value += rhs._value; return *this; }
+  String &operator+=(const char *rhs) { _value += rhs; return *this; }
+  String &operator+=(char rhs) { _value += rhs; return *this; }
+  bool operator==(const String &rhs) const { return _value == rhs._value; }
+  bool operator==(const char *rhs) const { return _value == rhs; }
+  bool operator!=(const String &rhs) const { return _value != rhs._value; }
+  int indexOf(char c, unsigned int from = 0) const
+  {
+    const size_t position{_value.find(c, from)};
+    return position == std::string::npos ? -1 : static_cast<int>(position);
+  }
+  String substring(unsigned int from) const { return from < _value.size() ? String{_value.substr(from)} : String{}; }
+  String substring(unsigned int from, unsigned int to) const { return from < _value.size() ? String{_value.substr(from, to - from)} : String{}; }
+  long toInt() const { return std::strtol(_value.c_str(), nullptr, 10); }
+  float toFloat() const { return std::strtof(_value.c_str(), nullptr); }
+  void trim()
+  {
+    const size_t first{_value.find_first_not_of(" \t\r\n")};
+    const size_t last{_value.find_last_not_of(" \t\r\n")};
+    _value = (first == std::string::npos) ? std::string{} : _value.substr(first, last - first + 1);
+  }
+  void toUpperCase()
+  {
+    for (char &c : _value)
+    {
+      c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    }
+  }
+  const std::string &str() const { return _value; }
+
+  friend String operator+(const String &lhs, const String &rhs) { return String{lhs._value + rhs._value}; }
+  friend String operator+(const String &lhs, const char *rhs) { return String{lhs._value + rhs}; }
+  friend String operator+(const char *lhs, const String &rhs) { return String{std::string{lhs} + rhs._value}; }
+
+private:
+  static std::string fromLong(long value, int base)
+  {
+    return (value < 0) ? "-" + fromUnsigned(static_cast<unsigned long>(-value), base) : fromUnsigned(static_cast<unsigned long>(value), base);
+  }
+
+  static std::string fromUnsigned(unsigned long value, int base)
+  {
+    char buffer[40]{};
+    std::snprintf(buffer, sizeof(buffer), base == HEX ? "%lX" : "%lu", value);
+    return buffer;
+  }
+
+  static std::string fromDouble(double value, int decimals)
+  {
+    char buffer[48]{};
+    std::snprintf(buffer, sizeof(buffer), "%.*f", decimals, value);
+    return buffer;
+  }
+};
+
+class Print
+{
+public:
+  virtual ~Print() = default;
+
+  virtual size_t write(uint8_t value) = 0;
+
+  virtual size_t write(const uint8_t *buffer, size_t size)
+  {
+    for (size_t index{0}; index < size; ++index)
+    {
+      write(buffer[index]);
+    }
+    return size;
+  }
+
+  size_t print(const String &value) { return write(reinterpret_cast<const uint8_t *>(value.c_str()), value.length()); }
+  size_t print(const char *value) { return print(String{value}); }
+  size_t print(char value) { return write(static_cast<uint8_t>(value)); }
+  size_t print(int value, int base = DEC) { return print(String{value, base}); }
+  size_t print(unsigned int value, int base = DEC) { return print(String{value, base}); }
+  size_t print(long value, int base = DEC) { return print(String{value, base}); }
+  size_t print(unsigned long value, int base = DEC) { return print(String{value, base}); }
+  size_t print(double value, int decimals = 2) { return print(String{value, decimals}); }
+
+  size_t println() { return print("\r\n"); }
+  template <typename T>
+  size_t println(const T &value) { return print(value) + println(); }
+  template <typename T>
+  size_t println(const T &value, int format) { return print(value, format) + println(); }
+};
+
+class Stream : public Print
+{
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() { return -1; }
+};
+
+// テストから受信データを入れ、送信データを取り出す Serial の代用
+class StubSerial : public Stream
+{
+  std::string _input{};
+  size_t _inputIndex{0};
+
+public:
+  std::string _output{};
+
+  void begin(unsigned long, int = 0) {}
+  void end() {}
+  explicit operator bool() const { return true; }
+
+  void feed(const std::string &text) { _input += text; }
+
+  int available() override { return static_cast<int>(_input.size() - _inputIndex); }
+
+  int read() override { return (_inputIndex < _input.size()) ? static_cast<uint8_t>(_input[_inputIndex++]) : -1; }
+
+  int peek() override { return (_inputIndex < _input.size()) ? static_cast<uint8_t>(_input[_inputIndex]) : -1; }
+
+  size_t write(uint8_t value) override
+  {
+    _output += static_cast<char>(value);
+    return 1;
+  }
+  using Print::write;
+
+  void flush() {}
+};
+
+extern StubSerial Serial;
+extern StubSerial Serial1;
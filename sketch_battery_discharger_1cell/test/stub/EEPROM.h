@@ -0,0 +1,50 @@
+#pragma once
+
+#include <Arduino.h>
+
+
+// EEPROM エミュレーションの代用。容量はテストから変えられる
+class EEPROMClass
+{
+  uint8_t _data[8192];
+  uint16_t _length{4096};
+
+public:
+  EEPROMClass()
+  {
+    std::memset(_data, 0xFF, sizeof(_data));
+  }
+
+  uint8_t read(int address) const
+  {
+    return (address >= 0 && address < _length) ? _data[address] : 0xFF;
+  }
+
+  void write(int address, uint8_t value)
+  {
+    if (address >= 0 && address < _length)
+    {
+      _data[address] = value;
+    }
+  }
+
+  void update(int address, uint8_t value)
+  {
+    write(address, value);
+  }
+
+  uint16_t length() const
+  {
+    return _length;
+  }
+
+  void setLength(uint16_t length)
+  {
+    _length = std::min<uint16_t>(length, sizeof(_data));
+  }
+
+  void begin(size_t = 0) {}
+  bool commit() { return true; }
+};
+
+extern EEPROMClass EEPROM;
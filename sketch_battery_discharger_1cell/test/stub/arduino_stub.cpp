@@ -0,0 +1,8 @@
+#include <Arduino.h>
+#include <Wire.h>
+#include <EEPROM.h>
+
+StubSerial Serial{};
+StubSerial Serial1{};
+TwoWire Wire{};
+EEPROMClass EEPROM{};
@@ -0,0 +1,6 @@
+#pragma once
+
+// 画面用フォント（リポジトリに含まれない）の代わり
+#include <Adafruit_GFX.h>
+
+const GFXfont BBHBogle_Regular9pt7b{};
@@ -0,0 +1,162 @@
+// AdcStatistics の平均、標準偏差、Allan 偏差を、double で全ての点から計算した値と比べる
+// 白色雑音では Allan 偏差が 1/sqrt(点数) で下がり、一定の傾き（ドリフト）では点数に比例して上がる
+
+#include <random>
+#include <vector>
+
+#include "src/adc/adc_statistics.hpp"
+#include "test_util.hpp"
+
+namespace
+{
+  struct Reference
+  {
+    double _mean{0.0};
+    double _deviation{0.0};
+  };
+
+  Reference referenceOf(const std::vector<int> &values)
+  {
+    Reference reference{};
+    for (int value : values)
+    {
+      reference._mean += value;
+    }
+    reference._mean /= values.size();
+    double sumSquare{0.0};
+    for (int value : values)
+    {
+      sumSquare += (value - reference._mean) * (value - reference._mean);
+    }
+    reference._deviation = std::sqrt(sumSquare / (values.size() - 1));
+    return reference;
+  }
+
+  // 重ならない windowSamples 点毎の平均で、隣り合う平均の差の2乗平均 / 2 の平方根
+  double referenceAllan(const std::vector<int> &values, size_t windowSamples)
+  {
+    std::vector<double> means{};
+    for (size_t begin{0}; begin + windowSamples <= values.size(); begin += windowSamples)
+    {
+      double sum{0.0};
+      for (size_t index{begin}; index < begin + windowSamples; ++index)
+      {
+        sum += values[index];
+      }
+      means.push_back(sum / windowSamples);
+    }
+    if (means.size() < 2)
+    {
+      return -1.0;
+    }
+    double sumSquare{0.0};
+    for (size_t index{1}; index < means.size(); ++index)
+    {
+      sumSquare += (means[index] - means[index - 1]) * (means[index] - means[index - 1]);
+    }
+    return std::sqrt(sumSquare / (2.0 * (means.size() - 1)));
+  }
+
+  void addAll(AdcStatistics &statistics, const std::vector<int> &values)
+  {
+    for (int value : values)
+    {
+      statistics.add(value);
+    }
+  }
+
+  void testSmallSet()
+  {
+    AdcStatistics statistics{};
+    CHECK(statistics.count() == 0);
+    CHECK(statistics.deviation() == 0.f);
+    CHECK(statistics.allanDeviation(0) < 0.f);
+
+    addAll(statistics, {2, 4, 4, 4, 5, 5, 7, 9});
+    CHECK(statistics.count() == 8);
+    CHECK_NEAR(statistics.mean(), 5.0, 1e-6);
+    CHECK_NEAR(statistics.deviation(), std::sqrt(32.0 / 7.0), 1e-5);
+    CHECK(statistics.minValue() == 2 && statistics.maxValue() == 9);
+    // 16 点に満たないので Allan 偏差はまだない
+    CHECK(statistics.allanDeviation(0) < 0.f);
+
+    statistics.reset();
+    CHECK(statistics.count() == 0);
+    statistics.add(3000);
+    CHECK_NEAR(statistics.mean(), 3000.0, 1e-6);
+    CHECK(statistics.deviation() == 0.f);
+  }
+
+  // 12bit の ADC 値付近（大きな平均に小さなばらつき）で、float でも桁落ちしない
+  void testNoiseMatchesReference()
+  {
+    std::mt19937 random{38};
+    std::normal_distribution<double> noise{0.0, 3.0};
+    std::vector<int> values{};
+    for (uint32_t count{0}; count < 100000; ++count)
+    {
+      values.push_back(static_cast<int>(std::lround(3500.0 + noise(random))));
+    }
+
+    AdcStatistics statistics{};
+    addAll(statistics, values);
+    const Reference reference{referenceOf(values)};
+    CHECK(statistics.count() == values.size());
+    CHECK_NEAR(statistics.mean(), reference._mean, 1e-3);
+    CHECK_NEAR(statistics.deviation(), reference._deviation, reference._deviation * 1e-3);
+    CHECK(statistics.minValue() == *std::min_element(values.begin(), values.end()));
+    CHECK(statistics.maxValue() == *std::max_element(values.begin(), values.end()));
+
+    for (uint8_t index{0}; index < AdcStatistics::WINDOW_COUNT; ++index)
+    {
+      const double expected{referenceAllan(values, AdcStatistics::WINDOW_SAMPLES[index])};
+      CHECK_NEAR(statistics.allanDeviation(index), expected, expected * 1e-3);
+    }
+
+    // 白色雑音では sigma / sqrt(点数)。窓の数が多い 16, 256 点で確かめる
+    CHECK_NEAR(statistics.allanDeviation(0), reference._deviation / 4.0, reference._deviation / 4.0 * 0.05);
+    CHECK_NEAR(statistics.allanDeviation(1), reference._deviation / 16.0, reference._deviation / 16.0 * 0.15);
+  }
+
+  // 1点毎に 1 ずつ上がるドリフトでは、隣り合う窓の平均の差は窓の点数と同じ（Allan 偏差 = N / sqrt(2)）
+  void testDriftGrowsWithWindow()
+  {
+    std::vector<int> values{};
+    for (int count{0}; count < 3 * 4096; ++count)
+    {
+      values.push_back(1000 + count);
+    }
+    AdcStatistics statistics{};
+    addAll(statistics, values);
+    for (uint8_t index{0}; index < AdcStatistics::WINDOW_COUNT; ++index)
+    {
+      const double expected{AdcStatistics::WINDOW_SAMPLES[index] / std::sqrt(2.0)};
+      CHECK_NEAR(statistics.allanDeviation(index), expected, expected * 1e-4);
+      CHECK_NEAR(statistics.allanDeviation(index), referenceAllan(values, AdcStatistics::WINDOW_SAMPLES[index]), expected * 1e-4);
+    }
+    CHECK_NEAR(statistics.mean(), 1000.0 + (values.size() - 1) / 2.0, 1e-2);
+  }
+
+  // 4096 点の窓は2窓目が完結するまで負（差が1つもない）
+  void testAllanNeedsTwoWindows()
+  {
+    AdcStatistics statistics{};
+    for (int count{0}; count < 2 * 4096 - 1; ++count)
+    {
+      statistics.add(count % 2);
+    }
+    CHECK(statistics.allanDeviation(1) >= 0.f);
+    CHECK(statistics.allanDeviation(2) < 0.f);
+    statistics.add(1);
+    CHECK_NEAR(statistics.allanDeviation(2), 0.0, 1e-6);
+  }
+}
+
+int main()
+{
+  testSmallSet();
+  testNoiseMatchesReference();
+  testDriftGrowsWithWindow();
+  testAllanNeedsTwoWindows();
+  return test_util::finish("test_adc_statistics");
+}
@@ -0,0 +1,140 @@
+// ButtonStatus のエッジ分類（チャタリング除去、長押し、同時押し）を合成したエッジ列で確かめる
+
+#include <Arduino.h>
+#include <limits>
+
+#include "button_status.hpp"
+#include "test_util.hpp"
+
+namespace
+{
+  struct Edge
+  {
+    unsigned long _millis;
+    bool _pushFlag;
+  };
+
+  template <size_t SIZE>
+  void feed(ButtonStatus &status, const Edge (&edges)[SIZE])
+  {
+    for (const Edge &edge : edges)
+    {
+      status.addEdge(edge._pushFlag, edge._millis);
+    }
+  }
+
+  ButtonStatus makeButton(unsigned long bootMillis)
+  {
+    stub_time::set(bootMillis);
+    ButtonStatus status{};
+    status.init(0);
+    return status;
+  }
+
+  void testFirstPressAfterBoot()
+  {
+    ButtonStatus status{makeButton(3)};
+    status.addEdge(true, 5);
+    status.updateType(6);
+    CHECK(status.getVal() == PushType::Pushed);
+    status.addEdge(false, 80);
+    status.updateType(81);
+    CHECK(status.getVal() == PushType::ReleaseShort);
+  }
+
+  void testDebounce()
+  {
+    ButtonStatus status{makeButton(0)};
+    feed(status, {{100, true}, {102, false}, {104, true}, {107, false}, {110, true}});
+    status.updateType(111);
+    CHECK(status.getVal() == PushType::Pushed);
+    status.updateType(200);
+    CHECK(status.getVal() == PushType::PushShort);
+
+    feed(status, {{300, false}, {302, true}, {305, false}});
+    status.updateType(306);
+    CHECK(status.getVal() == PushType::ReleaseShort);
+    status.updateType(330);
+    CHECK(status.getVal() == PushType::None);
+
+    // 除去期間中に本当に離された場合は、期間の終わりで離したことにする
+    feed(status, {{400, true}, {405, false}});
+    status.updateType(410);
+    CHECK(status.getVal() == PushType::Pushed);
+    status.updateType(415);
+    CHECK(status.getVal() == PushType::PushShort);
+    status.updateType(421);
+    CHECK(status.getVal() == PushType::ReleaseShort);
+    status.updateType(422);
+    CHECK(status.getVal() == PushType::None);
+  }
+
+  void testLongPress()
+  {
+    ButtonStatus status{makeButton(0)};
+    status.addEdge(true, 1000);
+    status.updateType(1000);
+    CHECK(status.getVal() == PushType::Pushed);
+    status.updateType(1999);
+    CHECK(status.getVal() == PushType::PushShort);
+    status.updateType(2000);
+    CHECK(status.getVal() == PushType::PushLong);
+    status.addEdge(false, 2500);
+    status.updateType(2500);
+    CHECK(status.getVal() == PushType::ReleaseLong);
+
+    // 1フレームの間に押して離しても、両方のエッジを順に返す
+    feed(status, {{3000, true}, {3100, false}});
+    status.updateType(3101);
+    CHECK(status.getVal() == PushType::Pushed);
+    status.updateType(3102);
+    CHECK(status.getVal() == PushType::ReleaseShort);
+  }
+
+  void testChord()
+  {
+    ButtonStatus up{makeButton(0)};
+    ButtonStatus down{makeButton(0)};
+    up.addEdge(true, 100);
+    up.updateType(100);
+    down.updateType(100);
+    CHECK(!ButtonStatus::isChordPushing(up, down));
+
+    down.addEdge(true, 130);
+    up.updateType(130);
+    down.updateType(130);
+    CHECK(ButtonStatus::isChordPushing(up, down));
+    up.updateType(1500);
+    down.updateType(1500);
+    CHECK(up.getVal() == PushType::PushLong);
+    CHECK(ButtonStatus::isChordPushing(up, down));
+
+    up.addEdge(false, 1600);
+    up.updateType(1600);
+    down.updateType(1600);
+    CHECK(!ButtonStatus::isChordPushing(up, down));
+  }
+
+  void testMillisWrap()
+  {
+    const unsigned long nearMax{std::numeric_limits<unsigned long>::max() - 50};
+    ButtonStatus status{};
+    status._stableMillis = nearMax - ButtonStatus::DEBOUNCE_MILLIS;
+    status.addEdge(true, nearMax + 10);
+    status.updateType(nearMax + 11);
+    CHECK(status.getVal() == PushType::Pushed);
+    status.addEdge(false, nearMax + 300);
+    status.updateType(nearMax + 301);
+    CHECK(status.getVal() == PushType::ReleaseShort);
+  }
+}
+
+int main()
+{
+  testFirstPressAfterBoot();
+  testDebounce();
+  testLongPress();
+  testChord();
+  testMillisWrap();
+  return test_util::finish("test_button_status");
+}
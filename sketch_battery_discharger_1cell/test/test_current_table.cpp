@@ -0,0 +1,142 @@
+// 電流テーブルの検証（0mA が続く点、減る点）と補間、校正手順でのエラー表示を確かめる
+
+#include <Arduino.h>
+#include <Adafruit_SSD1306.h>
+
+#include "current_table.hpp"
+#include "current_calibration.hpp"
+#include "test_util.hpp"
+
+Adafruit_SSD1306 oledDisplay{128, 64, &Wire, -1};
+
+namespace
+{
+  constexpr uint8_t PWM_VALUES[CurrentTable::POINT_SIZE]{10, 20, 30, 40, 60, 80, 120, 200};
+
+  CurrentTable makeTable(const uint16_t (&milliAmperes)[CurrentTable::POINT_SIZE])
+  {
+    CurrentTable table{};
+    for (uint8_t i{0}; i < CurrentTable::POINT_SIZE; ++i)
+    {
+      table.setPoint(i, PWM_VALUES[i], milliAmperes[i]);
+    }
+    return table;
+  }
+
+  double dutyToPwm(int32_t duty)
+  {
+    return static_cast<double>(duty) / (1 << CurrentTable::DUTY_FRACTION_BITS);
+  }
+
+  void testIncreasing()
+  {
+    CurrentTable table{makeTable({100, 200, 300, 400, 600, 800, 1200, 2000})};
+    CHECK(table.findInvalidPoint() < 0);
+    CHECK(table.validate());
+    CHECK(table.lookupDuty(0) == 0);
+    CHECK_NEAR(dutyToPwm(table.lookupDuty(150)), 15.0, 0.01);
+    CHECK_NEAR(dutyToPwm(table.lookupDuty(1600)), 160.0, 0.01);
+    // 範囲外は両端の区間を延長する
+    CHECK_NEAR(dutyToPwm(table.lookupDuty(50)), 5.0, 0.01);
+    CHECK_NEAR(dutyToPwm(table.lookupDuty(2100)), 210.0, 0.01);
+    CHECK(table.lookupDuty(5000) == CurrentTable::MAX_DUTY);
+  }
+
+  void testZeroBelowThreshold()
+  {
+    // ゲートしきい値以下では電流が流れない。最後の 0mA の点から補間する
+    CurrentTable table{makeTable({0, 0, 0, 120, 300, 500, 900, 1700})};
+    CHECK(table.findInvalidPoint() < 0);
+    CHECK(table.validate());
+    CHECK(table.lookupDuty(0) == 0);
+    CHECK_NEAR(dutyToPwm(table.lookupDuty(60)), 35.0, 0.01);
+    CHECK_NEAR(dutyToPwm(table.lookupDuty(120)), 40.0, 0.01);
+    CHECK_NEAR(dutyToPwm(table.lookupDuty(1300)), 160.0, 0.01);
+  }
+
+  void testPlateau()
+  {
+    // 電流が変わらない点があっても割り算しない。最後が平らなら手前の区間を延長する
+    CurrentTable middle{makeTable({100, 200, 300, 300, 600, 800, 1200, 2000})};
+    CHECK(middle.validate());
+    CHECK_NEAR(dutyToPwm(middle.lookupDuty(300)), 30.0, 0.01);
+    CHECK_NEAR(dutyToPwm(middle.lookupDuty(450)), 50.0, 0.01);
+
+    CurrentTable leading{makeTable({100, 100, 300, 400, 600, 800, 1200, 2000})};
+    CHECK(leading.validate());
+    CHECK_NEAR(dutyToPwm(leading.lookupDuty(200)), 25.0, 0.01);
+
+    CurrentTable trailing{makeTable({100, 200, 300, 400, 600, 800, 1200, 1200})};
+    CHECK(trailing.validate());
+    CHECK_NEAR(dutyToPwm(trailing.lookupDuty(1400)), 140.0, 0.01);
+  }
+
+  void testInvalid()
+  {
+    CHECK(makeTable({100, 200, 300, 250, 600, 800, 1200, 2000}).findInvalidPoint() == 3);
+    CurrentTable decreasing{makeTable({100, 200, 300, 250, 600, 800, 1200, 2000})};
+    CHECK(!decreasing.validate());
+
+    CHECK(makeTable({0, 0, 0, 0, 0, 0, 0, 0}).findInvalidPoint() == CurrentTable::POINT_SIZE - 1);
+
+    CurrentTable pwm{makeTable({100, 200, 300, 400, 600, 800, 1200, 2000})};
+    pwm._pwmValues[5] = pwm._pwmValues[4];
+    CHECK(pwm.findInvalidPoint() == 5);
+  }
+
+  void feedChannel(CurrentCalibration &calibration, const uint16_t (&milliAmperes)[CurrentTable::POINT_SIZE])
+  {
+    for (const uint16_t milliAmpere : milliAmperes)
+    {
+      Serial.feed(String(milliAmpere / 1000.f, 3).str() + "\n");
+      calibration.readSerial(Serial);
+    }
+  }
+
+  void testCalibrationError()
+  {
+    CurrentCalibration calibration{};
+    calibration.start();
+
+    // 0mA が続くチャンネルは校正できる
+    feedChannel(calibration, {0, 0, 90, 210, 400, 600, 1000, 1800});
+    CHECK(calibration.channel() == 1);
+
+    // 減った点があるとそのチャンネルに留まり、どの点かを表示する
+    feedChannel(calibration, {100, 200, 320, 310, 600, 800, 1200, 2000});
+    CHECK(calibration.channel() == 1);
+    oledDisplay.clearDisplay();
+    calibration.setDisplay(oledDisplay);
+    CHECK(oledDisplay._text.find("Error P4 310mA") != std::string::npos);
+    CHECK(oledDisplay._text.find("Slot 2 o x - -") != std::string::npos);
+    CHECK(oledDisplay._text.find("A:Retry") != std::string::npos);
+
+    // A でやり直す
+    calibration.confirm();
+    CHECK(calibration.channel() == 1);
+    CHECK(calibration.currentPWMValue() > 0);
+    oledDisplay.clearDisplay();
+    calibration.setDisplay(oledDisplay);
+    CHECK(oledDisplay._text.find("Step 1/8") != std::string::npos);
+    CHECK(oledDisplay._text.find("A:Next") != std::string::npos);
+
+    feedChannel(calibration, {100, 200, 300, 400, 600, 800, 1200, 2000});
+    CHECK(calibration.channel() == 2);
+
+    CurrentTable tables[CurrentCalibration::CHANNEL_SIZE]{};
+    CHECK(calibration.apply(tables));
+    CHECK(tables[0].isValid() && tables[1].isValid());
+    CHECK(!tables[2].isValid() && !tables[3].isValid());
+    CHECK(tables[0]._milliAmperes[2] == 90);
+  }
+}
+
+int main()
+{
+  testIncreasing();
+  testZeroBelowThreshold();
+  testPlateau();
+  testInvalid();
+  testCalibrationError();
+  return test_util::finish("test_current_table");
+}
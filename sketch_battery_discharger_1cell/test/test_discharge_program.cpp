@@ -0,0 +1,186 @@
+// 放電プログラムのテスト
+// ProgramRunner / PulseResistance の単体と、BatterySimulator の電池で PulseIR・Cond を実行した結果
+
+#include "battery_simulator.hpp"
+#include "test_util.hpp"
+
+Adafruit_SSD1306 oledDisplay{128, 64, &Wire, -1};
+
+namespace
+{
+  void testRunnerSteps()
+  {
+    ProgramRunner runner{};
+    runner.start(&DischargePrograms::CONDITIONING, 0);
+
+    ProgramSetpoint setpoint{runner.update(100, false)};
+    CHECK(setpoint._action == ProgramAction::Taper);
+    CHECK_NEAR(setpoint._targetV, 1.0, 1e-6);
+    CHECK_NEAR(setpoint._targetI, 1.0, 1e-6);
+
+    // 目標電圧に達したら休止へ。休止は10分
+    setpoint = runner.update(5000, true);
+    CHECK(setpoint._action == ProgramAction::Off && runner.stepIndex() == 1);
+    setpoint = runner.update(5000 + 10UL * 60UL * 1000UL - 1, false);
+    CHECK(setpoint._action == ProgramAction::Off && runner.stepIndex() == 1);
+    setpoint = runner.update(5000 + 10UL * 60UL * 1000UL, false);
+    CHECK(setpoint._action == ProgramAction::Taper && runner.stepIndex() == 2);
+    CHECK_NEAR(setpoint._targetI, 0.4, 1e-6);
+
+    setpoint = runner.update(700000, true);
+    CHECK(setpoint._action == ProgramAction::Finished);
+  }
+
+  void testRunnerPulseLoop()
+  {
+    ProgramRunner runner{};
+    runner.start(&DischargePrograms::PULSE_IR, 0);
+    uint8_t pulseCount{0};
+    bool lastOnFlag{false};
+    unsigned long onMillis{0};
+    unsigned long nowMillis{0};
+    for (; nowMillis < 20000 && runner.stepIndex() < 2; nowMillis += 10)
+    {
+      const ProgramSetpoint setpoint{runner.update(nowMillis, false)};
+      const bool onFlag{setpoint._action == ProgramAction::Constant};
+      if (onFlag)
+      {
+        CHECK_NEAR(setpoint._targetI, 1.0, 1e-6);
+        onMillis += 10;
+      }
+      if (onFlag && !lastOnFlag)
+      {
+        ++pulseCount;
+      }
+      lastOnFlag = onFlag;
+    }
+    CHECK(pulseCount == 10);
+    CHECK(onMillis == 10 * 100);
+    CHECK(nowMillis >= 10000 && nowMillis <= 10020);
+  }
+
+  void testPulseResistance()
+  {
+    PulseResistance pulseResistance{};
+    pulseResistance.reset();
+
+    // 休止 1.30V -> 1A パルス（最後のフレームが 1.22V）-> 休止
+    const float volts[]{1.30f, 1.30f, 1.25f, 1.23f, 1.22f, 1.28f, 1.29f, 1.18f, 1.30f, 1.20f};
+    const float nextIs[]{0.f, 1.f, 1.f, 1.f, 0.f, 0.f, 0.5f, 0.f, 0.f, -1.f};
+    for (uint8_t index{0}; index < 10; ++index)
+    {
+      pulseResistance.add(volts[index], nextIs[index]);
+    }
+    CHECK(pulseResistance.count() == 2);
+    // (1.30 - 1.22) / 1A = 80mΩ、(1.29 - 1.18) / 0.5A = 220mΩ
+    CHECK_NEAR(pulseResistance.milliOhm(), (80.0 + 220.0) / 2.0, 0.01);
+    CHECK(!pulseResistance.isMeasuring());
+
+    // 直前の休止が無いパルス（プログラムの最初、絞り放電の直後）は数えない
+    pulseResistance.reset();
+    pulseResistance.add(1.3f, 1.f);
+    pulseResistance.add(1.2f, 0.f);
+    CHECK(pulseResistance.count() == 0);
+    pulseResistance.add(1.3f, -1.f);
+    pulseResistance.add(1.25f, 1.f);
+    pulseResistance.add(1.2f, 0.f);
+    CHECK(pulseResistance.count() == 0);
+  }
+
+  void startProgram(BatteryController &controller, BatterySimulator &simulator, uint8_t slot, ProgramType programType)
+  {
+    char script[64]{};
+    snprintf(script, sizeof(script), "SET %d PROG %d\nSTART %d\n", slot + 1, static_cast<int>(programType), slot + 1);
+    Serial.feed(script);
+    simulator.run(200);
+  }
+
+  void testPulseIrOnSimulator(BatteryController &controller, BatterySimulator &simulator)
+  {
+    constexpr uint8_t SLOT{0};
+    const BatteryInfo &batteryStatus{controller._batteryStatuses[SLOT]};
+    const float targetV{batteryStatus._targetV};
+    const float targetI{batteryStatus._targetI};
+    simulator.cell(SLOT).ohm = 0.12f;
+
+    startProgram(controller, simulator, SLOT, ProgramType::PulseIR);
+    CHECK(batteryStatus._activeFlag && batteryStatus._programType == ProgramType::PulseIR);
+
+    // 10パルスの間に最大 1A 程度が流れる
+    float maxI{0.f};
+    simulator.runUntil(15000, [&] {
+      maxI = std::max(maxI, simulator.cell(SLOT).i);
+      return batteryStatus.programStepIndex() >= 2;
+    });
+    CHECK_NEAR(maxI, 1.0, 0.05);
+    CHECK_NEAR(batteryStatus._ohm, 120.0, 120.0 * 0.1);
+
+    // 終了後の記録にも内部抵抗が残る
+    CHECK(simulator.runUntil(70000, [&] { return batteryStatus.programStepIndex() == DischargeProgram::STEP_MAX; }));
+    simulator.run(100);
+    RunRecord record{};
+    CHECK(controller._runRecordStore.findByAge(0, record));
+    CHECK(record._slot == SLOT && record._programType == static_cast<uint8_t>(ProgramType::PulseIR));
+    CHECK_NEAR(record._deciMilliOhm / 10.0, 120.0, 120.0 * 0.1);
+
+    // プログラムの電流は設定を書き換えない
+    CHECK_NEAR(batteryStatus._targetV, targetV, 1e-6);
+    CHECK_NEAR(batteryStatus._targetI, targetI, 1e-6);
+  }
+
+  void testConditioningKeepsSetting(BatteryController &controller, BatterySimulator &simulator)
+  {
+    constexpr uint8_t SLOT{2};
+    BatteryInfo &batteryStatus{controller._batteryStatuses[SLOT]};
+    BatterySimulator::Cell &cell{simulator.cell(SLOT)};
+    cell.capacityMilliAmpereHour = 15.f;
+    cell.ohm = 0.05f;
+
+    Serial.feed("SET 3 I 0.5\n");
+    startProgram(controller, simulator, SLOT, ProgramType::Conditioning);
+    const float targetV{batteryStatus._targetV};
+    const float targetI{batteryStatus._targetI};
+    CHECK_NEAR(targetI, 0.5, 1e-6);
+
+    // 1段目は 1A で 1.0V まで。設定の TargetI（0.5A）ではなくプログラムの電流が流れる
+    float maxI{0.f};
+    CHECK(simulator.runUntil(200000, [&] {
+      maxI = std::max(maxI, cell.i);
+      return batteryStatus.programStepIndex() == 1;
+    }));
+    CHECK(maxI > 0.9f);
+    CHECK(cell.usedMilliAmpereHour > cell.capacityMilliAmpereHour * 0.9f);
+    CHECK_NEAR(batteryStatus._targetV, targetV, 1e-6);
+    CHECK_NEAR(batteryStatus._targetI, targetI, 1e-6);
+
+    // 設定画面で保存しても、プログラムの電流は設定に入らない
+    controller.updateBatterySaveData();
+    CHECK_NEAR(batteryStatus._saveBattery->_targetI, targetI, 1e-6);
+    CHECK_NEAR(batteryStatus._targetI, targetI, 1e-6);
+  }
+}
+
+int main()
+{
+  testRunnerSteps();
+  testRunnerPulseLoop();
+  testPulseResistance();
+
+  BatteryController controller{};
+  controller.setup();
+  // プログラムの電流だけを確かめる（熱制限は別に確かめる）
+  controller._thermalLimitFlag = false;
+  BatterySimulator simulator{controller};
+  for (uint8_t slot{0}; slot < BatterySimulator::SLOT_COUNT; ++slot)
+  {
+    simulator.cell(slot).presentFlag = true;
+  }
+  simulator.run(500);
+
+  CHECK(!controller._currentTables[0].isValid());
+  CHECK_NEAR(controller._batteryStatuses[0]._sleepV, 1.40, 0.01);
+
+  testPulseIrOnSimulator(controller, simulator);
+  testConditioningKeepsSetting(controller, simulator);
+  return test_util::finish("test_discharge_program");
+}
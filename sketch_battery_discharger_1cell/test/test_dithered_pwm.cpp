@@ -0,0 +1,143 @@
+// DitheredPwm の平均出力の誤差を、PWM 周期の境目で値を取り込むハードウェアのモデルで確かめる
+// loop は PWM 周期より十分速く、ばらつきがあり、ときどき画面の描画で長く止まる
+
+#include <Arduino.h>
+#include <random>
+
+#include "src/output/dithered_pwm.hpp"
+#include "test_util.hpp"
+
+namespace
+{
+  constexpr unsigned long PERIOD_MICROS{1000};
+
+  struct Result
+  {
+    double _averageValue{0.0};  // 出力された 8bit 値の時間平均
+    unsigned long _writeCount{0};
+    unsigned long _periodCount{0};
+  };
+
+  // hardwarePeriodMicros: 実際の PWM 周期（周期毎の境目で最後に書いた値を取り込む）
+  Result simulate(int32_t duty, unsigned long hardwarePeriodMicros, unsigned long durationMicros, uint32_t seed, bool stallFlag)
+  {
+    DitheredPwm pwm{PERIOD_MICROS};
+    pwm.reset();
+    pwm.setDuty(duty);
+
+    std::mt19937 random{seed};
+    std::uniform_int_distribution<unsigned long> loopMicros{20, 90};
+    std::uniform_int_distribution<int> stallChance{0, 999};
+
+    Result result{};
+    int writtenValue{0};
+    int latchedValue{0};
+    unsigned long nextBoundary{0};
+    double total{0.0};
+    for (unsigned long now{0}; now < durationMicros;)
+    {
+      pwm.update(now, [&](uint8_t value) {
+        writtenValue = value;
+        ++result._writeCount;
+      });
+
+      unsigned long next{now + loopMicros(random)};
+      if (stallFlag && stallChance(random) == 0)
+      {
+        next += 25000; // 画面の転送
+      }
+      // 次の loop までの間にある境目で値を取り込む
+      while (nextBoundary <= next && nextBoundary < durationMicros)
+      {
+        latchedValue = writtenValue;
+        total += latchedValue;
+        ++result._periodCount;
+        nextBoundary += hardwarePeriodMicros;
+      }
+      now = next;
+    }
+    result._averageValue = total / result._periodCount;
+    return result;
+  }
+
+  void testAverageError()
+  {
+    double worstError{0.0};
+    for (int32_t duty{0}; duty <= DitheredPwm::MAX_DUTY; duty += 1237)
+    {
+      const Result result{simulate(duty, PERIOD_MICROS, 2000000, static_cast<uint32_t>(duty), false)};
+      const double error{result._averageValue - static_cast<double>(duty) / 256.0};
+      worstError = std::max(worstError, std::fabs(error));
+      // 1周期に1回より多く書き込まない
+      CHECK(result._writeCount <= result._periodCount + 1);
+    }
+    // 2000周期の平均で 1/256 LSB 程度
+    CHECK_NEAR(worstError, 0.0, 0.005);
+  }
+
+  void testFractionOnly()
+  {
+    // 整数部 0 の小さな電流（1/256 - 255/256）も平均で出る
+    for (const int32_t duty : {1, 3, 64, 128, 200, 255})
+    {
+      const Result result{simulate(duty, PERIOD_MICROS, 4000000, 7, false)};
+      CHECK_NEAR(result._averageValue, duty / 256.0, 0.003);
+    }
+  }
+
+  void testStalls()
+  {
+    // loop が何周期も止まっても、止まっていた周期数分の誤差を後で取り戻す
+    for (const int32_t duty : {0x1280, 0x40C0, 0x7F01})
+    {
+      const Result result{simulate(duty, PERIOD_MICROS, 8000000, 11, true)};
+      CHECK_NEAR(result._averageValue, duty / 256.0, 0.01);
+    }
+  }
+
+  void testPeriodMismatch()
+  {
+    // 想定した周期がコアの PWM 周期と 3% ずれていても、経過時間で重み付けするので平均はずれにくい
+    for (const unsigned long hardwarePeriod : {970UL, 1030UL})
+    {
+      const Result result{simulate(0x2A55, hardwarePeriod, 4000000, 5, false)};
+      CHECK_NEAR(result._averageValue, 0x2A55 / 256.0, 0.005);
+    }
+  }
+
+  void testReset()
+  {
+    DitheredPwm pwm{PERIOD_MICROS};
+    int writeCount{0};
+    int writtenValue{-1};
+    auto write = [&](uint8_t value) {
+      writtenValue = value;
+      ++writeCount;
+    };
+
+    pwm.setDuty(0x0380);
+    pwm.update(5000, write);
+    CHECK(writeCount == 1 && writtenValue == 3);
+    // 同じ周期の中では進めない
+    pwm.update(5400, write);
+    pwm.update(5999, write);
+    CHECK(writeCount == 1);
+    pwm.update(6000, write);
+    CHECK(writeCount == 2 && writtenValue == 4);
+
+    // reset() 後は値が変わらなくても次の update() ですぐ書き込む
+    pwm.reset();
+    pwm.update(6100, write);
+    CHECK(writeCount == 3 && writtenValue == 0);
+  }
+}
+
+int main()
+{
+  testAverageError();
+  testFractionOnly();
+  testStalls();
+  testPeriodMismatch();
+  testReset();
+  return test_util::finish("test_dithered_pwm");
+}
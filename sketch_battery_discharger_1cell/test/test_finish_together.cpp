@@ -0,0 +1,113 @@
+// 同時終了モードのテスト
+// 容量と内部抵抗が揃っていない4本を BatterySimulator で放電し、終わる時刻が揃うこと、
+// その時一番遅い電池だけが TargetI を超えて流し、全体が別々に放電するより早く終わること（熱制限の有無どちらでも）
+
+#include "battery_simulator.hpp"
+#include "test_util.hpp"
+
+Adafruit_SSD1306 oledDisplay{128, 64, &Wire, -1};
+
+namespace
+{
+  constexpr uint8_t SLOT_COUNT{BatterySimulator::SLOT_COUNT};
+  constexpr float CAPACITIES[SLOT_COUNT]{700.f, 650.f, 600.f, 500.f};
+  constexpr float OHMS[SLOT_COUNT]{0.06f, 0.10f, 0.08f, 0.15f};
+
+  struct RunResult
+  {
+    float finishMinutes[SLOT_COUNT]{};
+    uint8_t overSlotCount{0}; // 同時に TargetI を超えて流したスロット数の最大
+    float maxCoordinatedI{0.f};
+    bool coordinatedFlag{false};
+    bool finishedFlag{false};
+
+    float spreadMinutes() const
+    {
+      return *std::max_element(finishMinutes, finishMinutes + SLOT_COUNT) - *std::min_element(finishMinutes, finishMinutes + SLOT_COUNT);
+    }
+  };
+
+  RunResult run(bool togetherFlag, bool thermalFlag)
+  {
+    BatteryController controller{};
+    controller.setup();
+    controller._thermalLimitFlag = thermalFlag;
+    controller._finishTogetherFlag = togetherFlag;
+
+    BatterySimulator simulator{controller};
+    for (uint8_t slot{0}; slot < SLOT_COUNT; ++slot)
+    {
+      BatterySimulator::Cell &cell{simulator.cell(slot)};
+      cell.presentFlag = true;
+      cell.capacityMilliAmpereHour = CAPACITIES[slot];
+      cell.ohm = OHMS[slot];
+    }
+    simulator.run(500);
+
+    // ペア毎に TargetI が違う
+    Serial.feed("SET ALL V 1.1\nSET 1 I 0.8\nSET 3 I 1.0\nSTART ALL\n");
+    simulator.run(200);
+
+    RunResult result{};
+    const unsigned long startMillis{millis()};
+    result.finishedFlag = simulator.runUntil(3UL * 60UL * 60UL * 1000UL, [&] {
+      bool finishedFlag{true};
+      uint8_t overSlotCount{0};
+      for (uint8_t slot{0}; slot < SLOT_COUNT; ++slot)
+      {
+        const BatteryInfo &batteryStatus{controller._batteryStatuses[slot]};
+        if (batteryStatus._coordinatedI > 0.f)
+        {
+          result.coordinatedFlag = true;
+          result.maxCoordinatedI = std::max(result.maxCoordinatedI, batteryStatus._coordinatedI);
+          if (batteryStatus._coordinatedI > batteryStatus._targetI + 1e-4f)
+          {
+            ++overSlotCount;
+          }
+        }
+        if (batteryStatus._dischargedCount > 0)
+        {
+          if (result.finishMinutes[slot] <= 0.f)
+          {
+            result.finishMinutes[slot] = (millis() - startMillis) / 60000.f;
+          }
+        }
+        else
+        {
+          finishedFlag = false;
+        }
+      }
+      result.overSlotCount = std::max(result.overSlotCount, overSlotCount);
+      return finishedFlag;
+    });
+    printf("together %d thermal %d: finish", togetherFlag, thermalFlag);
+    for (const float minutes : result.finishMinutes)
+    {
+      printf(" %.1f", minutes);
+    }
+    printf(" min, max coordinated %.2fA\n", result.maxCoordinatedI);
+    return result;
+  }
+}
+
+int main()
+{
+  const RunResult separateResult{run(false, false)};
+  CHECK(separateResult.finishedFlag);
+  CHECK(!separateResult.coordinatedFlag);
+  CHECK(separateResult.spreadMinutes() > 10.f);
+
+  for (const bool thermalFlag : {false, true})
+  {
+    const RunResult togetherResult{run(true, thermalFlag)};
+    CHECK(togetherResult.finishedFlag);
+    CHECK(togetherResult.coordinatedFlag);
+    CHECK(togetherResult.overSlotCount == 1);
+    CHECK(togetherResult.maxCoordinatedI <= SaveBattery::TARGET_I_MAX + 1e-4f);
+    CHECK(togetherResult.spreadMinutes() < separateResult.spreadMinutes() * 0.3f);
+    // 一番遅い電池を TargetI より多く流すので、全体は別々に放電するより早く終わる
+    CHECK(*std::max_element(togetherResult.finishMinutes, togetherResult.finishMinutes + SLOT_COUNT)
+          < *std::max_element(separateResult.finishMinutes, separateResult.finishMinutes + SLOT_COUNT) - 1.f);
+  }
+  return test_util::finish("test_finish_together");
+}
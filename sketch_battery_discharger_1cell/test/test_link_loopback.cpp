@@ -0,0 +1,268 @@
+// リンクをメモリ上のリングでつなぎ、2 - 8 台のノードで列挙、ポーリング、操作を確かめる
+// あわせて、LinkPin を有効にしたユニットだけ Serial1 と同じピンを読むスロット3,4が止まり、
+// 役割を選んだだけでは止まらないこと、リンクを止めると戻ることを確かめる
+
+#include <deque>
+#include <memory>
+
+#include "controller_harness.hpp"
+#include "src/link/link_node.hpp"
+#include "test_util.hpp"
+
+Adafruit_SSD1306 oledDisplay{128, 64, &Wire, -1};
+
+using controller_harness::contains;
+using controller_harness::countLines;
+using controller_harness::runScript;
+
+namespace
+{
+  constexpr unsigned long BYTE_MICROS{87}; // 115200bps で 1byte（10bit）
+
+  // リングの1区間。書いたバイトは1byte ずつ BYTE_MICROS 毎に次の機器に届く
+  class RingPort : public LinkPort
+  {
+  public:
+    explicit RingPort(const unsigned long &nowMicros)
+        : _nowMicros{nowMicros} {}
+
+    void connect(RingPort &next)
+    {
+      _next = &next;
+    }
+
+    int read() override
+    {
+      if (_inbox.empty() || _inbox.front().first > _nowMicros)
+      {
+        return -1;
+      }
+      const uint8_t value{_inbox.front().second};
+      _inbox.pop_front();
+      return value;
+    }
+
+    void write(const uint8_t *data, size_t length) override
+    {
+      for (size_t i{0}; i < length; ++i)
+      {
+        _sendMicros = std::max(_sendMicros, _nowMicros) + BYTE_MICROS;
+        _next->_inbox.emplace_back(_sendMicros, data[i]);
+      }
+    }
+
+  private:
+    const unsigned long &_nowMicros;
+    RingPort *_next{nullptr};
+    unsigned long _sendMicros{0};
+    std::deque<std::pair<unsigned long, uint8_t>> _inbox{};
+  };
+
+  // ノード1台分。状態はアドレスとスロットから決まる値で、受け取った操作を記録する
+  struct TestNode
+  {
+    explicit TestNode(const unsigned long &nowMicros)
+        : _port{nowMicros} {}
+
+    void update()
+    {
+      _node.update([this](LinkNodeState &state) {
+                     state._slotCount = 2;
+                     for (uint8_t slot{0}; slot < state._slotCount; ++slot)
+                     {
+                       state._slots[slot]._sleepMilliVolt = static_cast<uint16_t>(1000 + _node.address() * 10 + slot);
+                       state._slots[slot]._activeFlag = _activeFlags[slot];
+                     }
+                   },
+                   [this](const LinkCommand &command) { _commands.push_back(command); });
+    }
+
+    RingPort _port;
+    LinkNode _node{_port};
+    bool _activeFlags[LinkConst::SLOT_MAX]{};
+    std::vector<LinkCommand> _commands{};
+  };
+
+  struct Ring
+  {
+    explicit Ring(uint8_t nodeCount)
+    {
+      for (uint8_t i{0}; i < nodeCount; ++i)
+      {
+        _nodes.push_back(std::make_unique<TestNode>(_nowMicros));
+      }
+      // マスター TX -> ノード1 RX -> ... -> 最後のノード TX -> マスター RX
+      _masterPort.connect(_nodes.front()->_port);
+      for (uint8_t i{0}; i + 1 < nodeCount; ++i)
+      {
+        _nodes[i]->_port.connect(_nodes[i + 1]->_port);
+      }
+      _nodes.back()->_port.connect(_masterPort);
+      _master.start(0);
+    }
+
+    void run(unsigned long millisValue)
+    {
+      const unsigned long endMicros{_nowMicros + millisValue * 1000UL};
+      for (; _nowMicros < endMicros; _nowMicros += 50)
+      {
+        _master.update(_nowMicros / 1000UL);
+        for (auto &node : _nodes)
+        {
+          node->update();
+        }
+      }
+    }
+
+    unsigned long _nowMicros{0};
+    RingPort _masterPort{_nowMicros};
+    LinkMaster _master{_masterPort};
+    std::vector<std::unique_ptr<TestNode>> _nodes{};
+  };
+
+  void testRing(uint8_t nodeCount)
+  {
+    Ring ring{nodeCount};
+    // 1周のポーリングは 8台で約 0.3 秒
+    ring.run(600);
+
+    CHECK(ring._master.nodeCount() == nodeCount);
+    for (uint8_t nodeIndex{0}; nodeIndex < nodeCount; ++nodeIndex)
+    {
+      CHECK(ring._nodes[nodeIndex]->_node.address() == nodeIndex + 1);
+      CHECK(ring._master.isOnline(nodeIndex));
+      const LinkNodeState &state{ring._master.nodeState(nodeIndex)};
+      CHECK(state._slotCount == 2);
+      CHECK(state._slots[1]._sleepMilliVolt == 1000 + (nodeIndex + 1) * 10 + 1);
+    }
+    CHECK(ring._master.timeoutCount() == 0);
+
+    // 操作は宛先のノードだけが受け取り、応答の状態が次のポーリングを待たずに反映される
+    const uint8_t targetIndex{static_cast<uint8_t>(nodeCount - 1)};
+    ring._nodes[targetIndex]->_activeFlags[1] = true;
+    CHECK(ring._master.sendCommand(targetIndex, LinkCommand{1, LinkCommandOp::SetTargetV, 1234}));
+    ring.run(LinkMaster::CYCLE_MILLIS);
+    for (uint8_t nodeIndex{0}; nodeIndex < nodeCount; ++nodeIndex)
+    {
+      const auto &commands{ring._nodes[nodeIndex]->_commands};
+      if (nodeIndex == targetIndex)
+      {
+        CHECK(commands.size() == 1);
+        CHECK(commands.size() == 1 && commands[0]._slot == 1 && commands[0]._op == LinkCommandOp::SetTargetV && commands[0]._value == 1234);
+      }
+      else
+      {
+        CHECK(commands.empty());
+      }
+    }
+    CHECK(ring._master.nodeState(targetIndex)._slots[1]._activeFlag);
+
+    // 長く回しても、応答の遅れでタイムアウトしない
+    ring.run(2000);
+    CHECK(ring._master.timeoutCount() == 0);
+    CHECK(ring._master.isOnline(0) && ring._master.isOnline(targetIndex));
+  }
+
+  // 役割を選んだだけではピンを取らない。スロット3,4は読み続け、リンクも動かさない
+  void testRoleAloneKeepsSlots(BatteryController &controller)
+  {
+    for (const LinkRole linkRole : {LinkRole::Master, LinkRole::Node})
+    {
+      controller.beginLink(linkRole, false);
+      CHECK(!controller.isLinkActive());
+      for (uint8_t slot{0}; slot < 4; ++slot)
+      {
+        CHECK(controller._batteryStatuses[slot].isEnabled() && controller._autoCalibration.isEnabled(slot));
+      }
+      stub_pin::readCounts()[READ3_PIN] = 0;
+      stub_pin::readCounts()[READ4_PIN] = 0;
+      controller_harness::runFrames(controller, 2);
+      CHECK(stub_pin::readCounts()[READ3_PIN] > 0 && stub_pin::readCounts()[READ4_PIN] > 0);
+      const std::string output{runScript(controller, "STATUS ALL\n", 1)};
+      CHECK(countLines(output, "STATUS ") == 4);
+      LinkNodeState state{};
+      controller.fillLinkState(state);
+      CHECK(state._slotCount == 4);
+    }
+    controller.beginLink(LinkRole::Off, false);
+  }
+
+  void testLinkDisablesSharedSlots(BatteryController &controller)
+  {
+    controller.changeTargetBattery(3);
+    controller.beginLink(LinkRole::Master, true);
+    CHECK(controller.isLinkActive());
+
+    CHECK(controller._batteryStatuses[0].isEnabled() && controller._batteryStatuses[1].isEnabled());
+    CHECK(!controller._batteryStatuses[2].isEnabled() && !controller._batteryStatuses[3].isEnabled());
+    CHECK(!controller._autoCalibration.isEnabled(2) && !controller._autoCalibration.isEnabled(3));
+    CHECK(controller._currentBatteryIndex == 0);
+
+    // 選択はスロット3,4を飛ばす
+    controller.shiftTargetBattery(1);
+    CHECK(controller._currentBatteryIndex == 1);
+    controller.shiftTargetBattery(1);
+    CHECK(controller._currentBatteryIndex == 0);
+    controller.shiftTargetBattery(-1);
+    CHECK(controller._currentBatteryIndex == 1);
+
+    // リンクのピンは読まない
+    stub_pin::readCounts()[READ3_PIN] = 0;
+    stub_pin::readCounts()[READ4_PIN] = 0;
+    stub_pin::readCounts()[READ1_PIN] = 0;
+    oledDisplay._text.clear();
+    controller_harness::runFrames(controller, 10);
+    CHECK(stub_pin::readCounts()[READ3_PIN] == 0 && stub_pin::readCounts()[READ4_PIN] == 0);
+    CHECK(stub_pin::readCounts()[READ1_PIN] > 0);
+    CHECK(contains(oledDisplay._text, "Link"));
+
+    // Serial では単独指定は ERR SLOT、ALL は飛ばす
+    std::string output{runScript(controller, "STATUS 3\nSTART 4\nSTART ALL\nSTATUS ALL\n", 4)};
+    CHECK(countLines(output, "ERR SLOT") == 2);
+    CHECK(countLines(output, "STATUS ") == 2);
+    CHECK(controller._batteryStatuses[0]._activeFlag && controller._batteryStatuses[1]._activeFlag);
+    CHECK(!controller._batteryStatuses[2]._activeFlag && !controller._batteryStatuses[3]._activeFlag);
+
+    // ノードとして報告するのはスロット1,2だけ。スロット3,4への操作は無視する
+    LinkNodeState state{};
+    controller.fillLinkState(state);
+    CHECK(state._slotCount == 2);
+    controller.applyLinkCommand(LinkCommand{2, LinkCommandOp::Start, 0});
+    CHECK(!controller._batteryStatuses[2]._activeFlag);
+
+    // ピンの設定を戻すと、役割が残っていてもスロットは戻る
+    controller.beginLink(LinkRole::Master, false);
+    CHECK(!controller.isLinkActive());
+    CHECK(controller._batteryStatuses[2].isEnabled() && controller._batteryStatuses[3].isEnabled());
+    controller.beginLink(LinkRole::Node, true);
+    CHECK(!controller._batteryStatuses[2].isEnabled() && !controller._batteryStatuses[3].isEnabled());
+
+    // リンクを止めると戻る
+    controller.beginLink(LinkRole::Off, true);
+    CHECK(controller._batteryStatuses[2].isEnabled() && controller._batteryStatuses[3].isEnabled());
+    CHECK(controller._autoCalibration.isEnabled(2) && controller._autoCalibration.isEnabled(3));
+    controller_harness::runFrames(controller, 2);
+    CHECK(stub_pin::readCounts()[READ3_PIN] > 0 && stub_pin::readCounts()[READ4_PIN] > 0);
+    output = runScript(controller, "START 3\nSTATUS ALL\n", 2);
+    CHECK(!contains(output, "ERR"));
+    CHECK(countLines(output, "STATUS ") == 4);
+    CHECK(controller._batteryStatuses[2]._activeFlag);
+    controller.fillLinkState(state);
+    CHECK(state._slotCount == 4);
+  }
+}
+
+int main()
+{
+  for (uint8_t nodeCount{2}; nodeCount <= LinkConst::NODE_MAX; ++nodeCount)
+  {
+    testRing(nodeCount);
+  }
+
+  BatteryController controller{};
+  controller.setup();
+  controller_harness::runFrames(controller, 2);
+  testRoleAloneKeepsSlots(controller);
+  testLinkDisablesSharedSlots(controller);
+  return test_util::finish("test_link_loopback");
+}
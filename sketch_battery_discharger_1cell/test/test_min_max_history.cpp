@@ -0,0 +1,173 @@
+// MinMaxHistory の各段の区間を、全ての点を残した素直な計算と比べる
+// 上の段にまとめても最小値/最大値（1点だけの突出も）が残ること、表示する段の切り替わりを確かめる
+
+#include <random>
+#include <vector>
+
+#include "src/history/min_max_history.hpp"
+#include "test_util.hpp"
+
+namespace
+{
+  // 全ての点から、段level の区間（bucketSamples 点ずつ）を作り、表示と同じく最新 LEVEL_SIZE 列を返す
+  std::vector<MinMaxSample> referenceColumns(const std::vector<MinMaxSample> &samples, uint32_t bucketSamples, uint16_t levelSize)
+  {
+    std::vector<MinMaxSample> columns{};
+    for (size_t begin{0}; begin < samples.size(); begin += bucketSamples)
+    {
+      MinMaxSample column{};
+      for (size_t index{begin}; index < std::min(samples.size(), begin + bucketSamples); ++index)
+      {
+        column.merge(samples[index]);
+      }
+      columns.push_back(column);
+    }
+    if (columns.size() > levelSize)
+    {
+      columns.erase(columns.begin(), columns.end() - levelSize);
+    }
+    return columns;
+  }
+
+  template <uint8_t LEVEL_COUNT, uint16_t LEVEL_SIZE>
+  bool matchesReference(const MinMaxHistory<LEVEL_COUNT, LEVEL_SIZE> &history, const std::vector<MinMaxSample> &samples)
+  {
+    for (uint8_t level{0}; level < LEVEL_COUNT; ++level)
+    {
+      const std::vector<MinMaxSample> expected{referenceColumns(samples, history.bucketSamples(level), LEVEL_SIZE)};
+      if (history.columnCount(level) != expected.size())
+      {
+        std::printf("level %u: %u columns, expected %zu (after %zu samples)\n", level, history.columnCount(level), expected.size(), samples.size());
+        return false;
+      }
+      for (uint16_t index{0}; index < expected.size(); ++index)
+      {
+        const MinMaxSample column{history.column(level, index)};
+        if (column._min != expected[index]._min || column._max != expected[index]._max)
+        {
+          std::printf("level %u column %u: %u-%u, expected %u-%u (after %zu samples)\n", level, index,
+                      column._min, column._max, expected[index]._min, expected[index]._max, samples.size());
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  // 小さな段（区間 2, 6, 24 点、各8列）で、一周して上書きされるまで1点毎に比べる
+  void testLevelsMatchReference()
+  {
+    static constexpr uint16_t RATIOS[3]{2, 3, 4};
+    MinMaxHistory<3, 8> history{RATIOS};
+    CHECK(history.bucketSamples(0) == 2 && history.bucketSamples(1) == 6 && history.bucketSamples(2) == 24);
+
+    std::mt19937 random{12};
+    std::uniform_int_distribution<int> value{1000, 1100};
+    std::uniform_int_distribution<int> spikeChance{0, 49};
+    std::vector<MinMaxSample> samples{};
+    bool matchFlag{true};
+    for (uint16_t count{0}; count < 500 && matchFlag; ++count)
+    {
+      uint16_t minValue{static_cast<uint16_t>(value(random))};
+      uint16_t maxValue{static_cast<uint16_t>(minValue + value(random) % 20)};
+      // ときどき1点だけ大きく外れる（放電の開始、電池の抜き差し）
+      if (spikeChance(random) == 0)
+      {
+        minValue = 10;
+        maxValue = 1600;
+      }
+      // min と max を逆に渡しても並べ直す
+      if (count % 7 == 0)
+      {
+        history.add(maxValue, minValue);
+      }
+      else
+      {
+        history.add(minValue, maxValue);
+      }
+      samples.push_back(MinMaxSample{minValue, maxValue});
+      matchFlag = matchesReference(history, samples);
+    }
+    CHECK(matchFlag);
+    CHECK(history.sampleCount() == samples.size());
+
+    history.reset();
+    CHECK(history.sampleCount() == 0);
+    CHECK(history.columnCount(0) == 0 && history.columnCount(2) == 0);
+  }
+
+  // 突出した1点は、どの段にまとめても、その点を含む区間の最小値/最大値に残る
+  void testSpikeSurvivesDecimation()
+  {
+    static constexpr uint16_t RATIOS[4]{1, 10, 6, 10};
+    MinMaxHistory<4, 128> history{RATIOS};
+    for (uint32_t count{0}; count < 5000; ++count)
+    {
+      if (count == 1234)
+      {
+        history.add(50, 1700);
+      }
+      else
+      {
+        history.add(1200, 1210);
+      }
+    }
+
+    for (uint8_t level{1}; level < 4; ++level)
+    {
+      uint16_t spikeCount{0};
+      for (uint16_t index{0}; index < history.columnCount(level); ++index)
+      {
+        const MinMaxSample column{history.column(level, index)};
+        if (column._min == 50 && column._max == 1700)
+        {
+          ++spikeCount;
+        }
+        else
+        {
+          CHECK(column._min == 1200 && column._max == 1210);
+        }
+      }
+      // 段1 は 1280 点分しかなく、突出はもう上書きされている
+      CHECK(spikeCount == ((level == 1) ? 0 : 1));
+    }
+  }
+
+  // 表示する段は、全ての点が 128 列に収まる一番細かい段（1秒、10秒、1分、10分）
+  void testFitLevelSwitchesSpan()
+  {
+    static constexpr uint16_t RATIOS[4]{1, 10, 6, 10};
+    MinMaxHistory<4, 128> history{RATIOS};
+    CHECK(history.fitLevel() == 0);
+
+    struct Step
+    {
+      uint32_t _sampleCount;
+      uint8_t _level;
+    };
+    static constexpr Step STEPS[]{
+        {128, 0}, {129, 1}, {1280, 1}, {1281, 2}, {7680, 2}, {7681, 3}, {76800, 3}, {80000, 3}};
+
+    uint32_t count{0};
+    for (const Step &step : STEPS)
+    {
+      for (; count < step._sampleCount; ++count)
+      {
+        history.add(1000, 1000);
+      }
+      CHECK(history.fitLevel() == step._level);
+      // 選んだ段は全体を表示でき、途中の区間も含めて満たされている
+      const uint8_t level{history.fitLevel()};
+      const uint32_t expectedColumns{(count + history.bucketSamples(level) - 1) / history.bucketSamples(level)};
+      CHECK(history.columnCount(level) == std::min<uint32_t>(expectedColumns, 128));
+    }
+  }
+}
+
+int main()
+{
+  testLevelsMatchReference();
+  testSpikeSurvivesDecimation();
+  testFitLevelSwitchesSpan();
+  return test_util::finish("test_min_max_history");
+}
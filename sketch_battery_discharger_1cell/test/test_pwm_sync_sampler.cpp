@@ -0,0 +1,167 @@
+// PwmSyncSampler の窓平均が PWM リップルを打ち消すかを、フィルタ後のリップルのモデルで確かめる
+// 位相は合わせない（読み始めはランダム）。周期がずれた場合の残りとエイリアスも確かめる
+
+#include <Arduino.h>
+#include <random>
+
+#include "src/adc/pwm_sync_sampler.hpp"
+#include "test_util.hpp"
+
+namespace
+{
+  constexpr double PI{3.14159265358979323846};
+  constexpr unsigned long PERIOD_MICROS{1000};
+  constexpr uint8_t PERIODS{3};
+  constexpr uint8_t SAMPLES{8};
+  constexpr double RIPPLE{1.0}; // 基本波の振幅
+
+  // RC フィルタ後の PWM リップル（高調波ほど小さい）
+  struct Ripple
+  {
+    double _periodMicros{PERIOD_MICROS};
+    double _phase{0.0};
+    uint8_t _harmonicMax{7};
+    uint8_t _onlyHarmonic{0}; // 0 以外なら、その高調波だけ
+
+    double operator()(double micros) const
+    {
+      double value{0.0};
+      for (uint8_t k{1}; k <= _harmonicMax; ++k)
+      {
+        if (_onlyHarmonic != 0 && k != _onlyHarmonic)
+        {
+          continue;
+        }
+        value += (RIPPLE / k) * std::sin(2.0 * PI * k * micros / _periodMicros + k * _phase);
+      }
+      return value;
+    }
+  };
+
+  // 窓毎の平均（リップルの残り）を返す
+  template <typename Func>
+  void runWindows(const Ripple &ripple, unsigned long startMicros, uint16_t windowCount, uint32_t seed, Func &&onWindow)
+  {
+    PwmSyncSampler sampler{PERIOD_MICROS, PERIODS, SAMPLES};
+    sampler.restart(startMicros);
+    std::mt19937 random{seed};
+    std::uniform_int_distribution<unsigned long> loopMicros{5, 25};
+
+    double total{0.0};
+    uint8_t count{0};
+    uint16_t windows{0};
+    bool fullWindowFlag{true};
+    for (unsigned long now{startMicros}; windows < windowCount; now += loopMicros(random))
+    {
+      const SyncSampleEvent event{sampler.poll(now)};
+      if (event == SyncSampleEvent::None)
+      {
+        continue;
+      }
+      total += ripple(static_cast<double>(now));
+      ++count;
+      if (event == SyncSampleEvent::WindowEnd)
+      {
+        fullWindowFlag = fullWindowFlag && (count == SAMPLES);
+        onWindow(total / count);
+        total = 0.0;
+        count = 0;
+        ++windows;
+      }
+    }
+    CHECK(fullWindowFlag);
+  }
+
+  double worstWindow(const Ripple &ripple, uint32_t seed)
+  {
+    double worst{0.0};
+    runWindows(ripple, 123457, 200, seed, [&](double mean) { worst = std::max(worst, std::fabs(mean)); });
+    return worst;
+  }
+
+  // 同期しない場合の比較: loop 毎に続けて8回読んだ平均
+  double worstBackToBack(const Ripple &ripple)
+  {
+    double worst{0.0};
+    for (unsigned long start{0}; start < 20000; start += 137)
+    {
+      double total{0.0};
+      for (uint8_t i{0}; i < SAMPLES; ++i)
+      {
+        total += ripple(static_cast<double>(start + i * 15));
+      }
+      worst = std::max(worst, std::fabs(total / SAMPLES));
+    }
+    return worst;
+  }
+
+  void testExactPeriodAnyPhase()
+  {
+    // 周期が合っていれば、読み始めの位相によらず窓平均でリップルが消える（残りは loop の遅れの分）
+    double worst{0.0};
+    for (uint8_t phaseIndex{0}; phaseIndex < 16; ++phaseIndex)
+    {
+      const Ripple ripple{PERIOD_MICROS, 2.0 * PI * phaseIndex / 16.0};
+      worst = std::max(worst, worstWindow(ripple, phaseIndex));
+    }
+    CHECK(worst < 0.1 * RIPPLE);
+    CHECK(worstBackToBack(Ripple{}) > 1.0 * RIPPLE);
+  }
+
+  void testAliasedHarmonic()
+  {
+    // 3周期に8サンプルでは、8 の倍数次の高調波は打ち消せない（位相次第で残る）
+    Ripple ripple{};
+    ripple._onlyHarmonic = SAMPLES;
+    ripple._harmonicMax = SAMPLES;
+    CHECK(worstWindow(ripple, 3) > 0.5 * RIPPLE / SAMPLES);
+
+    // 8 の倍数でない高調波は消える
+    ripple._onlyHarmonic = 5;
+    CHECK(worstWindow(ripple, 3) < 0.05 * RIPPLE);
+  }
+
+  void testPeriodMismatch()
+  {
+    // PWM_PERIOD_MICROS がコアの周期と 2% ずれると窓毎には残るが、位相が回るので多数の窓の平均では消える
+    const Ripple ripple{PERIOD_MICROS * 1.02, 0.3};
+    double worst{0.0};
+    double total{0.0};
+    uint16_t count{0};
+    runWindows(ripple, 1000, 2000, 9, [&](double mean) {
+      worst = std::max(worst, std::fabs(mean));
+      total += mean;
+      ++count;
+    });
+    CHECK(worst > 0.1 * RIPPLE);
+    CHECK(worst < 0.25 * RIPPLE);
+    CHECK(std::fabs(total / count) < 0.02 * RIPPLE);
+  }
+
+  void testSlipped()
+  {
+    PwmSyncSampler sampler{PERIOD_MICROS, PERIODS, SAMPLES};
+    CHECK(sampler.intervalMicros() == 375);
+    sampler.restart(0);
+    CHECK(sampler.poll(0) == SyncSampleEvent::Sample);
+    CHECK(sampler.poll(100) == SyncSampleEvent::None);
+    CHECK(sampler.poll(380) == SyncSampleEvent::Sample);
+    // 間隔の半分より遅れると、途中の窓を捨ててやり直す
+    CHECK(sampler.poll(5000) == SyncSampleEvent::Slipped);
+    CHECK(sampler.poll(5374) == SyncSampleEvent::None);
+    for (uint8_t i{0}; i < SAMPLES - 1; ++i)
+    {
+      CHECK(sampler.poll(5375 + i * 375) == SyncSampleEvent::Sample);
+    }
+    CHECK(sampler.poll(5375 + 7 * 375) == SyncSampleEvent::WindowEnd);
+  }
+}
+
+int main()
+{
+  testExactPeriodAnyPhase();
+  testAliasedHarmonic();
+  testPeriodMismatch();
+  testSlipped();
+  return test_util::finish("test_pwm_sync_sampler");
+}
@@ -0,0 +1,189 @@
+// RunRecordStore を EEPROM の代用で確かめる
+// 一周して上書き、読み直し、書き込み途中の電源断（壊れた記録）、領域の大きさによる記録数の制限、起動時の容量不足の報告
+
+#include "controller_harness.hpp"
+#include "test_util.hpp"
+
+Adafruit_SSD1306 oledDisplay{128, 64, &Wire, -1};
+
+using controller_harness::contains;
+
+namespace
+{
+  constexpr int BASE_ADDRESS{0x800};
+  constexpr uint16_t CAPACITY{16};
+
+  using Store = RunRecordStore<EEPROMClass, CAPACITY>;
+
+  RunRecord makeRecord(uint16_t index)
+  {
+    RunRecord record{};
+    record._slot = static_cast<uint8_t>(index % 4);
+    record._milliAmpereHour = static_cast<uint16_t>(1000 + index);
+    record._durationSeconds = 60UL * index;
+    return record;
+  }
+
+  bool hasRun(const Store &store, uint32_t runId)
+  {
+    RunRecord record{};
+    return store.findByRunId(runId, record) && record._milliAmpereHour == 1000 + runId - 1;
+  }
+
+  void testRollover()
+  {
+    EEPROMClass storage{};
+    Store store{storage, BASE_ADDRESS};
+    store.load(10 * Store::RECORD_SIZE);
+    CHECK(store.capacity() == 10);
+    CHECK(store.count() == 0);
+    CHECK(store.newestRunId() == RunRecord::EMPTY_RUN_ID);
+
+    for (uint16_t index{0}; index < 25; ++index)
+    {
+      CHECK(store.append(makeRecord(index)) == index + 1U);
+    }
+    CHECK(store.count() == 10);
+    CHECK(store.newestRunId() == 25);
+    // 古い 15 件は上書きされている
+    CHECK(!hasRun(store, 15) && hasRun(store, 16) && hasRun(store, 25));
+    CHECK(!hasRun(store, 26));
+
+    RunRecord record{};
+    CHECK(store.findByAge(0, record) && record._runId == 25);
+    CHECK(store.findByAge(9, record) && record._runId == 16);
+    CHECK(!store.findByAge(10, record));
+    // 16 - 25 のスロットは 3,0,1,2,3,0,1,2,3,0
+    CHECK(store.countBySlot(0) == 3 && store.countBySlot(3) == 3 && store.countBySlot(1) == 2);
+    CHECK(store.findBySlot(3, 0, record) && record._runId == 24);
+    CHECK(store.findBySlot(3, 2, record) && record._runId == 16);
+    CHECK(!store.findBySlot(3, 3, record));
+
+    // 領域の外には書かない
+    CHECK(storage.read(BASE_ADDRESS + 10 * Store::RECORD_SIZE) == 0xFF);
+  }
+
+  void testReload()
+  {
+    EEPROMClass storage{};
+    {
+      Store store{storage, BASE_ADDRESS};
+      store.load(10 * Store::RECORD_SIZE);
+      for (uint16_t index{0}; index < 13; ++index)
+      {
+        store.append(makeRecord(index));
+      }
+    }
+
+    // 電源を入れ直しても、最新の位置と runId から続ける
+    Store store{storage, BASE_ADDRESS};
+    store.load(10 * Store::RECORD_SIZE);
+    CHECK(store.count() == 10);
+    CHECK(store.newestRunId() == 13);
+    CHECK(!hasRun(store, 3) && hasRun(store, 4) && hasRun(store, 13));
+    CHECK(store.append(makeRecord(13)) == 14);
+    CHECK(!hasRun(store, 4) && hasRun(store, 5) && hasRun(store, 14));
+
+    store.clear();
+    CHECK(store.count() == 0 && store.capacity() == 10);
+    CHECK(store.append(makeRecord(0)) == 1);
+  }
+
+  void testTornRecord()
+  {
+    EEPROMClass storage{};
+    Store store{storage, BASE_ADDRESS};
+    store.load(CAPACITY * Store::RECORD_SIZE);
+    for (uint16_t index{0}; index < 20; ++index)
+    {
+      store.append(makeRecord(index));
+    }
+    CHECK(store.newestRunId() == 20);
+
+    // 次の記録（runId 21、一番古い runId 5 の位置）を半分まで書いたところで電源が切れた
+    RunRecord torn{makeRecord(20)};
+    torn._runId = 21;
+    torn._checksum = torn.calcChecksum();
+    const int tornAddress{BASE_ADDRESS + (20 % CAPACITY) * Store::RECORD_SIZE};
+    const uint8_t *bytes{reinterpret_cast<const uint8_t *>(&torn)};
+    for (uint16_t i{0}; i < Store::RECORD_SIZE / 2; ++i)
+    {
+      storage.write(tornAddress + i, bytes[i]);
+    }
+
+    // 壊れた記録は数えず、最新は 20 のまま。次の記録は壊れた位置に書く
+    Store reloaded{storage, BASE_ADDRESS};
+    reloaded.load(CAPACITY * Store::RECORD_SIZE);
+    CHECK(reloaded.count() == CAPACITY - 1);
+    CHECK(reloaded.newestRunId() == 20);
+    CHECK(!hasRun(reloaded, 5) && hasRun(reloaded, 6) && hasRun(reloaded, 20));
+    RunRecord record{};
+    CHECK(!reloaded.findByRunId(21, record));
+    CHECK(reloaded.append(makeRecord(20)) == 21);
+    CHECK(reloaded.count() == CAPACITY);
+    CHECK(hasRun(reloaded, 21) && hasRun(reloaded, 6));
+    CHECK(storage.read(tornAddress) == 21);
+
+    // 中ほどの記録の1byte が化けた場合も、その記録だけ飛ばす
+    storage.write(BASE_ADDRESS + 10 * Store::RECORD_SIZE + 5, 0x5A);
+    reloaded.load(CAPACITY * Store::RECORD_SIZE);
+    CHECK(reloaded.count() == CAPACITY - 1);
+    CHECK(reloaded.newestRunId() == 21);
+    CHECK(!hasRun(reloaded, 11) && hasRun(reloaded, 10) && hasRun(reloaded, 12));
+  }
+
+  void testCapacityClamp()
+  {
+    EEPROMClass storage{};
+    Store store{storage, BASE_ADDRESS};
+    store.load(4096);
+    CHECK(store.capacity() == CAPACITY);
+    store.load(4 * Store::RECORD_SIZE + Store::RECORD_SIZE - 1);
+    CHECK(store.capacity() == 4);
+    store.load(Store::RECORD_SIZE - 1);
+    CHECK(store.capacity() == 0);
+    store.load(-100);
+    CHECK(store.capacity() == 0);
+    CHECK(store.append(makeRecord(0)) == RunRecord::EMPTY_RUN_ID);
+    CHECK(store.count() == 0);
+    RunRecord record{};
+    CHECK(!store.findByAge(0, record));
+  }
+
+  // EEPROM が小さい場合は、起動時に Serial と画面に出し、入る件数だけで続ける
+  void testControllerReportsShortArea()
+  {
+    const uint16_t defaultLength{EEPROM.length()};
+    {
+      BatteryController controller{};
+      Serial._output.clear();
+      controller.setup();
+      CHECK(controller._runRecordStore.capacity() == BatteryController::RUN_RECORD_CAPACITY);
+      CHECK(!contains(Serial._output, "ERR RECORD AREA"));
+    }
+
+    EEPROM.setLength(BatteryController::RUN_RECORD_ADDRESS + 20 * sizeof(RunRecord));
+    {
+      BatteryController controller{};
+      Serial._output.clear();
+      oledDisplay._text.clear();
+      controller.setup();
+      CHECK(controller._runRecordStore.capacity() == 20);
+      CHECK(contains(Serial._output, "ERR RECORD AREA 20/80"));
+      CHECK(contains(oledDisplay._text, "Record area short"));
+      RunRecord record{};
+      CHECK(controller._runRecordStore.append(record) != RunRecord::EMPTY_RUN_ID);
+    }
+    EEPROM.setLength(defaultLength);
+  }
+}
+
+int main()
+{
+  testRollover();
+  testReload();
+  testTornRecord();
+  testCapacityClamp();
+  testControllerReportsShortArea();
+  return test_util::finish("test_run_record_store");
+}
@@ -0,0 +1,150 @@
+// Serial コマンドを BatteryController 全体に流し込むスクリプトで確かめる
+// SET が電池設定を通ること、SET ALL が全ての対象を確かめてから変更すること、RECORDS が数件ずつ出力されること
+
+#include "controller_harness.hpp"
+#include "test_util.hpp"
+
+Adafruit_SSD1306 oledDisplay{128, 64, &Wire, -1};
+
+using controller_harness::contains;
+using controller_harness::countLines;
+using controller_harness::runScript;
+
+namespace
+{
+  void testSetGoesThroughSaveBattery(BatteryController &controller)
+  {
+    std::string output{runScript(controller, "SET 1 V 1.25\nSET 3 I 0.8\nGET ALL\n", 3)};
+    CHECK(countLines(output, "OK") == 3);
+    // 電池設定はペア（1-2、3-4）で共有する
+    CHECK(contains(output, "GET 1 V 1.250"));
+    CHECK(contains(output, "GET 2 V 1.250"));
+    CHECK(contains(output, "GET 3 V 1.400 I 0.800"));
+    CHECK(contains(output, "GET 4 V 1.400 I 0.800"));
+    CHECK_NEAR(controller._saveBatteryConfigData._battery[0]._targetV, 1.25, 1e-6);
+
+    // 電池設定画面で保存しても SET の値は残る
+    controller.updateBatterySaveData();
+    CHECK_NEAR(controller._batteryStatuses[1]._targetV, 1.25, 1e-6);
+    CHECK_NEAR(controller._batteryStatuses[2]._targetI, 0.8, 1e-6);
+
+    // 範囲外は丸める
+    output = runScript(controller, "SET 2 V 9\nGET 2\n", 2);
+    CHECK(contains(output, "GET 2 V 1.600"));
+  }
+
+  void testSetDoesNotRestartRunningSlot(BatteryController &controller)
+  {
+    BatteryInfo &batteryInfo{controller._batteryStatuses[0]};
+    batteryInfo._milliAmpereHour = 123.f;
+    Serial._output.clear();
+    Serial.feed("SET 1 HOLD 45\n");
+    controller._serialCommand.poll(Serial, controller);
+    CHECK(contains(Serial._output, "OK"));
+    CHECK(batteryInfo._holdMin == 45);
+    CHECK_NEAR(batteryInfo._milliAmpereHour, 123.0, 1e-6);
+  }
+
+  void testSetAllValidatesFirst(BatteryController &controller)
+  {
+    std::string output{runScript(controller, "SET ALL FOO 1\n", 1)};
+    CHECK(contains(output, "ERR KEY"));
+
+    // マスターでノードがある場合、ノードの電池に使えない key は、どの電池も変更せずに失敗する
+    controller._linkRole = LinkRole::Master;
+    controller._linkMaster._nodeCount = 1;
+    controller._linkMaster._nodeStates[0]._slotCount = 2; // リンク中のノードはスロット1,2だけ
+    const float targetV{controller._saveBatteryConfigData._battery[0]._targetV};
+    const DisChargeMode disChargeMode{controller._saveBatteryConfigData._battery[0]._disChargeMode};
+    output = runScript(controller, "SET ALL DMODE 2\n", 1);
+    CHECK(output.find("ERR KEY") == 0);
+    CHECK(countLines(output, "OK") == 0);
+    CHECK(controller._saveBatteryConfigData._battery[0]._disChargeMode == disChargeMode);
+    CHECK(controller._batteryStatuses[0]._disChargeMode == disChargeMode);
+    LinkMaster::PendingCommand pending{};
+    CHECK(!controller._linkMaster._commandQueue.pop(pending));
+
+    // V はノードの電池にも送る（マスターの update で送られないように poll だけ呼ぶ）
+    Serial._output.clear();
+    Serial.feed("SET ALL V 1.3\n");
+    controller._serialCommand.poll(Serial, controller);
+    CHECK(contains(Serial._output, "OK"));
+    CHECK_NEAR(controller._batteryStatuses[3]._targetV, 1.3, 1e-6);
+    uint8_t commandCount{0};
+    while (controller._linkMaster._commandQueue.pop(pending))
+    {
+      CHECK(pending._command._op == LinkCommandOp::SetTargetV && pending._command._value == 1300);
+      ++commandCount;
+    }
+    CHECK(commandCount == 2);
+    CHECK(controller._saveBatteryConfigData._battery[0]._targetV != targetV);
+
+    controller._linkMaster._nodeCount = 0;
+    controller._linkRole = LinkRole::Off;
+  }
+
+  void appendRecords(BatteryController &controller, uint16_t count)
+  {
+    for (uint16_t i{0}; i < count; ++i)
+    {
+      RunRecord record{};
+      record._slot = static_cast<uint8_t>(i % 4);
+      record._milliAmpereHour = static_cast<uint16_t>(1000 + i);
+      controller._runRecordStore.append(record);
+    }
+  }
+
+  void testRecordsAreChunked(BatteryController &controller)
+  {
+    controller._runRecordStore.clear();
+    // 一周して古い記録を上書きした状態
+    appendRecords(controller, BatteryController::RUN_RECORD_CAPACITY + 6);
+
+    // 1フレーム目は RECORDS_PER_POLL 件だけ。出力中は次の行（HELP）を読まない
+    Serial._output.clear();
+    Serial.feed("RECORDS\nHELP\n");
+    controller._serialCommand.poll(Serial, controller);
+    CHECK(countLines(Serial._output, "REC ") == SerialCommand::RECORDS_PER_POLL);
+    CHECK(Serial._output.find("REC 7 ") == 0);
+    CHECK(!contains(Serial._output, "OK START"));
+
+    // 途中で追加された記録は出力しない。追加で上書きされた runId 11 - 16 は飛ばす
+    appendRecords(controller, 10);
+
+    uint16_t pollCount{1};
+    while (!contains(Serial._output, "OK RECORDS") && pollCount < 100)
+    {
+      const size_t before{Serial._output.size()};
+      controller._serialCommand.poll(Serial, controller);
+      CHECK(countLines(Serial._output.substr(before), "REC ") <= SerialCommand::RECORDS_PER_POLL);
+      ++pollCount;
+    }
+    CHECK(contains(Serial._output, "OK RECORDS 74"));
+    CHECK(countLines(Serial._output, "REC ") == 74);
+    CHECK(contains(Serial._output, "REC 10 ") && !contains(Serial._output, "REC 16 ") && contains(Serial._output, "REC 17 "));
+    CHECK(contains(Serial._output, "REC 86 ") && !contains(Serial._output, "REC 87 "));
+    CHECK(!contains(Serial._output, "OK START"));
+    controller._serialCommand.poll(Serial, controller);
+    CHECK(contains(Serial._output, "OK START"));
+
+    // スロットを指定した場合。飛ばした記録も1フレームに調べる件数に数える
+    const std::string output{runScript(controller, "RECORDS 2\n", 30)};
+    const uint16_t slotCount{controller._runRecordStore.countBySlot(1)};
+    CHECK(slotCount > 0);
+    CHECK(countLines(output, "REC ") == slotCount);
+    CHECK(contains(output, "OK RECORDS " + std::to_string(slotCount)));
+  }
+}
+
+int main()
+{
+  BatteryController controller{};
+  controller.setup();
+  controller_harness::runFrames(controller, 2);
+
+  testSetGoesThroughSaveBattery(controller);
+  testSetDoesNotRestartRunningSlot(controller);
+  testSetAllValidatesFirst(controller);
+  testRecordsAreChunked(controller);
+  return test_util::finish("test_serial_command");
+}
@@ -0,0 +1,107 @@
+// SupplyReference の電源電圧（AVDD）の補正を、電源が 3.3V から下がっていく場合で確かめる
+// 読み取り値は 3.3V 基準に戻り、PWM の duty は平均電圧（duty x AVDD）が変わらないように上がる
+
+#include "controller_harness.hpp"
+#include "test_util.hpp"
+
+Adafruit_SSD1306 oledDisplay{128, 64, &Wire, -1};
+
+namespace
+{
+  constexpr double FULL_SCALE{4095.0};
+
+  // AVDD 基準の ADC で volt を読んだときの値
+  uint32_t readCount(double volt, double supplyMilliVolt)
+  {
+    return static_cast<uint32_t>(std::lround(volt / (supplyMilliVolt / 1000.0) * FULL_SCALE));
+  }
+
+  void testNominalUntilMeasured()
+  {
+    SupplyReference::reset();
+    CHECK(!SupplyReference::isValid());
+    CHECK(SupplyReference::milliVolt() == SupplyReference::NOMINAL_MILLI_VOLT);
+    CHECK(SupplyReference::compensate(1234) == 1234);
+    CHECK(SupplyReference::compensateDuty(40000) == 40000);
+
+    // 測れない（0）と範囲外は捨てる
+    SupplyReference::add(0);
+    SupplyReference::add(2000);
+    SupplyReference::add(4000);
+    CHECK(!SupplyReference::isValid());
+    CHECK(SupplyReference::rejectCount() == 2);
+    CHECK(SupplyReference::compensate(1234) == 1234);
+
+    // ホストでは測れないので update() は何も変えない
+    SupplyReference::update();
+    CHECK(!SupplyReference::isValid());
+  }
+
+  void testDroopIsCompensated()
+  {
+    SupplyReference::reset();
+    const double volt{1.2};
+    const double nominalCount{volt / 3.3 * FULL_SCALE};
+
+    for (const uint16_t supply : {3300, 3200, 3000, 2800})
+    {
+      SupplyReference::reset();
+      SupplyReference::add(supply);
+      CHECK(SupplyReference::milliVolt() == supply);
+
+      // 電源が下がると読み値は上がるが、補正すると 3.3V 基準の値に戻る
+      const uint32_t count{readCount(volt, supply)};
+      CHECK(supply == 3300 || count > nominalCount + 10);
+      CHECK_NEAR(SupplyReference::compensate(count), nominalCount, 1.0);
+      // 合計に掛けても同じ（平均の小数部を残す）
+      CHECK_NEAR(SupplyReference::compensate(count * 4096) / 4096.0, count * supply / 3300.0, 0.01);
+
+      // duty x AVDD（PWM の平均電圧）が 3.3V 基準の duty と同じになる
+      const int32_t duty{20000};
+      const int32_t compensated{SupplyReference::compensateDuty(duty)};
+      CHECK_NEAR(static_cast<double>(compensated) * supply, static_cast<double>(duty) * 3300.0, 3300.0);
+    }
+  }
+
+  // 1/4 ずつ新しい値に寄せる。1回の外れ値では大きく動かない
+  void testFilterFollowsSlowDroop()
+  {
+    SupplyReference::reset();
+    SupplyReference::add(3300);
+    SupplyReference::add(3100);
+    CHECK(SupplyReference::milliVolt() == 3250);
+    for (uint8_t count{0}; count < 40; ++count)
+    {
+      SupplyReference::add(3100);
+    }
+    CHECK_NEAR(SupplyReference::milliVolt(), 3100, 1);
+
+    // 範囲外の1回は捨て、範囲内の急な変化は 1/4 だけ反映する
+    SupplyReference::add(1500);
+    CHECK_NEAR(SupplyReference::milliVolt(), 3100, 1);
+    SupplyReference::add(2700);
+    CHECK_NEAR(SupplyReference::milliVolt(), 3000, 1);
+  }
+
+  // 放電電流の duty（BatteryInfo::calcDuty）も電源電圧で補正される
+  void testCalcDutyFollowsSupply()
+  {
+    const CurrentTable currentTable{};
+    SupplyReference::reset();
+    const int32_t nominalDuty{BatteryInfo::calcDuty(0.5f, 0.75f, 1.f, currentTable)};
+    SupplyReference::add(3000);
+    const int32_t droopDuty{BatteryInfo::calcDuty(0.5f, 0.75f, 1.f, currentTable)};
+    CHECK(nominalDuty > 0);
+    CHECK_NEAR(static_cast<double>(droopDuty) / nominalDuty, 3300.0 / 3000.0, 1e-3);
+    SupplyReference::reset();
+  }
+}
+
+int main()
+{
+  testNominalUntilMeasured();
+  testDroopIsCompensated();
+  testFilterFollowsSlowDroop();
+  testCalcDutyFollowsSupply();
+  return test_util::finish("test_supply_reference");
+}
@@ -0,0 +1,140 @@
+// 熱モデルによる電流制限のテスト
+// 4本の電池を放電する簡単なシミュレーションで、上限温度を超えない最大の固定電流より早く終わること
+// コントローラーでは、初期値が無効なことと、有効にしても電流が 0 に張り付かないこと
+
+#include "battery_simulator.hpp"
+#include "test_util.hpp"
+
+Adafruit_SSD1306 oledDisplay{128, 64, &Wire, -1};
+
+namespace
+{
+  constexpr uint8_t CHANNEL_SIZE{4};
+  constexpr float END_V{1.0f};
+  constexpr float FULL_V{1.40f};
+  constexpr float OHM{0.05f};
+  constexpr float CAPACITIES[CHANNEL_SIZE]{2000.f, 1900.f, 1500.f, 800.f};
+
+  struct RunResult
+  {
+    float minutes{0.f};
+    float maxChannelTemp{0.f};
+    float maxBoardTemp{0.f};
+    bool finishedFlag{false};
+  };
+
+  float openVolt(float usedMilliAmpereHour, float capacity)
+  {
+    return FULL_V - (FULL_V - END_V) * (usedMilliAmpereHour / capacity);
+  }
+
+  // limitFlag が true なら requestI を熱制限して流す。false なら requestI を固定で流す
+  RunResult run(float requestI, bool limitFlag)
+  {
+    constexpr float DT_SECONDS{1.f};
+    constexpr unsigned long MAX_SECONDS{12UL * 60UL * 60UL};
+
+    ThermalBudget<CHANNEL_SIZE> thermalBudget{};
+    float usedMilliAmpereHours[CHANNEL_SIZE]{};
+    float is[CHANNEL_SIZE]{};
+    RunResult result{};
+    for (unsigned long seconds{0}; seconds < MAX_SECONDS; ++seconds)
+    {
+      float requestIs[CHANNEL_SIZE]{};
+      float volts[CHANNEL_SIZE]{};
+      bool activeFlag{false};
+      for (uint8_t channel{0}; channel < CHANNEL_SIZE; ++channel)
+      {
+        const float openV{openVolt(usedMilliAmpereHours[channel], CAPACITIES[channel])};
+        volts[channel] = openV - is[channel] * OHM;
+        requestIs[channel] = (openV > END_V) ? requestI : 0.f;
+        activeFlag = activeFlag || (requestIs[channel] > 0.f);
+      }
+      if (!activeFlag)
+      {
+        result.minutes = seconds / 60.f;
+        result.finishedFlag = true;
+        return result;
+      }
+
+      float limitIs[CHANNEL_SIZE]{};
+      thermalBudget.allocate(requestIs, volts, limitIs);
+      float powers[CHANNEL_SIZE]{};
+      for (uint8_t channel{0}; channel < CHANNEL_SIZE; ++channel)
+      {
+        is[channel] = limitFlag ? std::min(requestIs[channel], limitIs[channel]) : requestIs[channel];
+        powers[channel] = volts[channel] * is[channel];
+        usedMilliAmpereHours[channel] += is[channel] * 1000.f * (DT_SECONDS / 3600.f);
+      }
+      thermalBudget.update(powers, DT_SECONDS);
+      for (uint8_t channel{0}; channel < CHANNEL_SIZE; ++channel)
+      {
+        result.maxChannelTemp = std::max(result.maxChannelTemp, thermalBudget.channelTemp(channel));
+      }
+      result.maxBoardTemp = std::max(result.maxBoardTemp, thermalBudget.boardTemp());
+    }
+    return result;
+  }
+
+  void testLimiterBeatsStaticCurrent()
+  {
+    const ThermalParameter parameter{};
+
+    // 上限温度を超えない最大の固定電流（50mA 刻み）
+    RunResult staticResult{};
+    float staticI{2.0f};
+    for (; staticI > 0.f; staticI -= 0.05f)
+    {
+      staticResult = run(staticI, false);
+      if (staticResult.maxChannelTemp <= parameter._channelLimitTemp && staticResult.maxBoardTemp <= parameter._boardLimitTemp)
+      {
+        break;
+      }
+    }
+    CHECK(staticResult.finishedFlag);
+    CHECK(staticI > 0.3f && staticI < 1.5f);
+
+    // 2A を要求して熱制限に任せる
+    const RunResult limitResult{run(2.0f, true)};
+    CHECK(limitResult.finishedFlag);
+    CHECK(limitResult.maxChannelTemp <= parameter._channelLimitTemp + 0.5f);
+    CHECK(limitResult.maxBoardTemp <= parameter._boardLimitTemp + 0.5f);
+    CHECK(limitResult.minutes < staticResult.minutes * 0.85f);
+    printf("static %.2fA %.0fmin, limited %.0fmin (%.1f / %.1f C)\n", staticI, staticResult.minutes, limitResult.minutes, limitResult.maxChannelTemp, limitResult.maxBoardTemp);
+
+    // 制限しなければ 2A は上限を超える
+    const RunResult unlimitedResult{run(2.0f, false)};
+    CHECK(unlimitedResult.maxChannelTemp > parameter._channelLimitTemp);
+  }
+
+  void testControllerDefaultAndRecovery()
+  {
+    BatteryController controller{};
+    controller.setup();
+    CHECK(!controller._thermalLimitFlag);
+    CHECK(controller._saveConfigData._thermalLimitFlag == 0);
+
+    BatterySimulator simulator{controller};
+    simulator.cell(0).presentFlag = true;
+    simulator.run(500);
+
+    // 有効にしても、冷えているうちは TargetI がそのまま流れる（休止から放電に戻っても 0 に張り付かない）
+    controller._thermalLimitFlag = true;
+    Serial.feed("SET 1 V 1.0\nSET 1 I 1.0\nSTART 1\n");
+    float maxI{0.f};
+    simulator.runUntil(20000, [&] {
+      maxI = std::max(maxI, simulator.cell(0).i);
+      return false;
+    });
+    // 放電中は 3/4 の時間だけ流すので、流している間の電流は TargetI / 0.75
+    CHECK_NEAR(maxI, 1.0 / 0.75, 0.1);
+    CHECK(simulator.cell(0).usedMilliAmpereHour > 3.f);
+  }
+}
+
+int main()
+{
+  testLimiterBeatsStaticCurrent();
+  testControllerDefaultAndRecovery();
+  return test_util::finish("test_thermal_budget");
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+// ホストで動かすテストの最小限の仕組み。失敗した CHECK を表示し、main の戻り値で結果を返す
+
+#include <cstdio>
+#include <cmath>
+
+namespace test_util
+{
+  inline int &failureCount()
+  {
+    static int count{0};
+    return count;
+  }
+
+  inline int &checkCount()
+  {
+    static int count{0};
+    return count;
+  }
+
+  inline void check(bool okFlag, const char *expression, const char *file, int line)
+  {
+    ++checkCount();
+    if (!okFlag)
+    {
+      ++failureCount();
+      std::printf("%s:%d: CHECK failed: %s\n", file, line, expression);
+    }
+  }
+
+  inline void checkNear(double actual, double expected, double tolerance, const char *expression, const char *file, int line)
+  {
+    ++checkCount();
+    if (!(std::fabs(actual - expected) <= tolerance))
+    {
+      ++failureCount();
+      std::printf("%s:%d: CHECK_NEAR failed: %s = %.6g, expected %.6g +- %.3g\n", file, line, expression, actual, expected, tolerance);
+    }
+  }
+
+  inline int finish(const char *name)
+  {
+    std::printf("%s: %d checks, %d failures\n", name, checkCount(), failureCount());
+    return (failureCount() == 0) ? 0 : 1;
+  }
+}
+
+#define CHECK(expression) test_util::check(static_cast<bool>(expression), #expression, __FILE__, __LINE__)
+#define CHECK_NEAR(actual, expected, tolerance) test_util::checkNear((actual), (expected), (tolerance), #actual, __FILE__, __LINE__)
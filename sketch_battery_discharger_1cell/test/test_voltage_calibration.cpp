@@ -0,0 +1,152 @@
+// 自動キャリブレーションの最小二乗法（CalibrationFit）と、補正式を無効にする条件を確かめる
+
+#include <Arduino.h>
+#include <random>
+
+#include "voltage_calibration.hpp"
+#include "save_config_data.hpp"
+#include "test_util.hpp"
+
+namespace
+{
+  // 固定小数点の丸め（C0: 0.1mV、C1/C2: 1e-5）を含めた許容差
+  constexpr double VOLT_TOLERANCE{0.0003};
+
+  void testOffsetOnly()
+  {
+    CalibrationFit fit{};
+    VoltCorrection correction{};
+    CHECK(!fit.fit(correction));
+
+    fit.addPoint(1.0123f, 1.f);
+    CHECK(fit.fit(correction));
+    CHECK(correction._c1 == 0 && correction._c2 == 0);
+    CHECK(correction._c0 == -123);
+    CHECK_NEAR(correction.apply(1.5f), 1.4877, VOLT_TOLERANCE);
+  }
+
+  void testLinear()
+  {
+    // 真の電圧 r、測定値 v = (r - 0.004) / 0.98
+    CalibrationFit fit{};
+    for (const float reference : {0.5f, 2.f})
+    {
+      fit.addPoint((reference - 0.004f) / 0.98f, reference);
+    }
+    VoltCorrection correction{};
+    CHECK(fit.fit(correction));
+    CHECK(correction._c2 == 0);
+    for (const float reference : {0.2f, 0.5f, 1.f, 1.5f, 2.f})
+    {
+      CHECK_NEAR(correction.apply((reference - 0.004f) / 0.98f), reference, VOLT_TOLERANCE);
+    }
+  }
+
+  void testQuadraticLeastSquares()
+  {
+    // 2次の誤差に雑音を加え、参照として解析的に解いた係数と比べる
+    const double c0{0.003}, c1{-0.012}, c2{0.006};
+    std::mt19937 random{1};
+    std::normal_distribution<double> noise{0.0, 0.0002};
+
+    CalibrationFit fit{};
+    double sums[5]{}, rhs[3]{};
+    for (uint8_t i{0}; i < CalibrationFit::POINT_MAX; ++i)
+    {
+      const double measured{0.1 + 0.25 * i};
+      const double reference{measured + c0 + c1 * measured + c2 * measured * measured + noise(random)};
+      fit.addPoint(static_cast<float>(measured), static_cast<float>(reference));
+      const double measuredFloat{static_cast<float>(measured)};
+      const double residual{static_cast<double>(static_cast<float>(reference)) - measuredFloat};
+      double power{1.0};
+      for (double &sum : sums)
+      {
+        sum += power;
+        power *= measuredFloat;
+      }
+      rhs[0] += residual;
+      rhs[1] += residual * measuredFloat;
+      rhs[2] += residual * measuredFloat * measuredFloat;
+    }
+    CHECK(!fit.addPoint(1.f, 1.f));
+
+    // 3x3 の正規方程式をクラメルの公式で解く
+    const double a[3][3]{{sums[0], sums[1], sums[2]}, {sums[1], sums[2], sums[3]}, {sums[2], sums[3], sums[4]}};
+    auto det = [](const double (&m)[3][3]) {
+      return m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+    };
+    const double base{det(a)};
+    double expected[3]{};
+    for (uint8_t col{0}; col < 3; ++col)
+    {
+      double m[3][3]{};
+      for (uint8_t row{0}; row < 3; ++row)
+      {
+        for (uint8_t k{0}; k < 3; ++k)
+        {
+          m[row][k] = (k == col) ? rhs[row] : a[row][k];
+        }
+      }
+      expected[col] = det(m) / base;
+    }
+
+    VoltCorrection correction{};
+    CHECK(fit.fit(correction));
+    CHECK_NEAR(correction._c0 / VoltCorrection::C0_SCALE, expected[0], 0.6 / VoltCorrection::C0_SCALE);
+    CHECK_NEAR(correction._c1 / VoltCorrection::C1_SCALE, expected[1], 0.6 / VoltCorrection::C1_SCALE);
+    CHECK_NEAR(correction._c2 / VoltCorrection::C2_SCALE, expected[2], 0.6 / VoltCorrection::C2_SCALE);
+    CHECK_NEAR(correction._c2 / VoltCorrection::C2_SCALE, c2, 0.002);
+  }
+
+  void testSingular()
+  {
+    // 同じ測定値の2点からは傾きが求まらない。補正は変えない
+    CalibrationFit fit{};
+    fit.addPoint(1.f, 1.01f);
+    fit.addPoint(1.f, 1.02f);
+    VoltCorrection correction{};
+    correction.setCoefficients(0.001f, 0.f, 0.f);
+    CHECK(!fit.fit(correction));
+    CHECK(correction._c0 == 10);
+  }
+
+  void testFixedPointClamp()
+  {
+    VoltCorrection correction{};
+    correction.setCoefficients(10.f, -10.f, 0.f);
+    CHECK(correction._c0 == 32767);
+    CHECK(correction._c1 == -32767);
+  }
+
+  void testVoltDataChangeClearsCorrections()
+  {
+    SaveConfigData saveConfigData{};
+    saveConfigData._voltCorrections[2].setCoefficients(0.002f, 0.f, 0.f);
+    CHECK(saveConfigData.hasVoltCorrection());
+
+    // 上限で変化しない場合はそのまま
+    saveConfigData._voltDatas[1] = SaveConfigData::VOLT_RANGE;
+    saveConfigData.shiftParam(ConfigSettingMode::tuneVolt05Setting, 1);
+    CHECK(saveConfigData.hasVoltCorrection());
+
+    saveConfigData.shiftParam(ConfigSettingMode::tuneVolt10Setting, -1);
+    CHECK(saveConfigData._voltDatas[2] == -1);
+    CHECK(!saveConfigData.hasVoltCorrection());
+
+    // 電圧の対応表以外の設定では消えない
+    saveConfigData._voltCorrections[0].setCoefficients(0.002f, 0.f, 0.f);
+    saveConfigData.shiftParam(ConfigSettingMode::decimalSetting, -1);
+    CHECK(saveConfigData.hasVoltCorrection());
+  }
+}
+
+int main()
+{
+  testOffsetOnly();
+  testLinear();
+  testQuadraticLeastSquares();
+  testSingular();
+  testFixedPointClamp();
+  testVoltDataChangeClearsCorrections();
+  return test_util::finish("test_voltage_calibration");
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <cmath>
+
+// チャンネル毎の電圧補正式 v' = v + c0 + c1 * v + c2 * v^2
+// EEPROM に保存するため、係数は int16 の固定小数点で持つ
+struct VoltCorrection
+{
+  static constexpr float C0_SCALE{10000.f};  // 0.1mV 単位
+  static constexpr float C1_SCALE{100000.f}; // 0.00001 単位
+  static constexpr float C2_SCALE{100000.f}; // 0.00001 / V 単位
+
+  int16_t _c0{0};
+  int16_t _c1{0};
+  int16_t _c2{0};
+
+  float apply(float volt) const
+  {
+    const float c0{static_cast<float>(_c0) / C0_SCALE};
+    const float c1{static_cast<float>(_c1) / C1_SCALE};
+    const float c2{static_cast<float>(_c2) / C2_SCALE};
+    return volt + c0 + (c1 * volt) + (c2 * volt * volt);
+  }
+
+  void setCoefficients(float c0, float c1, float c2)
+  {
+    _c0 = toFixed(c0, C0_SCALE);
+    _c1 = toFixed(c1, C1_SCALE);
+    _c2 = toFixed(c2, C2_SCALE);
+  }
+
+  bool isIdentity() const
+  {
+    return _c0 == 0 && _c1 == 0 && _c2 == 0;
+  }
+
+private:
+  static int16_t toFixed(float value, float scale)
+  {
+    const long fixedValue{std::lround(value * scale)};
+    return static_cast<int16_t>(std::clamp(fixedValue, -32767L, 32767L));
+  }
+};
+
+// 基準電圧と測定電圧の組から、最小二乗法で VoltCorrection を求める
+// 点数に応じて次数を決める（1点: オフセットのみ、2点: 1次、3点以上: 2次）
+class CalibrationFit
+{
+public:
+  static constexpr uint8_t POINT_MAX{8};
+  static constexpr uint8_t DEGREE_MAX{2};
+
+  void reset()
+  {
+    _pointCount = 0;
+  }
+
+  uint8_t pointCount() const
+  {
+    return _pointCount;
+  }
+
+  bool addPoint(float measuredVolt, float referenceVolt)
+  {
+    if (_pointCount >= POINT_MAX)
+    {
+      return false;
+    }
+    _measuredVolts[_pointCount] = measuredVolt;
+    _referenceVolts[_pointCount] = referenceVolt;
+    ++_pointCount;
+    return true;
+  }
+
+  bool fit(VoltCorrection &correction) const
+  {
+    if (_pointCount == 0)
+    {
+      return false;
+    }
+
+    const uint8_t degree{static_cast<uint8_t>(std::min<int>(_pointCount - 1, DEGREE_MAX))};
+    const uint8_t size{static_cast<uint8_t>(degree + 1)};
+
+    // 正規方程式 (X^T X) c = X^T r 、r = 基準電圧 - 測定電圧
+    double matrix[DEGREE_MAX + 1][DEGREE_MAX + 2]{};
+    for (uint8_t i{0}; i < _pointCount; ++i)
+    {
+      const double v{_measuredVolts[i]};
+      const double r{static_cast<double>(_referenceVolts[i]) - v};
+      double powers[DEGREE_MAX + 1]{1.0, v, v * v};
+      for (uint8_t row{0}; row < size; ++row)
+      {
+        for (uint8_t col{0}; col < size; ++col)
+        {
+          matrix[row][col] += powers[row] * powers[col];
+        }
+        matrix[row][size] += powers[row] * r;
+      }
+    }
+
+    double coefficients[DEGREE_MAX + 1]{};
+    if (!solve(matrix, size, coefficients))
+    {
+      return false;
+    }
+
+    correction.setCoefficients(static_cast<float>(coefficients[0]), static_cast<float>(coefficients[1]), static_cast<float>(coefficients[2]));
+    return true;
+  }
+
+private:
+  // 部分ピボット付きガウスの消去法
+  static bool solve(double (&matrix)[DEGREE_MAX + 1][DEGREE_MAX + 2], uint8_t size, double (&result)[DEGREE_MAX + 1])
+  {
+    static constexpr double EPSILON{1e-12};
+    for (uint8_t col{0}; col < size; ++col)
+    {
+      uint8_t pivot{col};
+      for (uint8_t row{static_cast<uint8_t>(col + 1)}; row < size; ++row)
+      {
+        if (std::fabs(matrix[row][col]) > std::fabs(matrix[pivot][col]))
+        {
+          pivot = row;
+        }
+      }
+      if (std::fabs(matrix[pivot][col]) < EPSILON)
+      {
+        return false;
+      }
+      if (pivot != col)
+      {
+        for (uint8_t k{0}; k <= size; ++k)
+        {
+          std::swap(matrix[pivot][k], matrix[col][k]);
+        }
+      }
+      for (uint8_t row{static_cast<uint8_t>(col + 1)}; row < size; ++row)
+      {
+        const double rate{matrix[row][col] / matrix[col][col]};
+        for (uint8_t k{col}; k <= size; ++k)
+        {
+          matrix[row][k] -= rate * matrix[col][k];
+        }
+      }
+    }
+
+    for (int row{size - 1}; row >= 0; --row)
+    {
+      double value{matrix[row][size]};
+      for (uint8_t k{static_cast<uint8_t>(row + 1)}; k < size; ++k)
+      {
+        value -= matrix[row][k] * result[k];
+      }
+      result[row] = value / matrix[row][row];
+    }
+    return true;
+  }
+
+  float _measuredVolts[POINT_MAX]{};
+  float _referenceVolts[POINT_MAX]{};
+  uint8_t _pointCount{0};
+};
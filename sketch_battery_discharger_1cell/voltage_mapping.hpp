@@ -1,5 +1,8 @@
 #pragma once
 
+#include "voltage_calibration.hpp"
+#include "src/adc/supply_reference.hpp"
+
 struct VoltageMapping
 {
   struct VoltPair
@@ -8,7 +11,26 @@ struct VoltageMapping
     float volt{0};
   };
 
-  float getVoltage(int input) const
+  static constexpr uint8_t CHANNEL_SIZE{4};
+
+  // チャンネル毎の補正（自動キャリブレーション）を含めた電圧
+  float getVoltage(float input, uint8_t channel) const
+  {
+    const float volt{getVoltage(input)};
+    if (channel >= CHANNEL_SIZE)
+    {
+      return volt;
+    }
+    return _corrections[channel].apply(volt);
+  }
+
+  // ADC の生の値（平均）から、電源電圧の補正とチャンネル毎の補正を含めた電圧
+  float getCompensatedVoltage(uint32_t count, uint8_t channel) const
+  {
+    return getVoltage(static_cast<float>(SupplyReference::compensate(count)), channel);
+  }
+
+  float getVoltage(float input) const
   {
     const VoltPair *before{nullptr};
     for (const VoltPair &current : _mappingData)
@@ -26,6 +48,14 @@ struct VoltageMapping
     return 0.f;
   }
 
+  void initCorrections(const VoltCorrection (&corrections)[CHANNEL_SIZE])
+  {
+    for (uint8_t channel{0}; channel < CHANNEL_SIZE; ++channel)
+    {
+      _corrections[channel] = corrections[channel];
+    }
+  }
+
   void initMapping(const std::vector<int> &customOffsetVolt)
   {
     _mappingData = _defaultMappingData;
@@ -41,4 +71,5 @@ private:
   static constexpr float REG_RATE = REG_B / (REG_A + REG_B);
   const std::vector<VoltPair> _defaultMappingData{{0, 0.f}, {static_cast<int>(621 * REG_RATE), 0.5f}, {static_cast<int>(1241 * REG_RATE), 1.0f}, {static_cast<int>(1862 * REG_RATE), 1.5f}, {static_cast<int>(2482 * REG_RATE), 2.0f}, {static_cast<int>(4094 * REG_RATE), VOLT3_3}};
   std::vector<VoltPair> _mappingData{_defaultMappingData};
+  VoltCorrection _corrections[CHANNEL_SIZE]{};
 };
@@ -0,0 +1,245 @@
+#ifndef BULK_TRANSFER_H
+#define BULK_TRANSFER_H
+
+#include <stdint.h>
+
+// Bulk download of the logged samples as back to back notifications.
+//
+// Data frame:  type(DATA_RAW / DATA_PACKED), generation, seq(u16), total(u16), payload, crc(u16)
+// End frame:   type(END), generation, total(u16), sampleCount(u16),
+//              rateHz(u16), decimation(u16), oldestSampleIndex(u32),
+//              page(u16), pageCount(u16), crc(u16)
+//
+// seq is the chunk index counted from the oldest sample, total is the chunk count.
+// generation changes whenever the log is reset, so a central resuming an
+// interrupted transfer can tell that the data is still the same.
+// Sample n of the log was taken (oldestSampleIndex + n * decimation) / rateHz seconds
+// after the sampler started.
+// All u16/u32 values are little endian, crc is CRC-16/CCITT-FALSE over the frame before it.
+//
+// Commands (first byte of the command value):
+//   START  fromSeq(u16), pack(u8)   start or resume from fromSeq
+//   RESEND first(u16), count(u16)   send the range again (up to RESEND_MAX pending ranges)
+//   ABORT
+//   PAGE   page(u16)                    download flash log block page (0 = oldest) with the
+//                                       following STARTs, PAGE_RAM for the RAM log again
+// The end frame tells the selected page and how many flash pages there are.
+class BulkTransfer
+{
+  public:
+
+  static constexpr uint8_t FRAME_DATA_RAW = 0xB0;
+  static constexpr uint8_t FRAME_DATA_PACKED = 0xB1;
+  static constexpr uint8_t FRAME_END = 0xBF;
+
+  static constexpr uint8_t COMMAND_START = 0x10;
+  static constexpr uint8_t COMMAND_RESEND = 0x11;
+  static constexpr uint8_t COMMAND_ABORT = 0x12;
+  static constexpr uint8_t COMMAND_PAGE = 0x13;
+  static constexpr uint16_t PAGE_RAM = 0xFFFF;
+  static constexpr int COMMAND_SIZE = 5;
+
+  static constexpr int HEADER_SIZE = 6;
+  static constexpr int CRC_SIZE = 2;
+  static constexpr int END_FRAME_SIZE = 20;
+  static constexpr int RESEND_MAX = 8;
+
+  struct Timing
+  {
+    uint16_t rateHz = 0;
+    uint16_t decimation = 1;
+    uint32_t oldestSampleIndex = 0;
+  };
+
+  // Pass the previous result as crc to continue over several pieces
+  static uint16_t crc16(const uint8_t* data, int size, uint16_t crc = 0xFFFF)
+  {
+    for (int i = 0; i < size; ++i)
+    {
+      crc ^= (uint16_t)data[i] << 8;
+      for (int bit = 0; bit < 8; ++bit)
+      {
+        crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+      }
+    }
+    return crc;
+  }
+
+  static void writeUint16(uint8_t* out, uint16_t value)
+  {
+    out[0] = (uint8_t)(value & 0xFF);
+    out[1] = (uint8_t)(value >> 8);
+  }
+
+  static uint16_t readUint16(const uint8_t* in)
+  {
+    return (uint16_t)(in[0] | (in[1] << 8));
+  }
+
+  static void writeUint32(uint8_t* out, uint32_t value)
+  {
+    writeUint16(out, (uint16_t)(value & 0xFFFF));
+    writeUint16(&out[2], (uint16_t)(value >> 16));
+  }
+
+  static uint32_t readUint32(const uint8_t* in)
+  {
+    return (uint32_t)readUint16(in) | ((uint32_t)readUint16(&in[2]) << 16);
+  }
+
+  // Checks the size and crc of a received frame (for the central side and tests)
+  static bool isValidFrame(const uint8_t* frame, int size)
+  {
+    if (size < HEADER_SIZE + CRC_SIZE)
+    {
+      return false;
+    }
+    return crc16(frame, size - CRC_SIZE) == readUint16(&frame[size - CRC_SIZE]);
+  }
+
+  // Reported in the end frame of the following transfers
+  void setPage(uint16_t inPage, uint16_t inPageCount)
+  {
+    page = inPage;
+    pageCount = inPageCount;
+  }
+
+  void start(uint16_t fromSeq, uint16_t inTotal, uint16_t inSampleCount, uint8_t inGeneration, const Timing& inTiming, bool inPackFlag)
+  {
+    timing = inTiming;
+    total = inTotal;
+    sampleCount = inSampleCount;
+    generation = inGeneration;
+    packFlag = inPackFlag;
+    nextSeq = (fromSeq < total) ? fromSeq : total;
+    resendCount = 0;
+    activeFlag = true;
+  }
+
+  // Returns false when the resend queue is full; the central asks again later
+  bool requestResend(uint16_t first, uint16_t count)
+  {
+    if (first >= total || count == 0)
+    {
+      return true;
+    }
+    if (resendCount >= RESEND_MAX)
+    {
+      return false;
+    }
+
+    const uint16_t last = (count > total - first) ? total : (uint16_t)(first + count);
+    resendFirsts[resendCount] = first;
+    resendLasts[resendCount] = last;
+    ++resendCount;
+    activeFlag = true;
+    return true;
+  }
+
+  void abort()
+  {
+    nextSeq = total;
+    resendCount = 0;
+    activeFlag = false;
+  }
+
+  bool isActive() const
+  {
+    return activeFlag;
+  }
+
+  // Builds the next frame without consuming it; call advance() once it was sent.
+  // Source needs int readChunk(uint16_t seq, bool packFlag, uint8_t* payload, int payloadMax, bool& packed).
+  template <typename Source>
+  int buildFrame(Source& source, uint8_t* out, int outSize)
+  {
+    if (!activeFlag)
+    {
+      return 0;
+    }
+
+    uint16_t seq = 0;
+    if (!currentSeq(seq))
+    {
+      out[0] = FRAME_END;
+      out[1] = generation;
+      writeUint16(&out[2], total);
+      writeUint16(&out[4], sampleCount);
+      writeUint16(&out[6], timing.rateHz);
+      writeUint16(&out[8], timing.decimation);
+      writeUint32(&out[10], timing.oldestSampleIndex);
+      writeUint16(&out[14], page);
+      writeUint16(&out[16], pageCount);
+      writeUint16(&out[18], crc16(out, END_FRAME_SIZE - CRC_SIZE));
+      return END_FRAME_SIZE;
+    }
+
+    bool packed = false;
+    const int payloadSize = source.readChunk(seq, packFlag, &out[HEADER_SIZE], outSize - HEADER_SIZE - CRC_SIZE, packed);
+    out[0] = packed ? FRAME_DATA_PACKED : FRAME_DATA_RAW;
+    out[1] = generation;
+    writeUint16(&out[2], seq);
+    writeUint16(&out[4], total);
+    const int size = HEADER_SIZE + payloadSize;
+    writeUint16(&out[size], crc16(out, size));
+    return size + CRC_SIZE;
+  }
+
+  void advance()
+  {
+    if (resendCount > 0)
+    {
+      if (++resendFirsts[0] >= resendLasts[0])
+      {
+        for (int i = 1; i < resendCount; ++i)
+        {
+          resendFirsts[i - 1] = resendFirsts[i];
+          resendLasts[i - 1] = resendLasts[i];
+        }
+        --resendCount;
+      }
+    }
+    else if (nextSeq < total)
+    {
+      ++nextSeq;
+    }
+    else
+    {
+      activeFlag = false;
+    }
+  }
+
+  private:
+
+  // Resends go first so gaps are filled before the rest of the stream
+  bool currentSeq(uint16_t& seq) const
+  {
+    if (resendCount > 0)
+    {
+      seq = resendFirsts[0];
+      return true;
+    }
+    if (nextSeq < total)
+    {
+      seq = nextSeq;
+      return true;
+    }
+    return false;
+  }
+
+  Timing timing;
+  uint16_t total{0};
+  uint16_t sampleCount{0};
+  uint16_t nextSeq{0};
+  uint8_t generation{0};
+  uint16_t page{PAGE_RAM};
+  uint16_t pageCount{0};
+  bool packFlag{false};
+  bool activeFlag{false};
+
+  uint16_t resendFirsts[RESEND_MAX] = {0};
+  uint16_t resendLasts[RESEND_MAX] = {0};
+  int resendCount{0};
+};
+
+#endif
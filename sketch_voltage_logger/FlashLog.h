@@ -0,0 +1,459 @@
+#ifndef FLASH_LOG_H
+#define FLASH_LOG_H
+
+#include <stdint.h>
+#include "SampleCodec.h"
+#include "BulkTransfer.h"
+
+// NOR flash access. Erase and program only start the operation, isBusy() tells
+// when it finished; read() waits for it.
+class FlashDevice
+{
+  public:
+
+  static constexpr uint32_t SECTOR_SIZE = 4096;
+
+  virtual ~FlashDevice() {}
+
+  virtual uint32_t getSize() const = 0;
+
+  virtual bool read(uint32_t address, void* data, uint32_t size) = 0;
+
+  // One SECTOR_SIZE sector
+  virtual bool startErase(uint32_t address) = 0;
+
+  // address, data and size 4 byte aligned; data has to stay untouched until done
+  virtual bool startProgram(uint32_t address, const void* data, uint32_t size) = 0;
+
+  virtual bool isBusy() = 0;
+};
+
+// Append only log of entries in flash, one erase sector per block:
+//   magic(u32), sequence(u32), firstSampleIndex(u32), rateHz(u16), decimation(u16),
+//   sampleCount(u16), session(u16), crc(u16), reserved(u16), samples(i16 x sampleCount)
+// crc is CRC-16/CCITT-FALSE over the header before it followed by the samples.
+// Blocks go around the flash as a ring with increasing sequence, the next block
+// erasing the oldest. Sample n of a block was taken at sampler index
+// firstSampleIndex + n * decimation; session changes with every recording.
+//
+// addSample() only fills one of two RAM blocks. update() erases and programs a full
+// one step by step from loop(), so logging never waits for the flash.
+//
+// Power loss can only damage the block being programmed (newest) or the one being
+// erased (oldest). begin() finds the newest block by sequence, follows the
+// consecutive sequences back, and drops damaged blocks at both ends by their crc.
+class FlashLog
+{
+  public:
+
+  static constexpr uint32_t BLOCK_SIZE = FlashDevice::SECTOR_SIZE;
+  static constexpr uint32_t MAGIC = 0x474F4C56; // "VLOG"
+  static constexpr int HEADER_SIZE = 24;
+  static constexpr int CRC_OFFSET = 20;
+  static constexpr int BLOCK_SAMPLE_MAX = (BLOCK_SIZE - HEADER_SIZE) / 2;
+
+  struct BlockInfo
+  {
+    uint32_t sequence = 0;
+    uint32_t firstSampleIndex = 0;
+    uint16_t rateHz = 0;
+    uint16_t decimation = 1;
+    uint16_t sampleCount = 0;
+    uint16_t session = 0;
+  };
+
+  bool begin(FlashDevice& inDevice)
+  {
+    device = &inDevice;
+    blockCount = device->getSize() / BLOCK_SIZE;
+    activeFlag = blockCount >= 2;
+    for (int i = 0; i < 2; ++i)
+    {
+      stageCount[i] = 0;
+      stageFullFlag[i] = false;
+    }
+    fillIndex = 0;
+    flushState = FlushState::Idle;
+    droppedCount = 0;
+    if (activeFlag)
+    {
+      recover();
+    }
+    return activeFlag;
+  }
+
+  bool isActive() const
+  {
+    return activeFlag;
+  }
+
+  // Starts a new recording; what was added before goes to its own block
+  void startSession(uint16_t inRateHz, uint16_t inDecimation)
+  {
+    closeBlock();
+    rateHz = inRateHz;
+    decimation = inDecimation;
+    ++session;
+  }
+
+  void addSample(int16_t sample, uint32_t sampleIndex)
+  {
+    if (!activeFlag)
+    {
+      return;
+    }
+
+    // a block only holds evenly spaced entries
+    if (stageCount[fillIndex] > 0 && sampleIndex != nextSampleIndex)
+    {
+      closeBlock();
+    }
+    // both blocks wait for the flash
+    if (stageFullFlag[fillIndex])
+    {
+      ++droppedCount;
+      return;
+    }
+
+    uint8_t* block = getStage(fillIndex);
+    // the recording the block belongs to is fixed by its first sample, not by the
+    // session running when update() gets to it
+    if (stageCount[fillIndex] == 0)
+    {
+      BulkTransfer::writeUint32(&block[8], sampleIndex);
+      BulkTransfer::writeUint16(&block[12], rateHz);
+      BulkTransfer::writeUint16(&block[14], decimation);
+      BulkTransfer::writeUint16(&block[18], session);
+    }
+    SampleCodec::writeInt16(&block[HEADER_SIZE + stageCount[fillIndex] * 2], sample);
+    ++stageCount[fillIndex];
+    nextSampleIndex = sampleIndex + decimation;
+
+    if (stageCount[fillIndex] >= BLOCK_SAMPLE_MAX)
+    {
+      closeBlock();
+    }
+  }
+
+  // Hands the partly filled RAM block to update(), e.g. when logging stops
+  void closeBlock()
+  {
+    if (stageCount[fillIndex] == 0 || stageFullFlag[fillIndex])
+    {
+      return;
+    }
+    stageFullFlag[fillIndex] = true;
+    fillIndex ^= 1;
+  }
+
+  // Advances the background erase / program. Call often from loop().
+  void update()
+  {
+    if (!activeFlag)
+    {
+      return;
+    }
+
+    switch (flushState)
+    {
+      case FlushState::Idle:
+      {
+        // the block closed first goes first: the other one, or the fill block
+        // itself when both are full (closeBlock() moved back onto it)
+        const int index = stageFullFlag[fillIndex] ? fillIndex : (fillIndex ^ 1);
+        if (!stageFullFlag[index])
+        {
+          return;
+        }
+        // once the ring is full the next position holds the oldest block
+        if (validCount == blockCount)
+        {
+          oldestPos = (oldestPos + 1) % blockCount;
+          --validCount;
+        }
+        finishHeader(index);
+        if (!device->startErase(nextPos * BLOCK_SIZE))
+        {
+          return;
+        }
+        flushIndex = index;
+        flushState = FlushState::Erasing;
+        break;
+      }
+
+      case FlushState::Erasing:
+      {
+        if (device->isBusy())
+        {
+          return;
+        }
+        const uint32_t size = (HEADER_SIZE + stageCount[flushIndex] * 2 + 3) & ~3UL;
+        if (!device->startProgram(nextPos * BLOCK_SIZE, getStage(flushIndex), size))
+        {
+          return;
+        }
+        flushState = FlushState::Programming;
+        break;
+      }
+
+      case FlushState::Programming:
+      {
+        if (device->isBusy())
+        {
+          return;
+        }
+        if (validCount == 0)
+        {
+          oldestPos = nextPos;
+        }
+        ++validCount;
+        nextPos = (nextPos + 1) % blockCount;
+        ++nextSequence;
+        stageCount[flushIndex] = 0;
+        stageFullFlag[flushIndex] = false;
+        flushState = FlushState::Idle;
+        break;
+      }
+    }
+  }
+
+  // Nothing left in RAM
+  bool isFlushed() const
+  {
+    return !stageFullFlag[0] && !stageFullFlag[1] && stageCount[0] == 0 && stageCount[1] == 0 && flushState == FlushState::Idle;
+  }
+
+  uint32_t getDroppedCount() const
+  {
+    return droppedCount;
+  }
+
+  // Blocks in flash, page 0 is the oldest
+  uint32_t getBlockCount() const
+  {
+    return validCount;
+  }
+
+  uint32_t getOldestSequence() const
+  {
+    return nextSequence - validCount;
+  }
+
+  // Blocks are addressed by sequence, so a read never hits a block that was
+  // erased for a newer one in the meantime
+  bool readBlockInfo(uint32_t sequence, BlockInfo& info)
+  {
+    uint32_t pos = 0;
+    uint8_t header[HEADER_SIZE];
+    return findBlock(sequence, pos) && readHeader(pos, header, info);
+  }
+
+  // Returns the number of samples read (0 once the block is gone)
+  int readBlockSamples(uint32_t sequence, int first, int16_t* samples, int count)
+  {
+    uint32_t pos = 0;
+    BlockInfo info;
+    uint8_t header[HEADER_SIZE];
+    if (!findBlock(sequence, pos) || !readHeader(pos, header, info) || first >= info.sampleCount)
+    {
+      return 0;
+    }
+    if (count > info.sampleCount - first)
+    {
+      count = info.sampleCount - first;
+    }
+    if (!device->read(pos * BLOCK_SIZE + HEADER_SIZE + first * 2, samples, count * 2))
+    {
+      return 0;
+    }
+    // stored little endian like the target, but keep it explicit
+    uint8_t* bytes = (uint8_t*)samples;
+    for (int i = count - 1; i >= 0; --i)
+    {
+      samples[i] = SampleCodec::readInt16(&bytes[i * 2]);
+    }
+    return count;
+  }
+
+  private:
+
+  enum class FlushState : uint8_t
+  {
+    Idle,
+    Erasing,
+    Programming,
+  };
+
+  uint8_t* getStage(int index)
+  {
+    return (uint8_t*)&stage[index][0];
+  }
+
+  void finishHeader(int index)
+  {
+    uint8_t* block = getStage(index);
+    BulkTransfer::writeUint32(&block[0], MAGIC);
+    BulkTransfer::writeUint32(&block[4], nextSequence);
+    BulkTransfer::writeUint16(&block[16], (uint16_t)stageCount[index]);
+    const uint16_t crc = BulkTransfer::crc16(&block[0], CRC_OFFSET);
+    BulkTransfer::writeUint16(&block[CRC_OFFSET], BulkTransfer::crc16(&block[HEADER_SIZE], stageCount[index] * 2, crc));
+    BulkTransfer::writeUint16(&block[22], 0xFFFF);
+  }
+
+  bool findBlock(uint32_t sequence, uint32_t& pos) const
+  {
+    const uint32_t offset = sequence - getOldestSequence();
+    if (!activeFlag || offset >= validCount)
+    {
+      return false;
+    }
+    pos = (oldestPos + offset) % blockCount;
+    return true;
+  }
+
+  bool readHeader(uint32_t pos, uint8_t* header, BlockInfo& info)
+  {
+    if (!device->read(pos * BLOCK_SIZE, header, HEADER_SIZE))
+    {
+      return false;
+    }
+    info.sequence = BulkTransfer::readUint32(&header[4]);
+    info.firstSampleIndex = BulkTransfer::readUint32(&header[8]);
+    info.rateHz = BulkTransfer::readUint16(&header[12]);
+    info.decimation = BulkTransfer::readUint16(&header[14]);
+    info.sampleCount = BulkTransfer::readUint16(&header[16]);
+    info.session = BulkTransfer::readUint16(&header[18]);
+    return BulkTransfer::readUint32(&header[0]) == MAGIC && info.sequence != 0xFFFFFFFF && info.sampleCount <= BLOCK_SAMPLE_MAX;
+  }
+
+  // Reads the whole block into a RAM stage (only used before logging starts)
+  bool isIntact(uint32_t pos)
+  {
+    uint8_t* block = getStage(0);
+    BlockInfo info;
+    if (!device->read(pos * BLOCK_SIZE, block, BLOCK_SIZE) || !readHeader(pos, block, info))
+    {
+      return false;
+    }
+    const uint16_t crc = BulkTransfer::crc16(&block[0], CRC_OFFSET);
+    return BulkTransfer::crc16(&block[HEADER_SIZE], info.sampleCount * 2, crc) == BulkTransfer::readUint16(&block[CRC_OFFSET]);
+  }
+
+  void recover()
+  {
+    validCount = 0;
+    oldestPos = 0;
+    nextPos = 0;
+    nextSequence = 0;
+    session = 0;
+
+    uint32_t newestPos = 0;
+    if (!findNewest(blockCount, newestPos) || recoverFrom(newestPos))
+    {
+      return;
+    }
+    // Only the block being erased or programmed at the power loss can be damaged. A
+    // half erased header can read as a sequence above the newest one (erase sets bits),
+    // so when the newest turns out broken look again without it.
+    const uint32_t damagedPos = newestPos;
+    if (findNewest(damagedPos, newestPos))
+    {
+      recoverFrom(newestPos);
+    }
+  }
+
+  // Position of the highest sequence with a valid header, skipping skipPos
+  bool findNewest(uint32_t skipPos, uint32_t& newestPos)
+  {
+    uint8_t header[HEADER_SIZE];
+    BlockInfo info;
+    bool foundFlag = false;
+    uint32_t newestSequence = 0;
+    for (uint32_t pos = 0; pos < blockCount; ++pos)
+    {
+      if (pos != skipPos && readHeader(pos, header, info) && (!foundFlag || info.sequence > newestSequence))
+      {
+        newestPos = pos;
+        newestSequence = info.sequence;
+        foundFlag = true;
+      }
+    }
+    return foundFlag;
+  }
+
+  // Follows the consecutive sequences back from newestPos and drops damaged blocks at
+  // both ends. Returns false (and changes nothing) when no intact block is left.
+  bool recoverFrom(uint32_t newestPos)
+  {
+    uint8_t header[HEADER_SIZE];
+    BlockInfo info;
+    if (!readHeader(newestPos, header, info))
+    {
+      return false;
+    }
+    uint32_t newestSequence = info.sequence;
+
+    // walk back over consecutive sequences
+    uint32_t count = 1;
+    while (count < blockCount)
+    {
+      const uint32_t pos = (newestPos + blockCount - count) % blockCount;
+      if (!readHeader(pos, header, info) || info.sequence != newestSequence - count)
+      {
+        break;
+      }
+      ++count;
+    }
+    uint32_t firstPos = (newestPos + blockCount - (count - 1)) % blockCount;
+
+    while (count > 0 && !isIntact(newestPos))
+    {
+      newestPos = (newestPos + blockCount - 1) % blockCount;
+      --newestSequence;
+      --count;
+    }
+    while (count > 0 && !isIntact(firstPos))
+    {
+      firstPos = (firstPos + 1) % blockCount;
+      --count;
+    }
+    if (count == 0)
+    {
+      return false;
+    }
+
+    // a dropped newest block is erased again before its position is reused
+    nextPos = (newestPos + 1) % blockCount;
+    nextSequence = newestSequence + 1;
+    oldestPos = firstPos;
+    validCount = count;
+    readHeader(newestPos, header, info);
+    session = info.session;
+    return true;
+  }
+
+  FlashDevice* device{nullptr};
+  uint32_t blockCount{0};
+  bool activeFlag{false};
+
+  uint32_t oldestPos{0};
+  uint32_t validCount{0};
+  uint32_t nextPos{0};
+  uint32_t nextSequence{0};
+  uint16_t session{0};
+
+  uint16_t rateHz{0};
+  uint16_t decimation{1};
+  uint32_t nextSampleIndex{0};
+
+  // word aligned for the flash DMA
+  uint32_t stage[2][BLOCK_SIZE / 4] = {{0}};
+  int stageCount[2] = {0, 0};
+  bool stageFullFlag[2] = {false, false};
+  int fillIndex{0};
+  int flushIndex{0};
+  FlushState flushState{FlushState::Idle};
+  uint32_t droppedCount{0};
+};
+
+#endif
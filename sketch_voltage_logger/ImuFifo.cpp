@@ -0,0 +1,102 @@
+#include "ImuFifo.h"
+
+#include <LSM6DS3.h>
+
+namespace {
+
+  constexpr uint8_t FIFO_DECIMATION_NONE = 0x09;   // FIFO_CTRL3: gyro and accel, every sample
+  constexpr uint8_t FIFO_ODR_208HZ = 0x05 << 3;     // FIFO_CTRL5 ODR_FIFO
+  constexpr uint8_t FIFO_MODE_BYPASS = 0x00;
+  constexpr uint8_t FIFO_MODE_CONTINUOUS = 0x06;
+  constexpr uint8_t FIFO_STATUS2_OVERRUN = 0x40;
+  constexpr uint8_t FIFO_STATUS2_DIFF_MASK = 0x0F;
+  constexpr uint8_t FIFO_STATUS4_PATTERN_MASK = 0x03;
+
+  static_assert(ImuFifo::ODR_HZ == 208, "update FIFO_ODR_208HZ with ODR_HZ");
+}
+
+bool ImuFifo::begin(LSM6DS3& imu)
+{
+  activeFlag = false;
+  overrunCount = 0;
+
+  // no threshold interrupt, the FIFO is polled from loop()
+  if (imu.writeRegister(LSM6DS3_ACC_GYRO_FIFO_CTRL1, 0) != IMU_SUCCESS ||
+      imu.writeRegister(LSM6DS3_ACC_GYRO_FIFO_CTRL2, 0) != IMU_SUCCESS ||
+      imu.writeRegister(LSM6DS3_ACC_GYRO_FIFO_CTRL3, FIFO_DECIMATION_NONE) != IMU_SUCCESS ||
+      imu.writeRegister(LSM6DS3_ACC_GYRO_FIFO_CTRL4, 0) != IMU_SUCCESS) {
+    return false;
+  }
+
+  activeFlag = true;
+  clear(imu);
+  return activeFlag;
+}
+
+void ImuFifo::end(LSM6DS3& imu)
+{
+  imu.writeRegister(LSM6DS3_ACC_GYRO_FIFO_CTRL5, FIFO_MODE_BYPASS);
+  activeFlag = false;
+}
+
+// Going through bypass mode empties the FIFO
+void ImuFifo::clear(LSM6DS3& imu)
+{
+  if (!activeFlag) {
+    return;
+  }
+  if (imu.writeRegister(LSM6DS3_ACC_GYRO_FIFO_CTRL5, FIFO_MODE_BYPASS) != IMU_SUCCESS ||
+      imu.writeRegister(LSM6DS3_ACC_GYRO_FIFO_CTRL5, FIFO_ODR_208HZ | FIFO_MODE_CONTINUOUS) != IMU_SUCCESS) {
+    activeFlag = false;
+  }
+}
+
+int ImuFifo::read(LSM6DS3& imu, ImuSample* samples, int sampleMax)
+{
+  if (!activeFlag) {
+    return 0;
+  }
+
+  // FIFO_STATUS1..4: unread words, flags and the pattern index of the next word
+  uint8_t status[4];
+  if (imu.readRegisterRegion(&status[0], LSM6DS3_ACC_GYRO_FIFO_STATUS1, 4) != IMU_SUCCESS) {
+    return 0;
+  }
+  if (status[1] & FIFO_STATUS2_OVERRUN) {
+    ++overrunCount;
+  }
+  int unreadWords = status[0] | ((status[1] & FIFO_STATUS2_DIFF_MASK) << 8);
+  const int pattern = status[2] | ((status[3] & FIFO_STATUS4_PATTERN_MASK) << 8);
+
+  uint8_t data[BURST_SAMPLE_MAX * BYTES_PER_SAMPLE];
+
+  // after an overrun the next word may be in the middle of a set
+  if (pattern != 0) {
+    const int skipWords = WORDS_PER_SAMPLE - pattern;
+    if (skipWords > unreadWords) {
+      return 0;
+    }
+    // FIFO_DATA_OUT_H rolls back to FIFO_DATA_OUT_L, so a burst reads consecutive words
+    imu.readRegisterRegion(&data[0], LSM6DS3_ACC_GYRO_FIFO_DATA_OUT_L, skipWords * 2);
+    unreadWords -= skipWords;
+  }
+
+  int count = unreadWords / WORDS_PER_SAMPLE;
+  if (count > sampleMax) {
+    count = sampleMax;
+  }
+  if (count > BURST_SAMPLE_MAX) {
+    count = BURST_SAMPLE_MAX;
+  }
+  if (count <= 0) {
+    return 0;
+  }
+
+  if (imu.readRegisterRegion(&data[0], LSM6DS3_ACC_GYRO_FIFO_DATA_OUT_L, count * BYTES_PER_SAMPLE) != IMU_SUCCESS) {
+    return 0;
+  }
+  for (int i = 0; i < count; ++i) {
+    decodeSample(&data[i * BYTES_PER_SAMPLE], samples[i]);
+  }
+  return count;
+}
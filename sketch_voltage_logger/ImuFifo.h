@@ -0,0 +1,69 @@
+#ifndef IMU_FIFO_H
+#define IMU_FIFO_H
+
+#include <stdint.h>
+
+class LSM6DS3;
+
+struct ImuSample
+{
+  int16_t gyro[3] = {0};  // raw, convert with LSM6DS3::calcGyro()
+  int16_t accel[3] = {0}; // raw, convert with LSM6DS3::calcAccel()
+};
+
+// LSM6DS3 FIFO in continuous mode with gyro and accel stored at ODR_HZ.
+// The sensor keeps sampling while loop() is busy (BLE, flash, ...) and read()
+// drains whole gyro + accel sets with one burst read, so each sample is taken
+// exactly getPeriodSec() after the previous one. If the FIFO overruns the
+// oldest sets are lost and read() realigns to the next gyro X word.
+class ImuFifo
+{
+  public:
+
+  static constexpr uint16_t ODR_HZ = 208;
+  static constexpr int WORDS_PER_SAMPLE = 6; // Gx Gy Gz XLx XLy XLz
+  static constexpr int BYTES_PER_SAMPLE = WORDS_PER_SAMPLE * 2;
+  static constexpr int BURST_SAMPLE_MAX = 10;
+
+  // Call after imu.begin() with the gyro and accel ODR set to ODR_HZ
+  bool begin(LSM6DS3& imu);
+
+  void end(LSM6DS3& imu);
+
+  // Drops everything stored so far
+  void clear(LSM6DS3& imu);
+
+  // Reads up to sampleMax (at most BURST_SAMPLE_MAX) complete samples, returns the count
+  int read(LSM6DS3& imu, ImuSample* samples, int sampleMax);
+
+  bool isActive() const
+  {
+    return activeFlag;
+  }
+
+  uint32_t getOverrunCount() const
+  {
+    return overrunCount;
+  }
+
+  static constexpr float getPeriodSec()
+  {
+    return 1.f / ODR_HZ;
+  }
+
+  // One set as stored in the FIFO, little endian words in pattern order
+  static void decodeSample(const uint8_t* data, ImuSample& sample)
+  {
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      sample.gyro[axis] = (int16_t)(data[axis * 2] | (data[axis * 2 + 1] << 8));
+      sample.accel[axis] = (int16_t)(data[6 + axis * 2] | (data[6 + axis * 2 + 1] << 8));
+    }
+  }
+
+  private:
+  bool activeFlag{false};
+  uint32_t overrunCount{0};
+};
+
+#endif
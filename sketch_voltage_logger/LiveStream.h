@@ -0,0 +1,211 @@
+#ifndef LIVE_STREAM_H
+#define LIVE_STREAM_H
+
+#include <stdint.h>
+#include "SampleCodec.h"
+#include "WindowStats.h"
+
+// Live logger frames: every entry since the previous frame plus the current angles,
+// packed into one notification.
+//
+// Frame: type(FRAME_LIVE), flags, seq(u16), firstSampleIndex(u32), rateHz(u16),
+//        decimation(u16), sampleCount(u8), fillPercent(u8),
+//        roll(i16), pitch(i16), yaw(i16),
+//        min(i16), max(i16), mean(i16), rms(u16), belowCount(u16), rawCount(u16),
+//        samples (SampleCodec packed)
+//
+// Sample n of the frame was taken (firstSampleIndex + n * decimation) / rateHz seconds
+// after the sampler started; a jump in firstSampleIndex means entries were dropped.
+// Angles are in ANGLE_SCALE units. With FLAG_ANGLE_ABSOLUTE they are the angles
+// themselves, otherwise the difference to the previous frame modulo 2^16, so adding
+// them as int16 restores the exact value. Every KEYFRAME_INTERVAL frames is absolute.
+// The statistics (WindowStats) cover every raw sample since the previous frame.
+// All values are little endian.
+class LiveStream
+{
+  public:
+
+  static constexpr uint8_t FRAME_LIVE = 0xA0;
+  static constexpr uint8_t FLAG_ANGLE_ABSOLUTE = 0x01;
+  static constexpr uint8_t FLAG_ANGLE_VALID = 0x02;
+
+  static constexpr int HEADER_SIZE = 32;
+  static constexpr int STATS_OFFSET = 20;
+  static constexpr int SAMPLE_COUNT_MAX = 255;
+  static constexpr int QUEUE_SIZE = 512; // power of two
+  static constexpr int KEYFRAME_INTERVAL = 30;
+  static constexpr float ANGLE_SCALE = 100.f; // 0.01 deg
+
+  struct Header
+  {
+    uint8_t flags = 0;
+    uint16_t seq = 0;
+    uint32_t firstSampleIndex = 0;
+    uint16_t rateHz = 0;
+    uint16_t decimation = 1;
+    uint8_t sampleCount = 0;
+    uint8_t fillPercent = 0;
+    int16_t angles[3] = {0, 0, 0};
+    WindowStats::Report stats;
+  };
+
+  void reset(uint16_t inRateHz, uint16_t inDecimation)
+  {
+    rateHz = inRateHz;
+    decimation = inDecimation;
+    queueCount = 0;
+    queueFirst = 0;
+    frameCount = 0;
+  }
+
+  // Entries arrive in order, decimation sample indexes apart. When the central
+  // does not keep up the oldest ones are dropped.
+  void addSample(int16_t sample, uint32_t sampleIndex)
+  {
+    if (queueCount == QUEUE_SIZE)
+    {
+      queueFirst = (queueFirst + 1) & (QUEUE_SIZE - 1);
+      --queueCount;
+      firstSampleIndex += decimation;
+    }
+    if (queueCount == 0)
+    {
+      firstSampleIndex = sampleIndex;
+    }
+    queue[(queueFirst + queueCount) & (QUEUE_SIZE - 1)] = sample;
+    ++queueCount;
+  }
+
+  int getQueueCount() const
+  {
+    return queueCount;
+  }
+
+  // Builds the next frame without consuming anything; call advance() once it was sent.
+  // angles are in degrees (roll, pitch, yaw).
+  int buildFrame(uint8_t* out, int outSize, const float* angles, bool angleValidFlag, uint8_t fillPercent, const WindowStats::Report& stats)
+  {
+    if (outSize < HEADER_SIZE)
+    {
+      return 0;
+    }
+
+    const bool absoluteFlag = (frameCount % KEYFRAME_INTERVAL) == 0;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      const float scaled = angles[axis] * ANGLE_SCALE;
+      pendingAngles[axis] = (int16_t)(scaled >= 0.f ? scaled + 0.5f : scaled - 0.5f);
+    }
+
+    // SampleCodec works on a contiguous array
+    int16_t samples[SAMPLE_COUNT_MAX];
+    const int count = (queueCount < SAMPLE_COUNT_MAX) ? queueCount : SAMPLE_COUNT_MAX;
+    for (int i = 0; i < count; ++i)
+    {
+      samples[i] = queue[(queueFirst + i) & (QUEUE_SIZE - 1)];
+    }
+    int packedSize = 0;
+    pendingCount = SampleCodec::pack(&samples[0], count, &out[HEADER_SIZE], outSize - HEADER_SIZE, packedSize);
+
+    out[0] = FRAME_LIVE;
+    out[1] = (absoluteFlag ? FLAG_ANGLE_ABSOLUTE : 0) | (angleValidFlag ? FLAG_ANGLE_VALID : 0);
+    writeUint16(&out[2], seq);
+    writeUint16(&out[4], (uint16_t)(firstSampleIndex & 0xFFFF));
+    writeUint16(&out[6], (uint16_t)(firstSampleIndex >> 16));
+    writeUint16(&out[8], rateHz);
+    writeUint16(&out[10], decimation);
+    out[12] = (uint8_t)pendingCount;
+    out[13] = fillPercent;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      const int16_t value = absoluteFlag ? pendingAngles[axis] : (int16_t)(uint16_t)(pendingAngles[axis] - sentAngles[axis]);
+      writeUint16(&out[14 + axis * 2], (uint16_t)value);
+    }
+    writeUint16(&out[STATS_OFFSET], (uint16_t)stats.minValue);
+    writeUint16(&out[STATS_OFFSET + 2], (uint16_t)stats.maxValue);
+    writeUint16(&out[STATS_OFFSET + 4], (uint16_t)stats.mean);
+    writeUint16(&out[STATS_OFFSET + 6], stats.rms);
+    writeUint16(&out[STATS_OFFSET + 8], stats.belowCount);
+    writeUint16(&out[STATS_OFFSET + 10], stats.count);
+    return HEADER_SIZE + packedSize;
+  }
+
+  void advance()
+  {
+    queueFirst = (queueFirst + pendingCount) & (QUEUE_SIZE - 1);
+    queueCount -= pendingCount;
+    firstSampleIndex += (uint32_t)pendingCount * decimation;
+    pendingCount = 0;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      sentAngles[axis] = pendingAngles[axis];
+    }
+    ++seq;
+    ++frameCount;
+  }
+
+  // Central side (and tests): decodes one frame. angles holds the previous absolute
+  // angles and is updated in place. Returns the sample count or -1 if malformed.
+  static int parseFrame(const uint8_t* in, int size, Header& header, int16_t* angles, int16_t* samples, int maxCount)
+  {
+    if (size < HEADER_SIZE || in[0] != FRAME_LIVE)
+    {
+      return -1;
+    }
+
+    header.flags = in[1];
+    header.seq = readUint16(&in[2]);
+    header.firstSampleIndex = (uint32_t)readUint16(&in[4]) | ((uint32_t)readUint16(&in[6]) << 16);
+    header.rateHz = readUint16(&in[8]);
+    header.decimation = readUint16(&in[10]);
+    header.sampleCount = in[12];
+    header.fillPercent = in[13];
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      const uint16_t value = readUint16(&in[14 + axis * 2]);
+      angles[axis] = (header.flags & FLAG_ANGLE_ABSOLUTE) ? (int16_t)value : (int16_t)(uint16_t)(angles[axis] + value);
+      header.angles[axis] = angles[axis];
+    }
+    header.stats.minValue = (int16_t)readUint16(&in[STATS_OFFSET]);
+    header.stats.maxValue = (int16_t)readUint16(&in[STATS_OFFSET + 2]);
+    header.stats.mean = (int16_t)readUint16(&in[STATS_OFFSET + 4]);
+    header.stats.rms = readUint16(&in[STATS_OFFSET + 6]);
+    header.stats.belowCount = readUint16(&in[STATS_OFFSET + 8]);
+    header.stats.count = readUint16(&in[STATS_OFFSET + 10]);
+
+    const int count = SampleCodec::unpack(&in[HEADER_SIZE], size - HEADER_SIZE, samples, maxCount);
+    if (count != header.sampleCount)
+    {
+      return -1;
+    }
+    return count;
+  }
+
+  private:
+
+  static void writeUint16(uint8_t* out, uint16_t value)
+  {
+    out[0] = (uint8_t)(value & 0xFF);
+    out[1] = (uint8_t)(value >> 8);
+  }
+
+  static uint16_t readUint16(const uint8_t* in)
+  {
+    return (uint16_t)(in[0] | (in[1] << 8));
+  }
+
+  int16_t queue[QUEUE_SIZE] = {0};
+  int queueFirst{0};
+  int queueCount{0};
+  uint32_t firstSampleIndex{0};
+  int pendingCount{0};
+
+  uint16_t rateHz{0};
+  uint16_t decimation{1};
+  uint16_t seq{0};
+  uint32_t frameCount{0};
+  int16_t pendingAngles[3] = {0, 0, 0};
+  int16_t sentAngles[3] = {0, 0, 0};
+};
+
+#endif
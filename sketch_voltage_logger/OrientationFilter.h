@@ -0,0 +1,167 @@
+#ifndef ORIENTATION_FILTER_H
+#define ORIENTATION_FILTER_H
+
+#include <stdint.h>
+#include <math.h>
+#include "Quaternion.h"
+
+// Mahony style complementary filter: the gyro is integrated and the error between
+// the measured gravity direction (accel) and the one predicted by the orientation
+// is fed back as a rate correction (kp) plus a slowly learned gyro bias (ki).
+// Roll and pitch are held by gravity; yaw has no reference and still drifts slowly.
+//
+// The quaternion rotates sensor coordinates to world coordinates (a = w).
+// It is normalized only every NORMALIZE_INTERVAL updates; between those it can be
+// off from unit length by a tiny amount.
+class OrientationFilter
+{
+  public:
+
+  struct Sample
+  {
+    float gyro[3] = {0.f, 0.f, 0.f};  // rad/s
+    float accel[3] = {0.f, 0.f, 0.f}; // any unit, only the direction is used
+  };
+
+  static constexpr int NORMALIZE_INTERVAL = 8;
+
+  float kp = 1.f;
+  float ki = 0.02f;
+
+  // The next sample with a valid accel sets roll and pitch directly
+  void reset()
+  {
+    quat = Quaternion();
+    biasX = 0.f;
+    biasY = 0.f;
+    biasZ = 0.f;
+    stepCount = 0;
+    initFlag = false;
+  }
+
+  void update(const Sample& sample, float dtSec)
+  {
+    updateBatch(&sample, 1, dtSec);
+  }
+
+  // Several samples taken periodSec apart (a FIFO burst). The gravity error is
+  // computed once from the mean accel and applied to every gyro step. The mean
+  // accel belongs to the middle of the burst, so the predicted gravity is turned
+  // by the mean gyro to the same time before they are compared.
+  void updateBatch(const Sample* samples, int count, float periodSec)
+  {
+    if (count <= 0)
+    {
+      return;
+    }
+
+    float ax = 0.f;
+    float ay = 0.f;
+    float az = 0.f;
+    float gx = 0.f;
+    float gy = 0.f;
+    float gz = 0.f;
+    for (int i = 0; i < count; ++i)
+    {
+      ax += samples[i].accel[0];
+      ay += samples[i].accel[1];
+      az += samples[i].accel[2];
+      gx += samples[i].gyro[0];
+      gy += samples[i].gyro[1];
+      gz += samples[i].gyro[2];
+    }
+
+    float ex = 0.f;
+    float ey = 0.f;
+    float ez = 0.f;
+    const float accelNorm = sqrtf(ax * ax + ay * ay + az * az);
+    if (accelNorm > 0.f)
+    {
+      ax /= accelNorm;
+      ay /= accelNorm;
+      az /= accelNorm;
+
+      if (!initFlag)
+      {
+        initFromGravity(ax, ay, az);
+      }
+
+      // gravity (world +z) seen from the sensor
+      float vx = 2.f * (quat.b * quat.d - quat.a * quat.c);
+      float vy = 2.f * (quat.a * quat.b + quat.c * quat.d);
+      float vz = quat.a * quat.a - quat.b * quat.b - quat.c * quat.c + quat.d * quat.d;
+
+      // seen from the sensor, gravity turns against the gyro: v += (v x w) * t
+      if (count > 1)
+      {
+        const float midSec = 0.5f * periodSec * (count - 1) / count;
+        gx *= midSec;
+        gy *= midSec;
+        gz *= midSec;
+        const float px = vy * gz - vz * gy;
+        const float py = vz * gx - vx * gz;
+        const float pz = vx * gy - vy * gx;
+        vx += px;
+        vy += py;
+        vz += pz;
+      }
+
+      ex = ay * vz - az * vy;
+      ey = az * vx - ax * vz;
+      ez = ax * vy - ay * vx;
+
+      const float batchSec = periodSec * count;
+      biasX += ki * ex * batchSec;
+      biasY += ki * ey * batchSec;
+      biasZ += ki * ez * batchSec;
+    }
+
+    const float cx = kp * ex + biasX;
+    const float cy = kp * ey + biasY;
+    const float cz = kp * ez + biasZ;
+    const float halfDt = 0.5f * periodSec;
+    for (int i = 0; i < count; ++i)
+    {
+      const Quaternion rate(samples[i].gyro[0] + cx, samples[i].gyro[1] + cy, samples[i].gyro[2] + cz);
+      quat += (quat * rate) * halfDt;
+
+      if (++stepCount >= NORMALIZE_INTERVAL)
+      {
+        quat.normalize();
+        stepCount = 0;
+      }
+    }
+  }
+
+  const Quaternion& getQuat() const
+  {
+    return quat;
+  }
+
+  private:
+
+  // Zero yaw, roll and pitch from the gravity direction (normalized)
+  void initFromGravity(float ax, float ay, float az)
+  {
+    const float roll = atan2f(ay, az);
+    const float pitch = atan2f(-ax, sqrtf(ay * ay + az * az));
+    const float cr = cosf(roll * 0.5f);
+    const float sr = sinf(roll * 0.5f);
+    const float cp = cosf(pitch * 0.5f);
+    const float sp = sinf(pitch * 0.5f);
+    quat.a = cr * cp;
+    quat.b = sr * cp;
+    quat.c = cr * sp;
+    quat.d = -sr * sp;
+    initFlag = true;
+  }
+
+  Quaternion quat;
+  float biasX{0.f};
+  float biasY{0.f};
+  float biasZ{0.f};
+  int stepCount{0};
+  bool initFlag{false};
+};
+
+#endif
@@ -0,0 +1,193 @@
+#include "QspiFlash.h"
+
+#ifdef ARDUINO
+#include "Arduino.h"
+#endif
+
+#if defined(NRF52840_XXAA)
+
+namespace {
+
+  // XIAO nRF52840: SCK P0.21, CSN P0.25, IO0..IO3 P0.20, P0.24, P0.22, P0.23
+  constexpr uint32_t PIN_SCK = 21;
+  constexpr uint32_t PIN_CSN = 25;
+  constexpr uint32_t PIN_IO[4] = {20, 24, 22, 23};
+
+  constexpr uint8_t OPCODE_READ_STATUS = 0x05;
+  constexpr uint8_t OPCODE_RELEASE_POWER_DOWN = 0xAB;
+  constexpr uint8_t STATUS_WIP = 0x01;
+  constexpr uint32_t READY_TIMEOUT_MICROS = 100000;
+
+  // the QSPI DMA needs word aligned RAM and sizes
+  constexpr int BOUNCE_SIZE = 64;
+  uint32_t bounceBuffer[BOUNCE_SIZE / 4];
+
+  bool waitReady() {
+    const uint32_t startMicros = micros();
+    while (!NRF_QSPI->EVENTS_READY) {
+      if (micros() - startMicros > READY_TIMEOUT_MICROS) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Short command with up to one data byte; keeps WP/HOLD (IO2/IO3) high
+  bool customInstruction(uint8_t opcode, int length, uint8_t& data) {
+    NRF_QSPI->EVENTS_READY = 0;
+    NRF_QSPI->CINSTRDAT0 = data;
+    NRF_QSPI->CINSTRCONF =
+      (opcode << QSPI_CINSTRCONF_OPCODE_Pos) |
+      (length << QSPI_CINSTRCONF_LENGTH_Pos) |
+      (1 << QSPI_CINSTRCONF_LIO2_Pos) |
+      (1 << QSPI_CINSTRCONF_LIO3_Pos);
+    if (!waitReady()) {
+      return false;
+    }
+    data = (uint8_t)(NRF_QSPI->CINSTRDAT0 & 0xFF);
+    return true;
+  }
+}
+
+bool QspiFlash::begin()
+{
+  activeFlag = false;
+
+  NRF_QSPI->PSEL.SCK = PIN_SCK;
+  NRF_QSPI->PSEL.CSN = PIN_CSN;
+  NRF_QSPI->PSEL.IO0 = PIN_IO[0];
+  NRF_QSPI->PSEL.IO1 = PIN_IO[1];
+  NRF_QSPI->PSEL.IO2 = PIN_IO[2];
+  NRF_QSPI->PSEL.IO3 = PIN_IO[3];
+  NRF_QSPI->XIPOFFSET = 0;
+  // single line FASTREAD / PP, 24 bit addresses, 256 byte pages
+  NRF_QSPI->IFCONFIG0 =
+    (QSPI_IFCONFIG0_READOC_FASTREAD << QSPI_IFCONFIG0_READOC_Pos) |
+    (QSPI_IFCONFIG0_WRITEOC_PP << QSPI_IFCONFIG0_WRITEOC_Pos) |
+    (QSPI_IFCONFIG0_ADDRMODE_24BIT << QSPI_IFCONFIG0_ADDRMODE_Pos);
+  // 32MHz / (1 + 1) = 16MHz
+  NRF_QSPI->IFCONFIG1 = (1 << QSPI_IFCONFIG1_SCKFREQ_Pos) | (1 << QSPI_IFCONFIG1_SCKDELAY_Pos);
+  NRF_QSPI->INTENCLR = QSPI_INTENCLR_READY_Msk;
+  NRF_QSPI->ENABLE = 1;
+
+  NRF_QSPI->EVENTS_READY = 0;
+  NRF_QSPI->TASKS_ACTIVATE = 1;
+  if (!waitReady()) {
+    NRF_QSPI->ENABLE = 0;
+    return false;
+  }
+
+  uint8_t data = 0;
+  if (!customInstruction(OPCODE_RELEASE_POWER_DOWN, 1, data)) {
+    NRF_QSPI->ENABLE = 0;
+    return false;
+  }
+  delayMicroseconds(50);
+
+  activeFlag = true;
+  return true;
+}
+
+bool QspiFlash::read(uint32_t address, void* data, uint32_t size)
+{
+  if (!activeFlag || address + size > SIZE) {
+    return false;
+  }
+  while (isBusy())
+    ;
+
+  uint8_t* out = (uint8_t*)data;
+  uint8_t* bounce = (uint8_t*)&bounceBuffer[0];
+  while (size > 0) {
+    const uint32_t alignedAddress = address & ~3UL;
+    const uint32_t offset = address - alignedAddress;
+    const uint32_t pieceSize = min(size, (uint32_t)BOUNCE_SIZE - offset);
+
+    NRF_QSPI->EVENTS_READY = 0;
+    NRF_QSPI->READ.SRC = alignedAddress;
+    NRF_QSPI->READ.DST = (uint32_t)bounce;
+    NRF_QSPI->READ.CNT = (offset + pieceSize + 3) & ~3UL;
+    NRF_QSPI->TASKS_READSTART = 1;
+    if (!waitReady()) {
+      return false;
+    }
+
+    memcpy(out, &bounce[offset], pieceSize);
+    out += pieceSize;
+    address += pieceSize;
+    size -= pieceSize;
+  }
+  return true;
+}
+
+bool QspiFlash::startErase(uint32_t address)
+{
+  if (!activeFlag || address >= SIZE || isBusy()) {
+    return false;
+  }
+  NRF_QSPI->EVENTS_READY = 0;
+  NRF_QSPI->ERASE.PTR = address;
+  NRF_QSPI->ERASE.LEN = QSPI_ERASE_LEN_LEN_4KB;
+  NRF_QSPI->TASKS_ERASESTART = 1;
+  return true;
+}
+
+bool QspiFlash::startProgram(uint32_t address, const void* data, uint32_t size)
+{
+  if (!activeFlag || address + size > SIZE || ((address | size | (uint32_t)data) & 3) || isBusy()) {
+    return false;
+  }
+  NRF_QSPI->EVENTS_READY = 0;
+  NRF_QSPI->WRITE.DST = address;
+  NRF_QSPI->WRITE.SRC = (uint32_t)data;
+  NRF_QSPI->WRITE.CNT = size;
+  NRF_QSPI->TASKS_WRITESTART = 1;
+  return true;
+}
+
+// READY only says the peripheral is done with the transfer; the flash itself
+// reports the end of an erase or program in its WIP bit
+bool QspiFlash::isBusy()
+{
+  if (!activeFlag) {
+    return false;
+  }
+  if (!NRF_QSPI->EVENTS_READY) {
+    return true;
+  }
+  uint8_t status = 0;
+  if (!customInstruction(OPCODE_READ_STATUS, 2, status)) {
+    return true;
+  }
+  return (status & STATUS_WIP) != 0;
+}
+
+#else
+
+bool QspiFlash::begin()
+{
+  activeFlag = false;
+  return false;
+}
+
+bool QspiFlash::read(uint32_t address, void* data, uint32_t size)
+{
+  return false;
+}
+
+bool QspiFlash::startErase(uint32_t address)
+{
+  return false;
+}
+
+bool QspiFlash::startProgram(uint32_t address, const void* data, uint32_t size)
+{
+  return false;
+}
+
+bool QspiFlash::isBusy()
+{
+  return false;
+}
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef QSPI_FLASH_H
+#define QSPI_FLASH_H
+
+#include "FlashLog.h"
+
+// The 2MB QSPI flash of the XIAO nRF52840 (P25Q16H), driven through the QSPI
+// peripheral registers. Erase and program are started and then polled, so
+// loop() keeps running while the flash works. Elsewhere begin() fails and the
+// flash log stays off.
+class QspiFlash : public FlashDevice
+{
+  public:
+
+  static constexpr uint32_t SIZE = 2UL * 1024UL * 1024UL;
+
+  bool begin();
+
+  uint32_t getSize() const override
+  {
+    return activeFlag ? SIZE : 0;
+  }
+
+  bool read(uint32_t address, void* data, uint32_t size) override;
+
+  bool startErase(uint32_t address) override;
+
+  bool startProgram(uint32_t address, const void* data, uint32_t size) override;
+
+  bool isBusy() override;
+
+  private:
+  bool activeFlag{false};
+};
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef SAMPLE_CODEC_H
+#define SAMPLE_CODEC_H
+
+#include <stdint.h>
+
+// Voltage samples are stored as int16 ADC counts (offset by the calibration zero)
+// with FRACTION_BITS of sub-count resolution from averaging.
+// For download they can be delta-packed: the first sample as little endian int16,
+// then one int8 delta per sample, or ESCAPE followed by the full int16 when the
+// delta does not fit.
+namespace SampleCodec {
+
+  constexpr int FRACTION_BITS = 3; // 12 bit counts << 3 still fit in int16
+  constexpr int8_t ESCAPE = -128;
+
+  inline void writeInt16(uint8_t* out, int16_t value) {
+    out[0] = (uint8_t)(value & 0xFF);
+    out[1] = (uint8_t)((uint16_t)value >> 8);
+  }
+
+  inline int16_t readInt16(const uint8_t* in) {
+    return (int16_t)(in[0] | (in[1] << 8));
+  }
+
+  // Packs as many samples as fit into outSize bytes.
+  // Returns the number of samples packed and sets packedSize to the bytes used.
+  inline int pack(const int16_t* samples, int count, uint8_t* out, int outSize, int& packedSize) {
+    packedSize = 0;
+    if (count <= 0 || outSize < 2) {
+      return 0;
+    }
+
+    writeInt16(out, samples[0]);
+    packedSize = 2;
+
+    int packedCount = 1;
+    for (; packedCount < count; ++packedCount) {
+      const int delta = samples[packedCount] - samples[packedCount - 1];
+      if (delta > ESCAPE && delta <= 127) {
+        if (packedSize + 1 > outSize) {
+          break;
+        }
+        out[packedSize++] = (uint8_t)(int8_t)delta;
+      }
+      else {
+        if (packedSize + 3 > outSize) {
+          break;
+        }
+        out[packedSize++] = (uint8_t)ESCAPE;
+        writeInt16(&out[packedSize], samples[packedCount]);
+        packedSize += 2;
+      }
+    }
+    return packedCount;
+  }
+
+  // Payload of one bulk frame: delta-packed when requested and every sample fits,
+  // otherwise raw int16 (only as many samples as fit in outSize).
+  // Returns the size and sets packed to the format used.
+  inline int writePayload(const int16_t* samples, int count, bool packFlag, uint8_t* out, int outSize, bool& packed) {
+    if (packFlag) {
+      int packedSize = 0;
+      if (pack(samples, count, out, outSize, packedSize) == count) {
+        packed = true;
+        return packedSize;
+      }
+    }
+
+    packed = false;
+    if (count > outSize / 2) {
+      count = outSize / 2;
+    }
+    for (int i = 0; i < count; ++i) {
+      writeInt16(&out[i * 2], samples[i]);
+    }
+    return count * 2;
+  }
+
+  // Returns the number of samples decoded, or -1 if the data is truncated or
+  // holds more than maxCount samples.
+  inline int unpack(const uint8_t* in, int size, int16_t* samples, int maxCount) {
+    if (size <= 0) {
+      return 0;
+    }
+    if (size < 2 || maxCount < 1) {
+      return -1;
+    }
+
+    samples[0] = readInt16(in);
+    int count = 1;
+    int index = 2;
+    while (index < size) {
+      if (count >= maxCount) {
+        return -1;
+      }
+
+      const int8_t delta = (int8_t)in[index++];
+      if (delta == ESCAPE) {
+        if (index + 2 > size) {
+          return -1;
+        }
+        samples[count] = readInt16(&in[index]);
+        index += 2;
+      }
+      else {
+        samples[count] = (int16_t)(samples[count - 1] + delta);
+      }
+      ++count;
+    }
+    return count;
+  }
+}
+
+#endif
@@ -0,0 +1,198 @@
+#ifndef TRIGGER_CAPTURE_H
+#define TRIGGER_CAPTURE_H
+
+#include <stdint.h>
+
+// Oscilloscope style trigger on the logged samples.
+// The log keeps being overwritten while armed; when the trigger fires, postCount
+// more samples are taken and the window [trigger - preCount, trigger + postCount)
+// is frozen for download.
+//
+// Rising:  fires when the sample reaches level after having been below level - hysteresis
+// Falling: fires when the sample reaches level after having been above level + hysteresis
+// Window:  fires when the sample leaves [level, levelHigh] after having been inside it
+//          by at least hysteresis
+// A trigger is accepted only once preCount samples were taken since arming and
+// holdoffCount samples passed since the previous trigger; an edge rejected by either
+// is dropped and the signal has to cross again.
+class TriggerCapture
+{
+  public:
+
+  enum class Mode : uint8_t
+  {
+    Off,
+    Rising,
+    Falling,
+    Window,
+    Max,
+  };
+
+  enum class State : uint8_t
+  {
+    Idle,      // Off or not armed
+    Armed,
+    Triggered, // taking the post trigger samples
+    Captured,
+  };
+
+  struct Setting
+  {
+    Mode mode = Mode::Off;
+    int16_t level = 0;
+    int16_t levelHigh = 0;
+    uint16_t hysteresis = 0;
+    uint16_t preCount = 0;
+    uint16_t postCount = 0;
+    uint16_t holdoffCount = 0;
+  };
+
+  void configure(const Setting& inSetting)
+  {
+    setting = inSetting;
+    state = State::Idle;
+  }
+
+  const Setting& getSetting() const
+  {
+    return setting;
+  }
+
+  bool isEnabled() const
+  {
+    return setting.mode != Mode::Off && setting.mode < Mode::Max;
+  }
+
+  // entryIndex is the index the next sample will get
+  void arm(uint32_t entryIndex)
+  {
+    if (!isEnabled())
+    {
+      state = State::Idle;
+      return;
+    }
+    state = State::Armed;
+    armIndex = entryIndex;
+    readyFlag = false;
+  }
+
+  State getState() const
+  {
+    return state;
+  }
+
+  uint32_t getTriggerIndex() const
+  {
+    return triggerIndex;
+  }
+
+  uint32_t getWindowFirst() const
+  {
+    return triggerIndex - setting.preCount;
+  }
+
+  uint32_t getWindowCount() const
+  {
+    return (uint32_t)setting.preCount + setting.postCount;
+  }
+
+  // Call for every logged sample in order. Returns true when the capture completes.
+  bool add(int16_t sample, uint32_t entryIndex)
+  {
+    if (state == State::Triggered)
+    {
+      if (entryIndex + 1 >= triggerIndex + setting.postCount)
+      {
+        state = State::Captured;
+        return true;
+      }
+      return false;
+    }
+    if (state != State::Armed)
+    {
+      return false;
+    }
+
+    updateReady(sample);
+    if (!readyFlag || !isCrossed(sample))
+    {
+      return false;
+    }
+    // A rejected crossing uses up the edge too; otherwise the first sample still past
+    // the level after the pre-fill or holdoff would fire without a new edge.
+    readyFlag = false;
+    if (entryIndex - armIndex < setting.preCount)
+    {
+      return false;
+    }
+    if (triggeredOnceFlag && entryIndex - triggerIndex < setting.holdoffCount)
+    {
+      return false;
+    }
+
+    triggerIndex = entryIndex;
+    triggeredOnceFlag = true;
+    // the trigger sample itself is the first post trigger sample
+    if (setting.postCount <= 1)
+    {
+      state = State::Captured;
+      return true;
+    }
+    state = State::Triggered;
+    return false;
+  }
+
+  private:
+
+  // Hysteresis: the signal has to be clearly on the other side before a crossing counts
+  void updateReady(int16_t sample)
+  {
+    switch (setting.mode)
+    {
+      case Mode::Rising:
+        if (sample < (int32_t)setting.level - setting.hysteresis)
+        {
+          readyFlag = true;
+        }
+        break;
+      case Mode::Falling:
+        if (sample > (int32_t)setting.level + setting.hysteresis)
+        {
+          readyFlag = true;
+        }
+        break;
+      case Mode::Window:
+        if (sample >= (int32_t)setting.level + setting.hysteresis && sample <= (int32_t)setting.levelHigh - setting.hysteresis)
+        {
+          readyFlag = true;
+        }
+        break;
+      default:
+        break;
+    }
+  }
+
+  bool isCrossed(int16_t sample) const
+  {
+    switch (setting.mode)
+    {
+      case Mode::Rising:
+        return sample >= setting.level;
+      case Mode::Falling:
+        return sample <= setting.level;
+      case Mode::Window:
+        return sample < setting.level || sample > setting.levelHigh;
+      default:
+        return false;
+    }
+  }
+
+  Setting setting;
+  State state{State::Idle};
+  uint32_t armIndex{0};
+  uint32_t triggerIndex{0};
+  bool readyFlag{false};
+  bool triggeredOnceFlag{false};
+};
+
+#endif
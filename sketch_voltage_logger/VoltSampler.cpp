@@ -0,0 +1,181 @@
+#include "VoltSampler.h"
+
+#ifdef ARDUINO
+#include "Arduino.h"
+#endif
+
+constexpr uint32_t VoltSampler::RATE_HZ[VoltSampler::RATE_COUNT];
+
+#if defined(NRF52840_XXAA)
+
+namespace {
+
+  // Change these if another library claims TIMER4 or PPI channels 10/11
+  NRF_TIMER_Type* const SAMPLE_TIMER = NRF_TIMER4;
+  constexpr int PPI_SAMPLE_CHANNEL = 10;
+  constexpr int PPI_RESTART_CHANNEL = 11;
+  constexpr uint32_t DMA_BLOCK_MICROS = 2000;
+  constexpr int DMA_SIZE_MAX = 32;
+
+  VoltSampler* activeSampler = nullptr;
+  uint32_t savedIrqVector = 0; // analogRead()'s SAADC handler, restored by end()
+  volatile int16_t dmaBuffers[2][DMA_SIZE_MAX];
+  volatile int dmaSize = 1;
+  volatile int endBuffer = 0;  // buffer that finishes next
+  volatile int nextBuffer = 1; // buffer queued for the next START
+
+  // XIAO nRF52840: A0..A5 = P0.02, P0.03, P0.28, P0.29, P0.04, P0.05
+  uint32_t toAnalogInput(int pin) {
+    static const uint32_t INPUTS[] = {
+      SAADC_CH_PSELP_PSELP_AnalogInput0,
+      SAADC_CH_PSELP_PSELP_AnalogInput1,
+      SAADC_CH_PSELP_PSELP_AnalogInput4,
+      SAADC_CH_PSELP_PSELP_AnalogInput5,
+      SAADC_CH_PSELP_PSELP_AnalogInput2,
+      SAADC_CH_PSELP_PSELP_AnalogInput3,
+    };
+    return (pin >= 0 && pin < 6) ? INPUTS[pin] : SAADC_CH_PSELP_PSELP_AnalogInput0;
+  }
+
+  void saadcIrqHandler() {
+    if (NRF_SAADC->EVENTS_STARTED) {
+      NRF_SAADC->EVENTS_STARTED = 0;
+      // RESULT.PTR is latched on START, so the following buffer can be queued now
+      NRF_SAADC->RESULT.PTR = (uint32_t)dmaBuffers[nextBuffer];
+      nextBuffer ^= 1;
+    }
+    if (NRF_SAADC->EVENTS_END) {
+      NRF_SAADC->EVENTS_END = 0;
+      if (activeSampler) {
+        activeSampler->pushBlock(dmaBuffers[endBuffer], dmaSize);
+      }
+      endBuffer ^= 1;
+    }
+  }
+}
+
+bool VoltSampler::begin(int inPin, uint8_t rateIndex, uint8_t inOversampleShift)
+{
+  end();
+
+  pin = inPin;
+  rateHz = RATE_HZ[(rateIndex < RATE_COUNT) ? rateIndex : 0];
+  oversampleShift = limitOversampleShift(rateIndex, inOversampleShift);
+  ring.reset();
+
+  dmaSize = constrain((int)((rateHz * DMA_BLOCK_MICROS) / 1000000UL), 1, DMA_SIZE_MAX);
+  endBuffer = 0;
+  nextBuffer = 1;
+
+  // Full scale VDD (gain 1/4, reference VDD/4), same as analogRead()
+  NRF_SAADC->ENABLE = 0;
+  NRF_SAADC->RESOLUTION = SAADC_RESOLUTION_VAL_12bit;
+  NRF_SAADC->OVERSAMPLE = oversampleShift;
+  NRF_SAADC->CH[0].PSELP = toAnalogInput(pin);
+  NRF_SAADC->CH[0].PSELN = SAADC_CH_PSELN_PSELN_NC;
+  NRF_SAADC->CH[0].CONFIG =
+    (SAADC_CH_CONFIG_GAIN_Gain1_4 << SAADC_CH_CONFIG_GAIN_Pos) |
+    (SAADC_CH_CONFIG_REFSEL_VDD1_4 << SAADC_CH_CONFIG_REFSEL_Pos) |
+    (SAADC_CH_CONFIG_TACQ_10us << SAADC_CH_CONFIG_TACQ_Pos) |
+    (SAADC_CH_CONFIG_MODE_SE << SAADC_CH_CONFIG_MODE_Pos) |
+    ((oversampleShift > 0 ? SAADC_CH_CONFIG_BURST_Enabled : SAADC_CH_CONFIG_BURST_Disabled) << SAADC_CH_CONFIG_BURST_Pos);
+  for (int channel = 1; channel < 8; ++channel) {
+    NRF_SAADC->CH[channel].PSELP = SAADC_CH_PSELP_PSELP_NC;
+  }
+  NRF_SAADC->SAMPLERATE = SAADC_SAMPLERATE_MODE_Task << SAADC_SAMPLERATE_MODE_Pos;
+  NRF_SAADC->RESULT.PTR = (uint32_t)dmaBuffers[0];
+  NRF_SAADC->RESULT.MAXCNT = dmaSize;
+  NRF_SAADC->EVENTS_STARTED = 0;
+  NRF_SAADC->EVENTS_END = 0;
+  NRF_SAADC->INTENSET = SAADC_INTENSET_STARTED_Msk | SAADC_INTENSET_END_Msk;
+  NRF_SAADC->ENABLE = 1;
+
+  activeSampler = this;
+  savedIrqVector = NVIC_GetVector(SAADC_IRQn);
+  NVIC_SetVector(SAADC_IRQn, (uint32_t)&saadcIrqHandler);
+  NVIC_ClearPendingIRQ(SAADC_IRQn);
+  NVIC_EnableIRQ(SAADC_IRQn);
+
+  // 1MHz timer, compare 0 triggers SAMPLE and clears itself
+  SAMPLE_TIMER->TASKS_STOP = 1;
+  SAMPLE_TIMER->TASKS_CLEAR = 1;
+  SAMPLE_TIMER->MODE = TIMER_MODE_MODE_Timer;
+  SAMPLE_TIMER->BITMODE = TIMER_BITMODE_BITMODE_32Bit;
+  SAMPLE_TIMER->PRESCALER = 4;
+  SAMPLE_TIMER->CC[0] = 1000000UL / rateHz;
+  SAMPLE_TIMER->SHORTS = TIMER_SHORTS_COMPARE0_CLEAR_Msk;
+
+  NRF_PPI->CH[PPI_SAMPLE_CHANNEL].EEP = (uint32_t)&SAMPLE_TIMER->EVENTS_COMPARE[0];
+  NRF_PPI->CH[PPI_SAMPLE_CHANNEL].TEP = (uint32_t)&NRF_SAADC->TASKS_SAMPLE;
+  NRF_PPI->CH[PPI_RESTART_CHANNEL].EEP = (uint32_t)&NRF_SAADC->EVENTS_END;
+  NRF_PPI->CH[PPI_RESTART_CHANNEL].TEP = (uint32_t)&NRF_SAADC->TASKS_START;
+  NRF_PPI->CHENSET = (1UL << PPI_SAMPLE_CHANNEL) | (1UL << PPI_RESTART_CHANNEL);
+
+  NRF_SAADC->TASKS_START = 1;
+  SAMPLE_TIMER->TASKS_START = 1;
+  return true;
+}
+
+void VoltSampler::end()
+{
+  if (!activeSampler) {
+    return;
+  }
+
+  SAMPLE_TIMER->TASKS_STOP = 1;
+  NRF_PPI->CHENCLR = (1UL << PPI_SAMPLE_CHANNEL) | (1UL << PPI_RESTART_CHANNEL);
+  NVIC_DisableIRQ(SAADC_IRQn);
+  NRF_SAADC->INTENCLR = SAADC_INTENCLR_STARTED_Msk | SAADC_INTENCLR_END_Msk;
+  NRF_SAADC->TASKS_STOP = 1;
+  while (NRF_SAADC->EVENTS_STOPPED == 0)
+    ;
+  NRF_SAADC->EVENTS_STOPPED = 0;
+  // give the SAADC back to analogRead()
+  NRF_SAADC->ENABLE = 0;
+  NVIC_SetVector(SAADC_IRQn, savedIrqVector);
+  NVIC_ClearPendingIRQ(SAADC_IRQn);
+  NVIC_EnableIRQ(SAADC_IRQn);
+  activeSampler = nullptr;
+}
+
+void VoltSampler::poll()
+{
+}
+
+#else
+
+bool VoltSampler::begin(int inPin, uint8_t rateIndex, uint8_t inOversampleShift)
+{
+  pin = inPin;
+  rateHz = RATE_HZ[(rateIndex < RATE_COUNT) ? rateIndex : 0];
+  oversampleShift = limitOversampleShift(rateIndex, inOversampleShift);
+  ring.reset();
+  analogReadResolution(RESOLUTION_BITS);
+  nextMicros = micros();
+  return true;
+}
+
+void VoltSampler::end()
+{
+}
+
+// Catches up on missed sample times, so the count per second stays at rateHz
+// even though each sample is taken a little late. After a stall longer than the
+// ring the missed time is skipped, so timing is only approximate here.
+void VoltSampler::poll()
+{
+  const uint32_t periodMicros = 1000000UL / rateHz;
+  if ((int32_t)(micros() - nextMicros) > (int32_t)(periodMicros * SampleRing::SIZE)) {
+    nextMicros = micros();
+  }
+  while ((int32_t)(micros() - nextMicros) >= 0) {
+    uint32_t sum = 0;
+    for (int i = 0; i < (1 << oversampleShift); ++i) {
+      sum += analogRead(pin);
+    }
+    ring.push((uint16_t)(sum >> oversampleShift));
+    nextMicros += periodMicros;
+  }
+}
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef VOLT_SAMPLER_H
+#define VOLT_SAMPLER_H
+
+#include <stdint.h>
+
+// Ring of raw ADC samples written from the sampling interrupt and read from loop().
+// The write index doubles as the sample clock: sample n was taken at n / rateHz
+// seconds after begin(). If the reader falls behind by more than SIZE samples the
+// oldest ones are dropped; the indexes of the remaining samples stay exact.
+class SampleRing
+{
+  public:
+
+  static constexpr uint32_t SIZE = 1024; // power of two
+
+  void reset()
+  {
+    writeIndex = 0;
+    readIndex = 0;
+    droppedCount = 0;
+  }
+
+  // interrupt side
+  void push(uint16_t value)
+  {
+    const uint32_t index = writeIndex;
+    data[index & (SIZE - 1)] = value;
+    writeIndex = index + 1;
+  }
+
+  bool pop(uint16_t& value, uint32_t& index)
+  {
+    while (true)
+    {
+      const uint32_t currentWrite = writeIndex;
+      if (currentWrite - readIndex > SIZE)
+      {
+        droppedCount += (currentWrite - readIndex) - SIZE;
+        readIndex = currentWrite - SIZE;
+      }
+      if (readIndex == currentWrite)
+      {
+        return false;
+      }
+
+      value = data[readIndex & (SIZE - 1)];
+      index = readIndex;
+      ++readIndex;
+
+      // the slot may have been overwritten while reading it
+      if (writeIndex - index <= SIZE)
+      {
+        return true;
+      }
+    }
+  }
+
+  uint32_t getWriteIndex() const
+  {
+    return writeIndex;
+  }
+
+  uint32_t getDroppedCount() const
+  {
+    return droppedCount;
+  }
+
+  private:
+  volatile uint16_t data[SIZE] = {0};
+  volatile uint32_t writeIndex{0};
+  uint32_t readIndex{0};
+  uint32_t droppedCount{0};
+};
+
+// Fixed rate sampling of one analog input at 12 bit.
+// On the nRF52840 a TIMER triggers the SAADC through PPI and EasyDMA fills two
+// buffers in turn, so the timing does not depend on loop(). Optional hardware
+// oversampling averages 2^oversampleShift conversions per sample; begin() lowers it
+// to what fits the rate, since the SAADC silently skips a SAMPLE that comes while
+// the previous burst still runs and the index would no longer be n / rateHz.
+// Elsewhere poll() paces analogRead() with micros() as a fallback.
+class VoltSampler
+{
+  public:
+
+  static constexpr uint8_t RATE_COUNT = 3;
+  static constexpr uint32_t RATE_HZ[RATE_COUNT] = {1000, 5000, 10000};
+  static constexpr uint8_t OVERSAMPLE_SHIFT_MAX = 4;
+  static constexpr int RESOLUTION_BITS = 12;
+  static constexpr uint32_t CONVERSION_MICROS = 12; // TACQ 10us + conversion
+
+  // Largest shift up to the requested one whose burst takes at most 3/4 of the
+  // sample period: x16 at 1kHz, x8 at 5kHz, x4 at 10kHz
+  static uint8_t limitOversampleShift(uint8_t rateIndex, uint8_t shift)
+  {
+    const uint32_t periodMicros = 1000000UL / RATE_HZ[(rateIndex < RATE_COUNT) ? rateIndex : 0];
+    if (shift > OVERSAMPLE_SHIFT_MAX)
+    {
+      shift = OVERSAMPLE_SHIFT_MAX;
+    }
+    while (shift > 0 && (CONVERSION_MICROS << shift) * 4 > periodMicros * 3)
+    {
+      --shift;
+    }
+    return shift;
+  }
+
+  // oversampleShift is limited with limitOversampleShift()
+  bool begin(int pin, uint8_t rateIndex, uint8_t oversampleShift);
+
+  void end();
+
+  // Only needed for the fallback; does nothing with the hardware sampler
+  void poll();
+
+  bool read(uint16_t& value, uint32_t& index)
+  {
+    return ring.pop(value, index);
+  }
+
+  uint32_t getRateHz() const
+  {
+    return rateHz;
+  }
+
+  uint8_t getOversampleShift() const
+  {
+    return oversampleShift;
+  }
+
+  uint32_t getDroppedCount() const
+  {
+    return ring.getDroppedCount();
+  }
+
+  // interrupt side
+  void pushBlock(const volatile int16_t* values, int count)
+  {
+    for (int i = 0; i < count; ++i)
+    {
+      // negative readings are noise around 0V in single ended mode
+      ring.push(values[i] < 0 ? 0 : (uint16_t)values[i]);
+    }
+  }
+
+  private:
+  SampleRing ring;
+  uint32_t rateHz{RATE_HZ[0]};
+  uint8_t oversampleShift{0};
+  int pin{0};
+  uint32_t nextMicros{0};
+};
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef WINDOW_STATS_H
+#define WINDOW_STATS_H
+
+#include <stdint.h>
+#include <math.h>
+
+// Min / max / mean / RMS and the number of samples below a threshold over every
+// raw sampler sample of one reporting window, so dips shorter than a log entry
+// still show up. add() is a few compares and adds; the report is computed once
+// per window.
+class WindowStats
+{
+  public:
+
+  // Values in stored sample units (calibrated counts << FRACTION_BITS) like the log
+  struct Report
+  {
+    int16_t minValue = 0;
+    int16_t maxValue = 0;
+    int16_t mean = 0;
+    uint16_t rms = 0;        // around the calibration zero
+    uint16_t belowCount = 0; // saturates
+    uint16_t count = 0;      // saturates
+  };
+
+  // threshold in raw counts, samples below it are counted
+  void reset(uint16_t inThreshold)
+  {
+    threshold = inThreshold;
+    minValue = UINT16_MAX;
+    maxValue = 0;
+    sum = 0;
+    sumSquare = 0;
+    count = 0;
+    belowCount = 0;
+  }
+
+  void add(uint16_t value)
+  {
+    if (value < minValue)
+    {
+      minValue = value;
+    }
+    if (value > maxValue)
+    {
+      maxValue = value;
+    }
+    sum += value;
+    sumSquare += (uint32_t)value * value;
+    ++count;
+    if (value < threshold)
+    {
+      ++belowCount;
+    }
+  }
+
+  uint32_t getCount() const
+  {
+    return count;
+  }
+
+  // zero: raw counts of 0V (calibration), fractionBits: stored units per count
+  Report getReport(float zero, int fractionBits) const
+  {
+    Report report;
+    report.count = (uint16_t)((count < UINT16_MAX) ? count : UINT16_MAX);
+    report.belowCount = (uint16_t)((belowCount < UINT16_MAX) ? belowCount : UINT16_MAX);
+    if (count == 0)
+    {
+      return report;
+    }
+
+    const double scale = (double)(1 << fractionBits);
+    const double mean = (double)sum / count;
+    // E[(x - zero)^2] from the raw sums; double keeps the cancellation harmless
+    const double meanSquare = (double)sumSquare / count - 2.0 * zero * mean + (double)zero * zero;
+
+    report.minValue = toStored((minValue - zero) * scale);
+    report.maxValue = toStored((maxValue - zero) * scale);
+    report.mean = toStored((mean - zero) * scale);
+    report.rms = (uint16_t)toStored(sqrt(meanSquare > 0.0 ? meanSquare : 0.0) * scale);
+    return report;
+  }
+
+  private:
+
+  static int16_t toStored(double value)
+  {
+    const double rounded = floor(value + 0.5);
+    return (int16_t)((rounded > 32767.0) ? 32767.0 : ((rounded < -32767.0) ? -32767.0 : rounded));
+  }
+
+  uint16_t threshold{0};
+  uint16_t minValue{UINT16_MAX};
+  uint16_t maxValue{0};
+  uint64_t sum{0}; // a window can run long while notifications fail
+  uint64_t sumSquare{0};
+  uint32_t count{0};
+  uint32_t belowCount{0};
+};
+
+#endif
@@ -17,6 +17,16 @@
 
 #endif
 
+#include "SampleCodec.h"
+#include "BulkTransfer.h"
+#include "VoltSampler.h"
+#include "TriggerCapture.h"
+#include "ImuFifo.h"
+#include "OrientationFilter.h"
+#include "LiveStream.h"
+#include "WindowStats.h"
+#include "QspiFlash.h"
+
 // See the following for generating UUIDs:
 // https://www.uuidgenerator.net/
 
@@ -31,15 +41,18 @@
 
 constexpr int SENSOR_READ_VOLT = 0;
 
-constexpr int LOGGER_DATA_SIZE = 20;
+constexpr int LOGGER_DATA_SIZE = 244; // one LiveStream frame at a 247 byte ATT MTU
 
 const float FPS = 60.f;
 
 const float ONE_FRAME_MS = (1.f / FPS) * 1000.f;
 
-const float TO_VOLT = (3.3f / 1024.f) * 2.f;
+const float TO_VOLT = (3.3f / (float)(1 << VoltSampler::RESOLUTION_BITS)) * 2.f;
+
+const float SAMPLE_TO_VOLT = TO_VOLT / (float)(1 << SampleCodec::FRACTION_BITS);
 
 LSM6DS3 IMU(I2C_MODE, 0x6A);
+ImuFifo imuFifo;
 
 class ReadVoltCache
 {
@@ -47,8 +60,13 @@ class ReadVoltCache
 
   static constexpr int DATA_CHUNK_MAX = 64;
   static constexpr int READ_DATA_MAX = 244;
-  static constexpr int FLOAT_READ_DATA_MAX = READ_DATA_MAX / 4; // 61
-  static constexpr int FLOAT_DATA_MAX = FLOAT_READ_DATA_MAX * DATA_CHUNK_MAX;
+  static constexpr int CHUNK_HEADER_SIZE = 4; // format, first chunk, chunk count, reserved
+  static constexpr int SAMPLE_READ_DATA_MAX = (READ_DATA_MAX - CHUNK_HEADER_SIZE) / 2 - 2; // 118, two chunks still fit when packed
+  static constexpr int SAMPLE_DATA_MAX = SAMPLE_READ_DATA_MAX * DATA_CHUNK_MAX;
+  static constexpr int PACKED_CHUNK_MAX = 2;
+
+  static constexpr uint8_t FORMAT_RAW = 0;
+  static constexpr uint8_t FORMAT_PACKED = 1;
 
   int voltdataCount{0};
 
@@ -56,11 +74,25 @@ class ReadVoltCache
 
   int endVoltdataCount{0};
 
-  float voltData[FLOAT_DATA_MAX] = {0.f};
+  bool wrappedFlag{false};
+
+  uint8_t generation{0}; // changes on reset so a resumed download can detect a new log
+
+  uint32_t firstSampleIndex{0}; // sampler index of the first entry since reset
+  uint32_t entryTotal{0};       // entries since reset (including overwritten ones)
+  uint32_t rateHz{0};
+  uint32_t decimation{1};       // sampler samples per entry
 
-  void setReadChunk(int inReadChunkCount)
+  bool frozenFlag{false};       // a trigger capture is held for download
+  uint32_t windowFirst{0};      // entry index of the capture window
+  uint32_t windowCount{0};
+
+  int16_t voltData[SAMPLE_DATA_MAX] = {0};
+
+  void setReadChunk(int inReadChunkCount, bool inPackFlag = false)
   {
     readChunkCount = inReadChunkCount;
+    packFlag = inPackFlag;
   }
 
   int getReadChunk()
@@ -68,8 +100,24 @@ class ReadVoltCache
     return readChunkCount;
   }
 
-  void setVolt(float volt)
+  void setTiming(uint32_t inRateHz, uint32_t inDecimation)
+  {
+    rateHz = inRateHz;
+    decimation = inDecimation;
+  }
+
+  void setSample(int16_t sample, uint32_t sampleIndex)
   {
+    if (frozenFlag)
+    {
+      return;
+    }
+    if (entryTotal == 0)
+    {
+      firstSampleIndex = sampleIndex;
+    }
+    ++entryTotal;
+
     /*
     if (voltData[voltdataCount] < 0.1f && volt > 1.f)
     {
@@ -81,13 +129,73 @@ class ReadVoltCache
     }
     */
 
-    voltData[voltdataCount] = volt;
-    voltdataCount = (voltdataCount + 1) % FLOAT_DATA_MAX;
+    voltData[voltdataCount] = sample;
+    voltdataCount = (voltdataCount + 1) % SAMPLE_DATA_MAX;
+    if (voltdataCount == 0)
+    {
+      wrappedFlag = true;
+    }
   }
 
   float getDataCountPercent()
   {
-    return ((float)voltdataCount / (float)FLOAT_DATA_MAX) * 100.f;
+    return ((float)voltdataCount / (float)SAMPLE_DATA_MAX) * 100.f;
+  }
+
+  int getSampleCount()
+  {
+    return wrappedFlag ? SAMPLE_DATA_MAX : voltdataCount;
+  }
+
+  // Stops writing and limits downloads to the entries [first, first + count)
+  void freezeWindow(uint32_t first, uint32_t count)
+  {
+    const uint32_t oldest = entryTotal - (uint32_t)getSampleCount();
+    if (first < oldest)
+    {
+      count -= min(count, oldest - first);
+      first = oldest;
+    }
+    windowFirst = first;
+    windowCount = min(count, entryTotal - first);
+    frozenFlag = true;
+  }
+
+  void unfreeze()
+  {
+    frozenFlag = false;
+  }
+
+  // Downloads cover the capture window while frozen, otherwise the whole buffer
+  uint32_t getViewFirst()
+  {
+    return frozenFlag ? windowFirst : entryTotal - (uint32_t)getSampleCount();
+  }
+
+  int getViewCount()
+  {
+    return frozenFlag ? (int)windowCount : getSampleCount();
+  }
+
+  // Sampler index of the first entry in the view; entry n started at
+  // getOldestSampleIndex() + n * decimation
+  uint32_t getOldestSampleIndex()
+  {
+    return firstSampleIndex + getViewFirst() * decimation;
+  }
+
+  BulkTransfer::Timing getTiming()
+  {
+    BulkTransfer::Timing timing;
+    timing.rateHz = (uint16_t)rateHz;
+    timing.decimation = (uint16_t)decimation;
+    timing.oldestSampleIndex = getOldestSampleIndex();
+    return timing;
+  }
+
+  int getChunkTotal()
+  {
+    return (getViewCount() + SAMPLE_READ_DATA_MAX - 1) / SAMPLE_READ_DATA_MAX;
   }
 
   bool isReadData()
@@ -102,54 +210,188 @@ class ReadVoltCache
     }
   }
 
-  size_t* getWritePointer()
+  // Copies chunk samples of the view in time order (chunk 0 holds the oldest
+  // sample), following the ring across its end. Returns the number of samples copied.
+  // Entry e is stored at e % SAMPLE_DATA_MAX since the ring restarts with the log.
+  int copyChunks(int firstChunk, int chunkCount, int16_t* out)
   {
-    if (readChunkCount >= 0)
+    const int firstSample = firstChunk * SAMPLE_READ_DATA_MAX;
+    const uint32_t firstEntry = getViewFirst() + firstSample;
+    const int sampleCount = max(0, min(chunkCount * SAMPLE_READ_DATA_MAX, getViewCount() - firstSample));
+    for (int i = 0; i < sampleCount; ++i)
     {
-      const int startChunk = startVoltdataCount / FLOAT_READ_DATA_MAX;
-      const int currentChunk = startChunk + readChunkCount;
-      return (size_t*)&voltData[currentChunk * FLOAT_READ_DATA_MAX];
+      out[i] = voltData[(firstEntry + i) % SAMPLE_DATA_MAX];
     }
-    else
+    return sampleCount;
+  }
+
+  // Payload of one bulk frame: the chunk delta-packed when it fits, otherwise raw int16
+  int readChunk(uint16_t seq, bool inPackFlag, uint8_t* payload, int payloadMax, bool& packed)
+  {
+    int16_t samples[SAMPLE_READ_DATA_MAX];
+    const int sampleCount = copyChunks(seq, 1, &samples[0]);
+    return SampleCodec::writePayload(&samples[0], sampleCount, inPackFlag, payload, payloadMax, packed);
+  }
+
+  // Fills one download value for the requested chunk and returns its size.
+  // Packed reads cover up to PACKED_CHUNK_MAX chunks when the deltas fit,
+  // otherwise the chunk is sent as raw int16.
+  int fillReadData(uint8_t* out)
+  {
+    int16_t samples[SAMPLE_READ_DATA_MAX * PACKED_CHUNK_MAX];
+    uint8_t* payload = &out[CHUNK_HEADER_SIZE];
+    const int payloadMax = READ_DATA_MAX - CHUNK_HEADER_SIZE;
+
+    out[0] = FORMAT_RAW;
+    out[1] = (uint8_t)readChunkCount;
+    out[2] = 1;
+    out[3] = 0;
+
+    if (packFlag)
+    {
+      for (int chunkCount = PACKED_CHUNK_MAX; chunkCount > 0; --chunkCount)
+      {
+        const int sampleCount = copyChunks(readChunkCount, chunkCount, &samples[0]);
+        int packedSize = 0;
+        if (sampleCount > 0 && SampleCodec::pack(&samples[0], sampleCount, payload, payloadMax, packedSize) == sampleCount)
+        {
+          out[0] = FORMAT_PACKED;
+          out[2] = (uint8_t)chunkCount;
+          return CHUNK_HEADER_SIZE + packedSize;
+        }
+      }
+    }
+
+    const int sampleCount = copyChunks(readChunkCount, 1, &samples[0]);
+    for (int i = 0; i < sampleCount; ++i)
     {
-      return (size_t*)&voltData[0];
+      SampleCodec::writeInt16(&payload[i * 2], samples[i]);
     }
+    return CHUNK_HEADER_SIZE + sampleCount * 2;
   }
 
   void reset()
   {
-    for (int i = 0; i < FLOAT_DATA_MAX; ++i)
+    for (int i = 0; i < SAMPLE_DATA_MAX; ++i)
     {
-      voltData[i] = 0.f;
+      voltData[i] = 0;
     }
 
     voltdataCount = 0;
     startVoltdataCount = 0;
     endVoltdataCount = 0;
+    wrappedFlag = false;
+    entryTotal = 0;
+    frozenFlag = false;
+    ++generation;
   }
 
   private:
   int readChunkCount{0};
 
+  bool packFlag{false};
+
+};
+
+TriggerCapture triggerCapture;
+LiveStream liveStream;
+WindowStats windowStats;
+QspiFlash qspiFlash;
+FlashLog flashLog;
+
+// Bulk download source for one flash log block, in the same chunks as ReadVoltCache
+class FlashPageSource
+{
+  public:
+
+  uint16_t page{BulkTransfer::PAGE_RAM};
+  uint32_t sequence{0};
+  FlashLog::BlockInfo info;
+
+  bool isRam() const
+  {
+    return page == BulkTransfer::PAGE_RAM;
+  }
+
+  // Looks the page up again, so a START after the ring moved on gets the current block
+  bool select(uint16_t inPage)
+  {
+    page = inPage;
+    info = FlashLog::BlockInfo();
+    if (isRam() || page >= flashLog.getBlockCount())
+    {
+      return false;
+    }
+    sequence = flashLog.getOldestSequence() + page;
+    return flashLog.readBlockInfo(sequence, info);
+  }
+
+  int getChunkTotal() const
+  {
+    return (info.sampleCount + ReadVoltCache::SAMPLE_READ_DATA_MAX - 1) / ReadVoltCache::SAMPLE_READ_DATA_MAX;
+  }
+
+  BulkTransfer::Timing getTiming() const
+  {
+    BulkTransfer::Timing timing;
+    timing.rateHz = info.rateHz;
+    timing.decimation = info.decimation;
+    timing.oldestSampleIndex = info.firstSampleIndex;
+    return timing;
+  }
+
+  int readChunk(uint16_t seq, bool packFlag, uint8_t* payload, int payloadMax, bool& packed)
+  {
+    int16_t samples[ReadVoltCache::SAMPLE_READ_DATA_MAX];
+    const int sampleCount = flashLog.readBlockSamples(sequence, seq * ReadVoltCache::SAMPLE_READ_DATA_MAX, &samples[0], ReadVoltCache::SAMPLE_READ_DATA_MAX);
+    return SampleCodec::writePayload(&samples[0], sampleCount, packFlag, payload, payloadMax, packed);
+  }
 };
 
+FlashPageSource flashPageSource;
+
 class ParamSet{
   public:
 
-  static constexpr int PARAM_SIZE = 2;
+  // 0 enable, 1 gyro, 2 rate index, 3 oversample shift (limited by the rate),
+  // 4 trigger mode, 5 hysteresis, 6-7 level, 8-9 level high, 10-11 pre count,
+  // 12-13 post count, 14-15 holdoff count, 16 arm (write) / trigger state (read),
+  // 17 calibration progress in percent (read only, 100 when done),
+  // 18-19 live statistics threshold (samples below it are counted)
+  // levels are in stored sample units, counts are log entries (little endian)
+  static constexpr int PARAM_SIZE = 20;
+  static constexpr int SAMPLER_PARAM_SIZE = 4;
+  static constexpr int TRIGGER_PARAM_SIZE = 18;
+  static constexpr int TRIGGER_INDEX = 4;
+  static constexpr int ARM_INDEX = 16;
+  static constexpr int CALIB_INDEX = 17;
+  static constexpr int STATS_INDEX = 18;
 
   bool enableFlag = false;
   bool gyroFlag = false;
+  uint8_t rateIndex = 0;       // VoltSampler::RATE_HZ
+  uint8_t oversampleShift = 0; // 2^n conversions per sample
 
   bool oldEnableFlag = enableFlag;
   bool oldGyroFlag = gyroFlag;
+  bool samplerChangedFlag = false;
+
+  TriggerCapture::Setting triggerSetting;
+  bool triggerChangedFlag = false;
+  bool armRequestFlag = false;
+
+  uint8_t calibProgress = 100;
+  int16_t statsThreshold = 0;
 
   uint8_t tempData[PARAM_SIZE]; 
 
-  void setState(const uint8_t* pCommandValue)
+  void setState(const uint8_t* pCommandValue, int length)
   {
     oldEnableFlag = enableFlag;
     oldGyroFlag = gyroFlag;
+    samplerChangedFlag = false;
+    triggerChangedFlag = false;
+    armRequestFlag = false;
 
     if (pCommandValue && pCommandValue[0] == 1) {
       Serial.print("Enable.");
@@ -172,8 +414,58 @@ class ParamSet{
       Serial.println("Off.");
       gyroFlag = false;
     }
+
+    // older centrals write only the first two bytes
+    if (pCommandValue && length >= SAMPLER_PARAM_SIZE) {
+      const uint8_t newRateIndex = min(pCommandValue[2], (uint8_t)(VoltSampler::RATE_COUNT - 1));
+      // as much oversampling as the rate leaves time for; byte 3 reads back what was applied
+      const uint8_t newOversampleShift = VoltSampler::limitOversampleShift(newRateIndex, pCommandValue[3]);
+      if (newRateIndex != rateIndex || newOversampleShift != oversampleShift) {
+        rateIndex = newRateIndex;
+        oversampleShift = newOversampleShift;
+        samplerChangedFlag = true;
+        Serial.print("Sampler ");
+        Serial.print(VoltSampler::RATE_HZ[rateIndex]);
+        Serial.print("Hz x");
+        Serial.println(1 << oversampleShift);
+      }
+    }
+
+    if (pCommandValue && length >= TRIGGER_PARAM_SIZE) {
+      setTrigger(&pCommandValue[TRIGGER_INDEX]);
+      armRequestFlag = pCommandValue[ARM_INDEX] == 1;
+    }
+
+    // applied from the next live statistics window
+    if (pCommandValue && length >= PARAM_SIZE) {
+      statsThreshold = (int16_t)BulkTransfer::readUint16(&pCommandValue[STATS_INDEX]);
+    }
   };
 
+  void setTrigger(const uint8_t* pValue)
+  {
+    TriggerCapture::Setting setting;
+    setting.mode = (TriggerCapture::Mode)min(pValue[0], (uint8_t)TriggerCapture::Mode::Window);
+    setting.hysteresis = pValue[1];
+    setting.level = (int16_t)BulkTransfer::readUint16(&pValue[2]);
+    setting.levelHigh = (int16_t)BulkTransfer::readUint16(&pValue[4]);
+    // the whole window has to stay in the log
+    setting.preCount = min(BulkTransfer::readUint16(&pValue[6]), (uint16_t)(ReadVoltCache::SAMPLE_DATA_MAX / 2));
+    setting.postCount = min(BulkTransfer::readUint16(&pValue[8]), (uint16_t)(ReadVoltCache::SAMPLE_DATA_MAX / 2));
+    setting.holdoffCount = BulkTransfer::readUint16(&pValue[10]);
+
+    const TriggerCapture::Setting& current = triggerCapture.getSetting();
+    if (setting.mode != current.mode || setting.hysteresis != current.hysteresis ||
+        setting.level != current.level || setting.levelHigh != current.levelHigh ||
+        setting.preCount != current.preCount || setting.postCount != current.postCount ||
+        setting.holdoffCount != current.holdoffCount) {
+      triggerSetting = setting;
+      triggerChangedFlag = true;
+      Serial.print("Trigger ");
+      Serial.println((int)setting.mode);
+    }
+  }
+
   const uint8_t* getState()
   {
     if (enableFlag) {
@@ -190,6 +482,20 @@ class ParamSet{
     else {
       tempData[1] = 0;
     }
+    tempData[2] = rateIndex;
+    tempData[3] = oversampleShift;
+
+    const TriggerCapture::Setting& setting = triggerCapture.getSetting();
+    tempData[TRIGGER_INDEX] = (uint8_t)setting.mode;
+    tempData[TRIGGER_INDEX + 1] = (uint8_t)min(setting.hysteresis, (uint16_t)255);
+    BulkTransfer::writeUint16(&tempData[TRIGGER_INDEX + 2], (uint16_t)setting.level);
+    BulkTransfer::writeUint16(&tempData[TRIGGER_INDEX + 4], (uint16_t)setting.levelHigh);
+    BulkTransfer::writeUint16(&tempData[TRIGGER_INDEX + 6], setting.preCount);
+    BulkTransfer::writeUint16(&tempData[TRIGGER_INDEX + 8], setting.postCount);
+    BulkTransfer::writeUint16(&tempData[TRIGGER_INDEX + 10], setting.holdoffCount);
+    tempData[ARM_INDEX] = (uint8_t)triggerCapture.getState();
+    tempData[CALIB_INDEX] = calibProgress;
+    BulkTransfer::writeUint16(&tempData[STATS_INDEX], (uint16_t)statsThreshold);
 
     return &tempData[0];
   }
@@ -209,19 +515,37 @@ class ParamSet{
     return !gyroFlag && (oldGyroFlag != gyroFlag);
   }
 
+  bool isSamplerChanged()
+  {
+    return samplerChangedFlag;
+  }
+
+  bool isTriggerChanged()
+  {
+    return triggerChangedFlag;
+  }
+
+  bool isArmRequested()
+  {
+    return armRequestFlag;
+  }
+
 };
 
 
 ParamSet paramSet;
 bool calibFlag = false;
+bool samplerRestartFlag = false;
 ReadVoltCache readVoltCache;
+BulkTransfer bulkTransfer;
+VoltSampler voltSampler;
 
 BLEService voltageLoggerService(SERVICE_UUID);  // create service
 // create switch characteristic and allow remote device to read and write
 BLECharacteristic loggerCharacteristic(LOGGER_CHARACTERISTIC_UUID, BLERead | BLEWrite | BLENotify, LOGGER_DATA_SIZE);
-BLECharacteristic commandCharacteristic(COMMAND_CHARACTERISTIC_UUID, BLERead | BLEWrite, 2);
+BLECharacteristic commandCharacteristic(COMMAND_CHARACTERISTIC_UUID, BLERead | BLEWrite, BulkTransfer::COMMAND_SIZE);
 BLECharacteristic readdataCharacteristic(DOWNLOAD_CHARACTERISTIC_UUID, BLERead | BLEWrite | BLENotify, ReadVoltCache::READ_DATA_MAX);
-BLECharacteristic paramCharacteristic(PARAM_CHARACTERISTIC_UUID, BLERead | BLEWrite, ParamSet::PARAM_SIZE);
+BLECharacteristic paramCharacteristic(PARAM_CHARACTERISTIC_UUID, BLERead | BLEWrite | BLENotify, ParamSet::PARAM_SIZE);
 
 void bleSetup() {
 
@@ -293,12 +617,20 @@ void gyroSetup() {
   IMU.writeRegister(LSM6DS3_ACC_GYRO_CTRL7_G,  0x00);
   IMU.writeRegister(LSM6DS3_ACC_GYRO_CTRL8_XL, 0x09);
 */
+  // the FIFO stores gyro and accel at its own ODR, so run both sensors at the same rate
+  IMU.settings.gyroSampleRate = ImuFifo::ODR_HZ;
+  IMU.settings.accelSampleRate = ImuFifo::ODR_HZ;
+
   while (IMU.begin() != 0) {
     Serial.println("Failed to initialize IMU!");
   }
 
   Serial.print("IMU Initailized.");
 
+  if (!imuFifo.begin(IMU)) {
+    Serial.println("IMU FIFO not available, reading the gyro registers.");
+  }
+
 }
 
 void blePeripheralConnectHandler(BLEDevice central) {
@@ -310,6 +642,8 @@ void blePeripheralConnectHandler(BLEDevice central) {
 void blePeripheralDisconnectHandler(BLEDevice central) {
   // central disconnected event handler
   Serial.println("Disconnected: ");
+  // the central resumes with a new START after reconnecting
+  bulkTransfer.abort();
   BLE.advertise();
   Serial.print("Advertise: ");
 
@@ -321,29 +655,128 @@ void commandCharacteristicWritten(BLEDevice central, BLECharacteristic character
 
   const uint8_t* pValue = characteristic.value();
 
+  if (pValue && bulkCommandWritten(pValue, characteristic.valueLength()))
+  {
+    return;
+  }
+
   constexpr int CALIB_INDEX = 0;
   constexpr int CHUNK_NUM_INDEX = 1;
+  constexpr int PACK_INDEX = 2;
 
   if (pValue && pValue[CALIB_INDEX] == 1) {
     Serial.println("Calib Flag On.");
     calibFlag = true;
   }
 
+  // Legacy one chunk reads cover the RAM log only. These centrals predate the flash
+  // log and their command has no room for a page (a u8 chunk and the pack flag), and
+  // one chunk per loop without crc or resend would be slow and fragile for 18 chunk
+  // blocks. Flash pages are downloaded with the bulk transfer (PAGE, then START).
   if (!(pValue && pValue[CHUNK_NUM_INDEX] < 0)) {
     Serial.print("ReadData Flag Status ");
     Serial.println(pValue[CHUNK_NUM_INDEX]);
     digitalWrite(LEDG, LOW);
-    readVoltCache.setReadChunk(pValue[CHUNK_NUM_INDEX]);
+    // older centrals write only the first two bytes
+    const bool packFlag = characteristic.valueLength() > PACK_INDEX && pValue[PACK_INDEX] == 1;
+    readVoltCache.setReadChunk(pValue[CHUNK_NUM_INDEX], packFlag);
+  }
+
+}
+
+bool bulkCommandWritten(const uint8_t* pValue, int length) {
+
+  if (pValue[0] == BulkTransfer::COMMAND_START && length >= 4) {
+    const uint16_t fromSeq = BulkTransfer::readUint16(&pValue[1]);
+    Serial.print("Bulk Start ");
+    Serial.println(fromSeq);
+    if (flashPageSource.isRam()) {
+      bulkTransfer.setPage(BulkTransfer::PAGE_RAM, (uint16_t)flashLog.getBlockCount());
+      bulkTransfer.start(fromSeq, readVoltCache.getChunkTotal(), readVoltCache.getViewCount(), readVoltCache.generation, readVoltCache.getTiming(), pValue[3] == 1);
+    }
+    else {
+      // a page that is gone sends only the end frame
+      flashPageSource.select(flashPageSource.page);
+      bulkTransfer.setPage(flashPageSource.page, (uint16_t)flashLog.getBlockCount());
+      bulkTransfer.start(fromSeq, flashPageSource.getChunkTotal(), flashPageSource.info.sampleCount, (uint8_t)flashPageSource.sequence, flashPageSource.getTiming(), pValue[3] == 1);
+    }
+    return true;
+  }
+
+  if (pValue[0] == BulkTransfer::COMMAND_PAGE && length >= 3) {
+    flashPageSource.select(BulkTransfer::readUint16(&pValue[1]));
+    Serial.print("Bulk Page ");
+    Serial.println(flashPageSource.page);
+    bulkTransfer.abort();
+    return true;
   }
 
+  if (pValue[0] == BulkTransfer::COMMAND_RESEND && length >= 5) {
+    if (!bulkTransfer.requestResend(BulkTransfer::readUint16(&pValue[1]), BulkTransfer::readUint16(&pValue[3]))) {
+      Serial.println("Bulk Resend Queue Full.");
+    }
+    return true;
+  }
+
+  if (pValue[0] == BulkTransfer::COMMAND_ABORT) {
+    Serial.println("Bulk Abort.");
+    bulkTransfer.abort();
+    return true;
+  }
+
+  return false;
+}
+
+// Sends bulk frames until the link stops accepting notifications
+void sendBulkFrames() {
+
+  constexpr int BULK_FRAMES_PER_LOOP = 4;
+
+  uint8_t frame[ReadVoltCache::READ_DATA_MAX];
+  for (int i = 0; i < BULK_FRAMES_PER_LOOP && bulkTransfer.isActive(); ++i) {
+    const int frameSize = flashPageSource.isRam() ?
+      bulkTransfer.buildFrame(readVoltCache, &frame[0], ReadVoltCache::READ_DATA_MAX) :
+      bulkTransfer.buildFrame(flashPageSource, &frame[0], ReadVoltCache::READ_DATA_MAX);
+    if (readdataCharacteristic.writeValue(&frame[0], frameSize) == 0) {
+      break;
+    }
+    bulkTransfer.advance();
+  }
 }
 
 void paramCharacteristicWritten(BLEDevice central, BLECharacteristic characteristic) {
 
   const uint8_t* pValue = characteristic.value();
-  paramSet.setState(pValue);
+  paramSet.setState(pValue, characteristic.valueLength());
+
+  if (paramSet.isSamplerChanged())
+  {
+    samplerRestartFlag = true;
+  }
+
+  if (paramSet.isTriggerChanged())
+  {
+    // trigger mode logs every sample, so switching it on or off changes the log timing
+    if (triggerCapture.isEnabled() != (paramSet.triggerSetting.mode != TriggerCapture::Mode::Off))
+    {
+      samplerRestartFlag = true;
+    }
+    triggerCapture.configure(paramSet.triggerSetting);
+  }
+
+  if (paramSet.isTriggerChanged() || paramSet.isArmRequested())
+  {
+    readVoltCache.unfreeze();
+    triggerCapture.arm(readVoltCache.entryTotal);
+  }
+
+  // the rest of the recording goes to flash
+  if (!paramSet.enableFlag)
+  {
+    flashLog.closeBlock();
+  }
 
-  if (paramSet.isEnableTurnOn() || paramSet.isGyroTurnOn()|| paramSet.isGyroTurnOff())
+  if (paramSet.isEnableTurnOn() || paramSet.isGyroTurnOn()|| paramSet.isGyroTurnOff() || samplerRestartFlag)
   {
     calibFlag = true;
   }
@@ -354,40 +787,137 @@ void paramCharacteristicWritten(BLEDevice central, BLECharacteristic characteris
 class VoltCache
 {
   public:
+  static constexpr float LOG_HZ = 60.f;
+
   int readCount = 0;
   float sumAnalogRead = 0.f;
-  float calibVolt = 0.f;
+  float calibCount = 0.f;
+  bool calibSumFlag = false;
 
   float cacheMillis = 0.f;
   float startMillis = 0.f;
 
   const float calibStartMillis = 100.f;
   const float calibEndMillis = 200.f;
+  bool calibratingFlag = false;
+
+  uint32_t decimation = 1;    // raw samples per log entry
+  uint32_t entryStartIndex = 0;
+  bool entryStartedFlag = false;
+  uint32_t entrySum = 0;
+  uint32_t entryCount = 0;
+  int16_t lastSample = 0;
+
+  // Call after the sampler was (re)started.
+  // With a trigger every sample is logged, otherwise about LOG_HZ entries per second.
+  void restart()
+  {
+    decimation = triggerCapture.isEnabled() ? 1UL : max(1UL, (unsigned long)(voltSampler.getRateHz() / LOG_HZ));
+    entryStartedFlag = false;
+    entrySum = 0;
+    entryCount = 0;
+    liveStream.reset((uint16_t)voltSampler.getRateHz(), (uint16_t)decimation);
+  }
+
+  // Drains the sampler. Every `decimation` sample indexes make one log entry, so
+  // entry n starts exactly at sample entryStartIndex + n * decimation even when
+  // samples were dropped.
+  void addVolt(bool logFlag, bool liveFlag) {
+    voltSampler.poll();
+
+    uint16_t value = 0;
+    uint32_t index = 0;
+    while (voltSampler.read(value, index)) {
+      if (liveFlag) {
+        windowStats.add(value);
+      }
+      if (calibSumFlag) {
+        readCount++;
+        sumAnalogRead += value;
+      }
+
+      if (!entryStartedFlag) {
+        entryStartIndex = index;
+        entryStartedFlag = true;
+      }
+      while (index - entryStartIndex >= decimation) {
+        finishEntry(logFlag, liveFlag);
+      }
+      entrySum += value;
+      entryCount++;
+    }
+  }
 
-  void addVolt() {
-    float analogReadValue0 = analogRead(SENSOR_READ_VOLT);
-    readCount++;
-    sumAnalogRead += analogReadValue0;
+  void finishEntry(bool logFlag, bool liveFlag)
+  {
+    // an entry whose samples were all dropped repeats the previous value
+    if (entryCount > 0)
+    {
+      const float count = (((float)entrySum / (float)entryCount) - calibCount) * (float)(1 << SampleCodec::FRACTION_BITS);
+      lastSample = (int16_t)constrain(lroundf(count), -32767L, 32767L);
+    }
+    if (liveFlag)
+    {
+      liveStream.addSample(lastSample, entryStartIndex);
+    }
+    if (logFlag)
+    {
+      flashLog.addSample(lastSample, entryStartIndex);
+    }
+    if (logFlag && !readVoltCache.frozenFlag)
+    {
+      const uint32_t entryIndex = readVoltCache.entryTotal;
+      readVoltCache.setSample(lastSample, entryStartIndex);
+      if (triggerCapture.add(lastSample, entryIndex))
+      {
+        readVoltCache.freezeWindow(triggerCapture.getWindowFirst(), triggerCapture.getWindowCount());
+      }
+    }
+    entryStartIndex += decimation;
+    entrySum = 0;
+    entryCount = 0;
   }
 
-  void calib()
+  // Calibration runs alongside loop(); call calibLoop() until isCalibrating() is false
+  void startCalib()
   {
     sumAnalogRead = 0.f;
-    calibVolt = 0.f;
+    calibCount = 0.f;
     readCount = 0;
 
     cacheMillis = 0.f;
     startMillis = 0.f;
+    calibratingFlag = true;
 
     Serial.println("Volt Calib Start.");
-    while(calibLoop())
-    ;
-    Serial.println(calibVolt);
-    Serial.println("Volt Calib End.");
   }
 
+  bool isCalibrating() const
+  {
+    return calibratingFlag;
+  }
+
+  uint8_t getCalibProgress() const
+  {
+    if (!calibratingFlag)
+    {
+      return 100;
+    }
+    if (startMillis == 0.f)
+    {
+      return 0;
+    }
+    return (uint8_t)constrain((millis() - startMillis) * 100.f / calibEndMillis, 0.f, 99.f);
+  }
+
+  // The samples themselves come in through addVolt()
   bool calibLoop()
   {
+    if (!calibratingFlag)
+    {
+      return false;
+    }
+
     float currentMillis = millis();
     if (startMillis == 0.f)
     {
@@ -399,24 +929,32 @@ class VoltCache
 
       if (deltaMillis > calibEndMillis)
       {
-        calibVolt = getVolt();
+        calibCount = (readCount > 0) ? (sumAnalogRead / (float)readCount) : 0.f;
+        calibSumFlag = false;
+        calibratingFlag = false;
+        Serial.println(calibCount * TO_VOLT);
+        Serial.println("Volt Calib End.");
         return false;
       }
       else if (deltaMillis > calibStartMillis)
       {
-        addVolt();
+        calibSumFlag = true;
       }
     }
 
     return true;
   }
 
-  float getVolt()
+  // Stored sample units (counts << FRACTION_BITS above the calibration zero) to raw counts
+  uint16_t toRawCount(int16_t sample) const
   {
-    float resultVolt = ((sumAnalogRead / (float)readCount) - calibVolt) * TO_VOLT;
-    sumAnalogRead = 0.f;
-    readCount = 0;
-    return resultVolt;
+    return (uint16_t)constrain(lroundf(calibCount + (float)sample / (float)(1 << SampleCodec::FRACTION_BITS)), 0L, 65535L);
+  }
+
+  // Latest log entry (counts << FRACTION_BITS)
+  int16_t getSample()
+  {
+    return lastSample;
   }
 };
 
@@ -434,19 +972,29 @@ class AngleCache
   float calibY = 0.f;
   float calibZ = 0.f;
 
-  float cacheMillis = 0.f;
-  float startMillis = 0.f;
+  // integer time stamps, float millis lose resolution after a few hours
+  uint32_t cacheMicros = 0;
+  uint32_t startMillis = 0;
 
-  const float calibStartMillis = 1000.f;
-  const float calibEndMillis = 3000.f;
+  const uint32_t calibStartMillis = 1000;
+  const uint32_t calibEndMillis = 3000;
   const float scale = 0.001f;
 
+  bool calibratingFlag = false;
+  uint32_t calibSampleCount = 0; // FIFO calibration
+
+  // Accel aided orientation, otherwise the gyro is integrated alone
+  static constexpr bool FUSION_ENABLED = true;
+  OrientationFilter filter;
+
   static constexpr float toRad = (M_PI / 180.f);
   static constexpr float toDeg = (180.f / M_PI);
 
-  void calib()
+  // Calibration runs alongside loop(); call update() until isCalibrating() is false
+  void startCalib()
   {
     quat = Quaternion();
+    filter.reset();
 
     x = 0.f;
     y = 0.f;
@@ -456,33 +1004,73 @@ class AngleCache
     calibY = 0.f;
     calibZ = 0.f;
 
-    cacheMillis = 0.f;
-    startMillis = 0.f;
+    cacheMicros = 0;
+    startMillis = 0;
 
-    Serial.println("Angle Calib Start.");
+    calibSampleCount = 0;
+    imuFifo.clear(IMU);
+    calibratingFlag = true;
 
+    Serial.println("Angle Calib Start.");
     digitalWrite(LED_BUILTIN, LOW);
-    while(calibLoop())
-    ;
+  }
+
+  bool isCalibrating() const
+  {
+    return calibratingFlag;
+  }
+
+  uint8_t getCalibProgress() const
+  {
+    if (!calibratingFlag)
+    {
+      return 100;
+    }
+    if (imuFifo.isActive())
+    {
+      return (uint8_t)min(calibSampleCount * 100 / getCalibSampleEnd(), (uint32_t)99);
+    }
+    if (startMillis == 0)
+    {
+      return 0;
+    }
+    return (uint8_t)min((uint32_t)(millis() - startMillis) * 100 / calibEndMillis, (uint32_t)99);
+  }
 
-    Serial.println("Angle Calib End.");
-    digitalWrite(LED_BUILTIN, HIGH);
+  // Calibrates while calibrating, otherwise integrates the new samples
+  void update()
+  {
+    if (!calibratingFlag)
+    {
+      addAngleForQuat();
+      return;
+    }
+
+    const bool runningFlag = imuFifo.isActive() ? calibFifo() : calibLoop();
+    if (!runningFlag)
+    {
+      calibratingFlag = false;
+      cacheMicros = micros();
+
+      Serial.println("Angle Calib End.");
+      digitalWrite(LED_BUILTIN, HIGH);
+    }
   }
 
   bool calibLoop()
   {
-    float currentMillis = millis();
+    uint32_t currentMillis = millis();
     float inX = IMU.readFloatGyroX();
     float inY = IMU.readFloatGyroY();
     float inZ = IMU.readFloatGyroZ();
 
-    if (startMillis == 0.f)
+    if (startMillis == 0)
     {
       startMillis = currentMillis;
     }
     else
     {
-      float deltaMillis = currentMillis - startMillis;
+      uint32_t deltaMillis = currentMillis - startMillis;
 
       if (deltaMillis > calibEndMillis)
       {
@@ -514,45 +1102,138 @@ class AngleCache
 
   }
 
+  uint32_t getCalibSampleStart() const
+  {
+    return (uint32_t)(calibStartMillis * 0.001f * ImuFifo::ODR_HZ);
+  }
+
+  uint32_t getCalibSampleEnd() const
+  {
+    return (uint32_t)(calibEndMillis * 0.001f * ImuFifo::ODR_HZ);
+  }
+
+  // Averages the gyro over the same window as calibLoop(), counted in sensor samples.
+  // Takes one burst per call, returns false when done.
+  bool calibFifo()
+  {
+    const uint32_t startCount = getCalibSampleStart();
+    const uint32_t endCount = getCalibSampleEnd();
+
+    ImuSample samples[ImuFifo::BURST_SAMPLE_MAX];
+    const int readCount = imuFifo.read(IMU, &samples[0], ImuFifo::BURST_SAMPLE_MAX);
+    for (int i = 0; i < readCount && calibSampleCount < endCount; ++i, ++calibSampleCount)
+    {
+      if (calibSampleCount >= startCount)
+      {
+        x += IMU.calcGyro(samples[i].gyro[0]);
+        y += IMU.calcGyro(samples[i].gyro[1]);
+        z += IMU.calcGyro(samples[i].gyro[2]);
+      }
+    }
+    if (calibSampleCount < endCount)
+    {
+      return true;
+    }
+
+    calibX = x / (endCount - startCount);
+    calibY = y / (endCount - startCount);
+    calibZ = z / (endCount - startCount);
+
+    x = 0.f;
+    y = 0.f;
+    z = 0.f;
+
+    return false;
+  }
+
   void addAngle()
   {
-    float currentMillis = millis();
+    uint32_t currentMicros = micros();
     float inX = IMU.readFloatGyroX();
     float inY = IMU.readFloatGyroY();
     float inZ = IMU.readFloatGyroZ();
 
-    float deltaMillis = currentMillis - cacheMillis;
-    cacheMillis = currentMillis;
+    float deltaSec = (currentMicros - cacheMicros) * 0.000001f;
+    cacheMicros = currentMicros;
 
-    x += (inX - calibX) * deltaMillis * scale;
-    y += (inY - calibY) * deltaMillis * scale;
-    z += (inZ - calibZ) * deltaMillis * scale;
+    x += (inX - calibX) * deltaSec;
+    y += (inY - calibY) * deltaSec;
+    z += (inZ - calibZ) * deltaSec;
   }
 
   void addAngleForQuat()
   {
-    float currentMillis = millis();
+    if (imuFifo.isActive())
+    {
+      addAngleFromFifo();
+      return;
+    }
 
-    // uint8_t tempOutValue[12];
-    // IMU.readRegisterRegion(&tempOutValue[0], LSM6DS3_ACC_GYRO_OUTX_L_G, 12);
-    // IMU.readRegisterRegion(&tempOutValue[0], LSM6DS3_ACC_GYRO_OUTX_L_XL, 6);
+    const uint32_t currentMicros = micros();
 
-    float inX = IMU.readFloatGyroX();
-    float inY = IMU.readFloatGyroY();
-    float inZ = IMU.readFloatGyroZ();
+    // the gyro and accel output registers are contiguous, one burst reads both
+    uint8_t tempOutValue[ImuFifo::BYTES_PER_SAMPLE];
+    if (IMU.readRegisterRegion(&tempOutValue[0], LSM6DS3_ACC_GYRO_OUTX_L_G, ImuFifo::BYTES_PER_SAMPLE) != IMU_SUCCESS)
+    {
+      return;
+    }
+
+    ImuSample sample;
+    ImuFifo::decodeSample(&tempOutValue[0], sample);
+
+    const float deltaSec = (currentMicros - cacheMicros) * 0.000001f;
+    cacheMicros = currentMicros;
+
+    addSamples(&sample, 1, deltaSec);
+  }
+
+  // count samples taken periodSec apart
+  void addSamples(const ImuSample* samples, int count, float periodSec)
+  {
+    if (FUSION_ENABLED)
+    {
+      OrientationFilter::Sample filterSamples[ImuFifo::BURST_SAMPLE_MAX];
+      count = min(count, ImuFifo::BURST_SAMPLE_MAX);
+      for (int i = 0; i < count; ++i)
+      {
+        filterSamples[i].gyro[0] = (IMU.calcGyro(samples[i].gyro[0]) - calibX) * toRad;
+        filterSamples[i].gyro[1] = (IMU.calcGyro(samples[i].gyro[1]) - calibY) * toRad;
+        filterSamples[i].gyro[2] = (IMU.calcGyro(samples[i].gyro[2]) - calibZ) * toRad;
+        filterSamples[i].accel[0] = IMU.calcAccel(samples[i].accel[0]);
+        filterSamples[i].accel[1] = IMU.calcAccel(samples[i].accel[1]);
+        filterSamples[i].accel[2] = IMU.calcAccel(samples[i].accel[2]);
+      }
+      filter.updateBatch(&filterSamples[0], count, periodSec);
+      quat = filter.getQuat();
+      return;
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+      const float tempX = (IMU.calcGyro(samples[i].gyro[0]) - calibX) * periodSec;
+      const float tempY = (IMU.calcGyro(samples[i].gyro[1]) - calibY) * periodSec;
+      const float tempZ = (IMU.calcGyro(samples[i].gyro[2]) - calibZ) * periodSec;
 
-    float deltaMillis = currentMillis - cacheMillis;
-    cacheMillis = currentMillis;
+      Quaternion mulQuat;
+      mulQuat = mulQuat.from_euler_rotation_approx(toRad * tempX, toRad * tempY, toRad * tempZ);
 
-    float tempX = (inX - calibX) * deltaMillis * scale;
-    float tempY = (inY - calibY) * deltaMillis * scale;
-    float tempZ = (inZ - calibZ) * deltaMillis * scale;
+      quat *= mulQuat;
+      quat.normalize();
+    }
+  }
 
-    Quaternion mulQuat;
-    mulQuat = mulQuat.from_euler_rotation_approx(toRad * tempX, toRad * tempY, toRad * tempZ);
+  // Drains the FIFO and integrates every sample over the sensor period
+  void addAngleFromFifo()
+  {
+    constexpr float periodSec = ImuFifo::getPeriodSec();
 
-    quat *= mulQuat;
-    quat.normalize();
+    ImuSample samples[ImuFifo::BURST_SAMPLE_MAX];
+    int readCount = 0;
+    do
+    {
+      readCount = imuFifo.read(IMU, &samples[0], ImuFifo::BURST_SAMPLE_MAX);
+      addSamples(&samples[0], readCount, periodSec);
+    } while (readCount == ImuFifo::BURST_SAMPLE_MAX);
   }
 
   static void quatToYPR(const Quaternion& quat, float& roll, float& pitch, float& yaw) {
@@ -562,7 +1243,8 @@ class AngleCache
     float z = quat.d;
 
     roll = atan2(2 * (w * x + y * z), 1 - 2 * (x * x + y * y)) * toDeg;
-    pitch = asin(2 * (w * y - x * z)) * toDeg;
+    // the filter normalizes only every few steps, keep asin() in range
+    pitch = asin(constrain(2 * (w * y - x * z), -1.f, 1.f)) * toDeg;
     yaw = atan2(2 * (w * z + x * y), 1 - 2 * (z * z + y * y)) * toDeg;
   }
 };
@@ -570,14 +1252,18 @@ class AngleCache
 AngleCache currentAngle;
 VoltCache voltCache;
 
+bool loggingFlag = false;
+bool liveFlag = false;
+
 void readVolt() {
 
-  voltCache.addVolt();
+  voltCache.addVolt(loggingFlag, liveFlag);
+  voltCache.calibLoop();
 }
 
 void readAngle() {
 
-  currentAngle.addAngleForQuat();
+  currentAngle.update();
 }
 
 void setup() {
@@ -591,6 +1277,17 @@ void setup() {
 
   bleSetup();
 
+  voltSampler.begin(SENSOR_READ_VOLT, paramSet.rateIndex, paramSet.oversampleShift);
+  voltCache.restart();
+
+  if (qspiFlash.begin() && flashLog.begin(qspiFlash)) {
+    Serial.print("Flash log blocks ");
+    Serial.println(flashLog.getBlockCount());
+  }
+  else {
+    Serial.println("Flash log not available.");
+  }
+
   gyroSetup();
 
 }
@@ -603,12 +1300,26 @@ void loop() {
 
   while (true) {
     readVolt();
+    flashLog.update();
 
-    if (paramSet.gyroFlag) {
+    if (!paramSet.enableFlag && bulkTransfer.isActive() && BLE.connected()) {
+      sendBulkFrames();
+    }
+
+    if (paramSet.gyroFlag || currentAngle.isCalibrating()) {
       readAngle();
     }
 
     if ((millis() - volt_millis_buf) > ONE_FRAME_MS) {
+      if (samplerRestartFlag) {
+        voltSampler.begin(SENSOR_READ_VOLT, paramSet.rateIndex, paramSet.oversampleShift);
+        voltCache.restart();
+        samplerRestartFlag = false;
+      }
+      // entries go to the log only while the central is recording
+      loggingFlag = false;
+      liveFlag = false;
+
 #if XIAO
       if (pServer->getConnectedCount() == 0) {
         BLEAdvertising *pAdvertising = pServer->getAdvertising();
@@ -633,12 +1344,36 @@ void loop() {
 
           if (calibFlag)
           {
-            currentAngle.calib();
-            voltCache.calib();
-            readVoltCache.reset();
+            currentAngle.startCalib();
+            voltCache.startCalib();
+            bulkTransfer.abort();
+            liveStream.reset((uint16_t)voltSampler.getRateHz(), (uint16_t)voltCache.decimation);
+            windowStats.reset(voltCache.toRawCount(paramSet.statsThreshold));
             calibFlag = false;
           }
 
+          // the calibrations advance in readVolt() / readAngle(); report progress meanwhile
+          const uint8_t calibProgress = min(currentAngle.getCalibProgress(), voltCache.getCalibProgress());
+          if (calibProgress != paramSet.calibProgress)
+          {
+            if (calibProgress == 100)
+            {
+              readVoltCache.reset();
+              readVoltCache.setTiming(voltSampler.getRateHz(), voltCache.decimation);
+              triggerCapture.arm(readVoltCache.entryTotal);
+              flashLog.startSession((uint16_t)voltSampler.getRateHz(), (uint16_t)voltCache.decimation);
+            }
+            // notify in 10% steps
+            if (calibProgress / 10 != paramSet.calibProgress / 10 || calibProgress == 100)
+            {
+              paramSet.calibProgress = calibProgress;
+              paramCharacteristic.writeValue(paramSet.getState(), ParamSet::PARAM_SIZE);
+            }
+          }
+          // live values keep flowing during calibration, the log starts after it
+          loggingFlag = paramSet.calibProgress == 100;
+          liveFlag = true;
+
           {
             /*
             Serial.print(currentAngle.quat.a);
@@ -666,18 +1401,36 @@ void loop() {
             */
           }
           {
-            sendValue[0] = voltCache.getVolt();
-            sendValue[4] = readVoltCache.getDataCountPercent();
-            readVoltCache.setVolt(sendValue[0]);
-            loggerCharacteristic.writeValue((size_t*)&sendValue[0], LOGGER_DATA_SIZE);
+            // every entry and the raw sample statistics since the last frame;
+            // kept for the next frame if the write fails
+            const WindowStats::Report stats = windowStats.getReport(voltCache.calibCount, SampleCodec::FRACTION_BITS);
+            uint8_t frame[LOGGER_DATA_SIZE];
+            const int frameSize = liveStream.buildFrame(&frame[0], LOGGER_DATA_SIZE, &sendValue[1], paramSet.gyroFlag, (uint8_t)readVoltCache.getDataCountPercent(), stats);
+            if (loggerCharacteristic.writeValue(&frame[0], frameSize) != 0)
+            {
+              liveStream.advance();
+              windowStats.reset(voltCache.toRawCount(paramSet.statsThreshold));
+            }
+          }
+          {
+            // let the central know when the trigger fired and the capture is ready
+            static TriggerCapture::State lastTriggerState = TriggerCapture::State::Idle;
+            if (triggerCapture.getState() != lastTriggerState)
+            {
+              lastTriggerState = triggerCapture.getState();
+              paramCharacteristic.writeValue(paramSet.getState(), ParamSet::PARAM_SIZE);
+            }
           }
         }
         else
         {
 
+          // legacy read: always the RAM log, whatever page a bulk PAGE selected
           if (readVoltCache.isReadData())
           {
-            readdataCharacteristic.writeValue(readVoltCache.getWritePointer(), ReadVoltCache::READ_DATA_MAX); // ReadVoltCache::READ_DATA_MAX
+            uint8_t readData[ReadVoltCache::READ_DATA_MAX];
+            const int readDataSize = readVoltCache.fillReadData(&readData[0]);
+            readdataCharacteristic.writeValue(&readData[0], readDataSize);
             Serial.println(readVoltCache.getReadChunk());
             readVoltCache.setReadChunk(-1);
             digitalWrite(LEDG, HIGH);
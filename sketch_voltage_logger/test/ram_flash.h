@@ -0,0 +1,129 @@
+#ifndef RAM_FLASH_H
+#define RAM_FLASH_H
+
+// FlashDevice in RAM for the host tests. Behaves like the NOR flash behind QspiFlash:
+// erase sets a sector to 0xFF, program can only clear bits, both stay busy for a few
+// isBusy() polls, read() waits for the running operation. A power cut stops the running
+// operation part way.
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "FlashLog.h"
+
+class RamFlash : public FlashDevice {
+  public:
+
+  explicit RamFlash(uint32_t size) : memory(size, 0xFF) {
+  }
+
+  uint32_t getSize() const override {
+    return (uint32_t)memory.size();
+  }
+
+  bool read(uint32_t address, void* data, uint32_t size) override {
+    while (isBusy()) {
+    }
+    if (address + size > memory.size()) {
+      return false;
+    }
+    std::memcpy(data, &memory[address], size);
+    ++readCount;
+    return true;
+  }
+
+  bool startErase(uint32_t address) override {
+    if (operation != Operation::None || address % SECTOR_SIZE != 0 || address >= memory.size()) {
+      return false;
+    }
+    operation = Operation::Erase;
+    operationAddress = address;
+    busyCount = busyPolls;
+    ++eraseCount;
+    return true;
+  }
+
+  bool startProgram(uint32_t address, const void* data, uint32_t size) override {
+    if (operation != Operation::None || ((address | size) & 3) != 0 || size == 0 || address + size > memory.size()) {
+      return false;
+    }
+    // a program never crosses a sector
+    if (address / SECTOR_SIZE != (address + size - 1) / SECTOR_SIZE) {
+      std::abort();
+    }
+    operation = Operation::Program;
+    operationAddress = address;
+    programData.assign((const uint8_t*)data, (const uint8_t*)data + size);
+    busyCount = busyPolls;
+    ++programCount;
+    return true;
+  }
+
+  bool isBusy() override {
+    if (operation == Operation::None) {
+      return false;
+    }
+    if (--busyCount > 0) {
+      return true;
+    }
+    finish(SECTOR_SIZE);
+    return false;
+  }
+
+  bool isErasing() const {
+    return operation == Operation::Erase;
+  }
+
+  bool isProgramming() const {
+    return operation == Operation::Program;
+  }
+
+  // Power cut while programming: only the first byteCount bytes got written
+  void cutProgram(uint32_t byteCount) {
+    if (operation == Operation::Program) {
+      finish(byteCount);
+    }
+    operation = Operation::None;
+  }
+
+  // Power cut while erasing: only [first, last) of the sector got erased
+  void cutErase(uint32_t first, uint32_t last) {
+    if (operation == Operation::Erase) {
+      std::memset(&memory[operationAddress + first], 0xFF, last - first);
+    }
+    operation = Operation::None;
+  }
+
+  std::vector<uint8_t> memory;
+  int busyPolls = 3;
+  int eraseCount = 0;
+  int programCount = 0;
+  int readCount = 0;
+
+  private:
+
+  enum class Operation {
+    None,
+    Erase,
+    Program,
+  };
+
+  void finish(uint32_t byteCount) {
+    if (operation == Operation::Erase) {
+      std::memset(&memory[operationAddress], 0xFF, SECTOR_SIZE);
+    } else if (operation == Operation::Program) {
+      for (uint32_t i = 0; i < byteCount && i < programData.size(); ++i) {
+        memory[operationAddress + i] &= programData[i];
+      }
+    }
+    operation = Operation::None;
+  }
+
+  Operation operation = Operation::None;
+  uint32_t operationAddress = 0;
+  std::vector<uint8_t> programData;
+  int busyCount = 0;
+};
+
+#endif
@@ -0,0 +1,508 @@
+// BulkTransfer over a lossy link: frames are dropped, reordered and corrupted on the
+// way, the central checks the crc, asks for the gaps with RESEND and resumes an
+// interrupted download with START fromSeq. The samples must arrive complete and in order.
+
+#include <deque>
+#include <random>
+#include <vector>
+
+#include "BulkTransfer.h"
+#include "SampleCodec.h"
+#include "test_util.h"
+
+namespace {
+
+  constexpr int FRAME_MAX = 244;
+  constexpr int CHUNK_SAMPLES = 118;
+
+  // Same chunking as ReadVoltCache::readChunk
+  struct Source {
+    std::vector<int16_t> samples;
+    int readCount = 0;
+
+    uint16_t chunkTotal() const {
+      return (uint16_t)((samples.size() + CHUNK_SAMPLES - 1) / CHUNK_SAMPLES);
+    }
+
+    int readChunk(uint16_t seq, bool packFlag, uint8_t* payload, int payloadMax, bool& packed) {
+      ++readCount;
+      const int first = seq * CHUNK_SAMPLES;
+      const int count = std::min<int>(CHUNK_SAMPLES, (int)samples.size() - first);
+      return SampleCodec::writePayload(&samples[first], count, packFlag, payload, payloadMax, packed);
+    }
+  };
+
+  Source makeSource(int sampleCount, uint32_t seed) {
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int> step(-40, 40);
+    std::uniform_int_distribution<int> jumpChance(0, 99);
+    Source source;
+    int value = 8000;
+    for (int i = 0; i < sampleCount; ++i) {
+      value += (jumpChance(random) == 0) ? 3000 : step(random);
+      value = (value > 30000) ? 2000 : value;
+      source.samples.push_back((int16_t)value);
+    }
+    return source;
+  }
+
+  BulkTransfer::Timing makeTiming() {
+    BulkTransfer::Timing timing;
+    timing.rateHz = 1000;
+    timing.decimation = 4;
+    timing.oldestSampleIndex = 123456;
+    return timing;
+  }
+
+  using Frame = std::vector<uint8_t>;
+
+  // Sends every frame the transfer has, as sendBulkFrames() does
+  std::vector<Frame> drain(BulkTransfer& transfer, Source& source) {
+    std::vector<Frame> frames;
+    uint8_t buffer[FRAME_MAX];
+    while (transfer.isActive()) {
+      const int size = transfer.buildFrame(source, buffer, FRAME_MAX);
+      CHECK(size > 0 && size <= FRAME_MAX);
+      frames.push_back(Frame(buffer, buffer + size));
+      transfer.advance();
+    }
+    return frames;
+  }
+
+  // Central side: keeps the decoded chunks and tells what is still missing
+  struct Central {
+    uint8_t generation = 0;
+    bool generationFlag = false;
+    int total = -1;
+    bool endFlag = false;
+    uint16_t endSampleCount = 0;
+    BulkTransfer::Timing endTiming;
+    uint16_t endPage = 0;
+    uint16_t endPageCount = 0;
+    std::vector<std::vector<int16_t>> chunks;
+    std::vector<bool> receivedFlags;
+    int rejectCount = 0;
+    int duplicateCount = 0;
+
+    void restart(uint8_t inGeneration) {
+      generation = inGeneration;
+      generationFlag = true;
+      total = -1;
+      endFlag = false;
+      chunks.clear();
+      receivedFlags.clear();
+    }
+
+    void setTotal(int inTotal) {
+      if (total < 0) {
+        total = inTotal;
+        chunks.resize(total);
+        receivedFlags.assign(total, false);
+      }
+    }
+
+    void receive(const Frame& frame) {
+      if (!BulkTransfer::isValidFrame(frame.data(), (int)frame.size())) {
+        ++rejectCount;
+        return;
+      }
+      // data recorded before a log reset can not be mixed with the new data
+      if (!generationFlag || frame[1] != generation) {
+        restart(frame[1]);
+      }
+
+      if (frame[0] == BulkTransfer::FRAME_END) {
+        CHECK(frame.size() == BulkTransfer::END_FRAME_SIZE);
+        setTotal(BulkTransfer::readUint16(&frame[2]));
+        endFlag = true;
+        endSampleCount = BulkTransfer::readUint16(&frame[4]);
+        endTiming.rateHz = BulkTransfer::readUint16(&frame[6]);
+        endTiming.decimation = BulkTransfer::readUint16(&frame[8]);
+        endTiming.oldestSampleIndex = BulkTransfer::readUint32(&frame[10]);
+        endPage = BulkTransfer::readUint16(&frame[14]);
+        endPageCount = BulkTransfer::readUint16(&frame[16]);
+        return;
+      }
+
+      const uint16_t seq = BulkTransfer::readUint16(&frame[2]);
+      setTotal(BulkTransfer::readUint16(&frame[4]));
+      CHECK(seq < total);
+      if (seq >= total) {
+        return;
+      }
+      if (receivedFlags[seq]) {
+        ++duplicateCount;
+        return;
+      }
+
+      const uint8_t* payload = &frame[BulkTransfer::HEADER_SIZE];
+      const int payloadSize = (int)frame.size() - BulkTransfer::HEADER_SIZE - BulkTransfer::CRC_SIZE;
+      std::vector<int16_t> samples(CHUNK_SAMPLES);
+      int count = 0;
+      if (frame[0] == BulkTransfer::FRAME_DATA_PACKED) {
+        count = SampleCodec::unpack(payload, payloadSize, samples.data(), CHUNK_SAMPLES);
+      } else {
+        CHECK(frame[0] == BulkTransfer::FRAME_DATA_RAW && payloadSize % 2 == 0);
+        count = payloadSize / 2;
+        for (int i = 0; i < count; ++i) {
+          samples[i] = SampleCodec::readInt16(&payload[i * 2]);
+        }
+      }
+      CHECK(count > 0);
+      samples.resize(count < 0 ? 0 : count);
+      chunks[seq] = samples;
+      receivedFlags[seq] = true;
+    }
+
+    int firstMissing() const {
+      for (int seq = 0; seq < total; ++seq) {
+        if (!receivedFlags[seq]) {
+          return seq;
+        }
+      }
+      return total;
+    }
+
+    // Missing chunks as (first, count) ranges
+    std::vector<std::pair<uint16_t, uint16_t>> missingRanges() const {
+      std::vector<std::pair<uint16_t, uint16_t>> ranges;
+      for (int seq = 0; seq < total; ++seq) {
+        if (receivedFlags[seq]) {
+          continue;
+        }
+        if (!ranges.empty() && ranges.back().first + ranges.back().second == seq) {
+          ++ranges.back().second;
+        } else {
+          ranges.push_back({(uint16_t)seq, 1});
+        }
+      }
+      return ranges;
+    }
+
+    bool isComplete() const {
+      return endFlag && total >= 0 && firstMissing() == total;
+    }
+
+    std::vector<int16_t> samples() const {
+      std::vector<int16_t> all;
+      for (const std::vector<int16_t>& chunk : chunks) {
+        all.insert(all.end(), chunk.begin(), chunk.end());
+      }
+      return all;
+    }
+  };
+
+  // Drops, delays (reorders) and corrupts frames at the given rates in percent
+  struct LossyLink {
+    std::mt19937 random;
+    int dropPercent;
+    int reorderPercent;
+    int corruptPercent;
+    int droppedCount = 0;
+    int reorderedCount = 0;
+    int corruptedCount = 0;
+
+    LossyLink(uint32_t seed, int inDropPercent, int inReorderPercent, int inCorruptPercent)
+      : random(seed), dropPercent(inDropPercent), reorderPercent(inReorderPercent), corruptPercent(inCorruptPercent) {
+    }
+
+    int percent() {
+      return std::uniform_int_distribution<int>(0, 99)(random);
+    }
+
+    std::vector<Frame> carry(const std::vector<Frame>& sent) {
+      std::vector<Frame> arrived;
+      std::deque<Frame> delayed;
+      for (Frame frame : sent) {
+        if (percent() < dropPercent) {
+          ++droppedCount;
+          continue;
+        }
+        if (percent() < corruptPercent) {
+          const int index = std::uniform_int_distribution<int>(0, (int)frame.size() - 1)(random);
+          frame[index] ^= (uint8_t)(1 << std::uniform_int_distribution<int>(0, 7)(random));
+          ++corruptedCount;
+        }
+        if (percent() < reorderPercent) {
+          delayed.push_back(frame);
+          ++reorderedCount;
+          continue;
+        }
+        arrived.push_back(frame);
+        // a delayed frame comes in after one or two later frames
+        if (!delayed.empty() && percent() < 50) {
+          arrived.push_back(delayed.front());
+          delayed.pop_front();
+        }
+      }
+      arrived.insert(arrived.end(), delayed.begin(), delayed.end());
+      return arrived;
+    }
+  };
+
+  void testCleanTransfer() {
+    Source source = makeSource(1000, 1);
+    BulkTransfer transfer;
+    CHECK(!transfer.isActive());
+    uint8_t buffer[FRAME_MAX];
+    CHECK(transfer.buildFrame(source, buffer, FRAME_MAX) == 0);
+
+    transfer.setPage(2, 5);
+    transfer.start(0, source.chunkTotal(), (uint16_t)source.samples.size(), 7, makeTiming(), true);
+    const std::vector<Frame> frames = drain(transfer, source);
+    CHECK(frames.size() == source.chunkTotal() + 1U);
+    CHECK(source.readCount == source.chunkTotal());
+
+    Central central;
+    for (const Frame& frame : frames) {
+      central.receive(frame);
+    }
+    CHECK(central.rejectCount == 0);
+    CHECK(central.isComplete());
+    CHECK(central.generation == 7);
+    CHECK(central.samples() == source.samples);
+    CHECK(central.endSampleCount == 1000);
+    CHECK(central.endTiming.rateHz == 1000 && central.endTiming.decimation == 4);
+    CHECK(central.endTiming.oldestSampleIndex == 123456);
+    CHECK(central.endPage == 2 && central.endPageCount == 5);
+
+    // every chunk fits packed; the occasional jump costs an escape, not the whole chunk
+    int packedCount = 0;
+    for (const Frame& frame : frames) {
+      packedCount += (frame[0] == BulkTransfer::FRAME_DATA_PACKED) ? 1 : 0;
+    }
+    CHECK(packedCount == source.chunkTotal());
+
+    // raw int16 when packing is off
+    transfer.start(0, source.chunkTotal(), (uint16_t)source.samples.size(), 7, makeTiming(), false);
+    const std::vector<Frame> rawFrames = drain(transfer, source);
+    CHECK(rawFrames.front()[0] == BulkTransfer::FRAME_DATA_RAW);
+    CHECK(rawFrames.front().size() == BulkTransfer::HEADER_SIZE + CHUNK_SAMPLES * 2 + BulkTransfer::CRC_SIZE);
+    Central rawCentral;
+    for (const Frame& frame : rawFrames) {
+      rawCentral.receive(frame);
+    }
+    CHECK(rawCentral.isComplete() && rawCentral.samples() == source.samples);
+
+    // an empty log only sends the end frame
+    Source empty;
+    transfer.start(0, 0, 0, 8, makeTiming(), true);
+    const std::vector<Frame> emptyFrames = drain(transfer, empty);
+    CHECK(emptyFrames.size() == 1 && emptyFrames[0][0] == BulkTransfer::FRAME_END);
+  }
+
+  // Every single bit flip is caught by the crc, frames shorter than header + crc are refused
+  void testCrcRejectsDamage() {
+    Source source = makeSource(300, 2);
+    BulkTransfer transfer;
+    transfer.start(0, source.chunkTotal(), (uint16_t)source.samples.size(), 1, makeTiming(), true);
+    const std::vector<Frame> frames = drain(transfer, source);
+
+    // CRC-16/CCITT-FALSE check value
+    const uint8_t check[9] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    CHECK(BulkTransfer::crc16(check, 9) == 0x29B1);
+    CHECK(BulkTransfer::crc16(&check[4], 5, BulkTransfer::crc16(check, 4)) == 0x29B1);
+
+    bool allRejectedFlag = true;
+    for (const Frame& sent : frames) {
+      CHECK(BulkTransfer::isValidFrame(sent.data(), (int)sent.size()));
+      for (size_t index = 0; index < sent.size(); ++index) {
+        for (int bit = 0; bit < 8; ++bit) {
+          Frame frame = sent;
+          frame[index] ^= (uint8_t)(1 << bit);
+          allRejectedFlag = allRejectedFlag && !BulkTransfer::isValidFrame(frame.data(), (int)frame.size());
+        }
+      }
+      for (int size = 0; size < BulkTransfer::HEADER_SIZE + BulkTransfer::CRC_SIZE; ++size) {
+        allRejectedFlag = allRejectedFlag && !BulkTransfer::isValidFrame(sent.data(), size);
+      }
+    }
+    CHECK(allRejectedFlag);
+
+    Central central;
+    Frame frame = frames[1];
+    frame[BulkTransfer::HEADER_SIZE + 3] ^= 0x10;
+    central.receive(frame);
+    CHECK(central.rejectCount == 1 && central.total < 0);
+  }
+
+  void testResendQueue() {
+    Source source = makeSource(2000, 3);
+    const uint16_t total = source.chunkTotal();
+    BulkTransfer transfer;
+    transfer.start(total, total, (uint16_t)source.samples.size(), 1, makeTiming(), true);
+
+    // out of range or empty requests are accepted and ignored
+    CHECK(transfer.requestResend(total, 1));
+    CHECK(transfer.requestResend(2, 0));
+    for (int i = 0; i < BulkTransfer::RESEND_MAX; ++i) {
+      CHECK(transfer.requestResend((uint16_t)(i * 2), 1));
+    }
+    CHECK(!transfer.requestResend(1, 1));
+
+    // resends go in the order asked, then the end frame; a count past the end is cut at total
+    std::vector<Frame> frames = drain(transfer, source);
+    CHECK(frames.size() == BulkTransfer::RESEND_MAX + 1U);
+    for (int i = 0; i < BulkTransfer::RESEND_MAX; ++i) {
+      CHECK(BulkTransfer::readUint16(&frames[i][2]) == i * 2);
+    }
+    CHECK(frames.back()[0] == BulkTransfer::FRAME_END);
+
+    CHECK(transfer.requestResend((uint16_t)(total - 2), 100));
+    frames = drain(transfer, source);
+    CHECK(frames.size() == 3);
+    CHECK(BulkTransfer::readUint16(&frames[0][2]) == total - 2);
+    CHECK(BulkTransfer::readUint16(&frames[1][2]) == total - 1);
+
+    // a resend during the stream fills the gap before the stream goes on
+    transfer.start(0, total, (uint16_t)source.samples.size(), 1, makeTiming(), true);
+    uint8_t buffer[FRAME_MAX];
+    for (int i = 0; i < 5; ++i) {
+      transfer.buildFrame(source, buffer, FRAME_MAX);
+      transfer.advance();
+    }
+    CHECK(transfer.requestResend(1, 2));
+    frames = drain(transfer, source);
+    CHECK(BulkTransfer::readUint16(&frames[0][2]) == 1);
+    CHECK(BulkTransfer::readUint16(&frames[1][2]) == 2);
+    CHECK(BulkTransfer::readUint16(&frames[2][2]) == 5);
+    CHECK(frames.size() == 2 + (total - 5) + 1U);
+
+    // a frame that was built but not sent (link busy) is built again
+    transfer.start(3, total, (uint16_t)source.samples.size(), 1, makeTiming(), true);
+    transfer.buildFrame(source, buffer, FRAME_MAX);
+    CHECK(BulkTransfer::readUint16(&buffer[2]) == 3);
+    transfer.buildFrame(source, buffer, FRAME_MAX);
+    CHECK(BulkTransfer::readUint16(&buffer[2]) == 3);
+
+    transfer.abort();
+    CHECK(!transfer.isActive());
+    CHECK(transfer.buildFrame(source, buffer, FRAME_MAX) == 0);
+  }
+
+  // Runs the central's recovery until the download is complete
+  int recover(Central& central, BulkTransfer& transfer, Source& source, LossyLink& link, uint8_t generation) {
+    int roundCount = 0;
+    while (!central.isComplete() && roundCount < 200) {
+      ++roundCount;
+      if (central.total < 0) {
+        transfer.start(0, source.chunkTotal(), (uint16_t)source.samples.size(), generation, makeTiming(), true);
+      } else {
+        const std::vector<std::pair<uint16_t, uint16_t>> ranges = central.missingRanges();
+        if (ranges.empty()) {
+          // only the end frame was lost
+          transfer.start((uint16_t)central.total, source.chunkTotal(), (uint16_t)source.samples.size(), generation, makeTiming(), true);
+        }
+        for (const std::pair<uint16_t, uint16_t>& range : ranges) {
+          if (!transfer.requestResend(range.first, range.second)) {
+            break;
+          }
+        }
+      }
+      for (const Frame& frame : link.carry(drain(transfer, source))) {
+        central.receive(frame);
+      }
+    }
+    return roundCount;
+  }
+
+  void testLossyLink() {
+    int droppedCount = 0;
+    int reorderedCount = 0;
+    int corruptedCount = 0;
+    int rejectCount = 0;
+    for (uint32_t seed = 0; seed < 20; ++seed) {
+      Source source = makeSource(4000 + seed * 37, 100 + seed);
+      BulkTransfer transfer;
+      LossyLink link(seed, 15, 10, 5);
+      Central central;
+      transfer.start(0, source.chunkTotal(), (uint16_t)source.samples.size(), 3, makeTiming(), true);
+      for (const Frame& frame : link.carry(drain(transfer, source))) {
+        central.receive(frame);
+      }
+      const int roundCount = recover(central, transfer, source, link, 3);
+
+      CHECK(roundCount < 200);
+      CHECK(central.isComplete());
+      CHECK(central.samples() == source.samples);
+      CHECK(central.endSampleCount == source.samples.size());
+      droppedCount += link.droppedCount;
+      reorderedCount += link.reorderedCount;
+      corruptedCount += link.corruptedCount;
+      rejectCount += central.rejectCount;
+    }
+    // the link really did all three, and the crc caught the corrupted frames
+    CHECK(droppedCount > 0 && reorderedCount > 0 && corruptedCount > 0);
+    CHECK(rejectCount == corruptedCount);
+  }
+
+  // The link drops out part way; the central resumes from its first missing chunk
+  void testResume() {
+    Source source = makeSource(3000, 4);
+    const uint16_t total = source.chunkTotal();
+    BulkTransfer transfer;
+    Central central;
+    transfer.start(0, total, (uint16_t)source.samples.size(), 5, makeTiming(), true);
+    uint8_t buffer[FRAME_MAX];
+    for (int i = 0; i < 10; ++i) {
+      const int size = transfer.buildFrame(source, buffer, FRAME_MAX);
+      central.receive(Frame(buffer, buffer + size));
+      transfer.advance();
+    }
+    // disconnect aborts the transfer
+    transfer.abort();
+    CHECK(!transfer.isActive());
+    CHECK(central.firstMissing() == 10 && !central.isComplete());
+
+    const int readBefore = source.readCount;
+    transfer.start((uint16_t)central.firstMissing(), total, (uint16_t)source.samples.size(), 5, makeTiming(), true);
+    for (const Frame& frame : drain(transfer, source)) {
+      central.receive(frame);
+    }
+    // nothing before fromSeq was read or sent again
+    CHECK(source.readCount - readBefore == total - 10);
+    CHECK(central.duplicateCount == 0);
+    CHECK(central.isComplete() && central.samples() == source.samples);
+
+    // fromSeq past the end only sends the end frame
+    transfer.start((uint16_t)(total + 5), total, (uint16_t)source.samples.size(), 5, makeTiming(), true);
+    const std::vector<Frame> frames = drain(transfer, source);
+    CHECK(frames.size() == 1 && frames[0][0] == BulkTransfer::FRAME_END);
+  }
+
+  // Resuming after the log was reset: the new generation throws away the old chunks
+  void testResumeAfterReset() {
+    Source oldSource = makeSource(2000, 5);
+    BulkTransfer transfer;
+    Central central;
+    transfer.start(0, oldSource.chunkTotal(), (uint16_t)oldSource.samples.size(), 9, makeTiming(), true);
+    uint8_t buffer[FRAME_MAX];
+    for (int i = 0; i < 6; ++i) {
+      const int size = transfer.buildFrame(oldSource, buffer, FRAME_MAX);
+      central.receive(Frame(buffer, buffer + size));
+      transfer.advance();
+    }
+    transfer.abort();
+
+    Source newSource = makeSource(700, 6);
+    LossyLink link(6, 20, 20, 5);
+    transfer.start((uint16_t)central.firstMissing(), newSource.chunkTotal(), (uint16_t)newSource.samples.size(), 10, makeTiming(), true);
+    for (const Frame& frame : link.carry(drain(transfer, newSource))) {
+      central.receive(frame);
+    }
+    CHECK(central.generation == 10);
+    recover(central, transfer, newSource, link, 10);
+    CHECK(central.isComplete());
+    CHECK(central.samples() == newSource.samples);
+  }
+}
+
+int main() {
+  testCleanTransfer();
+  testCrcRejectsDamage();
+  testResendQueue();
+  testLossyLink();
+  testResume();
+  testResumeAfterReset();
+  return test_util::finish("test_bulk_transfer");
+}
@@ -0,0 +1,367 @@
+// FlashLog on a RAM flash (ram_flash.h): round trip through a reboot, the ring wrapping,
+// recovery after a power cut that tore the newest block or half erased the oldest one,
+// and reading blocks by sequence while the ring moves on under the reader.
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "FlashLog.h"
+#include "ram_flash.h"
+#include "test_util.h"
+
+namespace {
+
+  constexpr uint32_t BLOCK_COUNT = 8;
+
+  int16_t sampleAt(uint32_t sampleIndex) {
+    return (int16_t)((sampleIndex * 2654435761u) >> 16);
+  }
+
+  // Runs update() until everything in RAM is in flash
+  void flush(FlashLog& log) {
+    log.closeBlock();
+    for (int i = 0; i < 1000 && !log.isFlushed(); ++i) {
+      log.update();
+    }
+    CHECK(log.isFlushed());
+  }
+
+  // Adds blockCount full blocks, writing each one out before the next
+  uint32_t writeBlocks(FlashLog& log, int blockCount, uint32_t sampleIndex, uint16_t decimation) {
+    for (int block = 0; block < blockCount; ++block) {
+      for (int i = 0; i < FlashLog::BLOCK_SAMPLE_MAX; ++i) {
+        log.addSample(sampleAt(sampleIndex), sampleIndex);
+        sampleIndex += decimation;
+      }
+      flush(log);
+    }
+    return sampleIndex;
+  }
+
+  // Every block from oldest to newest is readable, consecutive and holds its samples
+  bool checkBlocks(FlashLog& log) {
+    bool okFlag = true;
+    std::vector<int16_t> samples(FlashLog::BLOCK_SAMPLE_MAX);
+    for (uint32_t page = 0; page < log.getBlockCount(); ++page) {
+      const uint32_t sequence = log.getOldestSequence() + page;
+      FlashLog::BlockInfo info;
+      if (!log.readBlockInfo(sequence, info) || info.sequence != sequence) {
+        std::printf("page %u: no block %u\n", page, sequence);
+        return false;
+      }
+      const int count = log.readBlockSamples(sequence, 0, samples.data(), FlashLog::BLOCK_SAMPLE_MAX);
+      okFlag = okFlag && count == info.sampleCount && count > 0;
+      for (int i = 0; i < count; ++i) {
+        okFlag = okFlag && samples[i] == sampleAt(info.firstSampleIndex + i * info.decimation);
+      }
+      if (!okFlag) {
+        std::printf("page %u: block %u samples differ\n", page, sequence);
+        return false;
+      }
+    }
+    return okFlag;
+  }
+
+  std::unique_ptr<FlashLog> reboot(RamFlash& flash) {
+    std::unique_ptr<FlashLog> log(new FlashLog());
+    CHECK(log->begin(flash));
+    return log;
+  }
+
+  void testTooSmall() {
+    RamFlash flash(FlashLog::BLOCK_SIZE);
+    FlashLog log;
+    CHECK(!log.begin(flash));
+    CHECK(!log.isActive());
+    log.addSample(1, 0);
+    log.update();
+    CHECK(log.getBlockCount() == 0);
+    CHECK(flash.eraseCount == 0);
+  }
+
+  void testRoundTrip() {
+    RamFlash flash(BLOCK_COUNT * FlashLog::BLOCK_SIZE);
+    std::unique_ptr<FlashLog> log = reboot(flash);
+    CHECK(log->getBlockCount() == 0);
+    log->startSession(1000, 2);
+    uint32_t sampleIndex = writeBlocks(*log, 2, 100, 2);
+    // a partly filled block, then a gap in the sample index starts a new block
+    for (int i = 0; i < 300; ++i) {
+      log->addSample(sampleAt(sampleIndex), sampleIndex);
+      sampleIndex += 2;
+    }
+    sampleIndex += 50;
+    for (int i = 0; i < 10; ++i) {
+      log->addSample(sampleAt(sampleIndex), sampleIndex);
+      sampleIndex += 2;
+    }
+    flush(*log);
+    CHECK(log->getBlockCount() == 4);
+    CHECK(log->getDroppedCount() == 0);
+    CHECK(checkBlocks(*log));
+
+    log = reboot(flash);
+    CHECK(log->getBlockCount() == 4 && log->getOldestSequence() == 0);
+    CHECK(checkBlocks(*log));
+    FlashLog::BlockInfo info;
+    CHECK(log->readBlockInfo(0, info));
+    CHECK(info.firstSampleIndex == 100 && info.rateHz == 1000 && info.decimation == 2 && info.session == 1);
+    CHECK(info.sampleCount == FlashLog::BLOCK_SAMPLE_MAX);
+    CHECK(log->readBlockInfo(2, info) && info.sampleCount == 300);
+    CHECK(log->readBlockInfo(3, info) && info.sampleCount == 10);
+    CHECK(info.firstSampleIndex == 100 + (2 * FlashLog::BLOCK_SAMPLE_MAX + 300) * 2 + 50);
+    CHECK(!log->readBlockInfo(4, info));
+
+    // part of a block from an odd offset, and past its end
+    int16_t samples[8];
+    CHECK(log->readBlockSamples(2, 295, samples, 8) == 5);
+    CHECK(samples[0] == sampleAt(100 + (2 * FlashLog::BLOCK_SAMPLE_MAX + 295) * 2));
+    CHECK(log->readBlockSamples(2, 300, samples, 8) == 0);
+
+    // the session goes on counting after the reboot
+    log->startSession(500, 1);
+    writeBlocks(*log, 1, 0, 1);
+    CHECK(log->readBlockInfo(4, info) && info.session == 2 && info.rateHz == 500);
+  }
+
+  // Both RAM blocks full and the flash not called: the rest is dropped and counted
+  void testDroppedWhileFlashIsBehind() {
+    RamFlash flash(BLOCK_COUNT * FlashLog::BLOCK_SIZE);
+    std::unique_ptr<FlashLog> log = reboot(flash);
+    log->startSession(1000, 1);
+    for (uint32_t i = 0; i < 2 * FlashLog::BLOCK_SAMPLE_MAX + 10; ++i) {
+      log->addSample(sampleAt(i), i);
+    }
+    CHECK(log->getDroppedCount() == 10);
+    flush(*log);
+    CHECK(log->getBlockCount() == 2);
+    CHECK(checkBlocks(*log));
+  }
+
+  // The sketch starts a new session whenever the rate, oversampling or trigger mode changes
+  // while logging; blocks still in RAM keep the timing of the recording they came from
+  void testSessionChangeBeforeFlush() {
+    RamFlash flash(BLOCK_COUNT * FlashLog::BLOCK_SIZE);
+    std::unique_ptr<FlashLog> log = reboot(flash);
+    log->startSession(1000, 16);
+    // one full block waiting for the flash and 10 samples in the other one
+    uint32_t sampleIndex = 0;
+    for (int i = 0; i < FlashLog::BLOCK_SAMPLE_MAX + 10; ++i) {
+      log->addSample(sampleAt(sampleIndex), sampleIndex);
+      sampleIndex += 16;
+    }
+    log->startSession(2000, 1);
+    // the full block goes out, the partial one is still in RAM when the new session logs
+    for (int i = 0; i < 100 && log->getBlockCount() == 0; ++i) {
+      log->update();
+    }
+    CHECK(log->getBlockCount() == 1 && !log->isFlushed());
+    for (int i = 0; i < 20; ++i) {
+      log->addSample(sampleAt(i), (uint32_t)i);
+    }
+    flush(*log);
+    CHECK(log->getBlockCount() == 3);
+
+    log = reboot(flash);
+    FlashLog::BlockInfo info;
+    CHECK(log->readBlockInfo(0, info) && info.sampleCount == FlashLog::BLOCK_SAMPLE_MAX);
+    CHECK(info.rateHz == 1000 && info.decimation == 16 && info.session == 1);
+    CHECK(log->readBlockInfo(1, info) && info.sampleCount == 10);
+    CHECK(info.rateHz == 1000 && info.decimation == 16 && info.session == 1);
+    CHECK(info.firstSampleIndex == FlashLog::BLOCK_SAMPLE_MAX * 16);
+    CHECK(log->readBlockInfo(2, info) && info.sampleCount == 20);
+    CHECK(info.rateHz == 2000 && info.decimation == 1 && info.session == 2 && info.firstSampleIndex == 0);
+    CHECK(checkBlocks(*log));
+  }
+
+  void testRingWrap() {
+    RamFlash flash(BLOCK_COUNT * FlashLog::BLOCK_SIZE);
+    std::unique_ptr<FlashLog> log = reboot(flash);
+    log->startSession(1000, 1);
+    uint32_t sampleIndex = writeBlocks(*log, 20, 0, 1);
+    CHECK(log->getBlockCount() == BLOCK_COUNT);
+    CHECK(log->getOldestSequence() == 20 - BLOCK_COUNT);
+    CHECK(checkBlocks(*log));
+    // one erase and one program per block
+    CHECK(flash.eraseCount == 20 && flash.programCount == 20);
+
+    log = reboot(flash);
+    CHECK(log->getBlockCount() == BLOCK_COUNT);
+    CHECK(log->getOldestSequence() == 20 - BLOCK_COUNT);
+    CHECK(checkBlocks(*log));
+
+    // the next block replaces the oldest, in its position
+    log->startSession(1000, 1);
+    writeBlocks(*log, 1, sampleIndex, 1);
+    CHECK(log->getOldestSequence() == 21 - BLOCK_COUNT && log->getBlockCount() == BLOCK_COUNT);
+    CHECK(BulkTransfer::readUint32(&flash.memory[(20 % BLOCK_COUNT) * FlashLog::BLOCK_SIZE + 4]) == 20);
+    log = reboot(flash);
+    CHECK(log->getOldestSequence() == 21 - BLOCK_COUNT);
+    CHECK(checkBlocks(*log));
+  }
+
+  // Runs update() until the flash is at the wanted step of writing the next block
+  bool runUntil(FlashLog& log, RamFlash& flash, bool programmingFlag) {
+    log.closeBlock();
+    for (int i = 0; i < 100; ++i) {
+      log.update();
+      if (programmingFlag ? flash.isProgramming() : flash.isErasing()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Power cut while the newest block is programmed, at several points of the header and samples
+  void testTornNewestBlock() {
+    // nothing before it, some blocks, a full ring
+    for (int blockCount : {0, 5, 11}) {
+      for (uint32_t byteCount : {0u, 2u, 5u, 6u, 20u, 24u, 1000u, 4092u}) {
+        RamFlash flash(BLOCK_COUNT * FlashLog::BLOCK_SIZE);
+        std::unique_ptr<FlashLog> log = reboot(flash);
+        log->startSession(1000, 1);
+        uint32_t sampleIndex = writeBlocks(*log, blockCount, 0, 1);
+
+        for (int i = 0; i < FlashLog::BLOCK_SAMPLE_MAX; ++i) {
+          log->addSample(sampleAt(sampleIndex), sampleIndex);
+          ++sampleIndex;
+        }
+        CHECK(runUntil(*log, flash, true));
+        flash.cutProgram(byteCount);
+
+        // the torn block is dropped, the ones before it are all there
+        log = reboot(flash);
+        const uint32_t expectedCount = std::min<uint32_t>(blockCount, BLOCK_COUNT - 1);
+        CHECK(log->getBlockCount() == expectedCount);
+        CHECK(log->getOldestSequence() + log->getBlockCount() == (uint32_t)blockCount);
+        CHECK(checkBlocks(*log));
+
+        // logging goes on where it was torn
+        log->startSession(1000, 1);
+        writeBlocks(*log, 1, sampleIndex, 1);
+        log = reboot(flash);
+        CHECK(log->getBlockCount() == std::min<uint32_t>(blockCount + 1, BLOCK_COUNT));
+        CHECK(log->getOldestSequence() + log->getBlockCount() == blockCount + 1U);
+        CHECK(checkBlocks(*log));
+      }
+    }
+  }
+
+  // Power cut while the oldest block is erased for the next one; a partial erase can leave
+  // any part of it, including a header whose sequence bytes now read higher than the newest
+  void testHalfErasedOldestBlock() {
+    struct Cut {
+      uint32_t first;
+      uint32_t last;
+      uint32_t expectedCount; // blocks after the reboot
+    };
+    static constexpr Cut CUTS[] = {
+        {0, 0, BLOCK_COUNT},        // nothing erased yet: the oldest is still intact
+        {0, 2, BLOCK_COUNT - 1},    // magic gone
+        {6, 8, BLOCK_COUNT - 1},    // high bytes of the sequence set: looks like the newest
+        {4, 8, BLOCK_COUNT - 1},    // sequence 0xFFFFFFFF (an erased header)
+        {24, 2000, BLOCK_COUNT - 1}, // header left, samples erased
+        {0, 4096, BLOCK_COUNT - 1}, // erase done, program not started
+    };
+    for (const Cut& cut : CUTS) {
+      RamFlash flash(BLOCK_COUNT * FlashLog::BLOCK_SIZE);
+      std::unique_ptr<FlashLog> log = reboot(flash);
+      log->startSession(1000, 1);
+      uint32_t sampleIndex = writeBlocks(*log, 12, 0, 1);
+      const uint32_t newestSequence = 11;
+
+      for (int i = 0; i < 100; ++i) {
+        log->addSample(sampleAt(sampleIndex), sampleIndex);
+        ++sampleIndex;
+      }
+      CHECK(runUntil(*log, flash, false));
+      flash.cutErase(cut.first, cut.last);
+
+      log = reboot(flash);
+      CHECK(log->getBlockCount() == cut.expectedCount);
+      CHECK(log->getOldestSequence() + log->getBlockCount() == newestSequence + 1);
+      CHECK(checkBlocks(*log));
+
+      // the next block goes to the damaged position with the next sequence
+      log->startSession(1000, 1);
+      writeBlocks(*log, 1, sampleIndex, 1);
+      log = reboot(flash);
+      CHECK(log->getOldestSequence() + log->getBlockCount() == newestSequence + 2);
+      CHECK(log->getBlockCount() == BLOCK_COUNT);
+      CHECK(checkBlocks(*log));
+    }
+  }
+
+  // A central downloading page by page while logging goes on: a block is read by its
+  // sequence, so once it is erased for a newer one the read fails instead of returning
+  // the newer data
+  void testReadWhileRingAdvances() {
+    RamFlash flash(BLOCK_COUNT * FlashLog::BLOCK_SIZE);
+    flash.busyPolls = 20;
+    std::unique_ptr<FlashLog> log = reboot(flash);
+    log->startSession(1000, 1);
+    uint32_t sampleIndex = writeBlocks(*log, BLOCK_COUNT, 0, 1);
+    CHECK(log->getBlockCount() == BLOCK_COUNT);
+
+    const uint32_t oldest = log->getOldestSequence();
+    FlashLog::BlockInfo oldestInfo;
+    CHECK(log->readBlockInfo(oldest, oldestInfo));
+
+    for (int i = 0; i < 50; ++i) {
+      log->addSample(sampleAt(sampleIndex), sampleIndex);
+      ++sampleIndex;
+    }
+    log->closeBlock();
+
+    bool erasingSeenFlag = false;
+    bool programmingSeenFlag = false;
+    bool okFlag = true;
+    int16_t samples[16];
+    for (int step = 0; step < 200 && !log->isFlushed(); ++step) {
+      log->update();
+      // before any read, which waits for the flash
+      const bool busyFlag = flash.isErasing() || flash.isProgramming();
+      erasingSeenFlag = erasingSeenFlag || flash.isErasing();
+      programmingSeenFlag = programmingSeenFlag || flash.isProgramming();
+
+      // the oldest block is gone as soon as its erase started
+      FlashLog::BlockInfo info;
+      const bool oldestFlag = log->readBlockInfo(oldest, info);
+      if (busyFlag) {
+        okFlag = okFlag && !oldestFlag && log->readBlockSamples(oldest, 0, samples, 16) == 0;
+        okFlag = okFlag && log->getBlockCount() == BLOCK_COUNT - 1;
+      }
+      if (oldestFlag) {
+        okFlag = okFlag && info.firstSampleIndex == oldestInfo.firstSampleIndex;
+      }
+
+      // the others stay readable with their own samples (read() waits for the flash)
+      const uint32_t sequence = oldest + 1 + step % (BLOCK_COUNT - 1);
+      okFlag = okFlag && log->readBlockInfo(sequence, info) && info.sequence == sequence;
+      okFlag = okFlag && log->readBlockSamples(sequence, 10, samples, 16) == 16;
+      okFlag = okFlag && samples[0] == sampleAt(info.firstSampleIndex + 10) && samples[15] == sampleAt(info.firstSampleIndex + 25);
+    }
+    CHECK(erasingSeenFlag && programmingSeenFlag);
+    CHECK(okFlag);
+    CHECK(log->isFlushed());
+    CHECK(log->getOldestSequence() == oldest + 1 && log->getBlockCount() == BLOCK_COUNT);
+
+    FlashLog::BlockInfo newest;
+    CHECK(log->readBlockInfo(oldest + BLOCK_COUNT, newest) && newest.sampleCount == 50);
+    CHECK(!log->readBlockInfo(oldest, newest));
+    CHECK(checkBlocks(*log));
+  }
+}
+
+int main() {
+  testTooSmall();
+  testRoundTrip();
+  testDroppedWhileFlashIsBehind();
+  testSessionChangeBeforeFlush();
+  testRingWrap();
+  testTornNewestBlock();
+  testHalfErasedOldestBlock();
+  testReadWhileRingAdvances();
+  return test_util::finish("test_flash_log");
+}
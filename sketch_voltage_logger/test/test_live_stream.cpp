@@ -0,0 +1,257 @@
+// LiveStream frames built and parsed back: samples and their indexes, keyframe and delta
+// angles (also across the +-180 deg wrap), a queue that overflowed while the central was
+// away, and frames cut at the 244 byte notification.
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "LiveStream.h"
+#include "test_util.h"
+
+namespace {
+
+  constexpr int FRAME_MAX = 244;
+
+  struct Received {
+    std::vector<int16_t> samples;
+    std::vector<uint32_t> sampleIndexes;
+    LiveStream::Header header;
+    int frameCount = 0;
+  };
+
+  WindowStats::Report makeStats(int16_t seed) {
+    WindowStats::Report stats;
+    stats.minValue = (int16_t)(-100 - seed);
+    stats.maxValue = (int16_t)(2000 + seed);
+    stats.mean = (int16_t)(900 + seed);
+    stats.rms = (uint16_t)(1000 + seed);
+    stats.belowCount = (uint16_t)seed;
+    stats.count = (uint16_t)(40 + seed);
+    return stats;
+  }
+
+  // Sends one frame as the loop does and parses it on the central side
+  int sendFrame(LiveStream& stream, const float* angles, Received& received, int16_t* centralAngles, int outSize = FRAME_MAX) {
+    uint8_t frame[FRAME_MAX];
+    const WindowStats::Report stats = makeStats((int16_t)received.frameCount);
+    const int size = stream.buildFrame(frame, outSize, angles, true, 42, stats);
+    CHECK(size >= LiveStream::HEADER_SIZE && size <= outSize);
+    stream.advance();
+
+    int16_t samples[LiveStream::SAMPLE_COUNT_MAX];
+    const int count = LiveStream::parseFrame(frame, size, received.header, centralAngles, samples, LiveStream::SAMPLE_COUNT_MAX);
+    CHECK(count >= 0);
+    for (int i = 0; i < count; ++i) {
+      received.samples.push_back(samples[i]);
+      received.sampleIndexes.push_back(received.header.firstSampleIndex + (uint32_t)i * received.header.decimation);
+    }
+    CHECK(received.header.fillPercent == 42);
+    CHECK(received.header.stats.minValue == stats.minValue && received.header.stats.maxValue == stats.maxValue);
+    CHECK(received.header.stats.mean == stats.mean && received.header.stats.rms == stats.rms);
+    CHECK(received.header.stats.belowCount == stats.belowCount && received.header.stats.count == stats.count);
+    ++received.frameCount;
+    return count;
+  }
+
+  void testRoundTrip() {
+    LiveStream stream;
+    stream.reset(1000, 4);
+    Received received;
+    int16_t centralAngles[3] = {0, 0, 0};
+    const float angles[3] = {1.f, 2.f, 3.f};
+
+    std::vector<int16_t> sent;
+    std::vector<uint32_t> sentIndexes;
+    uint32_t sampleIndex = 70000; // past 16 bit
+    for (int frame = 0; frame < 20; ++frame) {
+      for (int i = 0; i < 10 + frame; ++i) {
+        const int16_t sample = (int16_t)(frame * 100 + i * 3 - 500);
+        stream.addSample(sample, sampleIndex);
+        sent.push_back(sample);
+        sentIndexes.push_back(sampleIndex);
+        sampleIndex += 4;
+      }
+      CHECK(sendFrame(stream, angles, received, centralAngles) == 10 + frame);
+      CHECK(received.header.seq == frame);
+      CHECK(received.header.rateHz == 1000 && received.header.decimation == 4);
+      CHECK(stream.getQueueCount() == 0);
+    }
+    CHECK(received.samples == sent);
+    CHECK(received.sampleIndexes == sentIndexes);
+
+    // nothing queued: a header only frame still carries the angles and stats
+    CHECK(sendFrame(stream, angles, received, centralAngles) == 0);
+    CHECK(received.header.firstSampleIndex == sampleIndex);
+  }
+
+  // Absolute every KEYFRAME_INTERVAL frames, differences in between; the central
+  // restores the exact 0.01 deg value each frame, also when yaw wraps
+  void testKeyframeAndDeltaAngles() {
+    LiveStream stream;
+    stream.reset(100, 1);
+    Received received;
+    int16_t centralAngles[3] = {0, 0, 0};
+
+    bool exactFlag = true;
+    for (int frame = 0; frame < 100; ++frame) {
+      float angles[3];
+      angles[0] = 30.f * std::sin(frame * 0.2f);
+      angles[1] = -85.f + frame * 0.37f;
+      // yaw runs through +180 to -180 and back
+      angles[2] = std::remainder(150.f + frame * 4.13f, 360.f);
+      stream.addSample((int16_t)frame, (uint32_t)frame);
+      sendFrame(stream, angles, received, centralAngles);
+
+      const bool keyFlag = (received.header.flags & LiveStream::FLAG_ANGLE_ABSOLUTE) != 0;
+      CHECK(keyFlag == (frame % LiveStream::KEYFRAME_INTERVAL == 0));
+      CHECK((received.header.flags & LiveStream::FLAG_ANGLE_VALID) != 0);
+      for (int axis = 0; axis < 3; ++axis) {
+        const int16_t expected = (int16_t)std::lround(angles[axis] * LiveStream::ANGLE_SCALE);
+        exactFlag = exactFlag && centralAngles[axis] == expected && received.header.angles[axis] == expected;
+      }
+    }
+    CHECK(exactFlag);
+
+    // a central joining late (or after a lost frame) is right again from the next keyframe
+    LiveStream late;
+    late.reset(100, 1);
+    Received lateReceived;
+    int16_t wrongAngles[3] = {1234, -4321, 77};
+    const float angles[3] = {10.5f, -20.25f, 179.99f};
+    uint8_t frame[FRAME_MAX];
+    int16_t samples[LiveStream::SAMPLE_COUNT_MAX];
+    for (int i = 0; i <= LiveStream::KEYFRAME_INTERVAL; ++i) {
+      const int size = late.buildFrame(frame, FRAME_MAX, angles, false, 0, WindowStats::Report());
+      late.advance();
+      if (i == 5 || i == LiveStream::KEYFRAME_INTERVAL) {
+        LiveStream::parseFrame(frame, size, lateReceived.header, wrongAngles, samples, LiveStream::SAMPLE_COUNT_MAX);
+      }
+      if (i == 5) {
+        // a zero difference keeps whatever the central had
+        CHECK(wrongAngles[0] == 1234);
+      }
+    }
+    CHECK(wrongAngles[0] == 1050 && wrongAngles[1] == -2025 && wrongAngles[2] == 17999);
+    CHECK((lateReceived.header.flags & LiveStream::FLAG_ANGLE_VALID) == 0);
+  }
+
+  // The central stopped reading: the oldest entries are dropped and the index shows the gap
+  void testFullQueue() {
+    LiveStream stream;
+    stream.reset(500, 2);
+    const int total = LiveStream::QUEUE_SIZE + 100;
+    for (int i = 0; i < total; ++i) {
+      stream.addSample((int16_t)(i * 5), (uint32_t)(1000 + i * 2));
+    }
+    CHECK(stream.getQueueCount() == LiveStream::QUEUE_SIZE);
+
+    Received received;
+    int16_t centralAngles[3] = {0, 0, 0};
+    const float angles[3] = {0.f, 0.f, 0.f};
+    int frameCount = 0;
+    while (stream.getQueueCount() > 0 && frameCount < 10) {
+      const int count = sendFrame(stream, angles, received, centralAngles);
+      CHECK(count > 0 && count <= LiveStream::SAMPLE_COUNT_MAX);
+      ++frameCount;
+    }
+    CHECK(frameCount == 3);
+    CHECK(received.samples.size() == LiveStream::QUEUE_SIZE);
+    bool matchFlag = true;
+    for (int i = 0; i < LiveStream::QUEUE_SIZE; ++i) {
+      const int entry = 100 + i;
+      matchFlag = matchFlag && received.samples[i] == entry * 5 && received.sampleIndexes[i] == 1000U + entry * 2;
+    }
+    CHECK(matchFlag);
+
+    // sampling goes on after the gap without a jump
+    stream.addSample(7, 1000 + total * 2);
+    sendFrame(stream, angles, received, centralAngles);
+    CHECK(received.header.firstSampleIndex == 1000U + total * 2 && received.samples.back() == 7);
+  }
+
+  // Noisy samples need escapes and do not all fit; the rest goes in the next frames
+  void testTruncatedAtMtu() {
+    LiveStream stream;
+    stream.reset(1000, 1);
+    std::mt19937 random(48);
+    std::uniform_int_distribution<int> wide(-20000, 20000);
+    std::vector<int16_t> sent;
+    for (int i = 0; i < 300; ++i) {
+      const int16_t sample = (int16_t)((i % 3 == 0) ? wide(random) : 100 + i % 7);
+      stream.addSample(sample, (uint32_t)i);
+      sent.push_back(sample);
+    }
+
+    Received received;
+    int16_t centralAngles[3] = {0, 0, 0};
+    const float angles[3] = {0.f, 0.f, 0.f};
+    uint8_t frame[FRAME_MAX + 8];
+    for (uint8_t& byte : frame) {
+      byte = 0xEE;
+    }
+    const int size = stream.buildFrame(frame, FRAME_MAX, angles, true, 0, WindowStats::Report());
+    CHECK(size <= FRAME_MAX && size > FRAME_MAX - 3);
+    CHECK(frame[FRAME_MAX] == 0xEE);
+    CHECK(frame[12] < LiveStream::SAMPLE_COUNT_MAX);
+
+    // not sent: built again the same, nothing consumed
+    uint8_t again[FRAME_MAX];
+    CHECK(stream.buildFrame(again, FRAME_MAX, angles, true, 0, WindowStats::Report()) == size);
+    CHECK(std::equal(frame, frame + size, again));
+    CHECK(stream.getQueueCount() == 300);
+
+    int frameCount = 0;
+    while (stream.getQueueCount() > 0 && frameCount < 20) {
+      sendFrame(stream, angles, received, centralAngles);
+      CHECK(received.header.sampleCount < 255);
+      ++frameCount;
+    }
+    CHECK(frameCount > 2);
+    CHECK(received.samples == sent);
+    for (size_t i = 0; i < sent.size(); ++i) {
+      CHECK(received.sampleIndexes[i] == i);
+    }
+
+    // a smaller buffer carries fewer samples, a buffer smaller than the header nothing
+    stream.addSample(1, 300);
+    stream.addSample(2, 301);
+    CHECK(stream.buildFrame(frame, LiveStream::HEADER_SIZE - 1, angles, true, 0, WindowStats::Report()) == 0);
+    CHECK(stream.buildFrame(frame, LiveStream::HEADER_SIZE + 2, angles, true, 0, WindowStats::Report()) == LiveStream::HEADER_SIZE + 2);
+    CHECK(frame[12] == 1);
+  }
+
+  void testMalformed() {
+    LiveStream stream;
+    stream.reset(100, 1);
+    for (int i = 0; i < 20; ++i) {
+      stream.addSample((int16_t)(i * 1000), (uint32_t)i);
+    }
+    uint8_t frame[FRAME_MAX];
+    const float angles[3] = {0.f, 0.f, 0.f};
+    const int size = stream.buildFrame(frame, FRAME_MAX, angles, true, 0, WindowStats::Report());
+
+    LiveStream::Header header;
+    int16_t centralAngles[3] = {0, 0, 0};
+    int16_t samples[LiveStream::SAMPLE_COUNT_MAX];
+    CHECK(LiveStream::parseFrame(frame, size, header, centralAngles, samples, LiveStream::SAMPLE_COUNT_MAX) == 20);
+    // cut short, wrong type, too small a buffer, wrong sample count
+    CHECK(LiveStream::parseFrame(frame, size - 1, header, centralAngles, samples, LiveStream::SAMPLE_COUNT_MAX) == -1);
+    CHECK(LiveStream::parseFrame(frame, LiveStream::HEADER_SIZE - 1, header, centralAngles, samples, LiveStream::SAMPLE_COUNT_MAX) == -1);
+    CHECK(LiveStream::parseFrame(frame, size, header, centralAngles, samples, 19) == -1);
+    frame[12] = 19;
+    CHECK(LiveStream::parseFrame(frame, size, header, centralAngles, samples, LiveStream::SAMPLE_COUNT_MAX) == -1);
+    frame[12] = 20;
+    frame[0] = 0xB0;
+    CHECK(LiveStream::parseFrame(frame, size, header, centralAngles, samples, LiveStream::SAMPLE_COUNT_MAX) == -1);
+  }
+}
+
+int main() {
+  testRoundTrip();
+  testKeyframeAndDeltaAngles();
+  testFullQueue();
+  testTruncatedAtMtu();
+  testMalformed();
+  return test_util::finish("test_live_stream");
+}
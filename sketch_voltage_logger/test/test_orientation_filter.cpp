@@ -0,0 +1,206 @@
+// OrientationFilter on synthetic IMU data: roll and pitch from a static accel, convergence
+// from a wrong start and with a gyro bias, yaw from the gyro, and a FIFO burst through
+// updateBatch() against the same samples one by one.
+
+#include <cmath>
+#include <vector>
+
+#include "OrientationFilter.h"
+#include "test_util.h"
+
+namespace {
+
+  constexpr double DEG = M_PI / 180.0;
+
+  struct Euler {
+    double roll;
+    double pitch;
+    double yaw;
+  };
+
+  // ZYX angles of the sensor to world rotation
+  Euler toEuler(const Quaternion& q) {
+    Euler euler;
+    euler.roll = std::atan2(2.0 * (q.a * q.b + q.c * q.d), 1.0 - 2.0 * (q.b * q.b + q.c * q.c));
+    euler.pitch = std::asin(std::fmax(-1.0, std::fmin(1.0, 2.0 * (q.a * q.c - q.d * q.b))));
+    euler.yaw = std::atan2(2.0 * (q.a * q.d + q.b * q.c), 1.0 - 2.0 * (q.c * q.c + q.d * q.d));
+    return euler;
+  }
+
+  // Gravity seen by a sensor at this roll and pitch (yaw does not change it)
+  OrientationFilter::Sample staticSample(double roll, double pitch, double scale = 9.8) {
+    OrientationFilter::Sample sample;
+    sample.accel[0] = (float)(-std::sin(pitch) * scale);
+    sample.accel[1] = (float)(std::cos(pitch) * std::sin(roll) * scale);
+    sample.accel[2] = (float)(std::cos(pitch) * std::cos(roll) * scale);
+    return sample;
+  }
+
+  double norm(const Quaternion& q) {
+    return std::sqrt(q.a * q.a + q.b * q.b + q.c * q.c + q.d * q.d);
+  }
+
+  // Angle between two orientations
+  double angleBetween(const Quaternion& p, const Quaternion& q) {
+    const double dot = std::fabs(p.a * q.a + p.b * q.b + p.c * q.c + p.d * q.d) / (norm(p) * norm(q));
+    return 2.0 * std::acos(std::fmin(1.0, dot));
+  }
+
+  void testInitFromGravity() {
+    for (double roll : {0.0, 25.0, -70.0, 170.0}) {
+      for (double pitch : {0.0, 15.0, -40.0, 80.0}) {
+        OrientationFilter filter;
+        filter.update(staticSample(roll * DEG, pitch * DEG), 0.01f);
+        const Euler euler = toEuler(filter.getQuat());
+        CHECK_NEAR(euler.roll, roll * DEG, 1e-3);
+        CHECK_NEAR(euler.pitch, pitch * DEG, 1e-3);
+        CHECK_NEAR(euler.yaw, 0.0, 1e-3);
+      }
+    }
+
+    // no accel (free fall, not read yet): the gyro alone, still waiting for gravity
+    OrientationFilter filter;
+    filter.update(OrientationFilter::Sample(), 0.01f);
+    CHECK_NEAR(filter.getQuat().a, 1.0, 1e-6);
+    filter.update(staticSample(30 * DEG, 0.0), 0.01f);
+    CHECK_NEAR(toEuler(filter.getQuat()).roll, 30 * DEG, 1e-3);
+
+    // an empty batch changes nothing
+    const Quaternion before = filter.getQuat();
+    filter.updateBatch(nullptr, 0, 0.01f);
+    CHECK(angleBetween(before, filter.getQuat()) == 0.0);
+  }
+
+  // Tilted to a new static attitude without any gyro (as after a jump the gyro missed).
+  // kp pulls it close within a few seconds; the bias the integral term picked up on the
+  // way overshoots a little and decays slowly (about kp / ki = 50 s).
+  void testConvergesOnStaticAccel() {
+    OrientationFilter filter;
+    filter.update(staticSample(0.0, 0.0), 0.01f);
+    const double roll = 30 * DEG;
+    const double pitch = -20 * DEG;
+    const OrientationFilter::Sample sample = staticSample(roll, pitch);
+
+    std::vector<double> errors;
+    for (int second = 0; second < 180; ++second) {
+      for (int i = 0; i < 100; ++i) {
+        filter.update(sample, 0.01f);
+      }
+      const Euler euler = toEuler(filter.getQuat());
+      errors.push_back(std::fabs(euler.roll - roll) + std::fabs(euler.pitch - pitch));
+    }
+    CHECK(errors[0] > 10 * DEG);
+    CHECK(errors[4] < 1 * DEG);
+    CHECK(errors[60] < errors[10] && errors[120] < errors[60]);
+    CHECK(errors.back() < 0.05 * DEG);
+
+    const Euler euler = toEuler(filter.getQuat());
+    CHECK_NEAR(euler.roll, roll, 0.05 * DEG);
+    CHECK_NEAR(euler.pitch, pitch, 0.05 * DEG);
+    CHECK_NEAR(norm(filter.getQuat()), 1.0, 1e-4);
+
+    // the size of the accel does not matter, only its direction
+    OrientationFilter scaled;
+    OrientationFilter unit;
+    for (int i = 0; i < 500; ++i) {
+      scaled.update(staticSample(roll, pitch, 16384.0), 0.01f);
+      unit.update(staticSample(roll, pitch, 1.0), 0.01f);
+    }
+    CHECK(angleBetween(scaled.getQuat(), unit.getQuat()) < 0.01 * DEG);
+  }
+
+  // A constant gyro offset is learned by the integral term; roll and pitch end up unbiased
+  void testLearnsGyroBias() {
+    OrientationFilter filter;
+    const double roll = -15 * DEG;
+    const double pitch = 10 * DEG;
+    OrientationFilter::Sample sample = staticSample(roll, pitch);
+    sample.gyro[0] = 0.02f;
+    sample.gyro[1] = -0.015f;
+
+    for (int i = 0; i < 100; ++i) {
+      filter.update(sample, 0.01f);
+    }
+    // proportional only so far: off by about bias / kp
+    Euler euler = toEuler(filter.getQuat());
+    CHECK(std::fabs(euler.roll - roll) > 0.3 * DEG);
+
+    for (int i = 0; i < 30000; ++i) {
+      filter.update(sample, 0.01f);
+    }
+    euler = toEuler(filter.getQuat());
+    CHECK_NEAR(euler.roll, roll, 0.05 * DEG);
+    CHECK_NEAR(euler.pitch, pitch, 0.05 * DEG);
+    CHECK_NEAR(norm(filter.getQuat()), 1.0, 1e-4);
+  }
+
+  // Level and turning around the vertical: yaw only comes from the gyro
+  void testYawFromGyro() {
+    OrientationFilter filter;
+    OrientationFilter::Sample sample = staticSample(0.0, 0.0);
+    sample.gyro[2] = 1.f;
+    for (int i = 0; i < 100; ++i) {
+      filter.update(sample, 0.01f);
+    }
+    const Euler euler = toEuler(filter.getQuat());
+    CHECK_NEAR(euler.yaw, 1.0, 1e-3);
+    CHECK_NEAR(euler.roll, 0.0, 1e-4);
+    CHECK_NEAR(euler.pitch, 0.0, 1e-4);
+  }
+
+  // Rolling at a constant rate, sampled at 200 Hz and read in FIFO bursts of 8
+  void testBatchMatchesSingle() {
+    const float periodSec = 0.005f;
+    const double rate = 0.5;
+    const int burst = 8;
+    std::vector<OrientationFilter::Sample> samples;
+    for (int i = 0; i < 200 * 12; ++i) {
+      const double roll = 10 * DEG + rate * i * periodSec;
+      // with pitch held, the roll rate is all on the sensor x axis
+      OrientationFilter::Sample sample = staticSample(roll, 5 * DEG);
+      sample.gyro[0] = (float)rate;
+      samples.push_back(sample);
+    }
+
+    // the batch starts from the mean accel (mid burst), which settles within the first seconds;
+    // after that the burst must not lead or lag the per-sample updates
+    OrientationFilter single;
+    OrientationFilter batched;
+    double maxDiff = 0.0;
+    for (size_t first = 0; first < samples.size(); first += burst) {
+      for (int i = 0; i < burst; ++i) {
+        single.update(samples[first + i], periodSec);
+      }
+      batched.updateBatch(&samples[first], burst, periodSec);
+      const double diff = angleBetween(single.getQuat(), batched.getQuat());
+      CHECK(diff < 0.6 * DEG);
+      if (first >= samples.size() / 2) {
+        maxDiff = std::fmax(maxDiff, diff);
+      }
+    }
+    CHECK(maxDiff < 0.1 * DEG);
+
+    // both follow the motion
+    const double endRoll = 10 * DEG + rate * samples.size() * periodSec;
+    CHECK_NEAR(std::remainder(toEuler(single.getQuat()).roll - endRoll, 2 * M_PI), 0.0, 1.0 * DEG);
+    CHECK_NEAR(std::remainder(toEuler(batched.getQuat()).roll - endRoll, 2 * M_PI), 0.0, 1.0 * DEG);
+
+    // a batch of one is a single update
+    OrientationFilter one;
+    OrientationFilter oneBatched;
+    for (size_t i = 0; i < 100; ++i) {
+      one.update(samples[i], periodSec);
+      oneBatched.updateBatch(&samples[i], 1, periodSec);
+    }
+    CHECK(angleBetween(one.getQuat(), oneBatched.getQuat()) == 0.0);
+  }
+}
+
+int main() {
+  testInitFromGravity();
+  testConvergesOnStaticAccel();
+  testLearnsGyroBias();
+  testYawFromGyro();
+  testBatchMatchesSingle();
+  return test_util::finish("test_orientation_filter");
+}
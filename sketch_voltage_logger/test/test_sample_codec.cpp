@@ -0,0 +1,167 @@
+// SampleCodec round trips: small deltas, escapes at the int8 limits, payloads that
+// only partly fit, truncated input and more samples than the caller can hold.
+
+#include <random>
+#include <vector>
+
+#include "SampleCodec.h"
+#include "test_util.h"
+
+namespace {
+
+  std::vector<int16_t> roundTrip(const std::vector<int16_t>& samples, int outSize, int& packedCount, int& packedSize) {
+    std::vector<uint8_t> out(outSize + 8, 0xEE);
+    packedCount = SampleCodec::pack(samples.data(), (int)samples.size(), out.data(), outSize, packedSize);
+    // nothing is written past outSize
+    for (int i = outSize; i < (int)out.size(); ++i) {
+      CHECK(out[i] == 0xEE);
+    }
+
+    std::vector<int16_t> decoded(samples.size() + 1);
+    const int count = SampleCodec::unpack(out.data(), packedSize, decoded.data(), (int)decoded.size());
+    decoded.resize(count < 0 ? 0 : count);
+    return decoded;
+  }
+
+  void testSmallDeltas() {
+    const std::vector<int16_t> samples = {1000, 1001, 999, 1126, 999, 872, 872, -5, -1};
+    int packedCount = 0;
+    int packedSize = 0;
+    const std::vector<int16_t> decoded = roundTrip(samples, 64, packedCount, packedSize);
+    CHECK(packedCount == (int)samples.size());
+    // 2 bytes for the first sample, one byte for each of the 7 deltas that fit
+    // (+127 and -127 included) and 3 bytes for the escaped -877
+    CHECK(packedSize == 2 + 7 + 3);
+    CHECK(decoded == samples);
+  }
+
+  // -128 is the escape marker, so a delta of -128 needs the escape as does +128
+  void testEscapes() {
+    const std::vector<int16_t> samples = {0, 127, -1, -129, -1, 127, 255, INT16_MAX, INT16_MIN, INT16_MIN, -32641};
+    int packedCount = 0;
+    int packedSize = 0;
+    const std::vector<int16_t> decoded = roundTrip(samples, 64, packedCount, packedSize);
+    CHECK(packedCount == (int)samples.size());
+    CHECK(decoded == samples);
+
+    // deltas: +127, -128(esc), -128(esc), +128(esc), +128(esc), +128(esc), esc, esc, 0, +127
+    CHECK(packedSize == 2 + 1 + 3 * 7 + 1 + 1);
+
+    uint8_t out[8];
+    const int16_t pair[2] = {0, -128};
+    CHECK(SampleCodec::pack(pair, 2, out, sizeof(out), packedSize) == 2);
+    CHECK(packedSize == 5 && (int8_t)out[2] == SampleCodec::ESCAPE);
+  }
+
+  // When the buffer is full pack stops on a whole sample; an escape is never split
+  void testPartialPack() {
+    const std::vector<int16_t> samples = {0, 1, 2, 500, 501, 502, 2000};
+    for (int outSize = 0; outSize <= 16; ++outSize) {
+      int packedCount = 0;
+      int packedSize = 0;
+      const std::vector<int16_t> decoded = roundTrip(samples, outSize, packedCount, packedSize);
+      CHECK(packedSize <= outSize);
+      CHECK((int)decoded.size() == packedCount);
+      CHECK(std::equal(decoded.begin(), decoded.end(), samples.begin()));
+    }
+
+    int packedSize = 0;
+    uint8_t out[16];
+    // 2 + 1 + 1 = 4 bytes for three samples; the escape for 500 needs 3 more
+    CHECK(SampleCodec::pack(samples.data(), (int)samples.size(), out, 6, packedSize) == 3);
+    CHECK(packedSize == 4);
+    CHECK(SampleCodec::pack(samples.data(), (int)samples.size(), out, 7, packedSize) == 4);
+    CHECK(SampleCodec::pack(samples.data(), 0, out, 7, packedSize) == 0 && packedSize == 0);
+    CHECK(SampleCodec::pack(samples.data(), 1, out, 1, packedSize) == 0 && packedSize == 0);
+  }
+
+  void testWritePayload() {
+    uint8_t out[32];
+    bool packed = false;
+    const int16_t smooth[4] = {100, 101, 102, 103};
+    CHECK(SampleCodec::writePayload(smooth, 4, true, out, sizeof(out), packed) == 5);
+    CHECK(packed);
+    CHECK(SampleCodec::writePayload(smooth, 4, false, out, sizeof(out), packed) == 8);
+    CHECK(!packed);
+    CHECK(SampleCodec::readInt16(&out[6]) == 103);
+
+    // packed does not fit (every delta escapes) -> raw
+    const int16_t jumpy[4] = {0, 1000, -1000, 1000};
+    CHECK(SampleCodec::writePayload(jumpy, 4, true, out, 8, packed) == 8);
+    CHECK(!packed);
+    CHECK(SampleCodec::readInt16(&out[2]) == 1000);
+
+    // raw is cut to the buffer too
+    uint8_t small[7];
+    small[6] = 0xEE;
+    CHECK(SampleCodec::writePayload(jumpy, 4, false, small, 6, packed) == 6);
+    CHECK(small[6] == 0xEE);
+  }
+
+  void testTruncated() {
+    int16_t samples[8];
+    uint8_t in[8] = {0x10, 0x00, 0x01, (uint8_t)SampleCodec::ESCAPE, 0x34, 0x12};
+    CHECK(SampleCodec::unpack(in, 0, samples, 8) == 0);
+    CHECK(SampleCodec::unpack(in, 1, samples, 8) == -1);
+    CHECK(SampleCodec::unpack(in, 3, samples, 8) == 2);
+    CHECK(samples[0] == 0x10 && samples[1] == 0x11);
+    // escape without its int16, or with only one byte of it
+    CHECK(SampleCodec::unpack(in, 4, samples, 8) == -1);
+    CHECK(SampleCodec::unpack(in, 5, samples, 8) == -1);
+    CHECK(SampleCodec::unpack(in, 6, samples, 8) == 3);
+    CHECK(samples[2] == 0x1234);
+  }
+
+  void testMaxCount() {
+    const int16_t source[5] = {7, 8, 9, 10, 11};
+    uint8_t out[16];
+    int packedSize = 0;
+    CHECK(SampleCodec::pack(source, 5, out, sizeof(out), packedSize) == 5);
+
+    int16_t samples[8];
+    for (int16_t& sample : samples) {
+      sample = -1;
+    }
+    CHECK(SampleCodec::unpack(out, packedSize, samples, 5) == 5);
+    CHECK(samples[4] == 11);
+    // one sample too many for the caller's buffer: rejected, nothing written past maxCount
+    samples[4] = -1;
+    CHECK(SampleCodec::unpack(out, packedSize, samples, 4) == -1);
+    CHECK(samples[4] == -1);
+    CHECK(SampleCodec::unpack(out, packedSize, samples, 0) == -1);
+    CHECK(SampleCodec::unpack(out, 2, samples, 1) == 1);
+  }
+
+  void testRandomRoundTrip() {
+    std::mt19937 random(41);
+    std::uniform_int_distribution<int> small(-130, 130);
+    std::uniform_int_distribution<int> wide(INT16_MIN, INT16_MAX);
+    std::uniform_int_distribution<int> jumpChance(0, 19);
+    bool okFlag = true;
+    for (int round = 0; round < 200 && okFlag; ++round) {
+      std::vector<int16_t> samples;
+      int value = 2000;
+      for (int i = 0; i < 120; ++i) {
+        value = (jumpChance(random) == 0) ? wide(random) : value + small(random);
+        value = value < INT16_MIN ? INT16_MIN : (value > INT16_MAX ? INT16_MAX : value);
+        samples.push_back((int16_t)value);
+      }
+      int packedCount = 0;
+      int packedSize = 0;
+      const std::vector<int16_t> decoded = roundTrip(samples, 3 * (int)samples.size(), packedCount, packedSize);
+      okFlag = packedCount == (int)samples.size() && decoded == samples;
+    }
+    CHECK(okFlag);
+  }
+}
+
+int main() {
+  testSmallDeltas();
+  testEscapes();
+  testPartialPack();
+  testWritePayload();
+  testTruncated();
+  testMaxCount();
+  testRandomRoundTrip();
+  return test_util::finish("test_sample_codec");
+}
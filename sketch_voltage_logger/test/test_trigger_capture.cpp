@@ -0,0 +1,234 @@
+// TriggerCapture on synthetic waveforms: rising, falling and window edges with hysteresis,
+// the pre trigger fill, holdoff between captures and the pre/post depth of the window.
+// A crossing rejected by the pre fill or the holdoff must not fire later without a new edge.
+
+#include <vector>
+
+#include "TriggerCapture.h"
+#include "test_util.h"
+
+namespace {
+
+  constexpr uint32_t NONE = 0xFFFFFFFF;
+
+  TriggerCapture::Setting makeSetting(TriggerCapture::Mode mode, int16_t level, uint16_t hysteresis, uint16_t preCount, uint16_t postCount) {
+    TriggerCapture::Setting setting;
+    setting.mode = mode;
+    setting.level = level;
+    setting.hysteresis = hysteresis;
+    setting.preCount = preCount;
+    setting.postCount = postCount;
+    return setting;
+  }
+
+  struct Feed {
+    uint32_t triggerIndex = NONE;  // entry of the first sample in Triggered (or Captured)
+    uint32_t capturedIndex = NONE; // entry for which add() returned true
+  };
+
+  // Feeds the samples as entries firstIndex, firstIndex + 1, ... until the capture completes
+  Feed feed(TriggerCapture& capture, const std::vector<int16_t>& samples, uint32_t firstIndex) {
+    Feed result;
+    for (size_t i = 0; i < samples.size(); ++i) {
+      const uint32_t entryIndex = firstIndex + (uint32_t)i;
+      const bool capturedFlag = capture.add(samples[i], entryIndex);
+      if (result.triggerIndex == NONE && capture.getState() != TriggerCapture::State::Armed) {
+        result.triggerIndex = entryIndex;
+      }
+      if (capturedFlag) {
+        result.capturedIndex = entryIndex;
+        break;
+      }
+    }
+    return result;
+  }
+
+  std::vector<int16_t> repeat(int16_t value, int count) {
+    return std::vector<int16_t>(count, value);
+  }
+
+  std::vector<int16_t> join(std::initializer_list<std::vector<int16_t>> parts) {
+    std::vector<int16_t> all;
+    for (const std::vector<int16_t>& part : parts) {
+      all.insert(all.end(), part.begin(), part.end());
+    }
+    return all;
+  }
+
+  void testIdle() {
+    TriggerCapture capture;
+    CHECK(!capture.isEnabled());
+    capture.arm(0);
+    CHECK(capture.getState() == TriggerCapture::State::Idle);
+    CHECK(feed(capture, join({repeat(0, 10), repeat(1000, 10)}), 0).capturedIndex == NONE);
+
+    capture.configure(makeSetting(TriggerCapture::Mode::Max, 500, 0, 0, 4));
+    CHECK(!capture.isEnabled());
+
+    // configured but not armed yet
+    capture.configure(makeSetting(TriggerCapture::Mode::Rising, 500, 0, 0, 4));
+    CHECK(capture.isEnabled());
+    CHECK(capture.getState() == TriggerCapture::State::Idle);
+    CHECK(feed(capture, join({repeat(0, 10), repeat(1000, 10)}), 0).capturedIndex == NONE);
+  }
+
+  void testRising() {
+    TriggerCapture capture;
+    capture.configure(makeSetting(TriggerCapture::Mode::Rising, 500, 50, 10, 5));
+    capture.arm(100);
+    CHECK(capture.getState() == TriggerCapture::State::Armed);
+
+    // chatter around the level that never goes below level - hysteresis (450), then a clean edge
+    const std::vector<int16_t> samples = join({repeat(470, 20), {460, 520, 470, 510, 455, 600}, {449, 480, 500}, repeat(700, 10)});
+    const Feed result = feed(capture, samples, 100);
+    CHECK(result.triggerIndex == 128);
+    CHECK(result.capturedIndex == 132);
+    CHECK(capture.getState() == TriggerCapture::State::Captured);
+    CHECK(capture.getTriggerIndex() == 128);
+    CHECK(capture.getWindowFirst() == 118);
+    CHECK(capture.getWindowCount() == 15);
+    // nothing more until armed again
+    CHECK(!capture.add(0, 126) && !capture.add(1000, 127));
+
+    // armed while already above: the level has to be left first
+    capture.arm(200);
+    CHECK(feed(capture, repeat(900, 30), 200).capturedIndex == NONE);
+    const Feed again = feed(capture, join({repeat(460, 3), repeat(449, 2), repeat(500, 6)}), 230);
+    CHECK(again.triggerIndex == 235 && again.capturedIndex == 239);
+  }
+
+  void testFalling() {
+    TriggerCapture capture;
+    capture.configure(makeSetting(TriggerCapture::Mode::Falling, -200, 30, 0, 3));
+    capture.arm(0);
+
+    // -180 is within the hysteresis, so only the dip after -169 counts
+    const Feed result = feed(capture, join({repeat(-250, 5), repeat(-180, 5), {-210}, repeat(-169, 2), {-200, -500}, repeat(-500, 5)}), 0);
+    CHECK(result.triggerIndex == 13);
+    CHECK(result.capturedIndex == 15);
+    CHECK(capture.getWindowFirst() == 13 && capture.getWindowCount() == 3);
+
+    // a rising edge never fires a falling trigger
+    capture.arm(100);
+    CHECK(feed(capture, join({repeat(-500, 5), repeat(500, 5), repeat(-100, 5)}), 100).capturedIndex == NONE);
+  }
+
+  void testWindow() {
+    TriggerCapture::Setting setting = makeSetting(TriggerCapture::Mode::Window, 400, 20, 0, 2);
+    setting.levelHigh = 600;
+    TriggerCapture capture;
+    capture.configure(setting);
+
+    // leaving above
+    capture.arm(0);
+    Feed result = feed(capture, join({repeat(500, 5), {600, 601, 601}}), 0);
+    CHECK(result.triggerIndex == 6 && result.capturedIndex == 7);
+
+    // leaving below
+    capture.arm(10);
+    result = feed(capture, join({repeat(500, 5), {400, 399, 300}}), 10);
+    CHECK(result.triggerIndex == 16 && result.capturedIndex == 17);
+
+    // starting outside: inside only near the edge (within hysteresis) does not count
+    capture.arm(20);
+    result = feed(capture, join({repeat(700, 5), repeat(410, 5), repeat(300, 5), repeat(590, 5), repeat(650, 3)}), 20);
+    CHECK(result.capturedIndex == NONE);
+    result = feed(capture, join({{420}, repeat(610, 3)}), 43);
+    CHECK(result.triggerIndex == 44 && result.capturedIndex == 45);
+  }
+
+  // The pre trigger samples have to be in the log before a trigger is taken
+  void testPreFill() {
+    TriggerCapture capture;
+    capture.configure(makeSetting(TriggerCapture::Mode::Rising, 500, 10, 10, 4));
+    capture.arm(1000);
+
+    // the edge at entry 1003 comes too early; the signal then stays high past the pre fill
+    Feed result = feed(capture, join({repeat(0, 3), repeat(800, 20)}), 1000);
+    CHECK(result.triggerIndex == NONE && result.capturedIndex == NONE);
+    CHECK(capture.getState() == TriggerCapture::State::Armed);
+
+    // the next edge fires
+    result = feed(capture, join({repeat(0, 2), repeat(800, 5)}), 1023);
+    CHECK(result.triggerIndex == 1025 && result.capturedIndex == 1028);
+    CHECK(capture.getWindowFirst() == 1015 && capture.getWindowCount() == 14);
+
+    // the first sample with the full pre fill is accepted
+    capture.arm(2000);
+    result = feed(capture, join({repeat(0, 10), repeat(800, 4)}), 2000);
+    CHECK(result.triggerIndex == 2010 && capture.getWindowFirst() == 2000);
+  }
+
+  void testHoldoff() {
+    TriggerCapture::Setting setting = makeSetting(TriggerCapture::Mode::Rising, 500, 10, 0, 2);
+    setting.holdoffCount = 50;
+    TriggerCapture capture;
+    capture.configure(setting);
+    capture.arm(0);
+    Feed result = feed(capture, join({repeat(0, 5), repeat(800, 2)}), 0);
+    CHECK(result.triggerIndex == 5 && result.capturedIndex == 6);
+
+    // re-armed right away: an edge 20 after the trigger is inside the holdoff and stays high after it
+    capture.arm(7);
+    result = feed(capture, join({repeat(0, 18), repeat(800, 60)}), 7);
+    CHECK(result.triggerIndex == NONE);
+
+    // edges after the holdoff fire again; the holdoff counts from the last accepted trigger
+    result = feed(capture, join({repeat(0, 3), repeat(800, 2)}), 85);
+    CHECK(result.triggerIndex == 88 && result.capturedIndex == 89);
+    capture.arm(90);
+    result = feed(capture, join({repeat(0, 3), repeat(800, 3), repeat(0, 42), repeat(800, 2)}), 90);
+    CHECK(result.triggerIndex == 138 && result.capturedIndex == 139);
+
+    // one sample short of the holdoff is still rejected
+    capture.arm(140);
+    result = feed(capture, join({repeat(0, 47), repeat(800, 2), repeat(0, 1), repeat(800, 2)}), 140);
+    CHECK(result.triggerIndex == 190 && result.capturedIndex == 191);
+
+    // configure keeps the last trigger, the holdoff still applies across it
+    capture.configure(setting);
+    capture.arm(192);
+    result = feed(capture, join({repeat(0, 2), repeat(800, 2), repeat(0, 60), repeat(800, 2)}), 192);
+    CHECK(result.triggerIndex == 256);
+  }
+
+  void testPostDepth() {
+    for (uint16_t postCount : {0, 1, 2, 100}) {
+      TriggerCapture capture;
+      capture.configure(makeSetting(TriggerCapture::Mode::Rising, 500, 0, 3, postCount));
+      capture.arm(0);
+      std::vector<int16_t> samples = join({repeat(0, 5), repeat(800, 200)});
+      const Feed result = feed(capture, samples, 0);
+      CHECK(result.triggerIndex == 5);
+      // the trigger sample is the first post trigger sample
+      const uint32_t lastIndex = 5 + (postCount > 1 ? postCount - 1 : 0);
+      CHECK(result.capturedIndex == lastIndex);
+      CHECK(capture.getWindowFirst() == 2);
+      CHECK(capture.getWindowCount() == 3U + postCount);
+      CHECK(capture.getState() == TriggerCapture::State::Captured);
+    }
+
+    // still taking the post trigger samples
+    TriggerCapture capture;
+    capture.configure(makeSetting(TriggerCapture::Mode::Rising, 500, 0, 0, 10));
+    capture.arm(0);
+    CHECK(!capture.add(0, 0));
+    CHECK(!capture.add(800, 1));
+    CHECK(capture.getState() == TriggerCapture::State::Triggered);
+    for (uint32_t entryIndex = 2; entryIndex < 10; ++entryIndex) {
+      CHECK(!capture.add(0, entryIndex));
+    }
+    CHECK(capture.add(0, 10));
+  }
+}
+
+int main() {
+  testIdle();
+  testRising();
+  testFalling();
+  testWindow();
+  testPreFill();
+  testHoldoff();
+  testPostDepth();
+  return test_util::finish("test_trigger_capture");
+}
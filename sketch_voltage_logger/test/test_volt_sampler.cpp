@@ -0,0 +1,72 @@
+// VoltSampler on the host: the oversampling limit that keeps a burst inside the sample
+// period (so no SAMPLE trigger is lost), and SampleRing keeping sample n at index n
+// when the reader falls behind.
+
+#include "VoltSampler.h"
+#include "test_util.h"
+
+namespace {
+
+  void testOversampleLimit() {
+    // 1kHz, 5kHz, 10kHz
+    CHECK(VoltSampler::limitOversampleShift(0, 4) == 4);
+    CHECK(VoltSampler::limitOversampleShift(1, 4) == 3);
+    CHECK(VoltSampler::limitOversampleShift(2, 4) == 2);
+    CHECK(VoltSampler::limitOversampleShift(2, 3) == 2);
+    // below the limit the request stands
+    CHECK(VoltSampler::limitOversampleShift(2, 1) == 1);
+    CHECK(VoltSampler::limitOversampleShift(1, 0) == 0);
+    // out of range requests as begin() treats them
+    CHECK(VoltSampler::limitOversampleShift(0, 200) == VoltSampler::OVERSAMPLE_SHIFT_MAX);
+    CHECK(VoltSampler::limitOversampleShift(9, 4) == VoltSampler::limitOversampleShift(0, 4));
+
+    // every allowed burst leaves a quarter of the period free, one more step would not
+    for (uint8_t rateIndex = 0; rateIndex < VoltSampler::RATE_COUNT; ++rateIndex) {
+      const uint32_t periodMicros = 1000000UL / VoltSampler::RATE_HZ[rateIndex];
+      for (uint8_t shift = 0; shift <= VoltSampler::OVERSAMPLE_SHIFT_MAX; ++shift) {
+        const uint8_t applied = VoltSampler::limitOversampleShift(rateIndex, shift);
+        CHECK(applied <= shift);
+        CHECK((VoltSampler::CONVERSION_MICROS << applied) * 4 <= periodMicros * 3);
+        if (applied < shift) {
+          CHECK((VoltSampler::CONVERSION_MICROS << (applied + 1)) * 4 > periodMicros * 3);
+        }
+      }
+    }
+  }
+
+  void testRingIndexes() {
+    SampleRing ring;
+    ring.reset();
+    uint16_t value = 0;
+    uint32_t index = 0;
+    CHECK(!ring.pop(value, index));
+
+    for (uint32_t i = 0; i < 10; ++i) {
+      ring.push((uint16_t)i);
+    }
+    CHECK(ring.pop(value, index) && value == 0 && index == 0);
+
+    // the reader falls behind: the oldest are dropped, the rest keep their index
+    for (uint32_t i = 10; i < 3 * SampleRing::SIZE; ++i) {
+      ring.push((uint16_t)i);
+    }
+    CHECK(ring.pop(value, index));
+    CHECK(index == 2 * SampleRing::SIZE && value == (uint16_t)index);
+    CHECK(ring.getDroppedCount() == 2 * SampleRing::SIZE - 1);
+    bool okFlag = true;
+    uint32_t count = 1;
+    while (ring.pop(value, index)) {
+      okFlag = okFlag && value == (uint16_t)index && index == 2 * SampleRing::SIZE + count;
+      ++count;
+    }
+    CHECK(okFlag);
+    CHECK(count == SampleRing::SIZE);
+    CHECK(ring.getWriteIndex() == 3 * SampleRing::SIZE);
+  }
+}
+
+int main() {
+  testOversampleLimit();
+  testRingIndexes();
+  return test_util::finish("test_volt_sampler");
+}
@@ -0,0 +1,170 @@
+// WindowStats against a double reference over every sample: min / max / mean / RMS in
+// stored units, counting below the threshold, and the counts saturating at UINT16_MAX
+// for a window that grew long while the central was not reading.
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "WindowStats.h"
+#include "test_util.h"
+
+namespace {
+
+  constexpr int FRACTION_BITS = 3;
+
+  // Same rounding and clamp as the stored samples
+  int16_t referenceStored(double value) {
+    const double rounded = std::floor(value + 0.5);
+    return (int16_t)std::fmax(-32767.0, std::fmin(32767.0, rounded));
+  }
+
+  WindowStats::Report referenceReport(const std::vector<uint16_t>& values, uint16_t threshold, double zero) {
+    WindowStats::Report report;
+    double sum = 0.0;
+    double sumSquare = 0.0;
+    uint32_t belowCount = 0;
+    uint16_t minValue = UINT16_MAX;
+    uint16_t maxValue = 0;
+    for (uint16_t value : values) {
+      sum += value;
+      sumSquare += (value - zero) * (value - zero);
+      belowCount += (value < threshold) ? 1 : 0;
+      minValue = std::min(minValue, value);
+      maxValue = std::max(maxValue, value);
+    }
+    const double scale = 1 << FRACTION_BITS;
+    report.count = (uint16_t)std::min<size_t>(values.size(), UINT16_MAX);
+    report.belowCount = (uint16_t)std::min<uint32_t>(belowCount, UINT16_MAX);
+    report.minValue = referenceStored((minValue - zero) * scale);
+    report.maxValue = referenceStored((maxValue - zero) * scale);
+    report.mean = referenceStored((sum / values.size() - zero) * scale);
+    report.rms = (uint16_t)referenceStored(std::sqrt(sumSquare / values.size()) * scale);
+    return report;
+  }
+
+  void checkReport(const WindowStats::Report& report, const WindowStats::Report& expected) {
+    CHECK(report.count == expected.count);
+    CHECK(report.belowCount == expected.belowCount);
+    CHECK(report.minValue == expected.minValue);
+    CHECK(report.maxValue == expected.maxValue);
+    // mean and RMS may round the other way at exactly .5
+    CHECK_NEAR(report.mean, expected.mean, 1);
+    CHECK_NEAR(report.rms, expected.rms, 1);
+  }
+
+  WindowStats collect(const std::vector<uint16_t>& values, uint16_t threshold) {
+    WindowStats stats;
+    stats.reset(threshold);
+    for (uint16_t value : values) {
+      stats.add(value);
+    }
+    return stats;
+  }
+
+  void testEmpty() {
+    WindowStats stats;
+    stats.reset(1000);
+    CHECK(stats.getCount() == 0);
+    const WindowStats::Report report = stats.getReport(100.f, FRACTION_BITS);
+    CHECK(report.count == 0 && report.belowCount == 0);
+    CHECK(report.minValue == 0 && report.maxValue == 0 && report.mean == 0 && report.rms == 0);
+  }
+
+  void testSmallSet() {
+    // zero at 100 counts: 90 .. 130 become -10 .. +30 counts, x8 in stored units
+    const WindowStats stats = collect({100, 130, 90, 110, 100}, 100);
+    const WindowStats::Report report = stats.getReport(100.f, FRACTION_BITS);
+    CHECK(report.count == 5);
+    CHECK(report.belowCount == 1);
+    CHECK(report.minValue == -80 && report.maxValue == 240);
+    CHECK(report.mean == 48);
+    // sqrt((0 + 900 + 100 + 100 + 0) / 5) * 8
+    CHECK(report.rms == (uint16_t)std::lround(std::sqrt(220.0) * 8));
+  }
+
+  // Noise on a 12 bit level with a dip shorter than a log entry; a fractional calibration zero
+  void testNoiseMatchesReference() {
+    std::mt19937 random(49);
+    std::normal_distribution<double> noise(0.0, 12.0);
+    for (int round = 0; round < 20; ++round) {
+      std::vector<uint16_t> values;
+      const double level = 500.0 + round * 180.0;
+      for (int i = 0; i < 3000; ++i) {
+        double value = level + noise(random);
+        if (i >= 1500 && i < 1504) {
+          value = level * 0.3;
+        }
+        values.push_back((uint16_t)std::fmax(0.0, std::fmin(4095.0, std::round(value))));
+      }
+      const uint16_t threshold = (uint16_t)(level - 20.0);
+      const double zero = 37.625 + round;
+      const WindowStats stats = collect(values, threshold);
+      checkReport(stats.getReport((float)zero, FRACTION_BITS), referenceReport(values, threshold, zero));
+      CHECK(stats.getReport((float)zero, FRACTION_BITS).belowCount >= 4);
+    }
+  }
+
+  void testThreshold() {
+    const std::vector<uint16_t> values = {0, 1, 999, 1000, 1001, 4095};
+    CHECK(collect(values, 0).getReport(0.f, FRACTION_BITS).belowCount == 0);
+    CHECK(collect(values, 1).getReport(0.f, FRACTION_BITS).belowCount == 1);
+    // the threshold itself is not below
+    CHECK(collect(values, 1000).getReport(0.f, FRACTION_BITS).belowCount == 3);
+    CHECK(collect(values, 4096).getReport(0.f, FRACTION_BITS).belowCount == 6);
+    CHECK(collect(values, UINT16_MAX).getReport(0.f, FRACTION_BITS).belowCount == 6);
+
+    // reset starts a new window with the new threshold
+    WindowStats stats = collect(values, 1000);
+    stats.reset(2);
+    stats.add(1);
+    stats.add(3);
+    const WindowStats::Report report = stats.getReport(0.f, FRACTION_BITS);
+    CHECK(report.count == 2 && report.belowCount == 1);
+    CHECK(report.minValue == 8 && report.maxValue == 24);
+  }
+
+  // The window only restarts when a frame was sent; while notifications fail it keeps
+  // growing. The counts stop at UINT16_MAX, the values stay right.
+  void testSaturation() {
+    std::vector<uint16_t> values;
+    for (uint32_t i = 0; i < 200000; ++i) {
+      values.push_back((uint16_t)((i % 2 == 0) ? 1000 : 3000));
+    }
+    const WindowStats stats = collect(values, 4000);
+    CHECK(stats.getCount() == 200000);
+    const WindowStats::Report report = stats.getReport(0.f, FRACTION_BITS);
+    CHECK(report.count == UINT16_MAX);
+    CHECK(report.belowCount == UINT16_MAX);
+    CHECK(report.mean == 2000 * 8);
+    CHECK(report.rms == (uint16_t)std::lround(std::sqrt((1000.0 * 1000.0 + 3000.0 * 3000.0) / 2.0) * 8));
+    checkReport(report, referenceReport(values, 4000, 0.0));
+
+    // just below and at the limit
+    const WindowStats below = collect(std::vector<uint16_t>(UINT16_MAX - 1, 5), 10);
+    CHECK(below.getReport(0.f, FRACTION_BITS).count == UINT16_MAX - 1);
+    CHECK(below.getReport(0.f, FRACTION_BITS).belowCount == UINT16_MAX - 1);
+    const WindowStats at = collect(std::vector<uint16_t>(UINT16_MAX, 5), 10);
+    CHECK(at.getReport(0.f, FRACTION_BITS).count == UINT16_MAX);
+
+    // full scale 16 bit values over a long window: the sums must not wrap, the stored
+    // values clamp at +-32767
+    const std::vector<uint16_t> fullScale(100000, UINT16_MAX);
+    const WindowStats high = collect(fullScale, 0);
+    const WindowStats::Report highReport = high.getReport(0.f, 0);
+    CHECK(highReport.mean == 32767 && highReport.maxValue == 32767 && highReport.rms == 32767);
+    const WindowStats::Report unscaled = high.getReport(65535.f - 100.f, 0);
+    CHECK(unscaled.mean == 100 && unscaled.minValue == 100 && unscaled.rms == 100);
+    const WindowStats::Report low = collect({0, 0}, 0).getReport(60000.f, 0);
+    CHECK(low.minValue == -32767 && low.mean == -32767);
+  }
+}
+
+int main() {
+  testEmpty();
+  testSmallSet();
+  testNoiseMatchesReference();
+  testThreshold();
+  testSaturation();
+  return test_util::finish("test_window_stats");
+}